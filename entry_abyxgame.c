@@ -150,7 +150,7 @@ typedef enum Entity_Type {
 } Entity_Type;
 
 typedef struct Entity {
-	bool is_valid;
+	Pool_Handle handle;
 	Entity_Type type;
 	Resource_ID resource_id;
 	Vector2 pos;
@@ -211,9 +211,9 @@ typedef enum Game_Mode {
 	GameMode_place,
 } Game_Mode;
 
-#define MAX_ENTITY_COUNT 1024
+#define ENTITIES_PER_CHUNK 1024
 typedef struct World {
-	Entity 		  entities[MAX_ENTITY_COUNT];
+	Pool 		  entities; // Entity
 	Inventory_Resource_Data inventory[ResourceID_count];
 	Game_Mode 	  game_mode;
 	float 		  inventory_alpha;
@@ -249,21 +249,14 @@ string entity_type_name(Entity_Type type) {
 }
 
 Entity *create_entity() {
-	Entity *found_entity = 0;
-	for (int i = 0; i < MAX_ENTITY_COUNT; i++) {
-		Entity *existing_entity = &world->entities[i];
-		if (!existing_entity->is_valid){
-			found_entity = existing_entity;
-			break;
-		}
-	}
-	assert(found_entity, "No more free entity spots in array");
-	found_entity->is_valid = true;
-	return found_entity;
+	Pool_Handle handle;
+	Entity *entity = pool_acquire(&world->entities, &handle);
+	entity->handle = handle;
+	return entity;
 }
 
 void entity_destroy(Entity *entity) {
-	memset(entity, 0, sizeof(Entity));
+	pool_release(&world->entities, entity->handle);
 }
 
 // :Init structs
@@ -579,6 +572,8 @@ int entry(int argc, char **argv) {
 	window.clear_color = hex_to_rgba(0x2a2d3aff);
 
 	world = alloc(get_heap_allocator(), sizeof(World));
+	memset(world, 0, sizeof(World));
+	world->entities = make_pool(Entity, ENTITIES_PER_CHUNK, get_heap_allocator());
 
 	sprites[0]               	 = (Sprite){ .image=load_image_from_disk(STR("res/sprites/missing_texture.png"), get_heap_allocator()) };
 	sprites[SpriteID_player] 	 = (Sprite){ .image=load_image_from_disk(STR("res/sprites/player.png"),    	 	 get_heap_allocator()) };
@@ -695,9 +690,9 @@ int entry(int argc, char **argv) {
 		// :select entity
 		if (!world_frame.hover_consumed) {
 			f32 current_selection_distance = INFINITY;
-			for (int i = 0; i < MAX_ENTITY_COUNT; i++) {
-				Entity *entity = &world->entities[i];
-				if (entity->is_valid && entity->destructable) {
+			for (u64 i = 0; i < pool_get_live_count(&world->entities); i++) {
+				Entity *entity = pool_get_live(&world->entities, i);
+				if (entity->destructable) {
 					Sprite *sprite = get_sprite_from_sprite_id(entity->sprite_id);
 
 					int entity_tile_x = world_pos_to_tile_pos(entity->pos.x);
@@ -748,15 +743,14 @@ int entry(int argc, char **argv) {
 		// Update Entities
 		//
 
-		for (int i = 0; i < MAX_ENTITY_COUNT; i++) {
-			Entity *entity = &world->entities[i];
-			if (entity->is_valid) {
-				if (entity->is_resource) {
-					f32 distance_to_player = v2_length(v2_sub(entity->pos, player_entity->pos));
-					if (fabsf(distance_to_player) < PICKUP_RADIUS) {
-						world->inventory[entity->resource_id].count += 1;
-						entity_destroy(entity);
-					}
+		// Backwards because picked up resources are destroyed while iterating
+		for (s64 i = (s64)pool_get_live_count(&world->entities)-1; i >= 0; i--) {
+			Entity *entity = pool_get_live(&world->entities, i);
+			if (entity->is_resource) {
+				f32 distance_to_player = v2_length(v2_sub(entity->pos, player_entity->pos));
+				if (fabsf(distance_to_player) < PICKUP_RADIUS) {
+					world->inventory[entity->resource_id].count += 1;
+					entity_destroy(entity);
 				}
 			}
 		}
@@ -799,27 +793,28 @@ int entry(int argc, char **argv) {
 		// NOTE: This is where we draw the entities, setup happens earlier
 		// but the actual draw happens now, that's why sprite info is needed
 		// here now and not earlier.
-		for (int i = 0; i < MAX_ENTITY_COUNT; i++) {
-			Entity *entity = &world->entities[i];
-			if (entity->is_valid) {
-				switch (entity->type) {
-					default: {
-						Sprite *sprite 		= get_sprite_from_sprite_id(entity->sprite_id);
-						Matrix4 rect_xform  = m4_scalar(1.0);
-						if (entity->is_resource) {
-							rect_xform = m4_translate(rect_xform, v3(0, 2.0*sin_bob(now, 5.0f), 0));
-						} 
-						rect_xform 			= m4_translate(rect_xform, v3(0, -TILE_HEIGHT*0.5, 0));
-						rect_xform          = m4_translate(rect_xform, v3(entity->pos.x, entity->pos.y, 0));
-						rect_xform          = m4_translate(rect_xform, v3(sprite->image->width * -0.5, 0, 0));
-
-						Vector4 col = COLOR_WHITE;
-						if (world_frame.selected_entity == entity) {
-							col = COLOR_GREEN;
-						}
-						draw_image_xform(sprite->image, rect_xform, get_sprite_size(sprite), col);
-					} break;
-				}
+		// In slot order, the live order changes whenever an entity is destroyed and
+		// overlapping sprites would swap.
+		for (u64 i = 0; i < pool_get_slot_count(&world->entities); i++) {
+			Entity *entity = pool_get_by_slot(&world->entities, i);
+			if (!entity) continue;
+			switch (entity->type) {
+				default: {
+					Sprite *sprite 		= get_sprite_from_sprite_id(entity->sprite_id);
+					Matrix4 rect_xform  = m4_scalar(1.0);
+					if (entity->is_resource) {
+						rect_xform = m4_translate(rect_xform, v3(0, 2.0*sin_bob(now, 5.0f), 0));
+					} 
+					rect_xform 			= m4_translate(rect_xform, v3(0, -TILE_HEIGHT*0.5, 0));
+					rect_xform          = m4_translate(rect_xform, v3(entity->pos.x, entity->pos.y, 0));
+					rect_xform          = m4_translate(rect_xform, v3(sprite->image->width * -0.5, 0, 0));
+
+					Vector4 col = COLOR_WHITE;
+					if (world_frame.selected_entity == entity) {
+						col = COLOR_GREEN;
+					}
+					draw_image_xform(sprite->image, rect_xform, get_sprite_size(sprite), col);
+				} break;
 			}
 		}
 		
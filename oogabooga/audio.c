@@ -14,6 +14,13 @@
 	void play_one_audio_clip_source_config(Audio_Source source, Audio_Playback_Config config);
 	void play_one_audio_clip_config(string path, Audio_Playback_Config config);
 	
+		The string versions intern (hash) the path on every call, intern it once and
+		use the atom versions for sounds you play a lot:
+		
+	Atom hit_sound = intern_string(STR("res/hit.wav"));
+	void play_one_audio_clip_atom(Atom path);
+	void play_one_audio_clip_atom_with_config(Atom path, Audio_Playback_Config config);
+	
 		Playing audio (with players):
 	
 	Audio_Player * audio_player_get_one();
@@ -71,6 +78,9 @@ ogb_instance u64 next_audio_source_uid;
 // Implemented per OS
 ogb_instance Audio_Format audio_output_format; 
 ogb_instance Mutex audio_init_mutex;
+// Held by the audio thread while it samples a source so a source isn't destroyed under it.
+// Audio_Source's are copied by value into players, so this can't live in the source.
+ogb_instance Mutex audio_source_destroy_mutex;
 ogb_instance void *audio_intermediate_mega_buffer;
 ogb_instance void *audio_intermediate_mega_buffer_next;
 ogb_instance u64   audio_intermediate_mega_buffer_size;
@@ -79,6 +89,7 @@ ogb_instance void **audio_intermediate_heap_buffers;
 #if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
 Audio_Format audio_output_format; 
 Mutex audio_init_mutex;
+Mutex audio_source_destroy_mutex;
 u64 next_audio_source_uid = 0;
 void *audio_intermediate_mega_buffer = 0;
 void *audio_intermediate_mega_buffer_next = 0;
@@ -160,8 +171,6 @@ typedef struct Audio_Source {
 	// For memory source
 	void *pcm_frames;
 	
-	Mutex mutex_for_destroy; // This should ONLY be used so a source isnt sampled on audio thread while it's being destroyed
-	
 } Audio_Source;
 
 int 
@@ -606,8 +615,6 @@ audio_open_source_stream_format(Audio_Source *src, string path, Audio_Format for
 	src->uid = next_audio_source_uid;
 	next_audio_source_uid += 1;
 	
-	mutex_init(&src->mutex_for_destroy);
-	
 	src->allocator = allocator;
 	src->kind = AUDIO_SOURCE_FILE_STREAM;
 	
@@ -664,8 +671,6 @@ audio_open_source_load_format(Audio_Source *src, string path, Audio_Format forma
 	src->uid = next_audio_source_uid;
 	next_audio_source_uid += 1;
 	
-	mutex_init(&src->mutex_for_destroy);
-	
 	src->allocator = allocator;
 	src->kind = AUDIO_SOURCE_MEMORY;
 	src->format = format;
@@ -737,7 +742,7 @@ audio_open_source_load(Audio_Source *src, string path, Allocator allocator) {
 void 
 audio_source_destroy(Audio_Source *src) {
 
-	mutex_acquire_or_wait(&src->mutex_for_destroy);
+	mutex_acquire_or_wait(&audio_source_destroy_mutex);
 
 	switch (src->kind) {
 		case AUDIO_SOURCE_FILE_STREAM: {
@@ -762,7 +767,7 @@ audio_source_destroy(Audio_Source *src) {
 		}
 	}
 	
-	mutex_release(&src->mutex_for_destroy);
+	mutex_release(&audio_source_destroy_mutex);
 }
 
 int
@@ -1453,7 +1458,7 @@ audio_player_set_looping(Audio_Player *p, bool looping) {
 }
 
 // #Global
-ogb_instance Hash_Table just_audio_clips;
+ogb_instance Hash_Table just_audio_clips; // Atom path, Audio_Source
 ogb_instance bool just_audio_clips_initted;
 
 
@@ -1497,10 +1502,11 @@ void
 DEPRECATED(play_one_audio_clip_at_position(string path, Vector3 pos), "Use play_one_audio_clip_with_config() instead") {
 	if (!just_audio_clips_initted) {
 		just_audio_clips_initted = true;
-		just_audio_clips = make_hash_table(string, Audio_Source, get_heap_allocator());
+		just_audio_clips = make_hash_table(Atom, Audio_Source, get_heap_allocator());
 	}
 	
-	Audio_Source *src_ptr = hash_table_find(&just_audio_clips, path);
+	Atom path_atom = intern_string(path);
+	Audio_Source *src_ptr = hash_table_find(&just_audio_clips, path_atom);
 	if (src_ptr) {
 		play_one_audio_clip_source_at_position(*src_ptr, pos);
 	} else {
@@ -1510,26 +1516,27 @@ DEPRECATED(play_one_audio_clip_at_position(string path, Vector3 pos), "Use play_
 			log_error("Could not load audio to play from %s", path);
 			return;
 		}
-		hash_table_add(&just_audio_clips, path, new_src);
+		hash_table_add(&just_audio_clips, path_atom, new_src);
 		play_one_audio_clip_source_at_position(new_src, pos);
 	}
 	
 }
 void
-play_one_audio_clip_with_config(string path, Audio_Playback_Config config) {
+play_one_audio_clip_atom_with_config(Atom path, Audio_Playback_Config config) {
 	if (!just_audio_clips_initted) {
 		just_audio_clips_initted = true;
-		just_audio_clips = make_hash_table(string, Audio_Source, get_heap_allocator());
+		just_audio_clips = make_hash_table(Atom, Audio_Source, get_heap_allocator());
 	}
 	
 	Audio_Source *src_ptr = hash_table_find(&just_audio_clips, path);
 	if (src_ptr) {
 		play_one_audio_clip_source_with_config(*src_ptr, config);
 	} else {
+		string path_string = atom_to_string(path);
 		Audio_Source new_src;
-		bool ok = audio_open_source_stream(&new_src, path, get_heap_allocator());
+		bool ok = audio_open_source_stream(&new_src, path_string, get_heap_allocator());
 		if (!ok) {
-			log_error("Could not load audio to play from %s", path);
+			log_error("Could not load audio to play from %s", path_string);
 			return;
 		}
 		hash_table_add(&just_audio_clips, path, new_src);
@@ -1537,11 +1544,19 @@ play_one_audio_clip_with_config(string path, Audio_Playback_Config config) {
 	}
 }
 void inline
-play_one_audio_clip(string path) {
+play_one_audio_clip_atom(Atom path) {
 	Audio_Playback_Config config = {0};
 	config.volume = 1.0;
 	config.playback_speed = 1.0;
-	play_one_audio_clip_with_config(path, config);
+	play_one_audio_clip_atom_with_config(path, config);
+}
+void
+play_one_audio_clip_with_config(string path, Audio_Playback_Config config) {
+	play_one_audio_clip_atom_with_config(intern_string(path), config);
+}
+void inline
+play_one_audio_clip(string path) {
+	play_one_audio_clip_atom(intern_string(path));
 }
 
 void
@@ -1760,6 +1775,7 @@ float64 *audio_source_start_time_records = 0;
 void 
 do_program_audio_sample(u64 number_of_output_frames, Audio_Format out_format, 
 							 void *output) {
+	engine_tm_begin("do_program_audio_sample");
 							 
 	reset_temporary_storage();
 	
@@ -1814,7 +1830,7 @@ do_program_audio_sample(u64 number_of_output_frames, Audio_Format out_format,
 			
 			Audio_Source src = p->source;
 			
-			mutex_acquire_or_wait(&src.mutex_for_destroy);
+			mutex_acquire_or_wait(&audio_source_destroy_mutex);
 
 			Audio_Format sample_format = src.format;
 			sample_format.sample_rate = sample_format.sample_rate*p->config.playback_speed;
@@ -2049,9 +2065,11 @@ do_program_audio_sample(u64 number_of_output_frames, Audio_Format out_format,
 			mix_frames(output, mix_buffer, number_of_output_frames, out_format);
 			
 			
-			mutex_release(&src.mutex_for_destroy);
+			mutex_release(&audio_source_destroy_mutex);
 		}
 		
 		block = block->next;
 	}
+	
+	engine_tm_end();
 }
@@ -83,6 +83,8 @@ typedef struct Allocator {
 
 Allocator
 get_heap_allocator();
+void*
+heap_allocator_proc(u64 size, void *p, Allocator_Message message, void* data);
 
 ogb_instance Allocator
 get_temporary_allocator();
@@ -114,6 +116,11 @@ alloc_uninitialized(Allocator allocator, u64 size);
 ogb_instance void 
 dealloc(Allocator allocator, void *p);
 
+// Resizes in place if the allocator can (heap allocator), otherwise alloc + copy + dealloc.
+// old_size is how many bytes to copy in the fallback.
+ogb_instance void* 
+reallocate(Allocator allocator, void *p, u64 old_size, u64 new_size);
+
 ogb_instance void 
 push_context(Context c);
 
@@ -151,6 +158,25 @@ dealloc(Allocator allocator, void *p) {
 	allocator.proc(0, p, ALLOCATOR_DEALLOCATE, allocator.data);
 }
 
+void* 
+reallocate(Allocator allocator, void *p, u64 old_size, u64 new_size) {
+	assert(new_size > 0, "You requested an allocation of zero bytes. I'm not sure what you want with that.");
+	if (!p) return alloc(allocator, new_size);
+	
+	if (allocator.proc == heap_allocator_proc) {
+		void *new = allocator.proc(new_size, p, ALLOCATOR_REALLOCATE, allocator.data);
+#if DO_ZERO_INITIALIZATION
+		if (new_size > old_size) memset((u8*)new+old_size, 0, new_size-old_size);
+#endif
+		return new;
+	}
+	
+	void *new = alloc(allocator, new_size);
+	memcpy(new, p, min(old_size, new_size));
+	dealloc(allocator, p);
+	return new;
+}
+
 void 
 push_context(Context c) {
 	assert(num_contexts < CONTEXT_STACK_MAX, "Context stack overflow");
@@ -173,6 +199,23 @@ Context get_context() {
 
 #endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
 
+// With ENABLE_ALLOCATION_TRACKING every alloc, alloc_uninitialized and reallocate call
+// passes its callsite along. See "Allocation tracking" in memory.c.
+#if ENABLE_ALLOCATION_TRACKING
+ogb_instance void* 
+_alloc_tracked(const char *file, u32 line, Allocator allocator, u64 size);
+
+ogb_instance void* 
+_alloc_uninitialized_tracked(const char *file, u32 line, Allocator allocator, u64 size);
+
+ogb_instance void* 
+_reallocate_tracked(const char *file, u32 line, Allocator allocator, void *p, u64 old_size, u64 new_size);
+
+#define alloc(...)               _alloc_tracked(__FILE__, __LINE__, __VA_ARGS__)
+#define alloc_uninitialized(...) _alloc_uninitialized_tracked(__FILE__, __LINE__, __VA_ARGS__)
+#define reallocate(...)          _reallocate_tracked(__FILE__, __LINE__, __VA_ARGS__)
+#endif
+
 u64 
 get_next_power_of_two(u64 x) {
     if (x == 0) {
@@ -191,4 +234,22 @@ get_next_power_of_two(u64 x) {
 }
 
 #define align_next(x, a)     ((u64)((x)+(a)-1ULL) & (u64)~((a)-1ULL))
-#define align_previous(x, a) ((u64)(x) & (u64)~((a) - 1ULL))
\ No newline at end of file
+#define align_previous(x, a) ((u64)(x) & (u64)~((a) - 1ULL))
+
+///
+// Engine instrumentation
+// Built-in profiler scopes on the engine's own hot paths (os_update, heap_alloc,
+// radix_sort, ...) so engine cost can be told apart from game cost. Compiled out unless
+// both ENABLE_PROFILING and ENABLE_ENGINE_PROFILING are on. They record into the same
+// per-thread buffers as tm_scope in profiling.c, which is included after a lot of the
+// engine, hence these live here.
+// One pair per function, every return needs its own engine_tm_end.
+#if ENABLE_PROFILING && ENABLE_ENGINE_PROFILING
+	ogb_instance void _profiler_record(const char *name, u64 begin_cycles, u64 end_cycles);
+	ogb_instance thread_local u64 _profiler_open_scopes;
+	#define engine_tm_begin(name) const char *_engine_tm_name = (name); u64 _engine_tm_depth = _profiler_open_scopes++; u64 _engine_tm_begin = rdtsc()
+	#define engine_tm_end() (_profiler_open_scopes = _engine_tm_depth, _profiler_record(_engine_tm_name, _engine_tm_begin, rdtsc()))
+#else
+	#define engine_tm_begin(name)
+	#define engine_tm_end()
+#endif
@@ -9,11 +9,33 @@ inline bool compare_and_swap_16(volatile uint16_t *a, uint16_t b, uint16_t old);
 inline bool compare_and_swap_32(volatile uint32_t *a, uint32_t b, uint32_t old);
 inline bool compare_and_swap_64(volatile uint64_t *a, uint64_t b, uint64_t old);
 inline bool compare_and_swap_bool(volatile bool *a, bool b, bool old);
+inline uint64_t atomic_add_64(volatile uint64_t *a, int64_t n);
+inline uint32_t atomic_exchange_32(volatile uint32_t *a, uint32_t b);
+
+// Pad data that different threads write to this far apart so they don't bounce the same
+// cache line between cores.
+#define CACHE_LINE_SIZE 64
+
+///
+// Spin backoff
+// For spin-wait loops: CPU_PAUSE 1, 2, 4 ... SPIN_BACKOFF_MAX_PAUSES times between each
+// look, then yield the thread every time after that. Pausing keeps us from hammering
+// the cache line and from starving the sibling hyperthread, yielding lets the thread
+// we're waiting for run if there are more threads than cores.
+#define SPIN_BACKOFF_MAX_PAUSES 64
+typedef struct Spin_Backoff {
+	u32 pauses;
+} Spin_Backoff;
+
+void ogb_instance
+spin_backoff(Spin_Backoff *b);
 
 ///
 // Spinlock "primitive"
 // Like a mutex but it eats up the entire core while waiting.
 // Beneficial if contention is low or sync speed is important
+// Waiters only read the lock until it looks free so they don't bounce the cache line
+// around with locked writes, and back off while it stays taken.
 typedef struct Spinlock {
 	volatile bool locked;
 } Spinlock;
@@ -28,20 +50,72 @@ spinlock_acquire_or_wait(Spinlock* l);
 bool ogb_instance
 spinlock_acquire_or_wait_timeout(Spinlock* l, f64 timeout_seconds);
 
+bool ogb_instance
+spinlock_try_acquire(Spinlock* l);
+
 void ogb_instance
 spinlock_release(Spinlock* l);
 
+///
+// Ticket lock
+// Fair spinlock, threads get the lock in the order they started waiting for it.
+// The catch is that if the next thread in line isn't running, everyone behind it
+// waits too, so prefer Spinlock when there are more busy threads than cores.
+typedef struct Ticket_Lock {
+	volatile u64 next_ticket;
+	u8 _pad[CACHE_LINE_SIZE-sizeof(u64)];
+	volatile u64 now_serving;
+} Ticket_Lock;
+
+void ogb_instance
+ticket_lock_init(Ticket_Lock *l);
+
+void ogb_instance
+ticket_lock_acquire_or_wait(Ticket_Lock *l);
+
+void ogb_instance
+ticket_lock_release(Ticket_Lock *l);
+
+///
+// Reader-writer spinlock
+// Any number of readers or one writer, for read-heavy shared data like font atlases
+// and asset caches. A waiting writer stops new readers from getting in so writers
+// don't starve, which also means a thread must not take the read lock twice.
+#define RW_LOCK_WRITER         (1ull << 63)
+#define RW_LOCK_WRITER_WAITING (1ull << 62)
+#define RW_LOCK_READER_MASK    (RW_LOCK_WRITER_WAITING-1)
+typedef struct Rw_Lock {
+	volatile u64 state; // Reader count | RW_LOCK_WRITER | RW_LOCK_WRITER_WAITING
+} Rw_Lock;
+
+void ogb_instance
+rw_lock_init(Rw_Lock *l);
+
+void ogb_instance
+rw_lock_acquire_read(Rw_Lock *l);
+
+void ogb_instance
+rw_lock_release_read(Rw_Lock *l);
+
+void ogb_instance
+rw_lock_acquire_write(Rw_Lock *l);
+
+void ogb_instance
+rw_lock_release_write(Rw_Lock *l);
+
 
 ///
-// High-level mutex primitive (short spinlock then OS mutex lock)
-// Just spins for a few (configurable) microseconds with a spinlock,
-// and if acquiring fails it falls back to a OS mutex.
-#define MUTEX_DEFAULT_SPIN_TIME_MICROSECONDS 100
+// High-level mutex primitive
+// One u32, taking it uncontended is a single compare_and_swap and releasing it is a
+// single exchange. When it's taken we spin with backoff for a little while, then park
+// the thread with os_wait_on_address until the owner wakes us.
+// Zero initialized is unlocked, mutex_init is optional.
+#define MUTEX_SPIN_ROUNDS 8 // Rounds of spin_backoff before parking
+#define MUTEX_UNLOCKED          0
+#define MUTEX_LOCKED            1
+#define MUTEX_LOCKED_AND_WAITED 2 // Release needs to wake someone up
 typedef struct Mutex {
-	Spinlock spinlock;
-	f64 spin_time_microseconds;
-	Mutex_Handle os_handle;
-	volatile bool spinlock_acquired;
+	volatile u32 state;
 	volatile u64 acquiring_thread;
 } Mutex;
 
@@ -57,35 +131,251 @@ mutex_acquire_or_wait(Mutex *m);
 void ogb_instance
 mutex_release(Mutex *m);
 
+///
+// Bounded lock-free ring queues.
+// Items are copied in and out. Push returns false (or how many were pushed, for batches)
+// when the queue is full, pop returns false (or how many were popped) when it's empty.
+// Capacity is rounded up to a power of two.
+//
+// Spsc_Queue: One producer thread, one consumer thread. No atomics at all, just ordered
+//             loads and stores.
+// Mpsc_Queue: Any number of producer threads, one consumer thread. Producers claim slots
+//             with compare_and_swap, each slot has a sequence number that says when it's
+//             been written (or read) so the consumer never sees a half written item.
+//
+// Producer and consumer indices are on separate cache lines so they don't bounce
+// between cores.
+//
+// #Portability
+// Ordering relies on x86 not reordering loads with loads or stores with stores, so
+// acquire/release only need COMPILER_BARRIER. ARM would need real barriers.
+
+typedef struct Spsc_Queue {
+	u8 *items;
+	u64 capacity;
+	u64 item_size;
+	Allocator allocator;
+	
+	u8 _pad0[CACHE_LINE_SIZE];
+	volatile u64 head; // Written by producer
+	u64 cached_tail;   // Producer's last look at tail
+	
+	u8 _pad1[CACHE_LINE_SIZE];
+	volatile u64 tail; // Written by consumer
+	u64 cached_head;   // Consumer's last look at head
+	
+	u8 _pad2[CACHE_LINE_SIZE];
+} Spsc_Queue;
+
+typedef struct Mpsc_Queue {
+	u8 *slots; // [u64 sequence][item] per slot
+	u64 capacity;
+	u64 item_size;
+	u64 slot_stride;
+	Allocator allocator;
+	
+	u8 _pad0[CACHE_LINE_SIZE];
+	volatile u64 head; // Claimed by producers
+	
+	u8 _pad1[CACHE_LINE_SIZE];
+	volatile u64 tail; // Written by consumer, producers read it for batches
+	
+	u8 _pad2[CACHE_LINE_SIZE];
+} Mpsc_Queue;
+
+void ogb_instance
+spsc_queue_init(Spsc_Queue *q, u64 item_size, u64 capacity, Allocator allocator);
+void ogb_instance
+spsc_queue_deinit(Spsc_Queue *q);
+bool ogb_instance
+spsc_queue_push(Spsc_Queue *q, void *item);
+u64 ogb_instance
+spsc_queue_push_batch(Spsc_Queue *q, void *items, u64 count);
+bool ogb_instance
+spsc_queue_pop(Spsc_Queue *q, void *out_item);
+u64 ogb_instance
+spsc_queue_pop_batch(Spsc_Queue *q, void *out_items, u64 max_count);
+
+void ogb_instance
+mpsc_queue_init(Mpsc_Queue *q, u64 item_size, u64 capacity, Allocator allocator);
+void ogb_instance
+mpsc_queue_deinit(Mpsc_Queue *q);
+bool ogb_instance
+mpsc_queue_push(Mpsc_Queue *q, void *item);
+u64 ogb_instance
+mpsc_queue_push_batch(Mpsc_Queue *q, void *items, u64 count);
+bool ogb_instance
+mpsc_queue_pop(Mpsc_Queue *q, void *out_item);
+u64 ogb_instance
+mpsc_queue_pop_batch(Mpsc_Queue *q, void *out_items, u64 max_count);
+
+
+///
+// Job system
+// Opt-in, define ENABLE_JOB_SYSTEM to have oogabooga_init start it, or call job_system_init.
+// One worker per logical processor, the thread that called job_system_init (main thread)
+// counts as worker 0 and only runs jobs while it's waiting for them.
+//
+// Each worker owns a Chase-Lev work-stealing deque. Workers push and pop their own
+// jobs at the bottom (LIFO, stays in cache), idle workers steal the oldest jobs from
+// the top of other workers' deques with compare_and_swap. Jobs submitted from threads
+// that aren't workers (audio thread, your own threads) go through a shared Mpsc_Queue.
+//
+// Job_Counter is a wait group: submitting increments it, a finished job decrements it.
+// job_wait() runs other jobs while the counter isn't zero, so waiting from inside a
+// job is fine (fork/join).
+//
+//     Job_Counter counter = ZERO(Job_Counter);
+//     for (u64 i = 0; i < chunk_count; i++) job_submit(&counter, decode_chunk, &chunks[i]);
+//     job_wait(&counter);
+//
+// parallel_for splits [0, count) in halves until pieces are at most grain items,
+// so idle workers steal big pieces and the owner keeps the small ones.
+//
+//     void update_particles(u64 first, u64 last, void *data) { ... }
+//     parallel_for(particle_count, 1024, update_particles, particles);
+//
+// #Portability the deque relies on x86 ordering like the queues above, plus one full
+// fence (MEMORY_BARRIER) in pop.
+
+#ifndef JOB_WORKER_COUNT
+	#define JOB_WORKER_COUNT 0 // 0 means one per logical processor
+#endif
+#define JOB_DEQUE_CAPACITY 2048
+#define JOB_INJECT_QUEUE_CAPACITY 1024
+// How many times an idle worker looks for work (yielding in between) before it sleeps
+#define JOB_WORKER_IDLE_SPIN_COUNT 64
+
+typedef void(*Job_Proc)(void *data);
+// Called with [first, last)
+typedef void(*Parallel_For_Proc)(u64 first, u64 last, void *data);
+
+typedef struct Job_Counter {
+	volatile u64 pending;
+} Job_Counter;
+
+typedef struct Job {
+	Job_Proc proc;
+	void *data;
+	Job_Counter *counter;
+	
+	// parallel_for ranges
+	Parallel_For_Proc range_proc;
+	u64 first;
+	u64 last;
+	u64 grain;
+} Job;
+
+typedef struct Job_Deque {
+	Job *jobs;
+	
+	u8 _pad0[CACHE_LINE_SIZE];
+	volatile s64 top;    // Thieves take from here
+	
+	u8 _pad1[CACHE_LINE_SIZE];
+	volatile s64 bottom; // Only written by the owner
+	
+	u8 _pad2[CACHE_LINE_SIZE];
+} Job_Deque;
+
+typedef struct Job_Worker {
+	Job_Deque deque;
+	Thread thread;
+	Binary_Semaphore wake;
+	volatile bool sleeping;
+	u64 index;
+	u64 steal_seed;
+} Job_Worker;
+
+typedef struct Job_System {
+	Job_Worker *workers;
+	u64 worker_count;
+	
+	Mpsc_Queue injected;
+	volatile bool injected_consumer_locked;
+	
+	volatile u64 sleeping_count;
+	volatile bool shutting_down;
+	Allocator allocator;
+} Job_System;
+
+ogb_instance Job_System job_system;
 
 #if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+Job_System job_system;
+#endif
+
+// worker_count includes the calling thread, 0 for one per logical processor
+void ogb_instance
+job_system_init(u64 worker_count, Allocator allocator);
+
+// Finishes queued jobs, then stops and joins the worker threads
+void ogb_instance
+job_system_shutdown();
+
+void ogb_instance
+job_submit(Job_Counter *counter, Job_Proc proc, void *data);
+
+// Runs other jobs until the counter reaches zero
+void ogb_instance
+job_wait(Job_Counter *counter);
+
+bool ogb_instance
+job_counter_is_done(Job_Counter *counter);
+
+// Calls proc on pieces of [0, count) of at most grain items and returns when all are done
+void ogb_instance
+parallel_for(u64 count, u64 grain, Parallel_For_Proc proc, void *data);
+
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+
+void spin_backoff(Spin_Backoff *b) {
+	if (b->pauses > SPIN_BACKOFF_MAX_PAUSES) {
+		os_yield_thread();
+		return;
+	}
+	for (u32 i = 0; i < b->pauses; i++) {
+		CPU_PAUSE;
+	}
+	b->pauses = b->pauses ? b->pauses*2 : 1;
+}
 
 void spinlock_init(Spinlock *l) {
 	memset(l, 0, sizeof(*l));
 }
+bool spinlock_try_acquire(Spinlock* l) {
+	return !l->locked && compare_and_swap_bool(&l->locked, true, false);
+}
 void spinlock_acquire_or_wait(Spinlock* l) {
+	Spin_Backoff backoff = ZERO(Spin_Backoff);
 	while (true) {
-        bool expected = false;
-        if (compare_and_swap_bool(&l->locked, true, expected)) {
+        if (compare_and_swap_bool(&l->locked, true, false)) {
             return;
         }
         while (l->locked) {
             // spinny boi
+            spin_backoff(&backoff);
         }
     }
 }
 // Returns true on aquired, false if timeout seconds reached
 bool spinlock_acquire_or_wait_timeout(Spinlock* l, f64 timeout_seconds) {
+	if (compare_and_swap_bool(&l->locked, true, false)) {
+		return true;
+	}
+	
     f64 start = os_get_elapsed_seconds();
+	Spin_Backoff backoff = ZERO(Spin_Backoff);
 	while (true) {
-        bool expected = false;
-        if (compare_and_swap_bool(&l->locked, true, expected)) {
-            return true;
-        }
         while (l->locked) {
-            // spinny boi
+            spin_backoff(&backoff);
+            // Only look at the clock once per backoff round
             if ((os_get_elapsed_seconds()-start) >= timeout_seconds) return false;
         }
+        if (compare_and_swap_bool(&l->locked, true, false)) {
+            return true;
+        }
     }
     return true;
 }
@@ -97,24 +387,107 @@ void spinlock_release(Spinlock* l) {
 
 
 ///
-// High-level mutex primitive (short spinlock then OS mutex lock)
+// Ticket lock
+
+void ticket_lock_init(Ticket_Lock *l) {
+	memset(l, 0, sizeof(*l));
+}
+void ticket_lock_acquire_or_wait(Ticket_Lock *l) {
+	u64 ticket = atomic_add_64(&l->next_ticket, 1) - 1;
+	Spin_Backoff backoff = ZERO(Spin_Backoff);
+	u64 last_serving = l->now_serving;
+	while (true) {
+		u64 serving = l->now_serving;
+		if (serving == ticket) break;
+		if (serving != last_serving) {
+			// Line moved, start over with short pauses. If it doesn't move the thread
+			// in front is probably not running, so we end up yielding to it.
+			last_serving = serving;
+			backoff = ZERO(Spin_Backoff);
+		}
+		spin_backoff(&backoff);
+	}
+	COMPILER_BARRIER; // Acquire
+}
+void ticket_lock_release(Ticket_Lock *l) {
+	COMPILER_BARRIER; // Release, only the owner writes now_serving
+	l->now_serving = l->now_serving + 1;
+}
+
+///
+// Reader-writer spinlock
+
+void rw_lock_init(Rw_Lock *l) {
+	memset(l, 0, sizeof(*l));
+}
+void rw_lock_acquire_read(Rw_Lock *l) {
+	Spin_Backoff backoff = ZERO(Spin_Backoff);
+	while (true) {
+		u64 state = l->state;
+		if (!(state & (RW_LOCK_WRITER | RW_LOCK_WRITER_WAITING))) {
+			if (compare_and_swap_64(&l->state, state+1, state)) return;
+		} else {
+			spin_backoff(&backoff);
+		}
+	}
+}
+void rw_lock_release_read(Rw_Lock *l) {
+	assert(l->state & RW_LOCK_READER_MASK, "Tried to release a read lock which is not acquired");
+	atomic_add_64(&l->state, -1);
+}
+void rw_lock_acquire_write(Rw_Lock *l) {
+	Spin_Backoff backoff = ZERO(Spin_Backoff);
+	while (true) {
+		u64 state = l->state;
+		if ((state & ~RW_LOCK_WRITER_WAITING) == 0) {
+			// No readers or writer. Clears the waiting bit, other waiting writers set it again.
+			if (compare_and_swap_64(&l->state, RW_LOCK_WRITER, state)) return;
+			continue;
+		}
+		if (!(state & RW_LOCK_WRITER_WAITING)) {
+			compare_and_swap_64(&l->state, state | RW_LOCK_WRITER_WAITING, state);
+		}
+		spin_backoff(&backoff);
+	}
+}
+void rw_lock_release_write(Rw_Lock *l) {
+	assert(l->state & RW_LOCK_WRITER, "Tried to release a write lock which is not acquired");
+	// Clear with an add rather than store 0, a waiting writer may have set its bit meanwhile.
+	// The writer bit is the top bit so adding it again wraps it off, and unlike negating
+	// (s64)RW_LOCK_WRITER (INT64_MIN) it doesn't overflow.
+	atomic_add_64(&l->state, (s64)RW_LOCK_WRITER);
+}
+
+///
+// High-level mutex primitive
 
 void mutex_init(Mutex *m) {
-	spinlock_init(&m->spinlock);
-	m->spin_time_microseconds = MUTEX_DEFAULT_SPIN_TIME_MICROSECONDS;
-	m->os_handle = os_make_mutex();
-	m->spinlock_acquired = false;
-	m->acquiring_thread = 0;
+	memset(m, 0, sizeof(*m));
 }
 void mutex_destroy(Mutex *m) {
-	os_destroy_mutex(m->os_handle);
+	assert(m->state == MUTEX_UNLOCKED, "Destroying a mutex which is acquired");
 }
 void mutex_acquire_or_wait(Mutex *m) {
-	if (spinlock_acquire_or_wait_timeout(&m->spinlock, m->spin_time_microseconds / 1000000.0)) {
-        assert(!m->spinlock_acquired, "Internal sync error in Mutex");
-    	m->spinlock_acquired = true;
-    }
-    os_lock_mutex(m->os_handle);
+	if (!compare_and_swap_32(&m->state, MUTEX_LOCKED, MUTEX_UNLOCKED)) {
+		Spin_Backoff backoff = ZERO(Spin_Backoff);
+		bool acquired = false;
+		for (u64 i = 0; i < MUTEX_SPIN_ROUNDS; i++) {
+			spin_backoff(&backoff);
+			if (m->state == MUTEX_UNLOCKED && compare_and_swap_32(&m->state, MUTEX_LOCKED, MUTEX_UNLOCKED)) {
+				acquired = true;
+				break;
+			}
+		}
+		
+		if (!acquired) {
+			// Mark it as waited on. If it was unlocked we got it, otherwise park until the
+			// owner releases. We can't know if others are still waiting when we get it, so
+			// we keep it marked and release does one unnecessary wake at worst.
+			while (atomic_exchange_32(&m->state, MUTEX_LOCKED_AND_WAITED) != MUTEX_UNLOCKED) {
+				os_wait_on_address_32(&m->state, MUTEX_LOCKED_AND_WAITED);
+			}
+		}
+	}
     
     assert(!m->acquiring_thread, "Internal sync error in Mutex: Multiple threads acquired");
     m->acquiring_thread = context.thread_id;
@@ -123,12 +496,480 @@ void mutex_release(Mutex *m) {
 	assert(m->acquiring_thread != 0, "Tried to release a mutex which is not acquired");
 	assert(m->acquiring_thread == context.thread_id, "Non-owning thread tried to release mutex");
 	m->acquiring_thread = 0;
-	bool was_spinlock_acquired = m->spinlock_acquired;
-	m->spinlock_acquired = false;
-	os_unlock_mutex(m->os_handle);
-	if (was_spinlock_acquired) {
-		spinlock_release(&m->spinlock);
+	if (atomic_exchange_32(&m->state, MUTEX_UNLOCKED) == MUTEX_LOCKED_AND_WAITED) {
+		os_wake_one_on_address(&m->state);
+	}
+}
+
+
+///
+// Spsc_Queue
+
+void spsc_queue_init(Spsc_Queue *q, u64 item_size, u64 capacity, Allocator allocator) {
+	assert(item_size > 0 && capacity > 0, "Spsc_Queue needs a non-zero item size and capacity");
+	*q = ZERO(Spsc_Queue);
+	q->capacity = get_next_power_of_two(capacity);
+	q->item_size = item_size;
+	q->allocator = allocator;
+	q->items = alloc(allocator, q->capacity*item_size);
+}
+void spsc_queue_deinit(Spsc_Queue *q) {
+	dealloc(q->allocator, q->items);
+	*q = ZERO(Spsc_Queue);
+}
+
+// Copies count items between items and the ring starting at index, in at most two parts
+void spsc_queue_copy_in(Spsc_Queue *q, u64 index, void *items, u64 count) {
+	u64 start = index & (q->capacity-1);
+	u64 first = min(count, q->capacity-start);
+	memcpy(q->items + start*q->item_size, items, first*q->item_size);
+	memcpy(q->items, (u8*)items + first*q->item_size, (count-first)*q->item_size);
+}
+void spsc_queue_copy_out(Spsc_Queue *q, u64 index, void *items, u64 count) {
+	u64 start = index & (q->capacity-1);
+	u64 first = min(count, q->capacity-start);
+	memcpy(items, q->items + start*q->item_size, first*q->item_size);
+	memcpy((u8*)items + first*q->item_size, q->items, (count-first)*q->item_size);
+}
+
+u64 spsc_queue_push_batch(Spsc_Queue *q, void *items, u64 count) {
+	u64 head = q->head;
+	
+	// Only look at the consumer's cache line when we think we're full
+	if (q->capacity - (head - q->cached_tail) < count) {
+		q->cached_tail = q->tail;
+		COMPILER_BARRIER; // Acquire, don't write slots before we've seen they're free
+	}
+	count = min(count, q->capacity - (head - q->cached_tail));
+	if (count == 0) return 0;
+	
+	spsc_queue_copy_in(q, head, items, count);
+	
+	COMPILER_BARRIER; // Release, items are written before head says so
+	q->head = head + count;
+	return count;
+}
+bool spsc_queue_push(Spsc_Queue *q, void *item) {
+	return spsc_queue_push_batch(q, item, 1) == 1;
+}
+
+u64 spsc_queue_pop_batch(Spsc_Queue *q, void *out_items, u64 max_count) {
+	u64 tail = q->tail;
+	
+	if (q->cached_head - tail < max_count) {
+		q->cached_head = q->head;
+		COMPILER_BARRIER; // Acquire, don't read items before we've seen head
+	}
+	u64 count = min(max_count, q->cached_head - tail);
+	if (count == 0) return 0;
+	
+	spsc_queue_copy_out(q, tail, out_items, count);
+	
+	COMPILER_BARRIER; // Release, items are read before the producer may overwrite them
+	q->tail = tail + count;
+	return count;
+}
+bool spsc_queue_pop(Spsc_Queue *q, void *out_item) {
+	return spsc_queue_pop_batch(q, out_item, 1) == 1;
+}
+
+///
+// Mpsc_Queue
+// A slot at position p is free for the producer claiming p when its sequence is p, and
+// readable for the consumer when its sequence is p+1. The consumer frees it for the next
+// lap by setting it to p+capacity.
+
+void mpsc_queue_init(Mpsc_Queue *q, u64 item_size, u64 capacity, Allocator allocator) {
+	assert(item_size > 0 && capacity > 0, "Mpsc_Queue needs a non-zero item size and capacity");
+	*q = ZERO(Mpsc_Queue);
+	q->capacity = get_next_power_of_two(capacity);
+	q->item_size = item_size;
+	q->slot_stride = align_next(sizeof(u64) + item_size, 8);
+	q->allocator = allocator;
+	q->slots = alloc(allocator, q->capacity*q->slot_stride);
+	for (u64 i = 0; i < q->capacity; i++) {
+		*(volatile u64*)(q->slots + i*q->slot_stride) = i;
+	}
+}
+void mpsc_queue_deinit(Mpsc_Queue *q) {
+	dealloc(q->allocator, q->slots);
+	*q = ZERO(Mpsc_Queue);
+}
+
+inline volatile u64 *mpsc_queue_get_sequence(Mpsc_Queue *q, u64 position) {
+	return (volatile u64*)(q->slots + (position & (q->capacity-1))*q->slot_stride);
+}
+
+bool mpsc_queue_push(Mpsc_Queue *q, void *item) {
+	u64 position = q->head;
+	volatile u64 *sequence;
+	while (true) {
+		sequence = mpsc_queue_get_sequence(q, position);
+		u64 seq = *sequence;
+		COMPILER_BARRIER;
+		s64 diff = (s64)(seq - position);
+		if (diff == 0) {
+			if (compare_and_swap_64(&q->head, position+1, position)) break;
+		} else if (diff < 0) {
+			// Consumer hasn't freed this slot from the last lap, full
+			return false;
+		}
+		// Another producer got it first
+		position = q->head;
+	}
+	
+	memcpy((u8*)sequence + sizeof(u64), item, q->item_size);
+	COMPILER_BARRIER; // Release
+	*sequence = position + 1;
+	return true;
+}
+
+// Claims all slots with one compare_and_swap, so items from one batch stay together
+u64 mpsc_queue_push_batch(Mpsc_Queue *q, void *items, u64 count) {
+	u64 position;
+	u64 claimed;
+	while (true) {
+		position = q->head;
+		// The consumer frees slots in order and writes tail after it did, so everything
+		// before tail is free.
+		u64 tail = q->tail;
+		COMPILER_BARRIER;
+		u64 used = position - tail;
+		if (used > q->capacity) continue; // Read head and tail from different moments, retry
+		claimed = min(count, q->capacity - used);
+		if (claimed == 0) return 0;
+		if (compare_and_swap_64(&q->head, position+claimed, position)) break;
+	}
+	
+	for (u64 i = 0; i < claimed; i++) {
+		volatile u64 *sequence = mpsc_queue_get_sequence(q, position+i);
+		// The consumer stamps sequences before it writes tail, so anything before tail is free
+		assert(*sequence == position+i, "Internal sync error in Mpsc_Queue");
+		memcpy((u8*)sequence + sizeof(u64), (u8*)items + i*q->item_size, q->item_size);
+		COMPILER_BARRIER; // Release
+		*sequence = position + i + 1;
+	}
+	return claimed;
+}
+
+u64 mpsc_queue_pop_batch(Mpsc_Queue *q, void *out_items, u64 max_count) {
+	u64 tail = q->tail;
+	u64 count = 0;
+	while (count < max_count) {
+		volatile u64 *sequence = mpsc_queue_get_sequence(q, tail+count);
+		u64 seq = *sequence;
+		COMPILER_BARRIER; // Acquire
+		// Empty, or the producer that claimed this slot isn't done writing yet
+		if (seq != tail+count+1) break;
+		memcpy((u8*)out_items + count*q->item_size, (u8*)sequence + sizeof(u64), q->item_size);
+		COMPILER_BARRIER; // Release, read before the slot is handed back
+		*sequence = tail + count + q->capacity;
+		count += 1;
+	}
+	if (count) q->tail = tail + count;
+	return count;
+}
+bool mpsc_queue_pop(Mpsc_Queue *q, void *out_item) {
+	return mpsc_queue_pop_batch(q, out_item, 1) == 1;
+}
+
+
+///
+// Job system
+
+thread_local Job_Worker *job_worker = 0;
+
+bool job_deque_push(Job_Deque *d, Job *job) {
+	s64 bottom = d->bottom;
+	s64 top = d->top;
+	// top only grows, so a stale top can only make us think we're fuller than we are
+	if (bottom - top >= JOB_DEQUE_CAPACITY) return false;
+	
+	d->jobs[bottom & (JOB_DEQUE_CAPACITY-1)] = *job;
+	COMPILER_BARRIER; // Release, job is written before thieves can see it
+	d->bottom = bottom + 1;
+	return true;
+}
+
+bool job_deque_pop(Job_Deque *d, Job *out_job) {
+	s64 bottom = d->bottom - 1;
+	d->bottom = bottom;
+	// Store-load, thieves need to see the new bottom before we look at top or we could
+	// both take the last job.
+	MEMORY_BARRIER;
+	s64 top = d->top;
+	
+	if (top > bottom) {
+		// Empty
+		d->bottom = bottom + 1;
+		return false;
 	}
+	
+	*out_job = d->jobs[bottom & (JOB_DEQUE_CAPACITY-1)];
+	if (top == bottom) {
+		// Last job, race the thieves for it
+		bool won = compare_and_swap_64((volatile u64*)&d->top, (u64)(top+1), (u64)top);
+		d->bottom = bottom + 1;
+		return won;
+	}
+	return true;
+}
+
+bool job_deque_steal(Job_Deque *d, Job *out_job) {
+	s64 top = d->top;
+	COMPILER_BARRIER; // Acquire, read top before bottom
+	s64 bottom = d->bottom;
+	if (top >= bottom) return false;
+	
+	// Might be torn if the owner is racing us for it, but then the swap fails and we
+	// throw it away.
+	*out_job = d->jobs[top & (JOB_DEQUE_CAPACITY-1)];
+	return compare_and_swap_64((volatile u64*)&d->top, (u64)(top+1), (u64)top);
+}
+
+bool job_system_has_work() {
+	for (u64 i = 0; i < job_system.worker_count; i++) {
+		Job_Deque *d = &job_system.workers[i].deque;
+		if (d->top < d->bottom) return true;
+	}
+	return job_system.injected.head != job_system.injected.tail;
+}
+
+void job_system_wake_one() {
+	MEMORY_BARRIER; // The job is visible before we look for sleepers
+	if (job_system.sleeping_count == 0) return;
+	
+	for (u64 i = 1; i < job_system.worker_count; i++) {
+		Job_Worker *w = &job_system.workers[i];
+		if (w->sleeping && compare_and_swap_bool(&w->sleeping, false, true)) {
+			atomic_add_64(&job_system.sleeping_count, -1);
+			os_binary_semaphore_signal(&w->wake);
+			return;
+		}
+	}
+}
+
+void job_run(Job *job);
+
+void job_push(Job *job) {
+	assert(job_system.workers, "Job system is not initialized. Define ENABLE_JOB_SYSTEM or call job_system_init");
+	if (job->counter) atomic_add_64(&job->counter->pending, 1);
+	
+	bool pushed;
+	if (job_worker) {
+		pushed = job_deque_push(&job_worker->deque, job);
+	} else {
+		pushed = mpsc_queue_push(&job_system.injected, job);
+	}
+	
+	if (!pushed) {
+		// Queue is full, doing it now is the best way to make room anyways
+		job_run(job);
+		return;
+	}
+	
+	job_system_wake_one();
+}
+
+void job_run(Job *job) {
+	if (job->range_proc) {
+		// Keep the left half, push the right half for someone to steal
+		while (job->last - job->first > job->grain) {
+			Job right = *job;
+			right.first = job->first + (job->last - job->first + 1) / 2;
+			job->last = right.first;
+			job_push(&right);
+		}
+		job->range_proc(job->first, job->last, job->data);
+	} else {
+		job->proc(job->data);
+	}
+	
+	if (job->counter) {
+		COMPILER_BARRIER; // Release, the job's writes are done before the waiter sees zero
+		atomic_add_64(&job->counter->pending, -1);
+	}
+}
+
+bool job_system_try_get_job(Job *out_job) {
+	if (job_worker && job_deque_pop(&job_worker->deque, out_job)) return true;
+	
+	if (job_system.injected.head != job_system.injected.tail
+	 && compare_and_swap_bool(&job_system.injected_consumer_locked, true, false)) {
+		bool got = mpsc_queue_pop(&job_system.injected, out_job);
+		job_system.injected_consumer_locked = false;
+		if (got) return true;
+	}
+	
+	if (job_system.worker_count == 0) return false;
+	
+	// Start stealing at a random worker so thieves spread out
+	u64 seed = job_worker ? job_worker->steal_seed : rdtsc();
+	seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+	if (job_worker) job_worker->steal_seed = seed;
+	
+	u64 start = seed % job_system.worker_count;
+	for (u64 i = 0; i < job_system.worker_count; i++) {
+		Job_Worker *victim = &job_system.workers[(start + i) % job_system.worker_count];
+		if (victim == job_worker) continue;
+		if (job_deque_steal(&victim->deque, out_job)) return true;
+	}
+	return false;
+}
+
+bool job_system_try_run_one() {
+	Job job;
+	if (!job_system_try_get_job(&job)) return false;
+	job_run(&job);
+	return true;
+}
+
+void job_worker_sleep(Job_Worker *w) {
+	w->sleeping = true;
+	// Locked add is a full fence, so we either see a job pushed before this or the
+	// pusher sees us sleeping.
+	atomic_add_64(&job_system.sleeping_count, 1);
+	
+	if (job_system_has_work() || job_system.shutting_down) {
+		if (compare_and_swap_bool(&w->sleeping, false, true)) {
+			atomic_add_64(&job_system.sleeping_count, -1);
+			return;
+		}
+		// Somebody is already waking us, take the signal so it doesn't wake us later
+	}
+	
+	os_binary_semaphore_wait(&w->wake);
+}
+
+void job_worker_proc(Thread *t) {
+	Job_Worker *w = (Job_Worker*)t->data;
+	job_worker = w;
+	
+	u64 idle_count = 0;
+	while (true) {
+		if (job_system_try_run_one()) {
+			idle_count = 0;
+			continue;
+		}
+		if (job_system.shutting_down) break;
+		
+		if (idle_count < JOB_WORKER_IDLE_SPIN_COUNT) {
+			idle_count += 1;
+			os_yield_thread();
+			continue;
+		}
+		
+		job_worker_sleep(w);
+		idle_count = 0;
+	}
+	
+	job_worker = 0;
+}
+
+void job_system_init(u64 worker_count, Allocator allocator) {
+	assert(job_system.worker_count == 0, "Job system is already initialized");
+	if (worker_count == 0) worker_count = os_get_number_of_logical_processors();
+	if (worker_count == 0) worker_count = 1;
+	
+	job_system = ZERO(Job_System);
+	job_system.allocator = allocator;
+	job_system.worker_count = worker_count;
+	job_system.workers = (Job_Worker*)alloc(allocator, worker_count*sizeof(Job_Worker));
+	memset(job_system.workers, 0, worker_count*sizeof(Job_Worker));
+	mpsc_queue_init(&job_system.injected, sizeof(Job), JOB_INJECT_QUEUE_CAPACITY, allocator);
+	
+	for (u64 i = 0; i < worker_count; i++) {
+		Job_Worker *w = &job_system.workers[i];
+		w->index = i;
+		w->steal_seed = rdtsc() + i*0x9E3779B97F4A7C15ull;
+		if (w->steal_seed == 0) w->steal_seed = 1;
+		w->deque.jobs = (Job*)alloc(allocator, JOB_DEQUE_CAPACITY*sizeof(Job));
+	}
+	
+	job_worker = &job_system.workers[0];
+	
+	for (u64 i = 1; i < worker_count; i++) {
+		Job_Worker *w = &job_system.workers[i];
+		os_binary_semaphore_init(&w->wake, false);
+		os_thread_init(&w->thread, job_worker_proc);
+		w->thread.data = w;
+		os_thread_start(&w->thread);
+	}
+}
+
+void job_system_shutdown() {
+	assert(job_worker == &job_system.workers[0], "job_system_shutdown must be called from the thread that called job_system_init");
+	
+	// Help finish what's queued
+	while (job_system_try_run_one()) {}
+	
+	job_system.shutting_down = true;
+	MEMORY_BARRIER;
+	for (u64 i = 1; i < job_system.worker_count; i++) {
+		Job_Worker *w = &job_system.workers[i];
+		if (compare_and_swap_bool(&w->sleeping, false, true)) {
+			atomic_add_64(&job_system.sleeping_count, -1);
+			os_binary_semaphore_signal(&w->wake);
+		}
+	}
+	
+	for (u64 i = 1; i < job_system.worker_count; i++) {
+		Job_Worker *w = &job_system.workers[i];
+		os_thread_join(&w->thread);
+		os_thread_destroy(&w->thread);
+		os_binary_semaphore_destroy(&w->wake);
+	}
+	for (u64 i = 0; i < job_system.worker_count; i++) {
+		dealloc(job_system.allocator, job_system.workers[i].deque.jobs);
+	}
+	mpsc_queue_deinit(&job_system.injected);
+	dealloc(job_system.allocator, job_system.workers);
+	
+	job_worker = 0;
+	job_system = ZERO(Job_System);
+}
+
+void job_submit(Job_Counter *counter, Job_Proc proc, void *data) {
+	Job job = ZERO(Job);
+	job.proc = proc;
+	job.data = data;
+	job.counter = counter;
+	job_push(&job);
+}
+
+bool job_counter_is_done(Job_Counter *counter) {
+	return counter->pending == 0;
+}
+
+void job_wait(Job_Counter *counter) {
+	while (counter->pending != 0) {
+		if (!job_system_try_run_one()) {
+			// Whatever we're waiting for is running on another thread
+			os_yield_thread();
+		}
+	}
+	COMPILER_BARRIER; // Acquire, don't read results before we've seen zero
+}
+
+void parallel_for(u64 count, u64 grain, Parallel_For_Proc proc, void *data) {
+	if (count == 0) return;
+	if (grain == 0) grain = 1;
+	
+	Job_Counter counter = ZERO(Job_Counter);
+	
+	Job job = ZERO(Job);
+	job.range_proc = proc;
+	job.data = data;
+	job.counter = &counter;
+	job.first = 0;
+	job.last = count;
+	job.grain = grain;
+	
+	// Split and run the first piece right here, the rest gets pushed for the workers
+	atomic_add_64(&counter.pending, 1);
+	job_run(&job);
+	
+	job_wait(&counter);
 }
 
 #endif
\ No newline at end of file
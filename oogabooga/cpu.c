@@ -79,6 +79,10 @@ typedef struct Cpu_Capabilities {
 	#pragma intrinsic(_InterlockedCompareExchange16)
 	#pragma intrinsic(_InterlockedCompareExchange)
 	#pragma intrinsic(_InterlockedCompareExchange64)
+	#pragma intrinsic(_InterlockedExchangeAdd64)
+	#pragma intrinsic(_InterlockedExchange)
+	#pragma intrinsic(_BitScanForward)
+	#pragma intrinsic(_BitScanReverse64)
 	
 	inline bool 
 	compare_and_swap_8(volatile uint8_t *a, uint8_t b, uint8_t old) {
@@ -105,7 +109,48 @@ typedef struct Cpu_Capabilities {
 	    return compare_and_swap_8((uint8_t*)a, (uint8_t)b, (uint8_t)old);
 	}
 	
-	#define MEMORY_BARRIER _ReadWriteBarrier()
+	// Returns the value after the add
+	inline uint64_t 
+	atomic_add_64(volatile uint64_t *a, int64_t n) {
+	    return (uint64_t)_InterlockedExchangeAdd64((volatile long long*)a, (long long)n) + (uint64_t)n;
+	}
+	
+	// Returns the old value
+	inline uint32_t 
+	atomic_exchange_32(volatile uint32_t *a, uint32_t b) {
+	    return (uint32_t)_InterlockedExchange((volatile long*)a, (long)b);
+	}
+	
+	// x must not be 0
+	inline u32
+	bit_scan_forward_32(u32 x) {
+		unsigned long index;
+		_BitScanForward(&index, x);
+		return (u32)index;
+	}
+	inline u32
+	bit_scan_reverse_32(u32 x) {
+		unsigned long index;
+		_BitScanReverse(&index, x);
+		return (u32)index;
+	}
+	inline u32
+	bit_scan_reverse_64(u64 x) {
+		unsigned long index;
+		_BitScanReverse64(&index, x);
+		return (u32)index;
+	}
+	
+	// MSVC lets us use avx2 intrinsics without /arch:AVX2, so procs can be compiled for
+	// avx2 and picked at runtime if query_cpu_capabilities() says it's supported.
+	#define COMPILER_CAN_TARGET_AVX2 1
+	#define target_avx2
+	
+	#define MEMORY_BARRIER {_ReadWriteBarrier();_mm_mfence();}
+	// Only stops the compiler from reordering. Enough for acquire/release on x86.
+	#define COMPILER_BARRIER _ReadWriteBarrier()
+	// Spin-wait hint, lets the sibling hyperthread run and saves power
+	#define CPU_PAUSE _mm_pause()
 	
 	#define thread_local __declspec(thread)
 	
@@ -225,7 +270,43 @@ typedef struct Cpu_Capabilities {
 	    return compare_and_swap_8((uint8_t*)a, (uint8_t)b, (uint8_t)old);
 	}
 	
+	// Returns the value after the add
+	inline uint64_t 
+	atomic_add_64(volatile uint64_t *a, int64_t n) {
+	    return __sync_add_and_fetch(a, (uint64_t)n);
+	}
+	
+	// Returns the old value
+	inline uint32_t 
+	atomic_exchange_32(volatile uint32_t *a, uint32_t b) {
+	    return __atomic_exchange_n(a, b, __ATOMIC_SEQ_CST);
+	}
+	
+	// x must not be 0
+	inline u32
+	bit_scan_forward_32(u32 x) {
+		return (u32)__builtin_ctz(x);
+	}
+	inline u32
+	bit_scan_reverse_32(u32 x) {
+		return 31 - (u32)__builtin_clz(x);
+	}
+	inline u32
+	bit_scan_reverse_64(u64 x) {
+		return 63 - (u32)__builtin_clzll(x);
+	}
+	
+	// Compile single procs for avx2 even if the rest of the program isn't, so they can be
+	// picked at runtime if query_cpu_capabilities() says it's supported.
+	// These procs can't be inline.
+	#define COMPILER_CAN_TARGET_AVX2 1
+	#define target_avx2 __attribute__((target("avx2")))
+	
 	#define MEMORY_BARRIER {__asm__ __volatile__("" ::: "memory");__sync_synchronize();}
+	// Only stops the compiler from reordering. Enough for acquire/release on x86.
+	#define COMPILER_BARRIER __asm__ __volatile__("" ::: "memory")
+	// Spin-wait hint, lets the sibling hyperthread run and saves power
+	#define CPU_PAUSE _mm_pause()
 	
 	#define thread_local __thread
 	
@@ -251,7 +332,19 @@ typedef struct Cpu_Capabilities {
     
     #define DEPRECATED(proc, msg) 
     
+    inline u32
+    bit_scan_forward_32(u32 x) { u32 i = 0; while (!(x & 1)) { x >>= 1; i += 1; } return i; }
+    inline u32
+    bit_scan_reverse_32(u32 x) { u32 i = 0; while (x >>= 1) i += 1; return i; }
+    inline u32
+    bit_scan_reverse_64(u64 x) { u32 i = 0; while (x >>= 1) i += 1; return i; }
+    
+    #define COMPILER_CAN_TARGET_AVX2 0
+    #define target_avx2
+    
     #define MEMORY_BARRIER
+    #define COMPILER_BARRIER
+    #define CPU_PAUSE
     
     #warning "Compiler is not explicitly supported, some things will probably not work as expected"
 #endif
@@ -53,6 +53,12 @@
 	
 			- For loading and dealing with fonts see font.c, or for a practical example see examples/text_rendering.c
 			
+		- Profiler overlay:
+		
+			void draw_profiler_overlay(Gfx_Font *font, u32 raster_height);
+			
+			- Draws the per-scope frame stats from profiling.c, needs ENABLE_PROFILING.
+			
 		- Lower-level quad drawing:
 		
 			Draw_Quad *draw_quad_projected(Draw_Quad quad, Matrix4 world_to_clip);
@@ -107,14 +113,21 @@
 		
 			void draw_frame_init(Draw_Frame *frame);
 			void draw_frame_init_reserve(Draw_Frame *frame, u64 number_of_quads_to_reserve);
+			void draw_frame_init_with_quad_arena(Draw_Frame *frame);
 			void draw_frame_reset(Draw_Frame *frame);
+			void draw_frame_deinit(Draw_Frame *frame);
 			
 			- draw_frame_init needs to be called once to set up some initial stuff. I don't like this so it
 				might change.
 			- draw_frame_init_reserve does the same as draw_frame_init, but you can pre-allocate for a certain
 				amount of quads.
+			- draw_frame_init_with_quad_arena stores quads in chunks instead of one growing array. Quads
+				never move, so the Draw_Quad* you get back stays valid for the whole frame, and the chunks
+				are kept around between resets so the heap isn't touched unless the frame draws more
+				quads than it recently has. The global draw_frame uses this.
 			- draw_frame_reset will, in short, clear the array of computed Draw_Quad's and zero everything
 				out.	
+			- draw_frame_deinit frees the quad array or chunks. The global draw_frame is deinitted on exit.
 				
 			- A practical example for using Draw_Frame's can be found in examples/threaded_drawing.c	
 		
@@ -166,6 +179,7 @@
 #define Z_STACK_MAX 4096
 #define SCISSOR_STACK_MAX 4096
 #define MAX_BOUND_IMAGES 16
+#define DRAW_QUAD_CHUNK_CAPACITY 1024
 
 typedef struct Draw_Quad {
 	// BEWARE !! These are in ndc
@@ -186,6 +200,13 @@ typedef struct Draw_Quad {
 	
 } Draw_Quad;
 
+typedef struct Draw_Quad_Chunk Draw_Quad_Chunk;
+typedef struct Draw_Quad_Chunk {
+	Draw_Quad_Chunk *next;
+	u64 count;
+	Draw_Quad quads[DRAW_QUAD_CHUNK_CAPACITY];
+} Draw_Quad_Chunk;
+
 typedef struct Draw_Frame {
 	Matrix4 projection;
 	// #Cleanup
@@ -199,8 +220,15 @@ typedef struct Draw_Frame {
 	u64 scissor_count;
 	Vector4 scissor_stack[SCISSOR_STACK_MAX];
 	
+	// Growing array, 0 if the frame uses a quad arena
 	Draw_Quad *quad_buffer;
 	
+	// Quad arena, see draw_frame_init_with_quad_arena
+	Draw_Quad_Chunk *first_quad_chunk;
+	Draw_Quad_Chunk *current_quad_chunk;
+	u64 quad_count;
+	u64 quad_high_water; // Decays a little every reset so we let go of chunks after a spike
+	
 	u64 z_count;
 	s32 z_stack[Z_STACK_MAX];
 	bool enable_z_sorting;
@@ -222,21 +250,84 @@ void draw_frame_init_reserve(Draw_Frame *frame, u64 number_of_quads_to_reserve)
 	
 	growing_array_init_reserve((void**)&frame->quad_buffer, sizeof(Draw_Quad), number_of_quads_to_reserve, get_heap_allocator());
 }
+void draw_frame_init_with_quad_arena(Draw_Frame *frame) {
+	*frame = ZERO(Draw_Frame);
+	
+	frame->first_quad_chunk = (Draw_Quad_Chunk*)alloc(get_heap_allocator(), sizeof(Draw_Quad_Chunk));
+	frame->first_quad_chunk->next = 0;
+	frame->first_quad_chunk->count = 0;
+	frame->current_quad_chunk = frame->first_quad_chunk;
+}
 
-void draw_frame_reset(Draw_Frame *frame) {
+u64 draw_frame_get_quad_count(Draw_Frame *frame) {
+	if (frame->quad_buffer) return growing_array_get_valid_count(frame->quad_buffer);
+	return frame->quad_count;
+}
+
+Draw_Quad *draw_frame_push_quad(Draw_Frame *frame) {
+	if (frame->quad_buffer) {
+		return (Draw_Quad*)growing_array_add_empty((void**)&frame->quad_buffer);
+	}
+	
+	assert(frame->first_quad_chunk, "Draw_Frame was not initialized. Call draw_frame_init or draw_frame_init_with_quad_arena.");
+	
+	Draw_Quad_Chunk *chunk = frame->current_quad_chunk;
+	if (chunk->count == DRAW_QUAD_CHUNK_CAPACITY) {
+		if (!chunk->next) {
+			// #Memory #Heapalloc
+			// Only happens when we draw more quads than we have recently
+			chunk->next = (Draw_Quad_Chunk*)alloc(get_heap_allocator(), sizeof(Draw_Quad_Chunk));
+			chunk->next->next = 0;
+			chunk->next->count = 0;
+		}
+		chunk = chunk->next;
+		frame->current_quad_chunk = chunk;
+	}
+	
+	Draw_Quad *q = &chunk->quads[chunk->count];
+	chunk->count += 1;
+	frame->quad_count += 1;
+	
+	return q;
+}
+
+// Keeps enough chunks for the recent high water mark of quads and frees the rest
+void draw_frame_reset_quad_arena(Draw_Frame *frame) {
+	frame->quad_high_water = max(frame->quad_count, frame->quad_high_water - frame->quad_high_water/64);
+	
+	u64 chunks_to_keep = max((frame->quad_high_water+DRAW_QUAD_CHUNK_CAPACITY-1)/DRAW_QUAD_CHUNK_CAPACITY, 1);
+	
+	Draw_Quad_Chunk *chunk = frame->first_quad_chunk;
+	for (u64 i = 0; chunk != 0; i += 1) {
+		Draw_Quad_Chunk *next = chunk->next;
+		if (i == chunks_to_keep-1) {
+			chunk->next = 0;
+		} else if (i >= chunks_to_keep) {
+			dealloc(get_heap_allocator(), chunk);
+		}
+		if (i < chunks_to_keep) chunk->count = 0;
+		chunk = next;
+	}
+	
+	frame->current_quad_chunk = frame->first_quad_chunk;
+	frame->quad_count = 0;
+}
 
-	// #Memory
-	// I would like to try to have the quad buffer to be allocated in a growing arena
-	// which is reset every frames, like temp allocator but large enough to fit the
-	// highest number of quads the program submits in a frame.
-	// For now, we just reset the count in the heap allocated buffer
+void draw_frame_reset(Draw_Frame *frame) {
 
 	Draw_Quad *quad_buffer = frame->quad_buffer;
 	if (quad_buffer) growing_array_clear((void**)&quad_buffer);
+	
+	if (frame->first_quad_chunk) draw_frame_reset_quad_arena(frame);
+	Draw_Quad_Chunk *first_quad_chunk = frame->first_quad_chunk;
+	u64 quad_high_water = frame->quad_high_water;
 
 	*frame = (Draw_Frame){0};
 	
 	frame->quad_buffer = quad_buffer;
+	frame->first_quad_chunk = first_quad_chunk;
+	frame->current_quad_chunk = first_quad_chunk;
+	frame->quad_high_water = quad_high_water;
 	
 	frame->projection 
 		= m4_make_orthographic_projection(-window.width/2, window.width/2, -window.height/2, window.height/2, -1, 10);
@@ -245,6 +336,19 @@ void draw_frame_reset(Draw_Frame *frame) {
 	frame->highest_bound_slot_index = -1;
 }
 
+void draw_frame_deinit(Draw_Frame *frame) {
+	if (frame->quad_buffer) growing_array_deinit((void**)&frame->quad_buffer);
+	
+	Draw_Quad_Chunk *chunk = frame->first_quad_chunk;
+	while (chunk) {
+		Draw_Quad_Chunk *next = chunk->next;
+		dealloc(get_heap_allocator(), chunk);
+		chunk = next;
+	}
+	
+	*frame = ZERO(Draw_Frame);
+}
+
 void draw_frame_bind_image_to_shader(Draw_Frame *frame, Gfx_Image *image, int slot_index) {
 	if (slot_index >= MAX_BOUND_IMAGES) {
 		log_error("The highest bind image slot is %i, you tried to bind to %i", MAX_BOUND_IMAGES-1, slot_index);
@@ -264,6 +368,8 @@ Draw_Frame draw_frame;
 
 Draw_Quad _nil_quad = {0};
 Draw_Quad *draw_quad_projected_in_frame(Draw_Quad quad, Matrix4 world_to_clip, Draw_Frame *frame) {
+	engine_tm_begin("draw_quad_projected_in_frame");
+	
 	quad.bottom_left  = m4_transform(world_to_clip, v4(v2_expand(quad.bottom_left), 0, 1)).xy;
 	quad.top_left     = m4_transform(world_to_clip, v4(v2_expand(quad.top_left), 0, 1)).xy;
 	quad.top_right    = m4_transform(world_to_clip, v4(v2_expand(quad.top_right), 0, 1)).xy;
@@ -276,6 +382,7 @@ Draw_Quad *draw_quad_projected_in_frame(Draw_Quad quad, Matrix4 world_to_clip, D
 	    (quad.bottom_left.y > 1 && quad.top_left.y > 1 && quad.top_right.y > 1 && quad.bottom_right.y > 1);
 
 	if (should_cull) {
+		engine_tm_end();
 		return &_nil_quad;
 	}
 	
@@ -294,11 +401,8 @@ Draw_Quad *draw_quad_projected_in_frame(Draw_Quad quad, Matrix4 world_to_clip, D
 	
 	memset(quad.userdata, 0, sizeof(quad.userdata));
 	
-	Draw_Quad **target_buffer = &frame->quad_buffer;
-	
-	growing_array_add((void**)target_buffer, &quad);
-	
-	Draw_Quad *q = &(*target_buffer)[growing_array_get_valid_count(*target_buffer)-1];
+	Draw_Quad *q = draw_frame_push_quad(frame);
+	*q = quad;
 	
 	// This is meant to fix the annoying artifacts that shows up when sampling from a large atlas
     // presumably for floating point precision issues or something.
@@ -319,6 +423,7 @@ Draw_Quad *draw_quad_projected_in_frame(Draw_Quad quad, Matrix4 world_to_clip, D
     q->bottom_right.x = round(q->bottom_right.x / pixel_width)  * pixel_width;
     q->bottom_right.y = round(q->bottom_right.y / pixel_height) * pixel_height;
 	
+	engine_tm_end();
 	return q;
 }
 Draw_Quad *draw_quad_in_frame(Draw_Quad quad, Draw_Frame *frame) {
@@ -579,3 +684,77 @@ void pop_window_scissor() { pop_window_scissor_in_frame(&draw_frame); }
 #define COLOR_WHITE ((Vector4){1.0, 1.0, 1.0, 1.0})
 #define COLOR_BLACK ((Vector4){0.0, 0.0, 0.0, 1.0})
 
+///
+// Profiler overlay
+// A table of profiler_get_all_scope_stats in the top left corner of the window, the
+// most expensive scopes first. Times are in milliseconds per frame averaged over the
+// stats window, except min/max which are single calls.
+#define PROFILER_OVERLAY_MAX_ROWS 32
+
+void draw_profiler_overlay(Gfx_Font *font, u32 raster_height) {
+	Profiler_Scope_Stats *stats = talloc(PROFILER_MAX_SCOPES*sizeof(Profiler_Scope_Stats));
+	u64 count = profiler_get_all_scope_stats(stats, PROFILER_MAX_SCOPES);
+	
+	// Most inclusive time first
+	for (u64 i = 1; i < count; i++) {
+		Profiler_Scope_Stats s = stats[i];
+		u64 j = i;
+		while (j > 0 && stats[j-1].total_seconds < s.total_seconds) {
+			stats[j] = stats[j-1];
+			j -= 1;
+		}
+		stats[j] = s;
+	}
+	count = min(count, PROFILER_OVERLAY_MAX_ROWS);
+	
+	// Draw in window pixels no matter what the game has set
+	Matrix4 last_projection = draw_frame.projection;
+	Matrix4 last_camera_xform = draw_frame.camera_xform;
+	draw_frame.projection = m4_make_orthographic_projection(0, window.width, 0, window.height, -1, 10);
+	draw_frame.camera_xform = m4_scalar(1.0);
+	
+	const string columns[] = {
+		STR("Scope"), STR("Calls"), STR("Total"), STR("Self"), STR("Min"), STR("Max"), STR("p50"), STR("p95"), STR("p99")
+	};
+	const u64 column_count = sizeof(columns)/sizeof(string);
+	float32 name_width = raster_height*14.0f;
+	float32 column_width = raster_height*5.0f;
+	float32 row_height = raster_height*1.3f;
+	float32 padding = raster_height*0.5f;
+	
+	Vector2 size = v2(name_width + column_width*(column_count-1) + padding*2, row_height*(count+1) + padding*2);
+	Vector2 top_left = v2(10, window.height-10);
+	draw_rect(v2(top_left.x, top_left.y-size.y), size, v4(0, 0, 0, 0.75));
+	
+	float32 y = top_left.y - padding - raster_height;
+	float32 x = top_left.x + padding;
+	for (u64 c = 0; c < column_count; c++) {
+		float32 column_x = c == 0 ? x : x + name_width + column_width*(c-1);
+		draw_text(font, columns[c], raster_height, v2(column_x, y), v2(1, 1), v4(1, 1, 0.5, 1));
+	}
+	
+	for (u64 i = 0; i < count; i++) {
+		Profiler_Scope_Stats *s = &stats[i];
+		y -= row_height;
+		f64 frames = (f64)max(s->frame_count, 1);
+		
+		string values[] = {
+			s->name,
+			tprint("%.1f", (f64)s->call_count/frames),
+			tprint("%.3f", s->total_seconds/frames*1000.0),
+			tprint("%.3f", s->self_seconds/frames*1000.0),
+			tprint("%.3f", s->min_seconds*1000.0),
+			tprint("%.3f", s->max_seconds*1000.0),
+			tprint("%.3f", s->p50_seconds*1000.0),
+			tprint("%.3f", s->p95_seconds*1000.0),
+			tprint("%.3f", s->p99_seconds*1000.0),
+		};
+		for (u64 c = 0; c < column_count; c++) {
+			float32 column_x = c == 0 ? x : x + name_width + column_width*(c-1);
+			draw_text(font, values[c], raster_height, v2(column_x, y), v2(1, 1), COLOR_WHITE);
+		}
+	}
+	
+	draw_frame.projection = last_projection;
+	draw_frame.camera_xform = last_camera_xform;
+}
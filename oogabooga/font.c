@@ -147,8 +147,9 @@ void destroy_font(Gfx_Font *font) {
 		Gfx_Font_Variation *variation = &font->variations[i];
 		if (!variation->initted) continue;
 		
-		for (u64 j = 0; j < variation->atlases.count; j++) {
-			Gfx_Font_Atlas *atlas = (Gfx_Font_Atlas*)hash_table_get_nth_value(&variation->atlases, j);
+		u64 iterator = 0;
+		Gfx_Font_Atlas *atlas;
+		while (hash_table_iterate(&variation->atlases, &iterator, 0, (void**)&atlas)) {
 			delete_image(atlas->image);
 			dealloc(font->allocator, atlas->glyphs);
 		}
@@ -214,6 +215,8 @@ void font_variation_init(Gfx_Font_Variation *variation, Gfx_Font *font, u32 font
 }
 
 void font_atlas_init(Gfx_Font_Atlas *atlas, Gfx_Font_Variation *variation, u32 first_codepoint) {
+	engine_tm_begin("font_atlas_init");
+	
 	stbtt_fontinfo stbtt_handle = variation->font->stbtt_handle;
 	atlas->first_codepoint = first_codepoint;
 	
@@ -267,6 +270,8 @@ void font_atlas_init(Gfx_Font_Atlas *atlas, Gfx_Font_Variation *variation, u32 f
 	}
 	
 	third_party_allocator = ZERO(Allocator);
+	
+	engine_tm_end();
 }
 
 void render_atlas_if_not_yet_rendered(Gfx_Font *font, u32 font_height, u32 codepoint) {
@@ -296,6 +301,25 @@ typedef struct {
 	bool ignore_control_codes;
 	void *ud;
 } Walk_Glyphs_Spec;
+
+// Decodes in batches into a stack buffer, it's a lot faster than next_utf8 per glyph
+// and doesn't need temporary memory proportional to the text.
+#define WALK_GLYPHS_DECODE_BATCH 256
+typedef struct Walk_Glyphs_Decoder {
+	string remaining;
+	u32 codepoints[WALK_GLYPHS_DECODE_BATCH];
+	u64 count;
+	u64 next;
+} Walk_Glyphs_Decoder;
+u32 walk_glyphs_next_codepoint(Walk_Glyphs_Decoder *d) {
+	if (d->next == d->count) {
+		d->count = utf8_to_utf32_bulk(&d->remaining, d->codepoints, WALK_GLYPHS_DECODE_BATCH);
+		d->next = 0;
+		if (d->count == 0) return 0;
+	}
+	return d->codepoints[d->next++];
+}
+
 void walk_glyphs(Walk_Glyphs_Spec spec, Walk_Glyphs_Callback_Proc proc) {
 	
 	if (spec.text.data == 0 || spec.text.count <= 0) return;
@@ -305,8 +329,13 @@ void walk_glyphs(Walk_Glyphs_Spec spec, Walk_Glyphs_Callback_Proc proc) {
 	float x = 0;
 	float y = 0;
 	
+	Walk_Glyphs_Decoder decoder;
+	decoder.remaining = spec.text;
+	decoder.count = 0;
+	decoder.next = 0;
+	
 	u32 last_c = 0;
-	u32 c = next_utf8(&spec.text);
+	u32 c = walk_glyphs_next_codepoint(&decoder);
 	while (c != 0) {
 		
 		render_atlas_if_not_yet_rendered(spec.font, spec.raster_height, c);
@@ -318,7 +347,7 @@ void walk_glyphs(Walk_Glyphs_Spec spec, Walk_Glyphs_Callback_Proc proc) {
 		}
 		
 		if (c < 32 && spec.ignore_control_codes) {
-			c = next_utf8(&spec.text);
+			c = walk_glyphs_next_codepoint(&decoder);
 			continue;
 		}
 		
@@ -342,7 +371,7 @@ void walk_glyphs(Walk_Glyphs_Spec spec, Walk_Glyphs_Callback_Proc proc) {
 		}
 		
 		last_c = c;
-		c = next_utf8(&spec.text);
+		c = walk_glyphs_next_codepoint(&decoder);
 	}
 }
 
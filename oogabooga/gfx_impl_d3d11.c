@@ -393,7 +393,7 @@ void gfx_init() {
 
 	window.enable_vsync = false;
 	
-	draw_frame_init(&draw_frame);
+	draw_frame_init_with_quad_arena(&draw_frame);
 	draw_frame_reset(&draw_frame);
 
 	log_verbose("d3d11 gfx_init");
@@ -644,13 +644,17 @@ void gfx_clear_render_target(Gfx_Image *render_target, Vector4 clear_color) {
 // gfx_interface.c impl
 void gfx_render_draw_frame(Draw_Frame *frame, Gfx_Image *render_target) {
 	assert(context.thread_id == d3d11_thread_id, "gfx_ functions must be called on the main thread");
+	engine_tm_begin("gfx_render_draw_frame");
 	
 	HRESULT hr;
 	
 	
-	if (!frame->quad_buffer) return;
+	if (!frame->quad_buffer && !frame->first_quad_chunk) {
+		engine_tm_end();
+		return;
+	}
 
-	u64 number_of_quads = growing_array_get_valid_count(frame->quad_buffer);
+	u64 number_of_quads = draw_frame_get_quad_count(frame);
 	
 	///
 	// Maybe grow quad vbo
@@ -729,19 +733,47 @@ void gfx_render_draw_frame(Draw_Frame *frame, Gfx_Image *render_target) {
 		// here on the main thread.
 		//
 		{
+			// Quads are either contiguous (growing array) or in the chunks of the frame's quad arena.
+			// Sorting needs them contiguous, so chunks are gathered into the sort buffer first.
+			Draw_Quad *quads = frame->quad_buffer;
+			Draw_Quad_Chunk *chunk = frame->first_quad_chunk;
+			u64 index_in_chunk = 0;
+			
 			if (frame->enable_z_sorting) {
-				if (!d3d11_sort_quad_buffer || (d3d11_sort_quad_buffer_size < number_of_quads*sizeof(Draw_Quad))) {
+				u64 required_sort_size = number_of_quads*sizeof(Draw_Quad);
+				if (!quads) required_sort_size *= 2;
+				if (!d3d11_sort_quad_buffer || (d3d11_sort_quad_buffer_size < required_sort_size)) {
 					// #Memory #Heapalloc
 					if (d3d11_sort_quad_buffer) dealloc(get_heap_allocator(), d3d11_sort_quad_buffer);
-					d3d11_sort_quad_buffer = alloc(get_heap_allocator(), number_of_quads*sizeof(Draw_Quad));
-					d3d11_sort_quad_buffer_size = number_of_quads*sizeof(Draw_Quad);
+					d3d11_sort_quad_buffer = alloc(get_heap_allocator(), required_sort_size);
+					d3d11_sort_quad_buffer_size = required_sort_size;
+				}
+				Draw_Quad *help_buffer = d3d11_sort_quad_buffer;
+				if (!quads) {
+					quads = d3d11_sort_quad_buffer;
+					help_buffer = quads + number_of_quads;
+					u64 gathered = 0;
+					for (Draw_Quad_Chunk *c = chunk; c != 0 && gathered < number_of_quads; c = c->next) {
+						memcpy(quads+gathered, c->quads, c->count*sizeof(Draw_Quad));
+						gathered += c->count;
+					}
 				}
-				radix_sort(frame->quad_buffer, d3d11_sort_quad_buffer, number_of_quads, sizeof(Draw_Quad), offsetof(Draw_Quad, z), MAX_Z_BITS);
+				radix_sort(quads, help_buffer, number_of_quads, sizeof(Draw_Quad), offsetof(Draw_Quad, z), MAX_Z_BITS);
 			}
 		
 			for (u64 i = 0; i < number_of_quads; i++)  {
 				
-				Draw_Quad *q = &frame->quad_buffer[i];
+				Draw_Quad *q;
+				if (quads) {
+					q = &quads[i];
+				} else {
+					if (index_in_chunk == chunk->count) {
+						chunk = chunk->next;
+						index_in_chunk = 0;
+					}
+					q = &chunk->quads[index_in_chunk];
+					index_in_chunk += 1;
+				}
 				
 				assert(q->z <= MAX_Z, "Z is too high. Z is %d, Max is %d.", q->z, MAX_Z);
 				assert(q->z >= (-MAX_Z+1), "Z is too low. Z is %d, Min is %d.", q->z, -MAX_Z+1);
@@ -891,7 +923,7 @@ void gfx_render_draw_frame(Draw_Frame *frame, Gfx_Image *render_target) {
 		d3d11_draw_call(number_of_rendered_quads, textures, num_textures, bind_textures, frame->highest_bound_slot_index+1, frame, render_target);
     }
     
-    
+    engine_tm_end();
 }
 void gfx_render_draw_frame_to_window(Draw_Frame *frame) {
 	gfx_render_draw_frame(frame, 0);
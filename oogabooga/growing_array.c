@@ -5,12 +5,16 @@
 	
 		void growing_array_init_reserve(void **array, u64 block_size_in_bytes, u64 count_to_reserve, Allocator allocator);
 		void growing_array_init(void **array, u64 block_size_in_bytes, Allocator allocator);
+		void growing_array_init_with_storage(void **array, u64 block_size_in_bytes, void *storage, u64 storage_size, Allocator allocator);
 		void growing_array_deinit(void **array);
 		
+		void growing_array_set_growth(void **array, Growing_Array_Growth growth);
+		
 		void *growing_array_add_empty(void **array);
-		void *growing_array_add_multiple_empty(void **array);
+		void *growing_array_add_multiple_empty(void **array, u64 count);
 		void growing_array_add(void **array, void *item);
 		void growing_array_add_multiple(void **array, void *items, u64 count);
+		void growing_array_insert_multiple(void **array, u64 index, void *items, u64 count);
 		
 		void growing_array_reserve(void **array, u64 count_to_reserve);
 		void growing_array_resize(void **array, u64 new_count);
@@ -18,18 +22,23 @@
 		void growing_array_clear(void **array);
 		
 		// Returns -1 if not found
-		s32  growing_array_find_index_from_left_by_pointer(void **array, void *p);
-		s32  growing_array_find_index_from_left_by_value(void **array, void *p);
+		s64  growing_array_find_index_from_left_by_pointer(void **array, void *p);
+		s64  growing_array_find_index_from_left_by_value(void **array, void *p);
 		
-		void growing_array_ordered_remove_by_index(void **array, u32 index);
-		void growing_array_unordered_remove_by_index(void **array, u32 index);
+		void growing_array_ordered_remove_by_index(void **array, u64 index);
+		void growing_array_unordered_remove_by_index(void **array, u64 index);
 		bool growing_array_ordered_remove_by_pointer(void **array, void *p);
 		bool growing_array_unordered_remove_by_pointer(void **array, void *p);
 		bool growing_array_ordered_remove_one_by_value(void **array, void *p);
 		bool growing_array_unordered_remove_one_by_value(void **array, void *p);
 		
-		u32  growing_array_get_valid_count(void *array);
-		u32  growing_array_get_allocated_count(void *array);
+		// Batch removal, one pass over the array. Return the number of removed items.
+		u64  growing_array_ordered_remove_if(void **array, Growing_Array_Predicate predicate, void *data);
+		u64  growing_array_unordered_remove_if(void **array, Growing_Array_Predicate predicate, void *data);
+		void growing_array_ordered_remove_indices(void **array, u64 *indices, u64 index_count);
+		
+		u64  growing_array_get_valid_count(void *array);
+		u64  growing_array_get_allocated_count(void *array);
 
 	Usage:
 	
@@ -63,19 +72,64 @@
 	    
 	    growing_array_get_valid_count(&things);
 	    growing_array_get_allocated_count(&things);
+	    
+	    // Removing many items, one pass instead of one move per item
+	    bool is_dead(void *item, void *data) { return ((Thing*)item)->is_dead; }
+	    growing_array_ordered_remove_if(&things, is_dead, 0);
+	    
+	    u64 indices[] = {2, 5, 6};
+	    growing_array_ordered_remove_indices(&things, indices, 3);
+	    
+	Growth:
+	
+	    By default the allocated count grows to the next power of two. Growth can be changed per
+	    array with growing_array_set_growth:
+	    
+	    GROWING_ARRAY_GROWTH_POWER_OF_TWO: Default, fewest reallocations
+	    GROWING_ARRAY_GROWTH_ONE_AND_A_HALF: Wastes less memory for very big arrays
+	    GROWING_ARRAY_GROWTH_EXACT: Only what was asked for. Use with growing_array_reserve,
+	                                adding one at a time will reallocate every time.
+	    
+	    Growing uses reallocate(), so arrays from the heap allocator grow in place when the heap
+	    can, which large arrays (> 1mb) almost always can.
+	
+	Inline storage:
+	
+	    Small arrays can start out in memory you provide (struct member, stack) and only go to
+	    the allocator when they outgrow it. The storage must stay at the same address while
+	    the array is in it.
+	    
+	    GROWING_ARRAY_INLINE_STORAGE(storage, Thing, 16);
+	    growing_array_init_with_storage(&things, sizeof(Thing), storage, sizeof(storage), allocator);
     
 */
 
 #define GROWING_ARRAY_SIGNATURE 2224364215
 
+typedef enum Growing_Array_Growth {
+	GROWING_ARRAY_GROWTH_POWER_OF_TWO = 0,
+	GROWING_ARRAY_GROWTH_ONE_AND_A_HALF,
+	GROWING_ARRAY_GROWTH_EXACT,
+} Growing_Array_Growth;
+
+typedef enum Growing_Array_Flags {
+	GROWING_ARRAY_IN_INLINE_STORAGE = 1 << 0,
+} Growing_Array_Flags;
+
 typedef struct Growing_Array_Header {
 	u32 signature;
-    u32 valid_count;
-    u32 allocated_count;
-    u32 block_size_in_bytes;
+    u16 flags;
+    u16 growth;
+    u64 valid_count;
+    u64 allocated_count;
+    u64 block_size_in_bytes;
     Allocator allocator;
 } Growing_Array_Header;
 
+// Declares u64 storage (for alignment) big enough for a header and count items
+#define GROWING_ARRAY_INLINE_STORAGE(name, Type, count) \
+	u64 name[(sizeof(Growing_Array_Header) + sizeof(Type)*(count) + 7)/8]
+
 bool 
 check_growing_array_signature(void **array) {
 	Growing_Array_Header *header = ((Growing_Array_Header*)*array) - 1;
@@ -95,6 +149,8 @@ growing_array_init_reserve(void **array, u64 block_size_in_bytes, u64 count_to_r
     header->block_size_in_bytes = block_size_in_bytes;
     header->valid_count = 0;
     header->allocated_count = count_to_reserve;
+    header->flags = 0;
+    header->growth = GROWING_ARRAY_GROWTH_POWER_OF_TWO;
     header->signature = GROWING_ARRAY_SIGNATURE;
     
     *array = header+1;
@@ -104,10 +160,51 @@ growing_array_init(void **array, u64 block_size_in_bytes, Allocator allocator) {
     growing_array_init_reserve(array, block_size_in_bytes, 8, allocator);
 }
 void
+growing_array_init_with_storage(void **array, u64 block_size_in_bytes, void *storage, u64 storage_size, Allocator allocator) {
+    assert(((u64)storage & 7) == 0, "Growing array storage must be 8 byte aligned, use GROWING_ARRAY_INLINE_STORAGE");
+    assert(storage_size >= sizeof(Growing_Array_Header), "Growing array storage is too small to fit the header");
+    
+    Growing_Array_Header *header = (Growing_Array_Header*)storage;
+    
+    header->allocator = allocator;
+    header->block_size_in_bytes = block_size_in_bytes;
+    header->valid_count = 0;
+    header->allocated_count = (storage_size - sizeof(Growing_Array_Header))/block_size_in_bytes;
+    header->flags = GROWING_ARRAY_IN_INLINE_STORAGE;
+    header->growth = GROWING_ARRAY_GROWTH_POWER_OF_TWO;
+    header->signature = GROWING_ARRAY_SIGNATURE;
+    
+    *array = header+1;
+}
+void
 growing_array_deinit(void **array) {
 	assert(check_growing_array_signature(array), "Not a valid growing array");
     Growing_Array_Header *header = ((Growing_Array_Header*)*array) - 1;
-    dealloc(header->allocator, header);
+    if (!(header->flags & GROWING_ARRAY_IN_INLINE_STORAGE)) dealloc(header->allocator, header);
+}
+
+void
+growing_array_set_growth(void **array, Growing_Array_Growth growth) {
+	assert(check_growing_array_signature(array), "Not a valid growing array");
+    Growing_Array_Header *header = ((Growing_Array_Header*)*array) - 1;
+    header->growth = (u16)growth;
+}
+
+u64
+growing_array_get_grown_count(Growing_Array_Header *header, u64 count_to_reserve) {
+    switch ((Growing_Array_Growth)header->growth) {
+        case GROWING_ARRAY_GROWTH_ONE_AND_A_HALF: {
+            u64 grown = header->allocated_count + header->allocated_count/2;
+            return max(count_to_reserve, max(grown, 8));
+        }
+        case GROWING_ARRAY_GROWTH_EXACT: {
+            return count_to_reserve;
+        }
+        case GROWING_ARRAY_GROWTH_POWER_OF_TWO:
+        default: {
+            return get_next_power_of_two(count_to_reserve);
+        }
+    }
 }
 
 void
@@ -117,19 +214,24 @@ growing_array_reserve(void **array, u64 count_to_reserve) {
     
     if (header->allocated_count >= count_to_reserve) return;
     
-    u64 old_allocated_bytes = header->allocated_count*header->block_size_in_bytes+sizeof(Growing_Array_Header);
-    count_to_reserve = get_next_power_of_two(count_to_reserve);
+    // Only valid items need to be kept if we can't grow in place
+    u64 used_bytes = header->valid_count*header->block_size_in_bytes+sizeof(Growing_Array_Header);
+    count_to_reserve = growing_array_get_grown_count(header, count_to_reserve);
     u64 bytes_to_allocate = count_to_reserve*header->block_size_in_bytes+sizeof(Growing_Array_Header);
-    Growing_Array_Header *new_header = (Growing_Array_Header*)alloc(header->allocator, bytes_to_allocate);
-    
-    memcpy(new_header, header, old_allocated_bytes);
     
+    Growing_Array_Header *new_header;
+    if (header->flags & GROWING_ARRAY_IN_INLINE_STORAGE) {
+        // Leaving the inline storage, it's not ours to reallocate
+        new_header = (Growing_Array_Header*)alloc(header->allocator, bytes_to_allocate);
+        memcpy(new_header, header, used_bytes);
+        new_header->flags &= ~GROWING_ARRAY_IN_INLINE_STORAGE;
+    } else {
+        new_header = (Growing_Array_Header*)reallocate(header->allocator, header, used_bytes, bytes_to_allocate);
+    }
     
     *array = new_header+1;
     
     new_header->allocated_count = count_to_reserve;
-    
-    dealloc(header->allocator, header);
 }
 
 void*
@@ -201,7 +303,7 @@ void growing_array_clear(void **array) {
 }
 
 void 
-growing_array_ordered_remove_by_index(void **array, u32 index) {
+growing_array_ordered_remove_by_index(void **array, u64 index) {
 	assert(check_growing_array_signature(array), "Not a valid growing array");
     Growing_Array_Header *header = ((Growing_Array_Header*)*array) - 1;
     assert(index < header->valid_count, "Growing array index out of range");
@@ -213,7 +315,7 @@ growing_array_ordered_remove_by_index(void **array, u32 index) {
     
     u64 byte_index = header->block_size_in_bytes*index;
     
-    memcpy(
+    memmove(
         (u8*)*array + byte_index, 
         (u8*)*array + byte_index + header->block_size_in_bytes,
         (header->valid_count-index-1)*header->block_size_in_bytes
@@ -221,7 +323,7 @@ growing_array_ordered_remove_by_index(void **array, u32 index) {
     header->valid_count -= 1;
 }
 void 
-growing_array_unordered_remove_by_index(void **array, u32 index) {
+growing_array_unordered_remove_by_index(void **array, u64 index) {
 	assert(check_growing_array_signature(array), "Not a valid growing array");
     Growing_Array_Header *header = ((Growing_Array_Header*)*array) - 1;
     assert(index < header->valid_count, "Growing array index out of range");
@@ -242,26 +344,63 @@ growing_array_unordered_remove_by_index(void **array, u32 index) {
     header->valid_count -= 1;
 }
 
-s32
+s64
 growing_array_find_index_from_left_by_pointer(void **array, void *p) {
 	assert(check_growing_array_signature(array), "Not a valid growing array");
     Growing_Array_Header *header = ((Growing_Array_Header*)*array) - 1;
     
-    for (u32 i = 0; i < header->valid_count; i++) {
-        void *next = (u8*)*array + i*header->block_size_in_bytes;
-        
-        if (next == p) {
-            return i;
+    // Items are contiguous so the index is just the offset
+    if ((u8*)p < (u8*)*array) return -1;
+    u64 offset = (u8*)p - (u8*)*array;
+    if (offset % header->block_size_in_bytes != 0) return -1;
+    u64 index = offset / header->block_size_in_bytes;
+    if (index >= header->valid_count) return -1;
+    return (s64)index;
+}
+
+// Finds the first item equal to value for the common item sizes, 4 items at a time (or 2, 1)
+s64
+growing_array_find_index_sized(void *items, u64 count, void *value, u64 size) {
+    u64 i = 0;
+#if ENABLE_SIMD && SIMD_ENABLE_SSE2
+    u64 per_vector = 16/size;
+    __m128i v;
+    if      (size == 4)  v = _mm_set1_epi32(*(s32*)value);
+    else if (size == 8)  v = _mm_set1_epi64x(*(s64*)value);
+    else                 v = _mm_loadu_si128((__m128i*)value);
+    // Each item is size bytes of the 16 bit mask, all of them must match
+    u32 item_mask = (1u << size) - 1;
+    for (; i + per_vector <= count; i += per_vector) {
+        __m128i x = _mm_loadu_si128((__m128i*)((u8*)items + i*size));
+        u32 mask = (u32)_mm_movemask_epi8(_mm_cmpeq_epi32(x, v));
+        if (!mask) continue;
+        for (u64 j = 0; j < per_vector; j++) {
+            if (((mask >> (j*size)) & item_mask) == item_mask) return (s64)(i + j);
         }
     }
+#endif
+    for (; i < count; i++) {
+        void *item = (u8*)items + i*size;
+        bool match;
+        if      (size == 4) match = *(u32*)item == *(u32*)value;
+        else if (size == 8) match = *(u64*)item == *(u64*)value;
+        else                match = bytes_match(item, value, size);
+        if (match) return (s64)i;
+    }
     return -1;
 }
-s32
+
+s64
 growing_array_find_index_from_left_by_value(void **array, void *p) {
 	assert(check_growing_array_signature(array), "Not a valid growing array");
     Growing_Array_Header *header = ((Growing_Array_Header*)*array) - 1;
     
-    for (u32 i = 0; i < header->valid_count; i++) {
+    u64 size = header->block_size_in_bytes;
+    if (size == 4 || size == 8 || size == 16) {
+        return growing_array_find_index_sized(*array, header->valid_count, p, size);
+    }
+    
+    for (u64 i = 0; i < header->valid_count; i++) {
         void *next = (u8*)*array + i*header->block_size_in_bytes;
         
         if (bytes_match(next, p, header->block_size_in_bytes)) {
@@ -275,7 +414,7 @@ bool
 growing_array_ordered_remove_by_pointer(void **array, void *p) {
     Growing_Array_Header *header = ((Growing_Array_Header*)*array) - 1;
     
-    s32 i = growing_array_find_index_from_left_by_pointer(array, p);
+    s64 i = growing_array_find_index_from_left_by_pointer(array, p);
     
     if (i < 0) return false;
     
@@ -287,7 +426,7 @@ bool
 growing_array_unordered_remove_by_pointer(void **array, void *p) {
     Growing_Array_Header *header = ((Growing_Array_Header*)*array) - 1;
     
-    s32 i = growing_array_find_index_from_left_by_pointer(array, p);
+    s64 i = growing_array_find_index_from_left_by_pointer(array, p);
     
     if (i < 0) return false;
     
@@ -299,7 +438,7 @@ bool
 growing_array_ordered_remove_one_by_value(void **array, void *p) {
     Growing_Array_Header *header = ((Growing_Array_Header*)*array) - 1;
     
-    s32 i = growing_array_find_index_from_left_by_value(array, p);
+    s64 i = growing_array_find_index_from_left_by_value(array, p);
     
     if (i < 0) return false;
     
@@ -311,7 +450,7 @@ bool
 growing_array_unordered_remove_one_by_value(void **array, void *p) {
     Growing_Array_Header *header = ((Growing_Array_Header*)*array) - 1;
     
-    s32 i = growing_array_find_index_from_left_by_value(array, p);
+    s64 i = growing_array_find_index_from_left_by_value(array, p);
     
     if (i < 0) return false;
     
@@ -320,17 +459,116 @@ growing_array_unordered_remove_one_by_value(void **array, void *p) {
     return true;
 }
 
+typedef bool(*Growing_Array_Predicate)(void *item, void *data);
+
+// Removes every item the predicate returns true for in one pass, keeps the order.
+// Returns the number of removed items.
+u64
+growing_array_ordered_remove_if(void **array, Growing_Array_Predicate predicate, void *data) {
+	assert(check_growing_array_signature(array), "Not a valid growing array");
+    Growing_Array_Header *header = ((Growing_Array_Header*)*array) - 1;
+    u64 size = header->block_size_in_bytes;
+    u8 *items = (u8*)*array;
+    
+    // Move kept runs down in one memmove each instead of one item at a time.
+    // The predicate is called exactly once per item.
+    u64 write = 0;
+    u64 run_start = 0;
+    for (u64 read = 0; read < header->valid_count; read++) {
+        if (!predicate(items + read*size, data)) continue;
+        u64 run_count = read - run_start;
+        if (run_count && write != run_start) memmove(items + write*size, items + run_start*size, run_count*size);
+        write += run_count;
+        run_start = read + 1;
+    }
+    u64 run_count = header->valid_count - run_start;
+    if (run_count && write != run_start) memmove(items + write*size, items + run_start*size, run_count*size);
+    write += run_count;
+    
+    u64 removed = header->valid_count - write;
+    header->valid_count = write;
+    return removed;
+}
+
+// Same as growing_array_ordered_remove_if but fills holes with items from the end, so it
+// moves at most one item per removed item. Does not keep the order.
+u64
+growing_array_unordered_remove_if(void **array, Growing_Array_Predicate predicate, void *data) {
+	assert(check_growing_array_signature(array), "Not a valid growing array");
+    Growing_Array_Header *header = ((Growing_Array_Header*)*array) - 1;
+    u64 size = header->block_size_in_bytes;
+    u8 *items = (u8*)*array;
+    
+    u64 count = header->valid_count;
+    u64 i = 0;
+    while (i < count) {
+        if (predicate(items + i*size, data)) {
+            count -= 1;
+            if (i != count) memcpy(items + i*size, items + count*size, size);
+        } else {
+            i += 1;
+        }
+    }
+    
+    u64 removed = header->valid_count - count;
+    header->valid_count = count;
+    return removed;
+}
+
+// Removes the items at the given indices in one pass, keeps the order.
+// Indices must be sorted and unique.
+void
+growing_array_ordered_remove_indices(void **array, u64 *indices, u64 index_count) {
+	assert(check_growing_array_signature(array), "Not a valid growing array");
+    Growing_Array_Header *header = ((Growing_Array_Header*)*array) - 1;
+    if (index_count == 0) return;
+    
+    u64 size = header->block_size_in_bytes;
+    u8 *items = (u8*)*array;
+    
+    u64 write = indices[0];
+    for (u64 i = 0; i < index_count; i++) {
+        assert(indices[i] < header->valid_count, "Growing array index out of range");
+        assert(i == 0 || indices[i] > indices[i-1], "Indices passed to growing_array_ordered_remove_indices must be sorted and unique");
+        
+        u64 run_start = indices[i] + 1;
+        u64 run_end = i+1 < index_count ? indices[i+1] : header->valid_count;
+        u64 run_count = run_end > run_start ? run_end - run_start : 0;
+        if (run_count) memmove(items + write*size, items + run_start*size, run_count*size);
+        write += run_count;
+    }
+    
+    header->valid_count -= index_count;
+}
+
+// Inserts count items at index in one move, keeps the order
+void
+growing_array_insert_multiple(void **array, u64 index, void *items, u64 count) {
+	assert(check_growing_array_signature(array), "Not a valid growing array");
+    Growing_Array_Header *header = ((Growing_Array_Header*)*array) - 1;
+    assert(index <= header->valid_count, "Growing array index out of range");
+    
+    u64 old_count = header->valid_count;
+    growing_array_add_multiple_empty(array, count);
+    header = ((Growing_Array_Header*)*array) - 1;
+    
+    u64 size = header->block_size_in_bytes;
+    u8 *base = (u8*)*array;
+    memmove(base + (index+count)*size, base + index*size, (old_count-index)*size);
+    memcpy(base + index*size, items, count*size);
+}
+
 // #Incomplete
 // s32 growing_array_ordered_remove_one_by_value(void **array, void *p)
 // s32 growing_array_unordered_remove_one_by_value(void **array, void *p)
 
-u32
+u64
 growing_array_get_valid_count(void *array) {
 	assert(check_growing_array_signature(&array), "Not a valid growing array");
     Growing_Array_Header *header = ((Growing_Array_Header*)array) - 1;
     return header->valid_count;
 }
-u32
+u64
 growing_array_get_allocated_count(void *array) {
 	assert(check_growing_array_signature(&array), "Not a valid growing array");
     Growing_Array_Header *header = ((Growing_Array_Header*)array) - 1;
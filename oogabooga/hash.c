@@ -18,32 +18,80 @@ static inline u64 xx_hash(u64 x) {
     return h64;
 }
 
-static inline u64 city_hash(string s) {
-    const u64 k = 0x9ddfea08eb382d69ULL;
-    u64 a = s.count;
-    u64 b = s.count * 5;
-    u64 c = 9;
-    u64 d = b;
+// wyhash (final version 4), see github.com/wangyi-fudan/wyhash.
+// Reads 48 bytes per step for long strings, which is most asset paths, and never reads
+// outside the string.
+#define WYHASH_SECRET_0 0x2d358dccaa6c78a5ULL
+#define WYHASH_SECRET_1 0x8bb84b93962eacc9ULL
+#define WYHASH_SECRET_2 0x4b33a62ed433d4a3ULL
+#define WYHASH_SECRET_3 0x4d5a2da51de1aa47ULL
 
-    if (s.count <= 16) {
-        memcpy(&a, s.data, sizeof(u64));
-        memcpy(&b, s.data + s.count - 8, sizeof(u64));
+static inline void wyhash_mum(u64 *a, u64 *b) {
+#if COMPILER_MSVC
+    *a = _umul128(*a, *b, b);
+#elif COMPILER_GCC || COMPILER_CLANG
+    __uint128_t r = (__uint128_t)*a * *b;
+    *a = (u64)r;
+    *b = (u64)(r >> 64);
+#else
+    u64 ha = *a >> 32, hb = *b >> 32, la = (u32)*a, lb = (u32)*b;
+    u64 rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    u64 t = rl + (rm0 << 32);
+    u64 c = t < rl;
+    u64 lo = t + (rm1 << 32);
+    c += lo < t;
+    u64 hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+    *a = lo;
+    *b = hi;
+#endif
+}
+static inline u64 wyhash_mix(u64 a, u64 b) {
+    wyhash_mum(&a, &b);
+    return a ^ b;
+}
+static inline u64 wyhash_read64(const u8 *p) { u64 v; memcpy(&v, p, 8); return v; }
+static inline u64 wyhash_read32(const u8 *p) { u32 v; memcpy(&v, p, 4); return v; }
+
+u64 wyhash(const void *data, u64 size, u64 seed) {
+    const u8 *p = (const u8*)data;
+    seed ^= wyhash_mix(seed ^ WYHASH_SECRET_0, WYHASH_SECRET_1);
+    u64 a, b;
+    if (size <= 16) {
+        if (size >= 4) {
+            a = (wyhash_read32(p) << 32) | wyhash_read32(p + ((size >> 3) << 2));
+            b = (wyhash_read32(p + size - 4) << 32) | wyhash_read32(p + size - 4 - ((size >> 3) << 2));
+        } else if (size > 0) {
+            a = ((u64)p[0] << 16) | ((u64)p[size >> 1] << 8) | p[size - 1];
+            b = 0;
+        } else {
+            a = b = 0;
+        }
     } else {
-        memcpy(&a, s.data, sizeof(u64));
-        memcpy(&b, s.data + 8, sizeof(u64));
-        memcpy(&c, s.data + s.count - 8, sizeof(u64));
-        memcpy(&d, s.data + s.count - 16, sizeof(u64));
+        u64 i = size;
+        if (i > 48) {
+            u64 seed1 = seed, seed2 = seed;
+            do {
+                seed  = wyhash_mix(wyhash_read64(p)      ^ WYHASH_SECRET_1, wyhash_read64(p + 8)  ^ seed);
+                seed1 = wyhash_mix(wyhash_read64(p + 16) ^ WYHASH_SECRET_2, wyhash_read64(p + 24) ^ seed1);
+                seed2 = wyhash_mix(wyhash_read64(p + 32) ^ WYHASH_SECRET_3, wyhash_read64(p + 40) ^ seed2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= seed1 ^ seed2;
+        }
+        while (i > 16) {
+            seed = wyhash_mix(wyhash_read64(p) ^ WYHASH_SECRET_1, wyhash_read64(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        // Last 16 bytes, may overlap with what we already hashed
+        a = wyhash_read64(p + i - 16);
+        b = wyhash_read64(p + i - 8);
     }
-
-    a += b;
-    a = (a << 43) | (a >> (64 - 43));
-    a += c;
-    a = a * 5 + 0x52dce729;
-    d ^= a;
-    d = (d << 44) | (d >> (64 - 44));
-    d += b;
-
-    return d * k;
+    a ^= WYHASH_SECRET_1;
+    b ^= seed;
+    wyhash_mum(&a, &b);
+    return wyhash_mix(a ^ WYHASH_SECRET_0 ^ size, b ^ WYHASH_SECRET_1);
 }
 
 u64 djb2_hash(string s) {
@@ -54,9 +102,13 @@ u64 djb2_hash(string s) {
     return hash;
 }
 
+// Same seed gives the same hash across runs, pass a random seed if the keys
+// can come from outside (user input, network).
+u64 string_get_hash_seeded(string s, u64 seed) {
+    return wyhash(s.data, s.count, seed);
+}
 u64 string_get_hash(string s) {
-    if (s.count > 32) return djb2_hash(s);
-    return city_hash(s);
+    return wyhash(s.data, s.count, 0);
 }
 u64 pointer_get_hash(void *p) {
 	return xx_hash((u64)p);
@@ -1,6 +1,12 @@
 
-// Very naive implementation but it should be very cache efficient so it's alright
-// for non-excessive use for now.
+// Open addressing hash table with SwissTable-style control bytes.
+// Each slot has a control byte which is either EMPTY, DELETED (tombstone) or the low
+// 7 bits of the hash of the key in that slot. Lookups compare control bytes first and
+// only touch the entry (hash, key, value) on a match, where the full hash and the key
+// are compared.
+// Slots are probed in groups of 16 control bytes which are checked all at once (SSE2
+// when SIMD is enabled), so a lookup usually touches one control group and one entry.
+// The table grows when live entries + tombstones would exceed 7/8 of the capacity.
 
 /*
 
@@ -30,6 +36,17 @@
 		
 	}
 	
+	// Remove key, returns whether or not the key existed
+	bool removed = hash_table_remove(&table, key);
+	
+	// Iterate all entries
+	u64 iterator = 0;
+	string *it_key;
+	int *it_value;
+	while (hash_table_iterate(&table, &iterator, (void**)&it_key, (void**)&it_value)) {
+	
+	}
+	
 	// Reset all entries (but keep allocated memory)
 	hash_table_reset(&table);
 	
@@ -38,12 +55,15 @@
 	
 	
 	Limitations:
-		- Key can only be a base type or pointer
+		- Key can only be a base type, pointer or string
+		- String keys are copied into the table (with the table allocator), other keys are
+		  compared by their bytes.
 		- Key and value passed to the following function needs to be lvalues (we need to be able to take their addresses with '&'):
 			- hash_table_add
 			- hash_table_find
 			- hash_table_contains
 			- hash_table_set
+			- hash_table_remove
 			
 			Example:
 			
@@ -52,167 +72,380 @@
 			int key = my_key+5;
 			int value = my_value+3;
 			hash_table_set(&table, key, value); // OK
+		- Pointers to values are invalidated when the table grows.
 			
 
 */
 
 typedef struct Hash_Table Hash_Table;
 
+typedef enum Hash_Table_Key_Kind {
+	HASH_TABLE_KEY_BYTES,
+	HASH_TABLE_KEY_STRING,
+} Hash_Table_Key_Kind;
+
+#define get_hash_table_key_kind(Key_Type) _Generic((Key_Type){0}, \
+		string: HASH_TABLE_KEY_STRING, \
+		default: HASH_TABLE_KEY_BYTES \
+	)
+
 // API:
 #define make_hash_table_reserve(Key_Type, Value_Type, capacity_count, allocator) \
-	make_hash_table_reserve(sizeof(Key_Type), sizeof(Value_Type), capacity_count, allocator)
-	
+	make_hash_table_reserve_raw(sizeof(Key_Type), sizeof(Value_Type), get_hash_table_key_kind(Key_Type), capacity_count, allocator)
+
 #define make_hash_table(Key_Type, Value_Type, allocator) \
-	make_hash_table_raw(sizeof(Key_Type), sizeof(Value_Type), allocator)
+	make_hash_table_raw(sizeof(Key_Type), sizeof(Value_Type), get_hash_table_key_kind(Key_Type), allocator)
 
 #define hash_table_add(table_ptr, key, value) \
 	hash_table_add_raw((table_ptr), get_hash(key), &(key), &(value), sizeof(key), sizeof(value))
 
 #define hash_table_find(table_ptr, key) \
-	hash_table_find_raw((table_ptr), get_hash(key))
-	
+	hash_table_find_raw((table_ptr), get_hash(key), &(key), sizeof(key))
+
 #define hash_table_contains(table_ptr, key) \
-	hash_table_contains_raw((table_ptr), get_hash(key))
-	
+	hash_table_contains_raw((table_ptr), get_hash(key), &(key), sizeof(key))
+
 #define hash_table_set(table_ptr, key, value) \
 	hash_table_set_raw((table_ptr), get_hash(key), &key, &value, sizeof(key), sizeof(value))
 
+#define hash_table_remove(table_ptr, key) \
+	hash_table_remove_raw((table_ptr), get_hash(key), &(key), sizeof(key))
+
 void hash_table_reserve(Hash_Table *t, u64 required_count);
 
+#define HASH_TABLE_CONTROL_EMPTY   ((u8)0x80)
+#define HASH_TABLE_CONTROL_DELETED ((u8)0xFE)
+// Full slots have the top bit cleared
+#define hash_table_control_is_full(c) (((c) & 0x80) == 0)
+
+#define HASH_TABLE_GROUP_WIDTH 16
+#define HASH_TABLE_MIN_CAPACITY HASH_TABLE_GROUP_WIDTH
 
 typedef struct Hash_Table {
-	
+
+	// One control byte per slot
+	u8 *control;
+
 	// Each entry is hash-key-value
-	// Hash is sizeof(u64) bytes, key is _key_size bytes and value is _value_size bytes
-	void *entries; 
-	
+	// Hash is sizeof(u64) bytes, key is _key_size bytes and value is _value_size bytes,
+	// key and value are each 8-byte aligned.
+	void *entries;
+
 	u64 count; // Number of valid entries
-	u64 capacity_count; // Number of allocated entries
-	
+	u64 capacity_count; // Number of slots, always a power of two
+	u64 tombstone_count;
+
 	u64 _key_size;
 	u64 _value_size;
-	
+	u64 _entry_size;
+	u64 _value_offset;
+	Hash_Table_Key_Kind _key_kind;
+
 	Allocator allocator;
 } Hash_Table;
 
-Hash_Table make_hash_table_reserve_raw(u64 key_size, u64 value_size, u64 capacity_count, Allocator allocator) {
+#define HASH_TABLE_KEY_OFFSET sizeof(u64)
 
-	capacity_count = min(capacity_count, 8);
+inline u64 hash_table_get_max_load(u64 capacity_count) {
+	return capacity_count - capacity_count/8;
+}
+// Hashes are mixed again before picking a group and control byte so that hash functions
+// with poor low or high bits don't pile everything into a few groups.
+inline u64 hash_table_mix(u64 hash) {
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdULL;
+	hash ^= hash >> 33;
+	return hash;
+}
+inline u8 hash_table_get_control_hash(u64 hash) {
+	return (u8)(hash_table_mix(hash) >> 57);
+}
+inline u64 hash_table_get_probe_start(u64 hash) {
+	return hash_table_mix(hash);
+}
+inline u8 *hash_table_get_entry(Hash_Table *t, u64 slot) {
+	return (u8*)t->entries + slot*t->_entry_size;
+}
+
+// Group matching. Bit i in the returned mask is set if control byte i in the group matches.
+#if ENABLE_SIMD && SIMD_ENABLE_SSE2
+inline u32 hash_table_group_match(u8 *group, u8 c) {
+	__m128i control = _mm_loadu_si128((__m128i*)group);
+	return (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(control, _mm_set1_epi8((char)c)));
+}
+inline u32 hash_table_group_match_empty(u8 *group) {
+	return hash_table_group_match(group, HASH_TABLE_CONTROL_EMPTY);
+}
+inline u32 hash_table_group_match_empty_or_deleted(u8 *group) {
+	// Full slots have the top bit cleared, EMPTY and DELETED have it set
+	__m128i control = _mm_loadu_si128((__m128i*)group);
+	return (u32)_mm_movemask_epi8(control);
+}
+#else
+inline u32 hash_table_group_match(u8 *group, u8 c) {
+	u32 mask = 0;
+	for (u32 i = 0; i < HASH_TABLE_GROUP_WIDTH; i++) {
+		if (group[i] == c) mask |= 1u << i;
+	}
+	return mask;
+}
+inline u32 hash_table_group_match_empty(u8 *group) {
+	return hash_table_group_match(group, HASH_TABLE_CONTROL_EMPTY);
+}
+inline u32 hash_table_group_match_empty_or_deleted(u8 *group) {
+	u32 mask = 0;
+	for (u32 i = 0; i < HASH_TABLE_GROUP_WIDTH; i++) {
+		if (!hash_table_control_is_full(group[i])) mask |= 1u << i;
+	}
+	return mask;
+}
+#endif
+
+void hash_table_allocate_slots(Hash_Table *t, u64 capacity_count) {
+	u64 control_size = align_next(capacity_count, 16);
+	t->control = alloc(t->allocator, control_size + capacity_count*t->_entry_size);
+	t->entries = t->control + control_size;
+	memset(t->control, HASH_TABLE_CONTROL_EMPTY, capacity_count);
+	t->capacity_count = capacity_count;
+	t->tombstone_count = 0;
+}
+
+Hash_Table make_hash_table_reserve_raw(u64 key_size, u64 value_size, Hash_Table_Key_Kind key_kind, u64 capacity_count, Allocator allocator) {
+
+	if (key_kind == HASH_TABLE_KEY_STRING) {
+		assert(key_size == sizeof(string), "String key kind with key size %llu", key_size);
+	}
 
 	Hash_Table t = ZERO(Hash_Table);
-	
+
 	t._key_size = key_size;
 	t._value_size = value_size;
+	t._key_kind = key_kind;
+	t._value_offset = HASH_TABLE_KEY_OFFSET + align_next(key_size, 8);
+	t._entry_size = t._value_offset + align_next(value_size, 8);
 	t.allocator = allocator;
-	
-	u64 entry_size = value_size+sizeof(u64);
-	t.entries = alloc(t.allocator, entry_size*capacity_count);
-	memset(t.entries, 0, entry_size*capacity_count);
-	t.capacity_count = capacity_count;
-	
+
+	// Enough slots to hold capacity_count entries without growing
+	u64 slot_count = get_next_power_of_two(capacity_count + capacity_count/7 + 1);
+	slot_count = max(slot_count, HASH_TABLE_MIN_CAPACITY);
+	hash_table_allocate_slots(&t, slot_count);
+
 	return t;
 }
-inline Hash_Table make_hash_table_raw(u64 key_size, u64 value_size, Allocator allocator) {
-	return make_hash_table_reserve_raw(key_size, value_size, 128, allocator);
+inline Hash_Table make_hash_table_raw(u64 key_size, u64 value_size, Hash_Table_Key_Kind key_kind, Allocator allocator) {
+	return make_hash_table_reserve_raw(key_size, value_size, key_kind, 128, allocator);
+}
+
+void hash_table_free_key(Hash_Table *t, u8 *entry) {
+	if (t->_key_kind == HASH_TABLE_KEY_STRING) {
+		string *key = (string*)(entry+HASH_TABLE_KEY_OFFSET);
+		if (key->data) dealloc_string(t->allocator, *key);
+	}
 }
 
 void hash_table_reset(Hash_Table *t) {
+	if (t->_key_kind == HASH_TABLE_KEY_STRING) {
+		for (u64 i = 0; i < t->capacity_count; i++) {
+			if (hash_table_control_is_full(t->control[i])) hash_table_free_key(t, hash_table_get_entry(t, i));
+		}
+	}
+	memset(t->control, HASH_TABLE_CONTROL_EMPTY, t->capacity_count);
 	t->count = 0;
+	t->tombstone_count = 0;
 }
 void hash_table_destroy(Hash_Table *t) {
-	dealloc(t->allocator, t->entries);
-	
+	if (t->control) hash_table_reset(t);
+	dealloc(t->allocator, t->control);
+
+	t->control = 0;
 	t->entries = 0;
 	t->count = 0;
 	t->capacity_count = 0;
+	t->tombstone_count = 0;
+}
+
+inline bool hash_table_keys_match(Hash_Table *t, void *a, void *b) {
+	if (t->_key_kind == HASH_TABLE_KEY_STRING) {
+		return strings_match(*(string*)a, *(string*)b);
+	}
+	return bytes_match(a, b, t->_key_size);
+}
+
+// Groups are probed in triangular steps (1, 2, 3...) which visits every group since the
+// group count is a power of two. Load factor is capped at 7/8 so there is always a group
+// with an EMPTY slot to stop at.
+// Returns slot index of the entry with the given hash and key, or -1
+s64 hash_table_find_slot(Hash_Table *t, u64 hash, void *k) {
+	u64 group_mask = t->capacity_count/HASH_TABLE_GROUP_WIDTH-1;
+	u8 control_hash = hash_table_get_control_hash(hash);
+
+	u64 group = hash_table_get_probe_start(hash) & group_mask;
+	for (u64 step = 1;; step++) {
+		u8 *control = t->control + group*HASH_TABLE_GROUP_WIDTH;
+
+		u32 matches = hash_table_group_match(control, control_hash);
+		while (matches) {
+			u64 slot = group*HASH_TABLE_GROUP_WIDTH + bit_scan_forward_32(matches);
+			u8 *entry = hash_table_get_entry(t, slot);
+			if (*(u64*)entry == hash && hash_table_keys_match(t, entry+HASH_TABLE_KEY_OFFSET, k)) {
+				return (s64)slot;
+			}
+			matches &= matches-1;
+		}
+
+		if (hash_table_group_match_empty(control)) return -1;
+
+		group = (group+step) & group_mask;
+	}
+}
+
+// First EMPTY or DELETED slot in the probe sequence for hash
+u64 hash_table_find_insert_slot(Hash_Table *t, u64 hash) {
+	u64 group_mask = t->capacity_count/HASH_TABLE_GROUP_WIDTH-1;
+
+	u64 group = hash_table_get_probe_start(hash) & group_mask;
+	for (u64 step = 1;; step++) {
+		u32 free_slots = hash_table_group_match_empty_or_deleted(t->control + group*HASH_TABLE_GROUP_WIDTH);
+		if (free_slots) return group*HASH_TABLE_GROUP_WIDTH + bit_scan_forward_32(free_slots);
+
+		group = (group+step) & group_mask;
+	}
+}
+
+void hash_table_rehash(Hash_Table *t, u64 new_capacity_count) {
+	u8 *old_control = t->control;
+	u8 *old_entries = t->entries;
+	u64 old_capacity_count = t->capacity_count;
+
+	hash_table_allocate_slots(t, new_capacity_count);
+
+	for (u64 i = 0; i < old_capacity_count; i++) {
+		if (!hash_table_control_is_full(old_control[i])) continue;
+
+		u8 *old_entry = old_entries + i*t->_entry_size;
+		u64 hash = *(u64*)old_entry;
+		u64 slot = hash_table_find_insert_slot(t, hash);
+		t->control[slot] = hash_table_get_control_hash(hash);
+		memcpy(hash_table_get_entry(t, slot), old_entry, t->_entry_size);
+	}
+
+	dealloc(t->allocator, old_control);
 }
 
 void hash_table_reserve(Hash_Table *t, u64 required_count) {
-	u64 entry_size = t->_value_size+sizeof(u64);
-	
-	u64 required_size = required_count*entry_size;
-	
-	u64 current_size = t->capacity_count*entry_size;
-	
-	if (current_size >= required_size) return;
-	
-	u64 new_count = get_next_power_of_two(required_count);
-	u64 new_size = new_count*entry_size;
-	
-	void *new_entries = alloc(t->allocator, new_size);
-	memcpy(new_entries, t->entries, current_size);
-	
-	dealloc(t->allocator, t->entries);
-	
-	t->entries = new_entries;
-	t->capacity_count = new_count;
+	if (required_count + t->tombstone_count <= hash_table_get_max_load(t->capacity_count)) return;
+
+	u64 new_capacity_count = t->capacity_count;
+	while (required_count > hash_table_get_max_load(new_capacity_count)) {
+		new_capacity_count *= 2;
+	}
+
+	// If it's the tombstones that pushed us over, rehashing at the same size clears them
+	hash_table_rehash(t, new_capacity_count);
 }
 
-// This can add multiple entries of same hash, beware!
+// This does not check if the key already exists, so it can add multiple entries of same key, beware!
+// Use hash_table_set if the key might already be in the table.
 void hash_table_add_raw(Hash_Table *t, u64 hash, void *k, void *v, u64 key_size, u64 value_size) {
 
 	assert(t->_key_size == key_size, "Key type size does not match hash table initted key type size");
 	assert(t->_value_size == value_size, "Value type size does not match hash table initted value type size");
 
 	hash_table_reserve(t, t->count+1);
-	
-	u64 entry_size = t->_value_size+sizeof(u64);
-	
-	u64 index = entry_size*t->count;
-	t->count += 1;
-	
-	u64 hash_offset = 0;
-	u64 value_offset = hash_offset + sizeof(u64);
-	
-	memcpy((u8*)t->entries+index+hash_offset,  &hash, sizeof(u64));
-	memcpy((u8*)t->entries+index+value_offset, v,     value_size);
-}
 
-void *hash_table_find_raw(Hash_Table *t, u64 hash) {
-
-	// #Speed #Incomplete
-	// Do quadratic probe 'triangular numbers'
+	u64 slot = hash_table_find_insert_slot(t, hash);
+	if (t->control[slot] == HASH_TABLE_CONTROL_DELETED) t->tombstone_count -= 1;
+	t->control[slot] = hash_table_get_control_hash(hash);
+	t->count += 1;
 
-	u64 entry_size = t->_value_size+sizeof(u64);
-	u64 hash_offset = 0;
-	u64 value_offset = hash_offset + sizeof(u64);
-	
-	for (u64 i = 0; i < t->count; i += 1) {
-		u64 existing_hash = *(u64*)((u8*)t->entries+i*entry_size+hash_offset);
-		if (existing_hash == hash) {
-			void *value = ((u8*)t->entries+i*entry_size+value_offset);
-			return value;
-		}
+	u8 *entry = hash_table_get_entry(t, slot);
+	memcpy(entry, &hash, sizeof(u64));
+	if (t->_key_kind == HASH_TABLE_KEY_STRING) {
+		string key_copy = string_copy(*(string*)k, t->allocator);
+		memcpy(entry+HASH_TABLE_KEY_OFFSET, &key_copy, sizeof(string));
+	} else {
+		memcpy(entry+HASH_TABLE_KEY_OFFSET, k, key_size);
 	}
-	return 0;
+	memcpy(entry+t->_value_offset, v, value_size);
 }
 
-void *hash_table_get_nth_value(Hash_Table *t, u64 n) {
-	assert(n < t->count, "Hash table n is out of range");
-	
-	u64 entry_size = t->_value_size+sizeof(u64);
-	u64 hash_offset = 0;
-	u64 value_offset = hash_offset + sizeof(u64);
-	
-	return (u8*)t->entries+entry_size*n+value_offset;
+void *hash_table_find_raw(Hash_Table *t, u64 hash, void *k, u64 key_size) {
+	assert(t->_key_size == key_size, "Key type size does not match hash table initted key type size");
+
+	s64 slot = hash_table_find_slot(t, hash, k);
+	if (slot < 0) return 0;
+
+	return hash_table_get_entry(t, (u64)slot)+t->_value_offset;
 }
 
-bool hash_table_contains_raw(Hash_Table *t, u64 hash) {
-	return hash_table_find_raw(t, hash) != 0;
+bool hash_table_contains_raw(Hash_Table *t, u64 hash, void *k, u64 key_size) {
+	return hash_table_find_raw(t, hash, k, key_size) != 0;
 }
 
 // Returns true if key was newly added or false if it already existed
 bool hash_table_set_raw(Hash_Table *t, u64 hash, void *k, void *v, u64 key_size, u64 value_size) {
-	bool newly_added = true;
-	
-	if (hash_table_contains_raw(t, hash)) newly_added = false;
-	
-	if (newly_added) {
-		hash_table_add_raw(t, hash, k, v, key_size, value_size);
+	assert(t->_value_size == value_size, "Value type size does not match hash table initted value type size");
+
+	void *existing = hash_table_find_raw(t, hash, k, key_size);
+
+	if (existing) {
+		memcpy(existing, v, value_size);
+		return false;
+	}
+
+	hash_table_add_raw(t, hash, k, v, key_size, value_size);
+	return true;
+}
+
+// Returns true if the key existed
+bool hash_table_remove_raw(Hash_Table *t, u64 hash, void *k, u64 key_size) {
+	assert(t->_key_size == key_size, "Key type size does not match hash table initted key type size");
+
+	s64 slot = hash_table_find_slot(t, hash, k);
+	if (slot < 0) return false;
+
+	hash_table_free_key(t, hash_table_get_entry(t, (u64)slot));
+
+	// Groups only lose their EMPTY slots until the next rehash, so if this group still has
+	// one, no probe sequence has ever continued past it and the slot can be EMPTY too
+	// instead of leaving a tombstone.
+	u8 *group = t->control + ((u64)slot & ~(u64)(HASH_TABLE_GROUP_WIDTH-1));
+	if (hash_table_group_match_empty(group)) {
+		t->control[slot] = HASH_TABLE_CONTROL_EMPTY;
 	} else {
-		memcpy(hash_table_find_raw(t, hash), v, value_size);
+		t->control[slot] = HASH_TABLE_CONTROL_DELETED;
+		t->tombstone_count += 1;
 	}
-	
-	return newly_added;
+	t->count -= 1;
+
+	return true;
+}
+
+// Iterate all entries. *iterator should be 0 on the first call.
+// key and value may be 0 if you don't need them.
+bool hash_table_iterate(Hash_Table *t, u64 *iterator, void **key, void **value) {
+	for (u64 slot = *iterator; slot < t->capacity_count; slot++) {
+		if (!hash_table_control_is_full(t->control[slot])) continue;
+
+		u8 *entry = hash_table_get_entry(t, slot);
+		if (key)   *key   = entry+HASH_TABLE_KEY_OFFSET;
+		if (value) *value = entry+t->_value_offset;
+		*iterator = slot+1;
+		return true;
+	}
+	*iterator = t->capacity_count;
+	return false;
 }
 
+// #Speed
+// This scans from the start of the table, use hash_table_iterate to iterate all entries.
+void *hash_table_get_nth_value(Hash_Table *t, u64 n) {
+	assert(n < t->count, "Hash table n is out of range");
+
+	u64 iterator = 0;
+	void *value = 0;
+	for (u64 i = 0; i <= n; i++) {
+		hash_table_iterate(t, &iterator, 0, &value);
+	}
+	return value;
+}
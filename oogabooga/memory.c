@@ -41,6 +41,335 @@ Allocator get_initialization_allocator() {
 	return a;
 }
 
+///
+///
+// Allocation tracking
+///
+// With ENABLE_ALLOCATION_TRACKING, alloc, alloc_uninitialized and reallocate are macros
+// that pass __FILE__ and __LINE__ along (base.c). Each callsite claims a slot in a fixed
+// table with a compare_and_swap the first time it's seen and all counters are atomic
+// adds, so nothing here takes a lock and it's cheap enough to leave on in release.
+//
+// Allocation counts and bytes are tracked for every allocator. Live bytes, peaks and leaks
+// are only tracked for the heap, which keeps the callsite and frame in the allocation
+// metadata. Temporary storage and arenas are freed all at once so they would always look
+// like they're leaking.
+// Heap allocations that don't go through the macros (allocator.proc, heap_alloc) are put on
+// callsite 0. Reallocations through allocator.proc keep their original callsite.
+//
+// allocation_tracker_end_frame is called by os_update.
+
+#if ENABLE_ALLOCATION_TRACKING
+
+#ifndef ALLOCATION_TRACKER_MAX_CALLSITES
+	#define ALLOCATION_TRACKER_MAX_CALLSITES 2048 // Must be a power of two
+#endif
+
+typedef struct Allocation_Callsite {
+	volatile u64 key; // 0 if the slot is free
+	const char *file;
+	u32 line;
+	u32 first_frame;
+	u32 last_frame;
+	
+	volatile u64 allocation_count;
+	volatile u64 allocated_bytes;
+	
+	// Heap only. Bytes include heap metadata and rounding up to the slot size.
+	volatile u64 live_count;
+	volatile u64 live_bytes;
+	volatile u64 peak_live_bytes;
+	
+	// For allocation_tracker_end_frame
+	u64 allocation_count_at_frame_start;
+	u64 allocated_bytes_at_frame_start;
+	u64 last_frame_allocation_count;
+	u64 last_frame_allocated_bytes;
+} Allocation_Callsite;
+
+typedef struct Allocation_Callsite_Stats {
+	string file;
+	u32 line;
+	u32 first_frame; // Frames of the first and the latest allocation
+	u32 last_frame;
+	u64 allocation_count; // Since startup
+	u64 allocated_bytes;
+	u64 last_frame_allocation_count;
+	u64 last_frame_allocated_bytes;
+	f64 allocations_per_frame; // Average since startup
+	// Heap only
+	u64 live_count;
+	u64 live_bytes;
+	u64 peak_live_bytes;
+} Allocation_Callsite_Stats;
+
+typedef struct Allocation_Tracker_Stats {
+	u64 frame;
+	u64 allocation_count;
+	u64 allocated_bytes;
+	u64 last_frame_allocation_count;
+	u64 last_frame_allocated_bytes;
+	// Heap only
+	u64 live_count;
+	u64 live_bytes;
+	u64 peak_live_bytes;
+} Allocation_Tracker_Stats;
+
+typedef struct Allocation_Block_Info {
+	string file;
+	u32 line;
+	u32 frame;
+	u64 size; // Usable size, may be more than what was asked for
+} Allocation_Block_Info;
+
+// #Global
+ogb_instance Allocation_Callsite allocation_callsites[ALLOCATION_TRACKER_MAX_CALLSITES];
+ogb_instance Allocation_Callsite allocation_tracker_totals; // Only the counters are used
+ogb_instance volatile u64 allocation_tracker_frame;
+ogb_instance thread_local u32 _allocation_tracker_current_callsite;
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+Allocation_Callsite allocation_callsites[ALLOCATION_TRACKER_MAX_CALLSITES] = { [0] = { .file = "(untracked)" } };
+Allocation_Callsite allocation_tracker_totals = {0};
+volatile u64 allocation_tracker_frame = 0;
+thread_local u32 _allocation_tracker_current_callsite = 0;
+#endif
+
+ogb_instance void 
+allocation_tracker_end_frame();
+
+ogb_instance void 
+allocation_tracker_get_stats(Allocation_Tracker_Stats *stats);
+
+// Returns the number of callsites written to stats
+ogb_instance u64 
+allocation_tracker_get_callsite_stats(Allocation_Callsite_Stats *stats, u64 max_count);
+
+// Where and when a heap allocation was made. p must come from the heap allocator.
+ogb_instance Allocation_Block_Info 
+allocation_tracker_get_block_info(void *p);
+
+// Totals, then every callsite with its live, peak and per frame numbers, most live bytes first
+ogb_instance void 
+allocation_tracker_build_report(String_Builder *sb);
+
+// Prints every callsite with heap allocations that were never deallocated
+ogb_instance void 
+allocation_tracker_report_leaks();
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+
+ogb_instance void* talloc(u64);
+
+u32 _allocation_tracker_get_callsite(const char *file, u32 line) {
+	u64 key = ((u64)file*0x9E3779B97F4A7C15ull) ^ ((u64)line*0xC2B2AE3D27D4EB4Full);
+	if (key == 0) key = 1;
+	
+	u64 start = key >> 40;
+	for (u64 i = 0; i < ALLOCATION_TRACKER_MAX_CALLSITES; i++) {
+		u64 slot = (start+i) & (ALLOCATION_TRACKER_MAX_CALLSITES-1);
+		if (slot == 0) continue;
+		
+		Allocation_Callsite *callsite = &allocation_callsites[slot];
+		u64 existing = callsite->key;
+		if (existing == key) return (u32)slot;
+		if (existing == 0 && compare_and_swap_64(&callsite->key, key, 0)) {
+			callsite->line = line;
+			callsite->first_frame = (u32)allocation_tracker_frame;
+			MEMORY_BARRIER;
+			callsite->file = file; // Reports skip the slot until this is set
+			return (u32)slot;
+		}
+		if (callsite->key == key) return (u32)slot;
+	}
+	
+	// Table is full
+	return 0;
+}
+
+inline void _allocation_tracker_update_peak(volatile u64 *peak, u64 value) {
+	u64 current = *peak;
+	while (value > current && !compare_and_swap_64(peak, value, current)) {
+		current = *peak;
+	}
+}
+
+void _allocation_tracker_count(u32 callsite_index, u64 size) {
+	Allocation_Callsite *callsite = &allocation_callsites[callsite_index];
+	callsite->last_frame = (u32)allocation_tracker_frame;
+	atomic_add_64(&callsite->allocation_count, 1);
+	atomic_add_64(&callsite->allocated_bytes, (s64)size);
+	atomic_add_64(&allocation_tracker_totals.allocation_count, 1);
+	atomic_add_64(&allocation_tracker_totals.allocated_bytes, (s64)size);
+}
+
+void _allocation_tracker_add_live(u32 callsite_index, s64 count, s64 bytes) {
+	Allocation_Callsite *callsite = &allocation_callsites[callsite_index];
+	atomic_add_64(&callsite->live_count, count);
+	_allocation_tracker_update_peak(&callsite->peak_live_bytes, atomic_add_64(&callsite->live_bytes, bytes));
+	atomic_add_64(&allocation_tracker_totals.live_count, count);
+	_allocation_tracker_update_peak(&allocation_tracker_totals.peak_live_bytes, atomic_add_64(&allocation_tracker_totals.live_bytes, bytes));
+}
+
+// (alloc)(...) calls the function rather than the macro
+void* 
+_alloc_tracked(const char *file, u32 line, Allocator allocator, u64 size) {
+	u32 callsite = _allocation_tracker_get_callsite(file, line);
+	_allocation_tracker_count(callsite, size);
+	
+	u32 previous = _allocation_tracker_current_callsite;
+	_allocation_tracker_current_callsite = callsite;
+	void *p = (alloc)(allocator, size);
+	_allocation_tracker_current_callsite = previous;
+	return p;
+}
+
+void* 
+_alloc_uninitialized_tracked(const char *file, u32 line, Allocator allocator, u64 size) {
+	u32 callsite = _allocation_tracker_get_callsite(file, line);
+	_allocation_tracker_count(callsite, size);
+	
+	u32 previous = _allocation_tracker_current_callsite;
+	_allocation_tracker_current_callsite = callsite;
+	void *p = (alloc_uninitialized)(allocator, size);
+	_allocation_tracker_current_callsite = previous;
+	return p;
+}
+
+// Counts as an allocation of new_size
+void* 
+_reallocate_tracked(const char *file, u32 line, Allocator allocator, void *p, u64 old_size, u64 new_size) {
+	u32 callsite = _allocation_tracker_get_callsite(file, line);
+	_allocation_tracker_count(callsite, new_size);
+	
+	u32 previous = _allocation_tracker_current_callsite;
+	_allocation_tracker_current_callsite = callsite;
+	void *new = (reallocate)(allocator, p, old_size, new_size);
+	_allocation_tracker_current_callsite = previous;
+	return new;
+}
+
+void allocation_tracker_end_frame() {
+	for (u64 i = 0; i < ALLOCATION_TRACKER_MAX_CALLSITES; i++) {
+		Allocation_Callsite *callsite = &allocation_callsites[i];
+		if (!callsite->file) continue;
+		
+		u64 count = callsite->allocation_count;
+		u64 bytes = callsite->allocated_bytes;
+		callsite->last_frame_allocation_count = count-callsite->allocation_count_at_frame_start;
+		callsite->last_frame_allocated_bytes = bytes-callsite->allocated_bytes_at_frame_start;
+		callsite->allocation_count_at_frame_start = count;
+		callsite->allocated_bytes_at_frame_start = bytes;
+	}
+	
+	Allocation_Callsite *totals = &allocation_tracker_totals;
+	u64 count = totals->allocation_count;
+	u64 bytes = totals->allocated_bytes;
+	totals->last_frame_allocation_count = count-totals->allocation_count_at_frame_start;
+	totals->last_frame_allocated_bytes = bytes-totals->allocated_bytes_at_frame_start;
+	totals->allocation_count_at_frame_start = count;
+	totals->allocated_bytes_at_frame_start = bytes;
+	
+	allocation_tracker_frame += 1;
+}
+
+void allocation_tracker_get_stats(Allocation_Tracker_Stats *stats) {
+	Allocation_Callsite *totals = &allocation_tracker_totals;
+	*stats = ZERO(Allocation_Tracker_Stats);
+	stats->frame = allocation_tracker_frame;
+	stats->allocation_count = totals->allocation_count;
+	stats->allocated_bytes = totals->allocated_bytes;
+	stats->last_frame_allocation_count = totals->last_frame_allocation_count;
+	stats->last_frame_allocated_bytes = totals->last_frame_allocated_bytes;
+	stats->live_count = totals->live_count;
+	stats->live_bytes = totals->live_bytes;
+	stats->peak_live_bytes = totals->peak_live_bytes;
+}
+
+u64 allocation_tracker_get_callsite_stats(Allocation_Callsite_Stats *stats, u64 max_count) {
+	u64 count = 0;
+	for (u64 i = 0; i < ALLOCATION_TRACKER_MAX_CALLSITES && count < max_count; i++) {
+		Allocation_Callsite *callsite = &allocation_callsites[i];
+		if (!callsite->file) continue;
+		if (!callsite->allocation_count && !callsite->live_count) continue;
+		
+		Allocation_Callsite_Stats *s = &stats[count];
+		*s = ZERO(Allocation_Callsite_Stats);
+		s->file = STR(callsite->file);
+		s->line = callsite->line;
+		s->first_frame = callsite->first_frame;
+		s->last_frame = callsite->last_frame;
+		s->allocation_count = callsite->allocation_count;
+		s->allocated_bytes = callsite->allocated_bytes;
+		s->last_frame_allocation_count = callsite->last_frame_allocation_count;
+		s->last_frame_allocated_bytes = callsite->last_frame_allocated_bytes;
+		s->allocations_per_frame = (f64)callsite->allocation_count/(f64)max(allocation_tracker_frame, 1);
+		s->live_count = callsite->live_count;
+		s->live_bytes = callsite->live_bytes;
+		s->peak_live_bytes = callsite->peak_live_bytes;
+		count += 1;
+	}
+	return count;
+}
+
+void allocation_tracker_build_report(String_Builder *sb) {
+	Allocation_Tracker_Stats totals;
+	allocation_tracker_get_stats(&totals);
+	string_builder_print(
+		sb, 
+		STR("Frame %llu: %llu allocations (%llu bytes) total, %llu (%llu bytes) last frame. Heap: %llu live blocks, %llu live bytes, %llu peak bytes\n"),
+		totals.frame, totals.allocation_count, totals.allocated_bytes, totals.last_frame_allocation_count, totals.last_frame_allocated_bytes,
+		totals.live_count, totals.live_bytes, totals.peak_live_bytes
+	);
+	
+	// Not alloc, the report shouldn't show up in itself
+	Allocation_Callsite_Stats *stats = talloc(ALLOCATION_TRACKER_MAX_CALLSITES*sizeof(Allocation_Callsite_Stats));
+	u64 count = allocation_tracker_get_callsite_stats(stats, ALLOCATION_TRACKER_MAX_CALLSITES);
+	
+	// Most live bytes first, then most allocated
+	for (u64 i = 1; i < count; i++) {
+		Allocation_Callsite_Stats s = stats[i];
+		u64 j = i;
+		while (j > 0 && (stats[j-1].live_bytes < s.live_bytes || (stats[j-1].live_bytes == s.live_bytes && stats[j-1].allocated_bytes < s.allocated_bytes))) {
+			stats[j] = stats[j-1];
+			j -= 1;
+		}
+		stats[j] = s;
+	}
+	
+	string_builder_append(sb, STR("   live blocks     live bytes     peak bytes   allocs/frame  last frame allocs (bytes)  callsite\n"));
+	for (u64 i = 0; i < count; i++) {
+		Allocation_Callsite_Stats s = stats[i];
+		string_builder_print(
+			sb, 
+			STR("%14llu %14llu %14llu %14.2f %18llu (%llu)  %s:%u\n"),
+			s.live_count, s.live_bytes, s.peak_live_bytes, s.allocations_per_frame,
+			s.last_frame_allocation_count, s.last_frame_allocated_bytes, s.file, s.line
+		);
+	}
+}
+
+void allocation_tracker_report_leaks() {
+	u64 leaked_count = 0;
+	u64 leaked_bytes = 0;
+	for (u64 i = 0; i < ALLOCATION_TRACKER_MAX_CALLSITES; i++) {
+		Allocation_Callsite *callsite = &allocation_callsites[i];
+		if (!callsite->file || !callsite->live_count) continue;
+		
+		print(
+			"Leaked %llu blocks (%llu bytes) allocated at %cs:%u, frames %u to %u\n", 
+			callsite->live_count, callsite->live_bytes, callsite->file, callsite->line, callsite->first_frame, callsite->last_frame
+		);
+		leaked_count += callsite->live_count;
+		leaked_bytes += callsite->live_bytes;
+	}
+	print("%llu heap blocks (%llu bytes) were never deallocated\n", leaked_count, leaked_bytes);
+}
+
+#endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
+
+#endif // ENABLE_ALLOCATION_TRACKING
+
 ///
 ///
 // Basic general heap allocator, free list
@@ -49,12 +378,42 @@ Allocator get_initialization_allocator() {
 // Fragmentation is catastrophic.
 // We could fix it by merging free nodes every now and then
 // BUT: We aren't really supposed to allocate/deallocate directly on the heap too much anyways...
+//
+// Small allocations (<= HEAP_SMALL_ALLOCATION_MAX including metadata) don't touch the free
+// list at all. They are rounded up to a size class and served from slabs of equally sized
+// slots, so alloc/free is a list pop/push no matter how fragmented the heap blocks are.
+// The slabs themselves are allocated with the best-fit free list path.
+//
+// Each slab is owned by one thread, which allocates from it and frees to it without any
+// synchronization. Other threads freeing into the slab push the slot to its remote free
+// list with a single compare_and_swap, and the owner takes those back when it runs out of
+// slots. heap_lock is only taken to get a whole slab from/to the heap blocks.
+// When a thread exits it abandons its slabs (heap_release_thread_cache) and other
+// threads adopt them later.
+//
+// Large allocations (>= HEAP_LARGE_ALLOCATION_MIN including metadata) don't touch the heap
+// blocks either. Each gets its own reserved range of virtual memory outside of program
+// memory, which is released back to the OS as soon as it's deallocated. We reserve a few
+// times more than we commit so realloc can grow in place by just committing more pages.
 
 #define MAX_HEAP_BLOCK_SIZE align_next(MB(500), os.page_size)
 #define DEFAULT_HEAP_BLOCK_SIZE (min(MAX_HEAP_BLOCK_SIZE, program_memory_capacity))
 #define HEAP_ALIGNMENT (sizeof(Heap_Free_Node))
+
+#define HEAP_SMALL_ALLOCATION_MAX KB(4)
+#ifndef HEAP_LARGE_ALLOCATION_MIN
+	#define HEAP_LARGE_ALLOCATION_MIN MB(1)
+#endif
+#define HEAP_LARGE_ALLOCATION_RESERVE_FACTOR 4
+#define HEAP_SLAB_SIZE KB(64)
+// 16..128 in steps of 16, then 4 classes per power of two up to HEAP_SMALL_ALLOCATION_MAX
+#define HEAP_SIZE_CLASS_COUNT 28
+
 typedef struct Heap_Free_Node Heap_Free_Node;
 typedef struct Heap_Block Heap_Block;
+typedef struct Heap_Slab Heap_Slab;
+typedef struct Heap_Slab_Slot Heap_Slab_Slot;
+typedef struct Heap_Large_Allocation Heap_Large_Allocation;
 
 typedef struct Heap_Free_Node {
 	u64 size;
@@ -73,26 +432,99 @@ typedef struct Heap_Block {
 #endif
 } Heap_Block;
 
+typedef struct Heap_Slab_Slot {
+	Heap_Slab_Slot *next;
+} Heap_Slab_Slot;
+
+#define HEAP_SLAB_SIGNATURE 4206942069696969ull
+typedef struct Heap_Slab {
+	// Linked in the owning Heap_Thread_Cache, or in heap_abandoned_slabs if owner is 0
+	Heap_Slab *next;
+	Heap_Slab *previous;
+	
+	volatile u64 owner; // Heap_Thread_Cache id
+	
+	Heap_Slab_Slot *free_head; // Only touched by owner
+	Heap_Slab_Slot *volatile remote_free_head; // Pushed to by other threads
+	u8 *slots;
+	u64 slot_size;
+	u64 slot_count;
+	u64 used_count;
+	u64 touched_count; // Slots past this have never been handed out and are not in the free list
+	u64 size_class;
+	u64 signature;
+} Heap_Slab;
+
+#define HEAP_LARGE_ALLOCATION_SIGNATURE 2069420696942069ull
+// Sits at the start of the reserved pages, followed by Heap_Allocation_Metadata
+typedef struct Heap_Large_Allocation {
+	Heap_Large_Allocation *next;
+	Heap_Large_Allocation *previous;
+	u64 reserved_size;
+	u64 committed_size;
+	u64 signature;
+	u64 padding;
+} Heap_Large_Allocation;
+
 #define HEAP_META_SIGNATURE 6969694206942069ull
 typedef alignat(16) struct Heap_Allocation_Metadata {
 	u64 size;
-	Heap_Block *block;
+	union {
+		Heap_Block *block;            // size >  HEAP_SMALL_ALLOCATION_MAX && size < HEAP_LARGE_ALLOCATION_MIN
+		Heap_Slab *slab;              // size <= HEAP_SMALL_ALLOCATION_MAX
+		Heap_Large_Allocation *large; // size >= HEAP_LARGE_ALLOCATION_MIN
+	};
 #if CONFIGURATION == DEBUG
 	u64 signature;
 	u64 padding;
 #endif
+#if ENABLE_ALLOCATION_TRACKING
+	u32 callsite; // Index in allocation_callsites
+	u32 frame;
+	u64 tracking_padding;
+#endif
 } Heap_Allocation_Metadata;
 
+typedef struct Heap_Thread_Cache {
+	u64 id; // 0 until first small allocation on this thread
+	
+	// Slabs we can allocate from without collecting remote frees
+	Heap_Slab *slabs_with_free_slots[HEAP_SIZE_CLASS_COUNT];
+	// Slabs with no local free slots. They may still have remote frees.
+	Heap_Slab *full_slabs[HEAP_SIZE_CLASS_COUNT];
+} Heap_Thread_Cache;
+
 // #Global
 ogb_instance Heap_Block *heap_head;
 ogb_instance bool heap_initted;
 ogb_instance Spinlock heap_lock;
+ogb_instance Heap_Slab *heap_abandoned_slabs[HEAP_SIZE_CLASS_COUNT]; // Synchronized by heap_lock
+ogb_instance volatile u64 heap_last_thread_cache_id;
+ogb_instance Heap_Large_Allocation *heap_large_allocations; // Synchronized by heap_lock
+ogb_instance thread_local Heap_Thread_Cache heap_thread_cache;
 
 #if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
 Heap_Block *heap_head;
 bool heap_initted = false;
 Spinlock heap_lock;
+Heap_Slab *heap_abandoned_slabs[HEAP_SIZE_CLASS_COUNT] = {0};
+volatile u64 heap_last_thread_cache_id = 0;
+Heap_Large_Allocation *heap_large_allocations = 0;
+thread_local Heap_Thread_Cache heap_thread_cache = {0};
 #endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
+
+// size must be aligned to HEAP_ALIGNMENT and <= HEAP_SMALL_ALLOCATION_MAX
+inline u64 heap_get_size_class(u64 size) {
+	if (size <= 128) return size/HEAP_ALIGNMENT - 1;
+	u64 p = bit_scan_reverse_64(size-1);
+	return 8 + (p-7)*4 + ((size-1) >> (p-2)) - 4;
+}
+inline u64 heap_get_size_class_slot_size(u64 size_class) {
+	if (size_class < 8) return (size_class+1)*HEAP_ALIGNMENT;
+	u64 k = size_class - 8;
+	u64 p = 7 + k/4;
+	return (4 + k%4 + 1) << (p-2);
+}
 	
 
 u64 get_heap_block_size_excluding_metadata(Heap_Block *block) {
@@ -113,8 +545,105 @@ bool is_pointer_in_stack(void* p) {
 bool is_pointer_in_static_memory(void* p) {
     return (uintptr_t)p >= (uintptr_t)os.static_memory_start && (uintptr_t)p < (uintptr_t)os.static_memory_end;
 }
+bool is_pointer_in_heap_large_allocation(void *p) {
+	bool result = false;
+	
+	// #Sync
+	spinlock_acquire_or_wait(&heap_lock);
+	Heap_Large_Allocation *large = heap_large_allocations;
+	while (large != 0) {
+		if ((u8*)p >= (u8*)large && (u8*)p < (u8*)large+large->committed_size) {
+			result = true;
+			break;
+		}
+		large = large->next;
+	}
+	spinlock_release(&heap_lock);
+	
+	return result;
+}
+
+///
+// Reserved ranges
+// Memory we reserve outside of program memory (large heap allocations, virtual arenas)
+// registers its committed range here, so is_pointer_valid can check it without a lock.
+// It's called for every %s in string formatting.
+// Slots are claimed with a compare_and_swap. A reader racing with a slot being reused may
+// see a mix of the old and new range, which is fine for a validity heuristic.
+
+#define MAX_RESERVED_RANGES 1024
+#define RESERVED_RANGE_CLAIMED 1
+
+typedef struct Reserved_Range {
+	volatile u64 start; // 0 if free, RESERVED_RANGE_CLAIMED while being filled in
+	volatile u64 end;
+} Reserved_Range;
+
+// #Global
+ogb_instance Reserved_Range reserved_ranges[MAX_RESERVED_RANGES];
+ogb_instance volatile u64 reserved_range_count; // Slots in use are all below this
+ogb_instance volatile u64 reserved_range_overflow_count; // Ranges that didn't fit
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+Reserved_Range reserved_ranges[MAX_RESERVED_RANGES] = {0};
+volatile u64 reserved_range_count = 0;
+volatile u64 reserved_range_overflow_count = 0;
+#endif
+
+void register_reserved_range(void *start, u64 size) {
+	for (u64 i = 0; i < MAX_RESERVED_RANGES; i++) {
+		Reserved_Range *range = &reserved_ranges[i];
+		if (range->start != 0 || !compare_and_swap_64(&range->start, RESERVED_RANGE_CLAIMED, 0)) continue;
+		
+		range->end = (u64)start+size;
+		MEMORY_BARRIER;
+		range->start = (u64)start;
+		
+		u64 count = reserved_range_count;
+		while (count < i+1 && !compare_and_swap_64(&reserved_range_count, i+1, count)) {
+			count = reserved_range_count;
+		}
+		return;
+	}
+	atomic_add_64(&reserved_range_overflow_count, 1);
+}
+void resize_reserved_range(void *start, u64 new_size) {
+	for (u64 i = 0; i < reserved_range_count; i++) {
+		if (reserved_ranges[i].start == (u64)start) {
+			reserved_ranges[i].end = (u64)start+new_size;
+			return;
+		}
+	}
+}
+void unregister_reserved_range(void *start) {
+	for (u64 i = 0; i < reserved_range_count; i++) {
+		if (reserved_ranges[i].start == (u64)start) {
+			reserved_ranges[i].start = 0;
+			return;
+		}
+	}
+	atomic_add_64(&reserved_range_overflow_count, -1);
+}
+bool is_pointer_in_reserved_range(void *p) {
+	u64 count = reserved_range_count;
+	for (u64 i = 0; i < count; i++) {
+		u64 start = reserved_ranges[i].start;
+		if (start <= RESERVED_RANGE_CLAIMED) continue;
+		if ((u64)p >= start && (u64)p < reserved_ranges[i].end) return true;
+	}
+	return false;
+}
+
+// Lock free, so it's safe while heap_lock is held. Once the registry has run out of slots
+// some reserved memory isn't in it, and we can't rule anything out without walking
+// the large allocations under heap_lock (is_pointer_in_heap_large_allocation).
+bool is_pointer_in_heap_or_reserved_range(void *p) {
+	return is_pointer_in_program_memory(p) || is_pointer_in_reserved_range(p) || reserved_range_overflow_count > 0;
+}
+
 bool is_pointer_valid(void *p) {
-	return is_pointer_in_program_memory(p) || is_pointer_in_stack(p) || is_pointer_in_static_memory(p);
+	if (is_pointer_in_stack(p) || is_pointer_in_static_memory(p)) return true;
+	return is_pointer_in_heap_or_reserved_range(p);
 }
 
 // Meant for debug
@@ -151,12 +680,51 @@ void sanity_check_block(Heap_Block *block) {
 	assert(block->total_allocated+total_free == expected_size, "Heap is corrupt.")
 #endif
 }
+// Meant for debug
+void sanity_check_slab(Heap_Slab *slab) {
+#if CONFIGURATION == DEBUG
+	assert(is_pointer_in_program_memory(slab), "Heap_Slab pointer is corrupt");
+	assert(slab->signature == HEAP_SLAB_SIGNATURE, "A heap slab is corrupt.");
+	assert(slab->size_class < HEAP_SIZE_CLASS_COUNT, "A heap slab is corrupt.");
+	assert(slab->slot_size == heap_get_size_class_slot_size(slab->size_class), "A heap slab is corrupt.");
+	assert(slab->used_count <= slab->touched_count && slab->touched_count <= slab->slot_count, "A heap slab is corrupt.");
+	
+	u64 free_count = 0;
+	Heap_Slab_Slot *slot = slab->free_head;
+	while (slot) {
+		assert((u8*)slot >= slab->slots && (u8*)slot < slab->slots+slab->touched_count*slab->slot_size, "Heap slab free list is corrupt");
+		free_count += 1;
+		assert(free_count <= slab->touched_count, "Circular reference in heap slab free list. This is probably an internal error, or heap corruption.");
+		slot = slot->next;
+	}
+	assert(slab->used_count+free_count == slab->touched_count, "Heap slab free list is corrupt.");
+#endif
+}
 inline void check_meta(Heap_Allocation_Metadata *meta) {
 #if CONFIGURATION == DEBUG
 	assert(meta->signature == HEAP_META_SIGNATURE, "Heap error. Either 1) You passed a bad pointer to dealloc or 2) You corrupted the heap.");
 #endif
 // If > 256GB then prolly not legit lol
 	assert(meta->size < 1024ULL*1024ULL*1024ULL*256ULL, "Heap error. Either 1) You passed a bad pointer to dealloc or 2) You corrupted the heap.");	
+	
+	if (meta->size <= HEAP_SMALL_ALLOCATION_MAX) {
+		assert(is_pointer_in_program_memory(meta->slab), "Heap error. Either 1) You passed a bad pointer to dealloc or 2) You corrupted the heap."); 
+#if CONFIGURATION == DEBUG
+		assert(meta->slab->signature == HEAP_SLAB_SIGNATURE, "Heap error. Either 1) You passed a bad pointer to dealloc or 2) You corrupted the heap.");
+#endif
+		assert(meta->size == meta->slab->slot_size, "Heap error. Either 1) You passed a bad pointer to dealloc or 2) You corrupted the heap.");
+		assert((u8*)meta >= meta->slab->slots && (u8*)meta < meta->slab->slots+meta->slab->slot_size*meta->slab->slot_count, "Heap error: Pointer is not in it's slab. This could be heap corruption but it's more likely an internal error. That's not good.");
+		assert(((u8*)meta-meta->slab->slots) % meta->slab->slot_size == 0, "Heap error: Pointer is not at the start of a slab slot. Either 1) You passed a bad pointer to dealloc or 2) You corrupted the heap.");
+		return;
+	}
+	
+	if (meta->size >= HEAP_LARGE_ALLOCATION_MIN) {
+		assert(meta->large == ((Heap_Large_Allocation*)meta)-1, "Heap error. Either 1) You passed a bad pointer to dealloc or 2) You corrupted the heap.");
+		assert(meta->large->signature == HEAP_LARGE_ALLOCATION_SIGNATURE, "Heap error. Either 1) You passed a bad pointer to dealloc or 2) You corrupted the heap.");
+		assert(sizeof(Heap_Large_Allocation)+meta->size <= meta->large->committed_size, "Heap error. Either 1) You passed a bad pointer to dealloc or 2) You corrupted the heap.");
+		return;
+	}
+	
 	assert(is_pointer_in_program_memory(meta->block), "Heap error. Either 1) You passed a bad pointer to dealloc or 2) You corrupted the heap."); 
 
 	assert((u64)meta >= (u64)meta->block->start && (u64)meta < (u64)meta->block->start+meta->block->size, "Heap error: Pointer is not in it's metadata block. This could be heap corruption but it's more likely an internal error. That's not good.");
@@ -244,27 +812,19 @@ void heap_init() {
 	if (heap_initted) return;
 	assert(HEAP_ALIGNMENT == 16);
 	assert(sizeof(Heap_Allocation_Metadata) % HEAP_ALIGNMENT == 0);
+	assert(sizeof(Heap_Large_Allocation) % HEAP_ALIGNMENT == 0);
+	assert(HEAP_LARGE_ALLOCATION_MIN > HEAP_SMALL_ALLOCATION_MAX && HEAP_LARGE_ALLOCATION_MIN < MAX_HEAP_BLOCK_SIZE);
+	assert(heap_get_size_class(HEAP_SMALL_ALLOCATION_MAX) == HEAP_SIZE_CLASS_COUNT-1);
+	assert(heap_get_size_class_slot_size(HEAP_SIZE_CLASS_COUNT-1) == HEAP_SMALL_ALLOCATION_MAX);
 	heap_initted = true;
 	heap_head = make_heap_block(0, DEFAULT_HEAP_BLOCK_SIZE);
 	spinlock_init(&heap_lock);
 }
 
-void *heap_alloc(u64 size) {
-
-	if (!heap_initted) heap_init();
-
-	// #Sync #Speed oof
-	spinlock_acquire_or_wait(&heap_lock);
+// Expects heap_lock to be acquired and size to include metadata & be aligned to HEAP_ALIGNMENT
+Heap_Allocation_Metadata *heap_alloc_in_blocks(u64 size) {
 	
-
-
-
-	
-	size += sizeof(Heap_Allocation_Metadata);
-	
-	size = (size+HEAP_ALIGNMENT) & ~(HEAP_ALIGNMENT-1);
-	
-	assert(size < MAX_HEAP_BLOCK_SIZE, "Past Charlie has been lazy and did not handle large allocations like this. I apologize on behalf of past Charlie. A quick fix could be to increase the heap block size for now. #Incomplete #Limitation");
+	assert(size < MAX_HEAP_BLOCK_SIZE, "Internal heap error: large allocations should go through heap_alloc_large");
 	
 	
 #if VERY_DEBUG
@@ -382,32 +942,378 @@ void *heap_alloc(u64 size) {
 	meta->block->total_allocated += size;
 #endif
 
-	check_meta(meta);
-
 #if VERY_DEBUG
 	sanity_check_block(meta->block);
 #endif
 	
-	// #Sync #Speed oof
+	return meta;
+}
+
+// Expects heap_lock to be acquired
+Heap_Slab *make_heap_slab(u64 size_class) {
+	Heap_Allocation_Metadata *slab_meta = heap_alloc_in_blocks(HEAP_SLAB_SIZE);
+	
+	Heap_Slab *slab = (Heap_Slab*)(slab_meta+1);
+	
+	slab->next = 0;
+	slab->previous = 0;
+	slab->owner = 0;
+	slab->free_head = 0;
+	slab->remote_free_head = 0;
+	slab->slots = (u8*)align_next((u64)(slab+1), HEAP_ALIGNMENT);
+	slab->size_class = size_class;
+	slab->slot_size = heap_get_size_class_slot_size(size_class);
+	slab->slot_count = ((u64)slab_meta+HEAP_SLAB_SIZE-(u64)slab->slots) / slab->slot_size;
+	slab->used_count = 0;
+	slab->touched_count = 0;
+	slab->signature = HEAP_SLAB_SIGNATURE;
+	
+	assert(slab->slot_count > 0, "Internal heap error: HEAP_SLAB_SIZE too small for size class");
+	
+	return slab;
+}
+
+void heap_slab_list_push(Heap_Slab **list, Heap_Slab *slab) {
+	slab->previous = 0;
+	slab->next = *list;
+	if (*list) (*list)->previous = slab;
+	*list = slab;
+}
+void heap_slab_list_remove(Heap_Slab **list, Heap_Slab *slab) {
+	if (slab->previous) slab->previous->next = slab->next;
+	else                *list = slab->next;
+	if (slab->next) slab->next->previous = slab->previous;
+	slab->next = 0;
+	slab->previous = 0;
+}
+
+inline bool heap_slab_has_local_free_slots(Heap_Slab *slab) {
+	return slab->free_head || slab->touched_count < slab->slot_count;
+}
+
+// Only the owner (or whoever holds heap_lock for an abandoned slab) may call this.
+// Returns number of slots taken back.
+u64 heap_slab_collect_remote_frees(Heap_Slab *slab) {
+	if (!slab->remote_free_head) return 0;
+	
+	Heap_Slab_Slot *remote;
+	while (true) {
+		remote = slab->remote_free_head;
+		if (compare_and_swap_64((volatile u64*)&slab->remote_free_head, 0, (u64)remote)) break;
+	}
+	
+	u64 count = 0;
+	Heap_Slab_Slot *last = 0;
+	for (Heap_Slab_Slot *slot = remote; slot != 0; slot = slot->next) {
+		last = slot;
+		count += 1;
+	}
+	
+	if (last) {
+		last->next = slab->free_head;
+		slab->free_head = remote;
+	}
+	
+	assert(slab->used_count >= count, "Heap slab remote free list is corrupt");
+	slab->used_count -= count;
+	
+	return count;
+}
+
+Heap_Thread_Cache *heap_get_thread_cache() {
+	if (!heap_thread_cache.id) {
+		while (true) {
+			u64 last = heap_last_thread_cache_id;
+			if (compare_and_swap_64(&heap_last_thread_cache_id, last+1, last)) {
+				heap_thread_cache.id = last+1;
+				break;
+			}
+		}
+	}
+	return &heap_thread_cache;
+}
+
+// Called when the thread cache has no slab with local free slots in size_class
+Heap_Slab *heap_refill_thread_cache(Heap_Thread_Cache *cache, u64 size_class) {
+	
+	// Slabs that filled up may have gotten slots back from other threads
+	Heap_Slab *slab = cache->full_slabs[size_class];
+	while (slab != 0) {
+		Heap_Slab *next = slab->next;
+		if (heap_slab_collect_remote_frees(slab)) {
+			heap_slab_list_remove(&cache->full_slabs[size_class], slab);
+			heap_slab_list_push(&cache->slabs_with_free_slots[size_class], slab);
+			return slab;
+		}
+		slab = next;
+	}
+	
+	// #Sync
+	spinlock_acquire_or_wait(&heap_lock);
+	
+	// Adopt slabs from threads that exited
+	while (heap_abandoned_slabs[size_class]) {
+		slab = heap_abandoned_slabs[size_class];
+		heap_slab_list_remove(&heap_abandoned_slabs[size_class], slab);
+		
+		slab->owner = cache->id;
+		heap_slab_collect_remote_frees(slab);
+		
+		if (heap_slab_has_local_free_slots(slab)) {
+			heap_slab_list_push(&cache->slabs_with_free_slots[size_class], slab);
+			spinlock_release(&heap_lock);
+			return slab;
+		}
+		heap_slab_list_push(&cache->full_slabs[size_class], slab);
+	}
+	
+	slab = make_heap_slab(size_class);
+	slab->owner = cache->id;
+	heap_slab_list_push(&cache->slabs_with_free_slots[size_class], slab);
+	
 	spinlock_release(&heap_lock);
 	
+	return slab;
+}
+
+// size must include metadata & be aligned to HEAP_ALIGNMENT
+Heap_Allocation_Metadata *heap_alloc_in_slab(u64 size) {
+	u64 size_class = heap_get_size_class(size);
 	
-	void *p = ((u8*)meta)+sizeof(Heap_Allocation_Metadata);
-	assert((u64)p % HEAP_ALIGNMENT == 0, "Internal heap error. Result pointer is not aligned to HEAP_ALIGNMENT");
-	return p;
+	Heap_Thread_Cache *cache = heap_get_thread_cache();
+	
+	Heap_Slab *slab = cache->slabs_with_free_slots[size_class];
+	if (!slab) slab = heap_refill_thread_cache(cache, size_class);
+	
+	assert(slab->owner == cache->id, "Internal heap error: thread cache has a slab it doesn't own");
+	
+	Heap_Allocation_Metadata *meta;
+	if (slab->free_head) {
+		meta = (Heap_Allocation_Metadata*)slab->free_head;
+		slab->free_head = slab->free_head->next;
+	} else {
+		assert(slab->touched_count < slab->slot_count, "Internal heap error: full slab in free slab list");
+		meta = (Heap_Allocation_Metadata*)(slab->slots + slab->touched_count*slab->slot_size);
+		slab->touched_count += 1;
+	}
+	slab->used_count += 1;
+	
+	if (!heap_slab_has_local_free_slots(slab) && !heap_slab_collect_remote_frees(slab)) {
+		heap_slab_list_remove(&cache->slabs_with_free_slots[size_class], slab);
+		heap_slab_list_push(&cache->full_slabs[size_class], slab);
+	}
+	
+	meta->size = slab->slot_size;
+	meta->slab = slab;
+#if CONFIGURATION == DEBUG
+	meta->signature = HEAP_META_SIGNATURE;
+#endif
+
+#if VERY_DEBUG
+	sanity_check_slab(slab);
+#endif
+
+	return meta;
 }
-void heap_dealloc(void *p) {
-	// #Sync #Speed oof
+
+void heap_dealloc_in_blocks(Heap_Allocation_Metadata *meta);
+
+void heap_dealloc_in_slab(Heap_Allocation_Metadata *meta) {
+	Heap_Slab *slab = meta->slab;
 	
-	if (!heap_initted) heap_init();
+#if CONFIGURATION == DEBUG
+	memset(meta, 0x69696969, slab->slot_size);
+#endif
+
+	Heap_Slab_Slot *slot = (Heap_Slab_Slot*)meta;
+	
+	Heap_Thread_Cache *cache = heap_get_thread_cache();
+	
+	if (slab->owner != cache->id) {
+		// Some other thread owns this slab (or nobody does right now), hand the slot back
+		// through the remote free list.
+		while (true) {
+			Heap_Slab_Slot *head = slab->remote_free_head;
+			slot->next = head;
+			if (compare_and_swap_64((volatile u64*)&slab->remote_free_head, (u64)slot, (u64)head)) break;
+		}
+		return;
+	}
 
+	bool was_full = !heap_slab_has_local_free_slots(slab);
+	
+	slot->next = slab->free_head;
+	slab->free_head = slot;
+	slab->used_count -= 1;
+	
+	Heap_Slab **list = &cache->slabs_with_free_slots[slab->size_class];
+	
+	if (was_full) {
+		heap_slab_list_remove(&cache->full_slabs[slab->size_class], slab);
+		heap_slab_list_push(list, slab);
+	} else if (slab->used_count == 0 && (slab->previous || slab->next)) {
+		// Empty and there are other slabs to allocate from in this size class, so give it
+		// back to the heap block. We keep the last one to not thrash on alloc/free loops.
+		// Nobody else can hold a slot from it, so there can't be any remote frees in flight.
+		heap_slab_list_remove(list, slab);
+		
+		// #Sync
+		spinlock_acquire_or_wait(&heap_lock);
+		heap_dealloc_in_blocks(((Heap_Allocation_Metadata*)slab)-1);
+		spinlock_release(&heap_lock);
+		return;
+	}
+
+#if VERY_DEBUG
+	sanity_check_slab(slab);
+#endif
+}
+
+// Gives this threads slabs to whoever needs them next. Call this when a thread is exiting.
+void heap_release_thread_cache() {
+	Heap_Thread_Cache *cache = &heap_thread_cache;
+	if (!cache->id) return;
+	
+	// #Sync
 	spinlock_acquire_or_wait(&heap_lock);
 	
-	assert(is_pointer_in_program_memory(p), "A bad pointer was passed tp heap_dealloc: it is out of program memory bounds!"); 
-	p = (u8*)p-sizeof(Heap_Allocation_Metadata);
-	Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)(p);
+	for (u64 size_class = 0; size_class < HEAP_SIZE_CLASS_COUNT; size_class++) {
+		Heap_Slab **lists[] = { &cache->slabs_with_free_slots[size_class], &cache->full_slabs[size_class] };
+		for (u64 i = 0; i < sizeof(lists)/sizeof(lists[0]); i++) {
+			while (*lists[i]) {
+				Heap_Slab *slab = *lists[i];
+				heap_slab_list_remove(lists[i], slab);
+				
+				heap_slab_collect_remote_frees(slab);
+				slab->owner = 0;
+				
+				if (slab->used_count == 0) {
+					heap_dealloc_in_blocks(((Heap_Allocation_Metadata*)slab)-1);
+				} else {
+					heap_slab_list_push(&heap_abandoned_slabs[size_class], slab);
+				}
+			}
+		}
+	}
+	
+	spinlock_release(&heap_lock);
+}
+
+// size must include metadata & be aligned to HEAP_ALIGNMENT
+Heap_Allocation_Metadata *heap_alloc_large(u64 size) {
+	u64 committed_size = align_next(sizeof(Heap_Large_Allocation)+size, os.page_size);
+	u64 reserved_size = align_next(committed_size*HEAP_LARGE_ALLOCATION_RESERVE_FACTOR, os.granularity);
+	
+	Heap_Large_Allocation *large = (Heap_Large_Allocation*)os_reserve_pages(reserved_size);
+	assert(large, "Failed reserving %llu bytes of virtual memory for a large allocation", reserved_size);
+	bool ok = os_commit_pages(large, committed_size);
+	assert(ok, "Failed committing %llu bytes of memory for a large allocation. Maybe we are out of memory?", committed_size);
+	
+	large->previous = 0;
+	large->reserved_size = reserved_size;
+	large->committed_size = committed_size;
+	large->signature = HEAP_LARGE_ALLOCATION_SIGNATURE;
+	
+	register_reserved_range(large, committed_size);
+	
+	// #Sync
+	spinlock_acquire_or_wait(&heap_lock);
+	large->next = heap_large_allocations;
+	if (heap_large_allocations) heap_large_allocations->previous = large;
+	heap_large_allocations = large;
+	spinlock_release(&heap_lock);
+	
+	Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)(large+1);
+	meta->size = size;
+	meta->large = large;
+#if CONFIGURATION == DEBUG
+	meta->signature = HEAP_META_SIGNATURE;
+#endif
+	
+	return meta;
+}
+void heap_dealloc_large(Heap_Allocation_Metadata *meta) {
+	Heap_Large_Allocation *large = meta->large;
+	
+	// #Sync
+	spinlock_acquire_or_wait(&heap_lock);
+	if (large->previous) large->previous->next = large->next;
+	else                 heap_large_allocations = large->next;
+	if (large->next) large->next->previous = large->previous;
+	spinlock_release(&heap_lock);
+	
+	unregister_reserved_range(large);
+	os_release_pages(large, large->reserved_size);
+}
+// new_size must include metadata & be aligned to HEAP_ALIGNMENT.
+// Returns false if new_size doesn't fit in what we reserved for the allocation.
+bool heap_resize_large(Heap_Allocation_Metadata *meta, u64 new_size) {
+	Heap_Large_Allocation *large = meta->large;
+	
+	u64 committed_size = align_next(sizeof(Heap_Large_Allocation)+new_size, os.page_size);
+	if (committed_size > large->reserved_size) return false;
+	
+	if (committed_size > large->committed_size) {
+		bool ok = os_commit_pages((u8*)large+large->committed_size, committed_size-large->committed_size);
+		if (!ok) return false;
+	}
+	
+	u64 old_committed_size = large->committed_size;
+	
+	// #Sync
+	spinlock_acquire_or_wait(&heap_lock);
+	large->committed_size = committed_size;
+	spinlock_release(&heap_lock);
+	resize_reserved_range(large, committed_size);
+	
+	if (committed_size < old_committed_size) {
+		os_decommit_pages((u8*)large+committed_size, old_committed_size-committed_size);
+	}
+	
+	meta->size = new_size;
+	
+	return true;
+}
+
+void *heap_alloc(u64 size) {
+	engine_tm_begin("heap_alloc");
+
+	if (!heap_initted) heap_init();
+
+	size += sizeof(Heap_Allocation_Metadata);
+	
+	size = (size+HEAP_ALIGNMENT) & ~(HEAP_ALIGNMENT-1);
+
+	Heap_Allocation_Metadata *meta;
+	if (size <= HEAP_SMALL_ALLOCATION_MAX) {
+		meta = heap_alloc_in_slab(size);
+	} else if (size >= HEAP_LARGE_ALLOCATION_MIN) {
+		meta = heap_alloc_large(size);
+	} else {
+		// #Sync #Speed oof
+		spinlock_acquire_or_wait(&heap_lock);
+		meta = heap_alloc_in_blocks(size);
+		spinlock_release(&heap_lock);
+	}
+	
 	check_meta(meta);
 	
+#if ENABLE_ALLOCATION_TRACKING
+	meta->callsite = _allocation_tracker_current_callsite;
+	meta->frame = (u32)allocation_tracker_frame;
+	_allocation_tracker_add_live(meta->callsite, 1, (s64)meta->size);
+#endif
+	
+	void *p = ((u8*)meta)+sizeof(Heap_Allocation_Metadata);
+	assert((u64)p % HEAP_ALIGNMENT == 0, "Internal heap error. Result pointer is not aligned to HEAP_ALIGNMENT");
+	engine_tm_end();
+	return p;
+}
+
+// Expects heap_lock to be acquired
+void heap_dealloc_in_blocks(Heap_Allocation_Metadata *meta) {
+	void *p = meta;
+	
 	// Yoink meta data before we start overwriting it
 	Heap_Block *block = meta->block;
 	u64 size = meta->size;
@@ -469,7 +1375,9 @@ void heap_dealloc(void *p) {
 				// allocator slows down your program you should rethink your memory management
 				// anyways...
 				
-				if (new_node >= node) {
+				// Keep the list sorted by address, heap_resize_in_blocks relies on it to find
+				// the free node right after an allocation.
+				if (new_node >= node && (!node->next || new_node < node->next)) {
 					u8* node_tail = (u8*)node + node->size;
 					if (cast(u8*)new_node == node_tail) {
 						
@@ -491,6 +1399,12 @@ void heap_dealloc(void *p) {
 						
 						node->size += new_node_size;
 						
+						// Filled the gap between two free nodes
+						if (node->next && (u8*)node->next == (u8*)node + node->size) {
+							node->size += node->next->size;
+							node->next = node->next->next;
+						}
+						
 						break;
 					} else {
 						new_node->next = node->next;
@@ -527,8 +1441,150 @@ void heap_dealloc(void *p) {
 #if VERY_DEBUG
 	sanity_check_block(block);
 #endif
-	// #Sync #Speed oof
-	spinlock_release(&heap_lock);
+}
+// Expects heap_lock to be acquired and new_size to include metadata & be aligned to HEAP_ALIGNMENT.
+// Returns false if the allocation can't be resized without moving it.
+bool heap_resize_in_blocks(Heap_Allocation_Metadata *meta, u64 new_size) {
+	Heap_Block *block = meta->block;
+	
+	if (new_size == meta->size) return true;
+	
+	if (new_size < meta->size) {
+		// Split off the tail and free it like any other allocation so it coalesces with
+		// the free node after it, if there is one.
+		Heap_Allocation_Metadata *tail = (Heap_Allocation_Metadata*)((u8*)meta + new_size);
+		tail->size = meta->size - new_size;
+		tail->block = block;
+		meta->size = new_size;
+		heap_dealloc_in_blocks(tail);
+		return true;
+	}
+	
+	u64 delta = new_size - meta->size;
+	u8 *tail = (u8*)meta + meta->size;
+	
+	// Free nodes are sorted by address
+	Heap_Free_Node *previous = 0;
+	Heap_Free_Node *node = block->free_head;
+	while (node && (u8*)node < tail) {
+		previous = node;
+		node = node->next;
+	}
+	
+	if ((u8*)node != tail || node->size < delta) return false;
+	
+	// Unlock the free node we are eating into
+	// #Copypaste
+	void *free_tail = (u8*)node + node->size;
+	void *first_page = (void*)align_previous(node, os.page_size);
+	void *last_page_end = (void*)align_previous(free_tail, os.page_size);
+	if ((u8*)last_page_end > (u8*)first_page) {
+		os_unlock_program_memory_pages(first_page, (u64)last_page_end-(u64)first_page);
+	}
+	
+	Heap_Free_Node *next = node->next;
+	if (node->size != delta) {
+		Heap_Free_Node *remainder = (Heap_Free_Node*)(tail+delta);
+		remainder->size = node->size - delta;
+		remainder->next = next;
+		next = remainder;
+		
+		// Lock remaining free node
+		// #Copypaste
+		void *free_tail = (u8*)remainder + remainder->size;
+		void *next_page = (void*)align_next(remainder, os.page_size);
+		void *last_page_end = (void*)align_previous(free_tail, os.page_size);
+		if ((u8*)last_page_end > (u8*)next_page) {
+			os_lock_program_memory_pages(next_page, (u64)last_page_end-(u64)next_page);
+		}
+	}
+	
+	if (previous) previous->next = next;
+	else          block->free_head = next;
+	
+	meta->size = new_size;
+#if CONFIGURATION == DEBUG
+	block->total_allocated += delta;
+#endif
+
+#if VERY_DEBUG
+	sanity_check_block(block);
+#endif
+
+	return true;
+}
+
+void heap_dealloc(void *p) {
+	
+	if (!heap_initted) heap_init();
+	
+	assert(is_pointer_in_heap_or_reserved_range(p), "A bad pointer was passed tp heap_dealloc: it is out of heap memory bounds!"); 
+	Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)((u8*)p-sizeof(Heap_Allocation_Metadata));
+	check_meta(meta);
+	
+#if ENABLE_ALLOCATION_TRACKING
+	_allocation_tracker_add_live(meta->callsite, -1, -(s64)meta->size);
+#endif
+	
+	if (meta->size <= HEAP_SMALL_ALLOCATION_MAX) {
+		heap_dealloc_in_slab(meta);
+	} else if (meta->size >= HEAP_LARGE_ALLOCATION_MIN) {
+		heap_dealloc_large(meta);
+	} else {
+		// #Sync #Speed oof
+		spinlock_acquire_or_wait(&heap_lock);
+		heap_dealloc_in_blocks(meta);
+		spinlock_release(&heap_lock);
+	}
+}
+
+// Grows or shrinks in place when the allocation has room in its slab slot, the free node
+// right after it in the heap block is big enough, or it's a large allocation with enough
+// reserved pages. Otherwise alloc + copy + dealloc.
+void *heap_realloc(void *p, u64 size) {
+
+	if (!heap_initted) heap_init();
+	
+	assert(is_pointer_in_heap_or_reserved_range(p), "A bad pointer was passed tp heap_realloc: it is out of heap memory bounds!"); 
+	Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)((u8*)p-sizeof(Heap_Allocation_Metadata));
+	check_meta(meta);
+	
+	u64 new_size = size + sizeof(Heap_Allocation_Metadata);
+	new_size = (new_size+HEAP_ALIGNMENT) & ~(HEAP_ALIGNMENT-1);
+	
+	u64 old_size = meta->size;
+	bool resized = false;
+	if (meta->size <= HEAP_SMALL_ALLOCATION_MAX) {
+		// Slots can't change size, but there may be room left in this one
+		resized = new_size <= meta->size;
+	} else if (meta->size >= HEAP_LARGE_ALLOCATION_MIN) {
+		resized = new_size >= HEAP_LARGE_ALLOCATION_MIN && heap_resize_large(meta, new_size);
+	} else if (new_size > HEAP_SMALL_ALLOCATION_MAX && new_size < HEAP_LARGE_ALLOCATION_MIN) {
+		// #Sync #Speed oof
+		spinlock_acquire_or_wait(&heap_lock);
+		resized = heap_resize_in_blocks(meta, new_size);
+		spinlock_release(&heap_lock);
+	}
+	
+	if (resized) {
+#if ENABLE_ALLOCATION_TRACKING
+		_allocation_tracker_add_live(meta->callsite, 0, (s64)meta->size-(s64)old_size);
+#endif
+		return p;
+	}
+	
+#if ENABLE_ALLOCATION_TRACKING
+	// Reallocating through allocator.proc keeps the callsite it was allocated at
+	u32 previous_callsite = _allocation_tracker_current_callsite;
+	if (!previous_callsite) _allocation_tracker_current_callsite = meta->callsite;
+#endif
+	void *new = heap_alloc(size);
+#if ENABLE_ALLOCATION_TRACKING
+	_allocation_tracker_current_callsite = previous_callsite;
+#endif
+	memcpy(new, p, min(size, old_size-sizeof(Heap_Allocation_Metadata)));
+	heap_dealloc(p);
+	return new;
 }
 
 void* heap_allocator_proc(u64 size, void *p, Allocator_Message message, void* data) {
@@ -546,12 +1602,7 @@ void* heap_allocator_proc(u64 size, void *p, Allocator_Message message, void* da
 				return heap_alloc(size);
 			}
 			assert(is_pointer_valid(p), "Invalid pointer passed to heap allocator reallocate");
-			Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)(((u64)p)-sizeof(Heap_Allocation_Metadata));
-			check_meta(meta);
-			void *new = heap_alloc(size);
-			memcpy(new, p, min(size, meta->size));
-			heap_dealloc(p);
-			return new;
+			return heap_realloc(p, size);
 		}
 	}
 	return 0;
@@ -566,6 +1617,22 @@ Allocator get_heap_allocator() {
 	return heap_allocator;
 }
 
+#if ENABLE_ALLOCATION_TRACKING && !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+Allocation_Block_Info allocation_tracker_get_block_info(void *p) {
+	assert(is_pointer_in_heap_or_reserved_range(p), "A bad pointer was passed to allocation_tracker_get_block_info: it is out of heap memory bounds!");
+	Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)((u8*)p-sizeof(Heap_Allocation_Metadata));
+	check_meta(meta);
+	
+	Allocation_Callsite *callsite = &allocation_callsites[meta->callsite];
+	Allocation_Block_Info info = ZERO(Allocation_Block_Info);
+	info.file = callsite->file ? STR(callsite->file) : STR("");
+	info.line = callsite->line;
+	info.frame = meta->frame;
+	info.size = meta->size-sizeof(Heap_Allocation_Metadata);
+	return info;
+}
+#endif
+
 ///
 ///
 // Temporary storage
@@ -575,6 +1642,24 @@ Allocator get_heap_allocator() {
 	#define TEMPORARY_STORAGE_SIZE (1024ULL*1024ULL*2ULL) // 2mb
 #endif
 
+// Temporary storage is a per-thread bump allocator which is reset with reset_temporary_storage().
+// When it runs out it links in another chunk from the heap instead of wrapping around.
+// On reset, extra chunks are freed and the first chunk is grown to fit the high water mark,
+// so a thread that keeps overflowing stops doing so after the first reset.
+
+typedef struct Temporary_Storage_Chunk Temporary_Storage_Chunk;
+typedef struct Temporary_Storage_Chunk {
+	Temporary_Storage_Chunk *next;
+	u64 size; // Excluding this header
+} Temporary_Storage_Chunk;
+
+typedef struct Temporary_Storage_Stats {
+	u64 used;           // Bytes allocated since last reset
+	u64 high_water;     // Most bytes allocated between two resets
+	u64 capacity;       // Bytes in the first chunk
+	u64 overflow_count; // Number of times we had to link in another chunk
+} Temporary_Storage_Stats;
+
 ogb_instance void* talloc(u64);
 ogb_instance void* temp_allocator_proc(u64 size, void *p, Allocator_Message message, void*);
 
@@ -583,9 +1668,10 @@ ogb_instance Allocator
 get_temporary_allocator();
 
 #if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
-thread_local void * temporary_storage = 0;
+thread_local void * temporary_storage = 0; // First Temporary_Storage_Chunk
 thread_local void * temporary_storage_pointer = 0;
-thread_local bool   has_warned_temporary_storage_overflow = false;
+thread_local Temporary_Storage_Chunk *temporary_storage_current_chunk = 0;
+thread_local Temporary_Storage_Stats temporary_storage_stats = {0};
 thread_local Allocator temp_allocator;
 
 ogb_instance Allocator 
@@ -601,12 +1687,19 @@ temp_allocator_proc(u64 size, void *p, Allocator_Message message, void* data);
 ogb_instance void 
 temporary_storage_init(u64 arena_size);
 
+ogb_instance void 
+temporary_storage_deinit();
+
 ogb_instance void* 
 talloc(u64 size);
 
 ogb_instance void 
 reset_temporary_storage();
 
+// For the calling thread
+ogb_instance Temporary_Storage_Stats 
+get_temporary_storage_stats();
+
 
 #if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
 void* temp_allocator_proc(u64 size, void *p, Allocator_Message message, void* data) {
@@ -626,58 +1719,128 @@ void* temp_allocator_proc(u64 size, void *p, Allocator_Message message, void* da
 	return 0;
 }
 
+Temporary_Storage_Chunk *make_temporary_storage_chunk(u64 size) {
+	Temporary_Storage_Chunk *chunk = (Temporary_Storage_Chunk*)heap_alloc(sizeof(Temporary_Storage_Chunk)+size);
+	assert(chunk, "Failed allocating temporary storage");
+	chunk->next = 0;
+	chunk->size = size;
+	return chunk;
+}
+
 void temporary_storage_init(u64 arena_size) {
 	
-	temporary_storage = heap_alloc(arena_size);
-	assert(temporary_storage, "Failed allocating temporary storage");
-	temporary_storage_pointer = temporary_storage;
+	Temporary_Storage_Chunk *first = make_temporary_storage_chunk(arena_size);
+	
+	temporary_storage = first;
+	temporary_storage_current_chunk = first;
+	temporary_storage_pointer = first+1;
+	
+	temporary_storage_stats = ZERO(Temporary_Storage_Stats);
+	temporary_storage_stats.capacity = arena_size;
 
 	temp_allocator.proc = temp_allocator_proc;
 	temp_allocator.data = 0;
-	
-	temp_allocator.proc = temp_allocator_proc;
+}
+
+void temporary_storage_deinit() {
+	Temporary_Storage_Chunk *chunk = (Temporary_Storage_Chunk*)temporary_storage;
+	while (chunk != 0) {
+		Temporary_Storage_Chunk *next = chunk->next;
+		heap_dealloc(chunk);
+		chunk = next;
+	}
+	temporary_storage = 0;
+	temporary_storage_pointer = 0;
+	temporary_storage_current_chunk = 0;
 }
 
 void* talloc(u64 size) {
 	
-	assert(size < TEMPORARY_STORAGE_SIZE, "Bruddah this is too large for temp allocator");
+	size = align_next(size, 8);
+	
+	Temporary_Storage_Chunk *chunk = temporary_storage_current_chunk;
+	u8 *chunk_end = (u8*)(chunk+1) + chunk->size;
+	
+	if ((u8*)temporary_storage_pointer + size > chunk_end) {
+		u64 new_size = max(temporary_storage_stats.capacity, size);
+		Temporary_Storage_Chunk *next = make_temporary_storage_chunk(new_size);
+		
+		chunk->next = next;
+		temporary_storage_current_chunk = next;
+		temporary_storage_pointer = next+1;
+		
+		temporary_storage_stats.overflow_count += 1;
+	}
 	
 	void* p = temporary_storage_pointer;
 	
 	temporary_storage_pointer = (u8*)temporary_storage_pointer + size;
 	
-	if ((u8*)temporary_storage_pointer >= (u8*)temporary_storage+TEMPORARY_STORAGE_SIZE) {
-		if (!has_warned_temporary_storage_overflow) {
-			os_write_string_to_stdout(STR("WARNING: temporary storage was overflown, we wrap around at the start.\n"));
-			has_warned_temporary_storage_overflow = true;
-		}
-		temporary_storage_pointer = temporary_storage;
-		return talloc(size);;
+	temporary_storage_stats.used += size;
+	if (temporary_storage_stats.used > temporary_storage_stats.high_water) {
+		temporary_storage_stats.high_water = temporary_storage_stats.used;
 	}
 	
 	return p;
 }
 
 void reset_temporary_storage() {
-	temporary_storage_pointer = temporary_storage;	
-	has_warned_temporary_storage_overflow = false;
+	Temporary_Storage_Chunk *first = (Temporary_Storage_Chunk*)temporary_storage;
+	if (!first) return;
+	
+	if (first->next) {
+		// We overflowed since last reset. Replace the chunks with one that fits.
+		u64 new_size = get_next_power_of_two(temporary_storage_stats.high_water);
+		temporary_storage_deinit();
+		first = make_temporary_storage_chunk(new_size);
+		temporary_storage = first;
+		temporary_storage_stats.capacity = new_size;
+	}
+	
+	temporary_storage_current_chunk = first;
+	temporary_storage_pointer = first+1;
+	temporary_storage_stats.used = 0;
+}
+
+Temporary_Storage_Stats get_temporary_storage_stats() {
+	return temporary_storage_stats;
 }
 
 #endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
 
 
+// An Arena is either:
+// - A fixed block of memory (make_arena, make_arena_allocator, make_arena_allocator_with_memory)
+// - A reserved range of virtual memory where pages are committed as the arena grows
+//   (make_virtual_arena). This never moves so pointers stay valid until restore/reset.
+// Use arena_checkpoint/arena_restore to throw away everything pushed since the checkpoint.
 typedef struct Arena {
 	void *start;
 	void *next;
-	u64 size;
+	u64 size; // Usable bytes. For virtual arenas this is the committed size.
+	
+	// Only for virtual arenas, 0 otherwise
+	u64 reserved_size;
+	// When restoring/resetting a virtual arena, committed pages past
+	// max(position, decommit_threshold) are given back to the OS.
+	// Defaults to ARENA_NEVER_DECOMMIT.
+	u64 decommit_threshold;
+	
+	u64 high_water; // Most bytes ever used at once
 } Arena;
 
+#define ARENA_NEVER_DECOMMIT UINT64_MAX
+#define ARENA_COMMIT_GRANULARITY KB(64)
 
+typedef struct Arena_Checkpoint {
+	Arena *arena;
+	void *next;
+} Arena_Checkpoint;
 
 // Allocates arena from heap
 Arena make_arena(u64 size) {
 	size = align_next(size, 8);
-	Arena arena;
+	Arena arena = ZERO(Arena);
 	
 	arena.start = alloc(get_heap_allocator(), size);
 	arena.next = arena.start;
@@ -686,13 +1849,84 @@ Arena make_arena(u64 size) {
 	return arena;
 }
 
+// Reserves reserved_size of virtual memory but doesn't commit any of it until it's pushed to
+Arena make_virtual_arena(u64 reserved_size) {
+	reserved_size = align_next(reserved_size, os.granularity);
+	Arena arena = ZERO(Arena);
+	
+	arena.start = os_reserve_pages(reserved_size);
+	assert(arena.start, "Failed reserving %llu bytes of virtual memory for arena", reserved_size);
+	arena.next = arena.start;
+	arena.size = 0;
+	arena.reserved_size = reserved_size;
+	arena.decommit_threshold = ARENA_NEVER_DECOMMIT;
+	
+	register_reserved_range(arena.start, 0);
+	
+	return arena;
+}
+void destroy_virtual_arena(Arena *arena) {
+	assert(arena->reserved_size, "Not a virtual arena");
+	unregister_reserved_range(arena->start);
+	os_release_pages(arena->start, arena->reserved_size);
+	*arena = ZERO(Arena);
+}
+
 void *arena_push(Arena *arena, u64 size) {
 	void *p = arena->next;
-	arena->next = (u8*)arena->next + size;
+	u64 used = (u64)((u8*)p - (u8*)arena->start) + size;
+	
+	if (used > arena->size) {
+		assert(arena->reserved_size, "Arena overflow: pushed %llu bytes but only %llu bytes are left", size, arena->size-(used-size));
+		assert(used <= arena->reserved_size, "Virtual arena overflow: pushed %llu bytes but only %llu bytes are reserved. Reserve more in make_virtual_arena.", size, arena->reserved_size-(used-size));
+		
+		u64 new_size = min(align_next(used, ARENA_COMMIT_GRANULARITY), arena->reserved_size);
+		bool ok = os_commit_pages((u8*)arena->start+arena->size, new_size-arena->size);
+		assert(ok, "Failed committing memory for virtual arena. Maybe we are out of memory?");
+		arena->size = new_size;
+		resize_reserved_range(arena->start, new_size);
+	}
+	
+	arena->next = (u8*)p + size;
+	if (used > arena->high_water) arena->high_water = used;
+	
 	return p;
 }
 #define arena_push_struct(parena, type) arena_push((parena), sizeof(type))
 
+Arena_Checkpoint arena_checkpoint(Arena *arena) {
+	Arena_Checkpoint checkpoint;
+	checkpoint.arena = arena;
+	checkpoint.next = arena->next;
+	return checkpoint;
+}
+void arena_restore(Arena_Checkpoint checkpoint) {
+	Arena *arena = checkpoint.arena;
+	assert((u8*)checkpoint.next >= (u8*)arena->start && (u8*)checkpoint.next <= (u8*)arena->next, "Restoring arena to a checkpoint past its current position. Checkpoints must be restored in reverse order.");
+	
+#if CONFIGURATION == DEBUG
+	memset(checkpoint.next, 0x69696969, (u8*)arena->next-(u8*)checkpoint.next);
+#endif
+	
+	arena->next = checkpoint.next;
+	
+	if (arena->reserved_size && arena->decommit_threshold != ARENA_NEVER_DECOMMIT) {
+		u64 used = (u64)((u8*)arena->next-(u8*)arena->start);
+		u64 keep_size = min(align_next(max(used, arena->decommit_threshold), ARENA_COMMIT_GRANULARITY), arena->reserved_size);
+		if (arena->size > keep_size) {
+			resize_reserved_range(arena->start, keep_size);
+			os_decommit_pages((u8*)arena->start+keep_size, arena->size-keep_size);
+			arena->size = keep_size;
+		}
+	}
+}
+void arena_reset(Arena *arena) {
+	Arena_Checkpoint start;
+	start.arena = arena;
+	start.next = arena->start;
+	arena_restore(start);
+}
+
 void* arena_allocator_proc(u64 size, void *p, Allocator_Message message, void* data) {
 	if (size > 8) size = align_next(size, 8);
 	Arena *arena = (Arena*)data;
@@ -716,6 +1950,7 @@ Allocator make_arena_allocator(u64 size) {
 	void *mem = alloc(get_heap_allocator(), size + sizeof(Arena));
 	
 	Arena *arena = (Arena*)mem;
+	*arena = ZERO(Arena);
 	
 	arena->start = (u8*)mem + sizeof(Arena);
 	arena->next = arena->start;
@@ -731,6 +1966,7 @@ Allocator make_arena_allocator_with_memory(u64 size, void *p) {
 	void *mem = alloc(get_heap_allocator(), size + sizeof(Arena));
 	
 	Arena *arena = (Arena*)alloc(get_heap_allocator(), sizeof(Arena));
+	*arena = ZERO(Arena);
 	
 	arena->start = p;
 	arena->next = arena->start;
@@ -749,3 +1985,213 @@ Allocator make_arena_allocator_from_arena(Arena *arena) {
 	
 	return allocator;
 }
+
+///
+///
+// Pool
+///
+
+// A Pool hands out fixed size items and gives each one a generational handle.
+// - Acquire/release are O(1) through an intrusive free list threaded through the free slots.
+// - Items live in chunks that are never moved or freed until pool_deinit, so pointers to live
+//   items stay valid while the pool grows.
+// - A handle is {index, generation}. Releasing a slot bumps its generation, so stale handles
+//   to a released (or released and reused) slot are detected by pool_get returning 0.
+// - Live items are also tracked in a dense array so iterating them doesn't scan dead slots.
+//   pool_release swap-removes from the dense array, so iterate backwards if you release
+//   while iterating. That also means the dense order changes on every release; iterate by
+//   slot (pool_get_by_slot) when the order matters, for example for draw order.
+//
+// Usage:
+//
+//     Pool entities = make_pool(Entity, 256, get_heap_allocator());
+//
+//     Pool_Handle handle;
+//     Entity *e = pool_acquire(&entities, &handle); // Zeroed
+//
+//     Entity *same = pool_get(&entities, handle); // 0 if released
+//
+//     for (u64 i = 0; i < pool_get_live_count(&entities); i++) {
+//         Entity *e = pool_get_live(&entities, i);
+//     }
+//
+//     pool_release(&entities, handle);
+//
+// A zeroed Pool_Handle is never valid, so it can be used as a null handle.
+
+typedef struct Pool_Handle {
+	u32 index;
+	u32 generation;
+} Pool_Handle;
+
+#define POOL_INVALID_INDEX 0xFFFFFFFF
+
+typedef struct Pool_Slot_Header {
+	u32 generation; // Even when free, odd when live
+	u32 link; // Next free slot when free, index into pool->live_slots when live
+} Pool_Slot_Header;
+
+typedef struct Pool {
+	u64 item_size;
+	u64 slot_stride;
+	u64 chunk_shift; // Slots per chunk is 1 << chunk_shift
+	
+	u8 **chunks; // Growing array. The array of chunk pointers moves, the chunks don't.
+	u32 *live_slots; // Growing array of live slot indices
+	
+	u32 slot_count;
+	u32 first_free;
+	
+	Allocator allocator;
+} Pool;
+
+Pool make_pool_raw(u64 item_size, u64 slots_per_chunk, Allocator allocator) {
+	assert(item_size > 0, "Pool item size must be > 0");
+	assert(slots_per_chunk > 0, "Pool must have at least 1 slot per chunk");
+	
+	Pool pool = ZERO(Pool);
+	pool.item_size = item_size;
+	pool.slot_stride = align_next(sizeof(Pool_Slot_Header)+item_size, 8);
+	pool.chunk_shift = bit_scan_reverse_64(get_next_power_of_two(slots_per_chunk));
+	pool.first_free = POOL_INVALID_INDEX;
+	pool.allocator = allocator;
+	
+	growing_array_init((void**)&pool.chunks, sizeof(u8*), allocator);
+	growing_array_init((void**)&pool.live_slots, sizeof(u32), allocator);
+	
+	return pool;
+}
+#define make_pool(Item_Type, slots_per_chunk, allocator) \
+	make_pool_raw(sizeof(Item_Type), slots_per_chunk, allocator)
+
+void pool_deinit(Pool *pool) {
+	u32 chunk_count = (u32)growing_array_get_valid_count(pool->chunks);
+	for (u32 i = 0; i < chunk_count; i++) {
+		dealloc(pool->allocator, pool->chunks[i]);
+	}
+	growing_array_deinit((void**)&pool->chunks);
+	growing_array_deinit((void**)&pool->live_slots);
+	*pool = ZERO(Pool);
+}
+
+inline Pool_Slot_Header *pool_get_slot(Pool *pool, u32 index) {
+	u8 *chunk = pool->chunks[index >> pool->chunk_shift];
+	u64 index_in_chunk = index & ((1ull << pool->chunk_shift)-1);
+	return (Pool_Slot_Header*)(chunk + index_in_chunk*pool->slot_stride);
+}
+
+void pool_grow(Pool *pool) {
+	u64 slots_per_chunk = 1ull << pool->chunk_shift;
+	assert((u64)pool->slot_count + slots_per_chunk < POOL_INVALID_INDEX, "Pool is full");
+	
+	u8 *chunk = alloc(pool->allocator, slots_per_chunk*pool->slot_stride);
+	growing_array_add((void**)&pool->chunks, &chunk);
+	
+	// Thread the new slots onto the free list in order so they're handed out front to back
+	u32 first_index = pool->slot_count;
+	for (u64 i = 0; i < slots_per_chunk; i++) {
+		Pool_Slot_Header *slot = (Pool_Slot_Header*)(chunk + i*pool->slot_stride);
+		slot->generation = 0;
+		slot->link = (i == slots_per_chunk-1) ? pool->first_free : (u32)(first_index+i+1);
+	}
+	pool->first_free = first_index;
+	pool->slot_count += (u32)slots_per_chunk;
+}
+
+// Returned item is zeroed. out_handle may be 0.
+void *pool_acquire(Pool *pool, Pool_Handle *out_handle) {
+	if (pool->first_free == POOL_INVALID_INDEX) pool_grow(pool);
+	
+	u32 index = pool->first_free;
+	Pool_Slot_Header *slot = pool_get_slot(pool, index);
+	assert((slot->generation & 1) == 0, "Pool free list is corrupt");
+	
+	pool->first_free = slot->link;
+	
+	slot->generation += 1;
+	slot->link = (u32)growing_array_get_valid_count(pool->live_slots);
+	growing_array_add((void**)&pool->live_slots, &index);
+	
+	void *item = slot+1;
+	memset(item, 0, pool->item_size);
+	
+	if (out_handle) {
+		out_handle->index = index;
+		out_handle->generation = slot->generation;
+	}
+	return item;
+}
+
+inline bool pool_is_valid(Pool *pool, Pool_Handle handle) {
+	if (handle.index >= pool->slot_count) return false;
+	Pool_Slot_Header *slot = pool_get_slot(pool, handle.index);
+	return (slot->generation & 1) && slot->generation == handle.generation;
+}
+
+// Returns 0 if the handle is stale
+inline void *pool_get(Pool *pool, Pool_Handle handle) {
+	if (!pool_is_valid(pool, handle)) return 0;
+	return pool_get_slot(pool, handle.index)+1;
+}
+
+void pool_release(Pool *pool, Pool_Handle handle) {
+	assert(pool_is_valid(pool, handle), "Releasing invalid or stale pool handle (index %u, generation %u)", handle.index, handle.generation);
+	
+	Pool_Slot_Header *slot = pool_get_slot(pool, handle.index);
+	
+	// Swap-remove from the dense array and fix up the slot that got moved into our place
+	u32 live_count = (u32)growing_array_get_valid_count(pool->live_slots);
+	u32 last = pool->live_slots[live_count-1];
+	pool->live_slots[slot->link] = last;
+	pool_get_slot(pool, last)->link = slot->link;
+	growing_array_pop((void**)&pool->live_slots);
+	
+#if CONFIGURATION == DEBUG
+	memset(slot+1, 0xCD, pool->item_size);
+#endif
+	
+	slot->generation += 1;
+	slot->link = pool->first_free;
+	pool->first_free = handle.index;
+}
+
+// Releases all items. Existing handles become stale but chunks are kept.
+void pool_clear(Pool *pool) {
+	while (growing_array_get_valid_count(pool->live_slots) > 0) {
+		u32 index = pool->live_slots[growing_array_get_valid_count(pool->live_slots)-1];
+		Pool_Handle handle = {index, pool_get_slot(pool, index)->generation};
+		pool_release(pool, handle);
+	}
+}
+
+inline u64 pool_get_live_count(Pool *pool) {
+	return growing_array_get_valid_count(pool->live_slots);
+}
+// For iterating live items, 0 <= live_index < pool_get_live_count(pool)
+inline void *pool_get_live(Pool *pool, u64 live_index) {
+	assert(live_index < pool_get_live_count(pool), "Live index %llu out of range", live_index);
+	return pool_get_slot(pool, pool->live_slots[live_index])+1;
+}
+inline Pool_Handle pool_get_live_handle(Pool *pool, u64 live_index) {
+	assert(live_index < pool_get_live_count(pool), "Live index %llu out of range", live_index);
+	u32 index = pool->live_slots[live_index];
+	Pool_Handle handle = {index, pool_get_slot(pool, index)->generation};
+	return handle;
+}
+
+inline u64 pool_get_slot_count(Pool *pool) {
+	return pool->slot_count;
+}
+// For iterating in slot order, 0 <= slot_index < pool_get_slot_count(pool). Returns 0 for
+// free slots. Releasing doesn't move other items between slots, so the order is stable.
+inline void *pool_get_by_slot(Pool *pool, u64 slot_index) {
+	assert(slot_index < pool->slot_count, "Slot index %llu out of range", slot_index);
+	Pool_Slot_Header *slot = pool_get_slot(pool, (u32)slot_index);
+	if (!(slot->generation & 1)) return 0;
+	return slot+1;
+}
+inline Pool_Handle pool_get_handle_by_slot(Pool *pool, u64 slot_index) {
+	assert(slot_index < pool->slot_count, "Slot index %llu out of range", slot_index);
+	Pool_Handle handle = {(u32)slot_index, pool_get_slot(pool, (u32)slot_index)->generation};
+	return handle;
+}
@@ -110,6 +110,16 @@
 			
 				#define RUN_TESTS 1
 				
+		- RUN_BENCHMARKS
+			Run ooga booga benchmarks and print the timings. These take a while.
+		
+			0: Disable
+			1: Enable
+			
+			Example:
+			
+				#define RUN_BENCHMARKS 1
+				
 		- ENABLE_PROFILING
 			Enable time profiling which will be dumped to google_trace.json.
 		
@@ -126,6 +136,58 @@
 					tm_scope_var
 					tm_scope_accum
 					
+		- ENABLE_ENGINE_PROFILING
+			Also profile the engine's own hot paths (os_update, heap_alloc, radix_sort,
+			gfx_render_draw_frame, draw_quad_projected_in_frame, font_atlas_init,
+			do_program_audio_sample). Needs ENABLE_PROFILING.
+			
+			0: Disable
+			1: Enable
+			
+			Example:
+			
+				#define ENABLE_ENGINE_PROFILING 1
+				
+			Note:
+				draw_quad_projected_in_frame and heap_alloc record one event per call, so
+				you might need a bigger PROFILER_EVENTS_PER_THREAD for heavy frames.
+				Use profiler_dump_frame_flame to print the call tree of the last frame.
+					
+		- ENABLE_ALLOCATION_TRACKING
+			Track allocations per callsite (__FILE__/__LINE__). Heap allocations still
+			alive at exit are reported as leaks.
+			
+			0: Disable
+			1: Enable
+			
+			Example:
+			
+				#define ENABLE_ALLOCATION_TRACKING 1
+				
+			Note:
+				See "Allocation tracking" in memory.c
+					allocation_tracker_get_stats
+					allocation_tracker_get_callsite_stats
+					allocation_tracker_build_report
+					
+		- ENABLE_JOB_SYSTEM
+			Start the job system in oogabooga_init, one worker thread per logical processor
+			(or JOB_WORKER_COUNT). It's shut down when the entry returns.
+			Without this you can still call job_system_init yourself.
+			
+			0: Disable
+			1: Enable
+			
+			Example:
+			
+				#define ENABLE_JOB_SYSTEM 1
+				
+			Note:
+				See "Job system" in concurrency.c
+					job_submit
+					job_wait
+					parallel_for
+					
 		- OOGABOOGA_HEADLESS
             Run oogabooga in headless mode, i.e. no window, no graphics, no audio.
             Useful if you only need the oogabooga standard library for something like a game server.
@@ -332,6 +394,7 @@ typedef u8 bool;
 #include "random.c"
 #include "color.c"
 #include "memory.c"
+#include "string_intern.c"
 #include "input.c"
 
 #ifndef OOGABOOGA_HEADLESS
@@ -411,9 +474,14 @@ void oogabooga_init(u64 program_memory_size) {
 	context.logger = default_logger;
 	temp_allocator = get_initialization_allocator();
 	Cpu_Capabilities features = query_cpu_capabilities();
+	string_select_simd_procs(features);
+	unicode_select_simd_procs(features);
 	os_init(program_memory_size);
 	heap_init();
 	temporary_storage_init(TEMPORARY_STORAGE_SIZE);
+#if ENABLE_JOB_SYSTEM
+	job_system_init(JOB_WORKER_COUNT, get_heap_allocator());
+#endif
 	log_info("Ooga booga version is %d.%02d.%03d", OGB_VERSION_MAJOR, OGB_VERSION_MINOR, OGB_VERSION_PATCH);
 #ifndef OOGABOOGA_HEADLESS
 	gfx_init();
@@ -464,13 +532,27 @@ int main(int argc, char **argv) {
 	#if RUN_TESTS
 		oogabooga_run_tests();
 	#endif
+	#if RUN_BENCHMARKS
+		oogabooga_run_benchmarks();
+	#endif
 	
 	int code = ENTRY_PROC(argc, argv);
 	
+	// Started by ENABLE_JOB_SYSTEM or by the program itself
+	if (job_system.workers) job_system_shutdown();
+	
+#ifndef OOGABOOGA_HEADLESS
+	draw_frame_deinit(&draw_frame);
+#endif
+	
 #if ENABLE_PROFILING
 	
 	dump_profile_result();
 	
+#endif
+
+#if ENABLE_ALLOCATION_TRACKING
+	allocation_tracker_report_leaks();
 #endif
 	
 	// This is so any threads waiting for window to close will close on exit
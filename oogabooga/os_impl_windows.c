@@ -614,7 +614,9 @@ DWORD WINAPI win32_thread_invoker(LPVOID param) {
 	
 	t->proc(t);
 	
-	heap_dealloc(temporary_storage);
+	temporary_storage_deinit();
+	
+	heap_release_thread_cache();
 	
 	return 0;
 }
@@ -738,6 +740,16 @@ void os_binary_semaphore_signal(Binary_Semaphore *sem) {
 	SetEvent(sem->os_event);
 }
 
+void os_wait_on_address_32(volatile u32 *address, u32 expected) {
+	WaitOnAddress((volatile VOID*)address, &expected, sizeof(u32), INFINITE);
+}
+void os_wake_one_on_address(volatile void *address) {
+	WakeByAddressSingle((PVOID)address);
+}
+void os_wake_all_on_address(volatile void *address) {
+	WakeByAddressAll((PVOID)address);
+}
+
 
 void os_sleep(u32 ms) {
     Sleep(ms);
@@ -1451,6 +1463,31 @@ os_lock_program_memory_pages(void *start, u64 size) {
 #endif
 }
 
+void*
+os_reserve_pages(u64 size) {
+	assert(size % os.page_size == 0, "size was not aligned to page size in os_reserve_pages");
+	return VirtualAlloc(0, size, MEM_RESERVE, PAGE_NOACCESS);
+}
+bool
+os_commit_pages(void *start, u64 size) {
+	assert((u64)start % os.page_size == 0, "When committing memory pages, the start address must be the start of a page");
+	assert(size       % os.page_size == 0, "When committing memory pages, the size must be aligned to page_size");
+	return VirtualAlloc(start, size, MEM_COMMIT, PAGE_READWRITE) != 0;
+}
+void
+os_decommit_pages(void *start, u64 size) {
+	assert((u64)start % os.page_size == 0, "When decommitting memory pages, the start address must be the start of a page");
+	assert(size       % os.page_size == 0, "When decommitting memory pages, the size must be aligned to page_size");
+	BOOL ok = VirtualFree(start, size, MEM_DECOMMIT);
+	assert(ok, "VirtualFree Failed with error %d", GetLastError());
+}
+void
+os_release_pages(void *start, u64 size) {
+	assert((u64)start % os.page_size == 0, "When releasing memory pages, the start address must be the start of a page");
+	BOOL ok = VirtualFree(start, 0, MEM_RELEASE);
+	assert(ok, "VirtualFree Failed with error %d", GetLastError());
+}
+
 ///
 ///
 // Mouse pointer
@@ -1916,6 +1953,14 @@ void set_specific_gamepad_vibration(u64 gamepad_index, float32 left, float32 rig
 
 void os_update() {
 
+#if ENABLE_PROFILING
+	profiler_end_frame();
+#endif
+#if ENABLE_ALLOCATION_TRACKING
+	allocation_tracker_end_frame();
+#endif
+	engine_tm_begin("os_update");
+
 	// Only show window after first call to os_update
 	if (!has_os_update_been_called_at_all) {
 		ShowWindow(window._os_handle, SW_SHOW);
@@ -2249,6 +2294,8 @@ void os_update() {
 		win32_window_proc(window._os_handle, WM_CLOSE, 0, 0);
 	}
 #endif /* OOGABOOGA_HEADLESS */
+
+	engine_tm_end();
 }
 
 #ifndef OOGABOOGA_HEADLESS
@@ -188,6 +188,19 @@ os_binary_semaphore_wait(Binary_Semaphore *sem);
 void ogb_instance
 os_binary_semaphore_signal(Binary_Semaphore *sem);
 
+///
+// Address waiting (futex)
+// Parks the thread while *address == expected, without any spinning or OS object to
+// create. Can return without being woken, so check the value again after.
+void ogb_instance
+os_wait_on_address_32(volatile u32 *address, u32 expected);
+
+void ogb_instance
+os_wake_one_on_address(volatile void *address);
+
+void ogb_instance
+os_wake_all_on_address(volatile void *address);
+
 ///
 // Threading utilities
 
@@ -396,28 +409,17 @@ fprintf(File f, const char* fmt, ...);
                           )(__VA_ARGS__)
 
 
+void format_flush_to_file(string s, void *data) {
+	os_file_write_string(*(File*)data, s);
+}
 void fprint_va_list_buffered(File f, const string fmt, va_list args) {
 
-	string current = fmt;
-
 	char buffer[PRINT_BUFFER_SIZE];
 	
-	while (true) {
-		u64 size = min(current.count, PRINT_BUFFER_SIZE-1);
-		if (current.count <= 0) break;
-		
-		memcpy(buffer, current.data, size);
-		
-		char fmt_cstring[PRINT_BUFFER_SIZE+1];
-		memcpy(fmt_cstring, current.data, size);
-		fmt_cstring[size] = 0;
-		
-		string s = sprint_null_terminated_string_va_list_to_buffer(fmt_cstring, args, buffer, PRINT_BUFFER_SIZE);
-		os_file_write_string(f, s);
-		
-		current.count -= size;
-		current.data += size;
-	}
+	Format_Writer w = make_format_writer(buffer, PRINT_BUFFER_SIZE);
+	w.flush = format_flush_to_file;
+	w.flush_data = &f;
+	format_string_to_writer(&w, fmt, args);
 }
 
 void os_wait_and_read_stdin(string *result, u64 max_count, Allocator allocator);
@@ -487,6 +489,20 @@ os_unlock_program_memory_pages(void *start, u64 size);
 void ogb_instance
 os_lock_program_memory_pages(void *start, u64 size);
 
+// Virtual memory outside of program memory, for when we want to hand pages back to the OS.
+// - Sizes and addresses must be aligned to os.page_size
+// - Reserved pages can't be touched until they are committed
+// Returns 0 on fail
+ogb_instance void*
+os_reserve_pages(u64 size);
+bool ogb_instance
+os_commit_pages(void *start, u64 size);
+void ogb_instance
+os_decommit_pages(void *start, u64 size);
+// start must be the address returned from os_reserve_pages, releases the whole reservation
+void ogb_instance
+os_release_pages(void *start, u64 size);
+
 ///
 ///
 // Mouse pointer
@@ -1,59 +1,569 @@
+///
+// Profiler
+// tm_scope records a begin and end rdtsc plus the name into a fixed size ring buffer
+// owned by the calling thread, so recording takes no locks and never allocates after
+// the thread's first event. When a thread's buffer is full the oldest events are
+// overwritten.
+// Names must be string literals, we keep the pointer as the name's id and only look at
+// the characters when converting to a Chrome trace in dump_profile_result.
 
+#ifndef PROFILER_EVENTS_PER_THREAD
+	#define PROFILER_EVENTS_PER_THREAD (1 << 15) // Must be a power of two
+#endif
+
+typedef struct Profile_Event {
+	u64 begin_cycles;
+	u64 end_cycles;
+	const char *name;
+	u64 depth; // Scopes that were still open when this one ended
+} Profile_Event;
+
+#define PROFILER_MAX_NESTING 64
+
+// Finished siblings waiting for their parent, see Profiler_Thread_Events.unclaimed
+typedef struct Profiler_Unclaimed {
+	u64 begin_cycles; // Of the earliest sibling
+	u64 cycles;       // Summed over all siblings
+	u64 depth;
+} Profiler_Unclaimed;
+
+typedef struct Profiler_Thread_Events {
+	Profile_Event *events;
+	volatile u64 count; // Total recorded, the latest PROFILER_EVENTS_PER_THREAD are kept
+	u64 thread_id;
+	struct Profiler_Thread_Events *next;
+	
+	// For profiler_end_frame. Events are recorded when they end, so children come before
+	// their parent. Finished scopes wait here until a scope that started before them ends
+	// and claims their time as its child time. Consecutive siblings are folded into one
+	// entry, so this only grows with nesting depth.
+	u64 aggregated_count;
+	Profiler_Unclaimed unclaimed[PROFILER_MAX_NESTING];
+	u64 unclaimed_count;
+	
+	// Events of the last finished frame, for profiler_build_frame_flame
+	u64 frame_first;
+	u64 frame_end;
+} Profiler_Thread_Events;
 
 // #Global
-ogb_instance String_Builder _profile_output;
+ogb_instance Profiler_Thread_Events *_profiler_threads;
 ogb_instance bool profiler_initted;
 ogb_instance Spinlock _profiler_lock;
+ogb_instance u64 _profiler_start_cycles;
+ogb_instance f64 _profiler_start_seconds;
 
 #if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
-String_Builder _profile_output = {0};
+Profiler_Thread_Events *_profiler_threads = 0;
 bool profiler_initted = false;
 Spinlock _profiler_lock;
+u64 _profiler_start_cycles = 0;
+f64 _profiler_start_seconds = 0;
 #endif
 
-void dump_profile_result() {
-	File file = os_file_open("google_trace.json", O_CREATE | O_WRITE);
+thread_local Profiler_Thread_Events *_profiler_this_thread = 0;
+
+// tm_scope and engine_tm_begin count the scopes open on this thread so profiler_end_frame
+// can tell siblings apart from a parent's siblings
+ogb_instance thread_local u64 _profiler_open_scopes;
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+thread_local u64 _profiler_open_scopes = 0;
+#endif
+// Allocating the thread's buffers goes through heap_alloc, which is itself instrumented
+// with ENABLE_ENGINE_PROFILING
+thread_local bool _profiler_initting_this_thread = false;
+
+///
+// Frame statistics
+// profiler_end_frame folds the events recorded since the last call into per-scope
+// stats over the last PROFILER_STATS_FRAME_COUNT frames. os_update calls it when
+// ENABLE_PROFILING is on. Query the numbers with profiler_get_scope_stats or draw them
+// with draw_profiler_overlay (drawing.c).
+// Same names from different tm_scope's are merged into one scope.
+
+#ifndef PROFILER_STATS_FRAME_COUNT
+	#define PROFILER_STATS_FRAME_COUNT 120
+#endif
+#define PROFILER_MAX_SCOPES 256
+#define PROFILER_SCOPE_LOOKUP_SIZE 512 // Power of two, at least PROFILER_MAX_SCOPES*2
+
+typedef struct Profiler_Scope_Stats {
+	string name;
+	u64 frame_count;   // Frames in the window, up to PROFILER_STATS_FRAME_COUNT
+	u64 call_count;    // Calls in the window
+	f64 total_seconds; // Inclusive time in the window
+	f64 self_seconds;  // Inclusive time minus time spent in nested scopes
+	f64 min_seconds;   // Fastest single call
+	f64 max_seconds;   // Slowest single call
+	// Percentiles of inclusive time per frame
+	f64 p50_seconds;
+	f64 p95_seconds;
+	f64 p99_seconds;
+} Profiler_Scope_Stats;
+
+typedef struct Profiler_Scope {
+	const char *name;
+	// Per frame, indexed by frame % PROFILER_STATS_FRAME_COUNT. Kept in cycles and
+	// converted when queried, the rdtsc frequency estimate gets better over time.
+	u32 calls[PROFILER_STATS_FRAME_COUNT];
+	u64 inclusive_cycles[PROFILER_STATS_FRAME_COUNT];
+	u64 self_cycles[PROFILER_STATS_FRAME_COUNT];
+	u64 min_cycles[PROFILER_STATS_FRAME_COUNT];
+	u64 max_cycles[PROFILER_STATS_FRAME_COUNT];
+} Profiler_Scope;
+
+ogb_instance Profiler_Scope *_profiler_scopes;
+ogb_instance u64 _profiler_scope_count;
+ogb_instance u64 _profiler_frame_count;
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+Profiler_Scope *_profiler_scopes = 0;
+u64 _profiler_scope_count = 0;
+u64 _profiler_frame_count = 0;
+#endif
+
+void ogb_instance
+profiler_end_frame();
+
+// Returns false if no scope with that name has been recorded
+bool ogb_instance
+profiler_get_scope_stats(string name, Profiler_Scope_Stats *stats);
+
+// Returns the number of scopes written to stats
+u64 ogb_instance
+profiler_get_all_scope_stats(Profiler_Scope_Stats *stats, u64 max_count);
+
+// Call tree of the last frame passed to profiler_end_frame, one per thread, with
+// inclusive time, self time and call count per node. Calls with the same name under the
+// same parent are merged.
+void ogb_instance
+profiler_build_frame_flame(String_Builder *sb);
+
+// Prints profiler_build_frame_flame
+void ogb_instance
+profiler_dump_frame_flame();
+
+// Converts everything recorded so far to Chrome trace JSON (chrome://tracing, ui.perfetto.dev)
+void ogb_instance
+profiler_build_trace_json(String_Builder *sb);
+
+void ogb_instance
+dump_profile_result();
+
+void ogb_instance
+_profiler_record(const char *name, u64 begin_cycles, u64 end_cycles);
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+
+Profiler_Thread_Events *_profiler_init_thread() {
+	// Only happens once per thread, so locking is fine here
+	spinlock_acquire_or_wait(&_profiler_lock);
+	if (!profiler_initted) {
+		_profiler_start_cycles = rdtsc();
+		_profiler_start_seconds = os_get_elapsed_seconds();
+		profiler_initted = true;
+	}
 	
-	os_file_write_string(file, STR("["));
-	os_file_write_string(file, _profile_output.result);
-	os_file_write_string(file, STR("{}]"));
+	Profiler_Thread_Events *t = alloc(get_heap_allocator(), sizeof(Profiler_Thread_Events));
+	*t = ZERO(Profiler_Thread_Events);
+	t->events = alloc(get_heap_allocator(), PROFILER_EVENTS_PER_THREAD*sizeof(Profile_Event));
+	t->thread_id = get_context().thread_id;
+	t->next = _profiler_threads;
+	_profiler_threads = t;
+	spinlock_release(&_profiler_lock);
 	
-	os_file_close(file);
+	_profiler_this_thread = t;
+	return t;
+}
+
+void _profiler_record(const char *name, u64 begin_cycles, u64 end_cycles) {
+	Profiler_Thread_Events *t = _profiler_this_thread;
+	if (!t) {
+		if (_profiler_initting_this_thread) return;
+		_profiler_initting_this_thread = true;
+		t = _profiler_init_thread();
+		_profiler_initting_this_thread = false;
+	}
 	
-	log_verbose("Wrote profiling result to google_trace.json");
+	Profile_Event *e = &t->events[t->count & (PROFILER_EVENTS_PER_THREAD-1)];
+	e->begin_cycles = begin_cycles;
+	e->end_cycles = end_cycles;
+	e->name = name;
+	e->depth = _profiler_open_scopes;
+	COMPILER_BARRIER; // Release, so a dump from another thread sees the whole event
+	t->count = t->count + 1;
 }
-void _profiler_report_time(string name, f64 count, f64 start) {
-	if (!profiler_initted) {
-		spinlock_init(&_profiler_lock);
-		profiler_initted = true;
+
+// Threads are only ever pushed to the front of the list, so the list can be walked
+// without the lock once we have the head. That matters when walking it while appending
+// to a String_Builder, heap_alloc may record an event and a new thread takes the lock
+// to register itself.
+Profiler_Thread_Events *_profiler_get_threads() {
+	spinlock_acquire_or_wait(&_profiler_lock);
+	Profiler_Thread_Events *threads = _profiler_threads;
+	spinlock_release(&_profiler_lock);
+	return threads;
+}
+
+f64 _profiler_get_seconds_per_cycle() {
+	u64 now_cycles = rdtsc();
+	f64 now_seconds = os_get_elapsed_seconds();
+	if (now_cycles <= _profiler_start_cycles) return 0;
+	return (now_seconds-_profiler_start_seconds)/(f64)(now_cycles-_profiler_start_cycles);
+}
+
+Profiler_Scope *_profiler_get_scope(const char *name) {
+	// Pointer lookup first, every tm_scope has its own literal
+	local_persist const char *lookup_names[PROFILER_SCOPE_LOOKUP_SIZE];
+	local_persist u16 lookup_scopes[PROFILER_SCOPE_LOOKUP_SIZE];
+	local_persist u64 lookup_count = 0;
+	
+	u64 slot = ((((u64)name) >> 3) * 0x9E3779B97F4A7C15ull) & (PROFILER_SCOPE_LOOKUP_SIZE-1);
+	while (lookup_names[slot]) {
+		if (lookup_names[slot] == name) return &_profiler_scopes[lookup_scopes[slot]];
+		slot = (slot+1) & (PROFILER_SCOPE_LOOKUP_SIZE-1);
+	}
+	
+	u64 index = 0;
+	for (; index < _profiler_scope_count; index++) {
+		if (strings_match(STR(_profiler_scopes[index].name), STR(name))) break;
+	}
+	if (index == _profiler_scope_count) {
+		if (_profiler_scope_count == PROFILER_MAX_SCOPES) return 0;
+		_profiler_scopes[index] = ZERO(Profiler_Scope);
+		_profiler_scopes[index].name = name;
+		_profiler_scope_count += 1;
+	}
+	
+	// Keep some slots empty so probing always ends
+	if (lookup_count < PROFILER_SCOPE_LOOKUP_SIZE*3/4) {
+		lookup_names[slot] = name;
+		lookup_scopes[slot] = (u16)index;
+		lookup_count += 1;
+	}
+	return &_profiler_scopes[index];
+}
+
+void profiler_end_frame() {
+	if (!profiler_initted) return;
+	
+	if (!_profiler_scopes) {
+		_profiler_scopes = alloc(get_heap_allocator(), PROFILER_MAX_SCOPES*sizeof(Profiler_Scope));
+	}
+	
+	u64 frame = _profiler_frame_count % PROFILER_STATS_FRAME_COUNT;
+	for (u64 i = 0; i < _profiler_scope_count; i++) {
+		Profiler_Scope *scope = &_profiler_scopes[i];
+		scope->calls[frame] = 0;
+		scope->inclusive_cycles[frame] = 0;
+		scope->self_cycles[frame] = 0;
+		scope->min_cycles[frame] = 0;
+		scope->max_cycles[frame] = 0;
+	}
+	
+	spinlock_acquire_or_wait(&_profiler_lock);
+	for (Profiler_Thread_Events *t = _profiler_threads; t; t = t->next) {
+		u64 count = t->count;
+		COMPILER_BARRIER; // Acquire
+		u64 first = max(t->aggregated_count, count > PROFILER_EVENTS_PER_THREAD ? count-PROFILER_EVENTS_PER_THREAD : 0);
 		
-		string_builder_init_reserve(&_profile_output, 1024*1000, get_heap_allocator());	
+		for (u64 i = first; i < count; i++) {
+			Profile_Event e = t->events[i & (PROFILER_EVENTS_PER_THREAD-1)];
+			
+			s64 cycles = max((s64)(e.end_cycles-e.begin_cycles), 0);
+			
+			// Anything that finished before this and started after it is nested in it
+			u64 child_cycles = 0;
+			while (t->unclaimed_count > 0 && t->unclaimed[t->unclaimed_count-1].begin_cycles >= e.begin_cycles) {
+				child_cycles += t->unclaimed[t->unclaimed_count-1].cycles;
+				t->unclaimed_count -= 1;
+			}
+			
+			// A finished sibling on top has the same parent, fold into it. Deeper than
+			// PROFILER_MAX_NESTING gets folded into the deepest entry we can keep.
+			Profiler_Unclaimed *top = t->unclaimed_count > 0 ? &t->unclaimed[t->unclaimed_count-1] : 0;
+			if (top && (top->depth == e.depth || t->unclaimed_count == PROFILER_MAX_NESTING)) {
+				top->cycles += (u64)cycles;
+			} else {
+				t->unclaimed[t->unclaimed_count].begin_cycles = e.begin_cycles;
+				t->unclaimed[t->unclaimed_count].cycles = (u64)cycles;
+				t->unclaimed[t->unclaimed_count].depth = e.depth;
+				t->unclaimed_count += 1;
+			}
+			
+			Profiler_Scope *scope = _profiler_get_scope(e.name);
+			if (!scope) continue;
+			
+			s64 self = max(cycles-(s64)child_cycles, 0);
+			
+			if (scope->calls[frame] == 0 || (u64)cycles < scope->min_cycles[frame]) scope->min_cycles[frame] = (u64)cycles;
+			if ((u64)cycles > scope->max_cycles[frame]) scope->max_cycles[frame] = (u64)cycles;
+			scope->calls[frame] += 1;
+			scope->inclusive_cycles[frame] += (u64)cycles;
+			scope->self_cycles[frame] += (u64)self;
+		}
+		t->aggregated_count = count;
+		t->frame_first = first;
+		t->frame_end = count;
+	}
+	spinlock_release(&_profiler_lock);
+	
+	_profiler_frame_count += 1;
+}
+
+void _profiler_compute_stats(Profiler_Scope *scope, f64 seconds_per_cycle, Profiler_Scope_Stats *stats) {
+	*stats = ZERO(Profiler_Scope_Stats);
+	stats->name = STR(scope->name);
+	stats->frame_count = min(_profiler_frame_count, PROFILER_STATS_FRAME_COUNT);
+	
+	u64 min_cycles = 0;
+	u64 max_cycles = 0;
+	u64 total_cycles = 0;
+	u64 self_cycles = 0;
+	u64 per_frame[PROFILER_STATS_FRAME_COUNT];
+	for (u64 i = 0; i < stats->frame_count; i++) {
+		if (scope->calls[i]) {
+			if (stats->call_count == 0 || scope->min_cycles[i] < min_cycles) min_cycles = scope->min_cycles[i];
+			max_cycles = max(max_cycles, scope->max_cycles[i]);
+		}
+		stats->call_count += scope->calls[i];
+		total_cycles      += scope->inclusive_cycles[i];
+		self_cycles       += scope->self_cycles[i];
 		
+		// Insertion sort, it's at most PROFILER_STATS_FRAME_COUNT
+		u64 j = i;
+		while (j > 0 && per_frame[j-1] > scope->inclusive_cycles[i]) {
+			per_frame[j] = per_frame[j-1];
+			j -= 1;
+		}
+		per_frame[j] = scope->inclusive_cycles[i];
 	}
 	
-	spinlock_acquire_or_wait(&_profiler_lock);
+	stats->total_seconds = (f64)total_cycles*seconds_per_cycle;
+	stats->self_seconds  = (f64)self_cycles*seconds_per_cycle;
+	stats->min_seconds   = (f64)min_cycles*seconds_per_cycle;
+	stats->max_seconds   = (f64)max_cycles*seconds_per_cycle;
+	if (stats->frame_count > 0) {
+		u64 last = stats->frame_count-1;
+		stats->p50_seconds = (f64)per_frame[(last*50+50)/100]*seconds_per_cycle;
+		stats->p95_seconds = (f64)per_frame[(last*95+50)/100]*seconds_per_cycle;
+		stats->p99_seconds = (f64)per_frame[(last*99+50)/100]*seconds_per_cycle;
+	}
+}
+
+bool profiler_get_scope_stats(string name, Profiler_Scope_Stats *stats) {
+	for (u64 i = 0; i < _profiler_scope_count; i++) {
+		if (strings_match(STR(_profiler_scopes[i].name), name)) {
+			_profiler_compute_stats(&_profiler_scopes[i], _profiler_get_seconds_per_cycle(), stats);
+			return true;
+		}
+	}
+	return false;
+}
+
+u64 profiler_get_all_scope_stats(Profiler_Scope_Stats *stats, u64 max_count) {
+	u64 count = min(max_count, _profiler_scope_count);
+	f64 seconds_per_cycle = _profiler_get_seconds_per_cycle();
+	for (u64 i = 0; i < count; i++) {
+		_profiler_compute_stats(&_profiler_scopes[i], seconds_per_cycle, &stats[i]);
+	}
+	return count;
+}
+
+///
+// Frame flame
+
+#define PROFILER_FLAME_NAME_COLUMN 48
+
+typedef struct Profiler_Flame_Node {
+	string name;
+	u64 calls;
+	u64 cycles;
+	u64 child_cycles;
+	s64 first_child;
+	s64 next_sibling;
+} Profiler_Flame_Node;
+
+void _profiler_append_flame_node(String_Builder *sb, Profiler_Flame_Node *nodes, s64 index, u64 depth, f64 ms_per_cycle) {
+	Profiler_Flame_Node *node = &nodes[index];
 	
-	string fmt = STR("{\"cat\":\"function\",\"dur\":%.3f,\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%zu,\"ts\":%.3f},");
-    string_builder_print(
-        &_profile_output,
-        fmt,
-        (float64)(count * 1000000),  
-        name,                  
-        get_context().thread_id,
-        start * 1000000              
-    );
-	spinlock_release(&_profiler_lock);
+	for (u64 i = 0; i < depth; i++) string_builder_append(sb, STR("  "));
+	string_builder_append(sb, node->name);
+	for (u64 i = depth*2+node->name.count; i < PROFILER_FLAME_NAME_COLUMN; i++) string_builder_append(sb, STR(" "));
+	string_builder_print(
+		sb, 
+		STR(" %10.3f %10.3f %8llu\n"), 
+		(f64)node->cycles*ms_per_cycle, 
+		(f64)(node->cycles-min(node->child_cycles, node->cycles))*ms_per_cycle, 
+		node->calls
+	);
+	
+	// Heaviest child first
+	s64 sorted = -1;
+	s64 child = node->first_child;
+	while (child != -1) {
+		s64 next = nodes[child].next_sibling;
+		s64 *link = &sorted;
+		while (*link != -1 && nodes[*link].cycles >= nodes[child].cycles) link = &nodes[*link].next_sibling;
+		nodes[child].next_sibling = *link;
+		*link = child;
+		child = next;
+	}
+	node->first_child = sorted;
+	
+	for (child = node->first_child; child != -1; child = nodes[child].next_sibling) {
+		_profiler_append_flame_node(sb, nodes, child, depth+1, ms_per_cycle);
+	}
 }
+
+void profiler_build_frame_flame(String_Builder *sb) {
+	if (!profiler_initted || _profiler_frame_count == 0) return;
+	
+	f64 ms_per_cycle = _profiler_get_seconds_per_cycle()*1000.0;
+	
+	// At most one node per event plus the root
+	Profiler_Flame_Node *nodes = alloc(get_heap_allocator(), (PROFILER_EVENTS_PER_THREAD+1)*sizeof(Profiler_Flame_Node));
+	
+	string_builder_print(sb, STR("Frame %llu\n"), _profiler_frame_count-1);
+	for (u64 i = 0; i < PROFILER_FLAME_NAME_COLUMN; i++) string_builder_append(sb, STR(" "));
+	string_builder_append(sb, STR("   total ms    self ms    calls\n"));
+	
+	for (Profiler_Thread_Events *t = _profiler_get_threads(); t; t = t->next) {
+		u64 count = t->count;
+		COMPILER_BARRIER; // Acquire
+		u64 first = max(t->frame_first, count > PROFILER_EVENTS_PER_THREAD ? count-PROFILER_EVENTS_PER_THREAD : 0);
+		u64 end = t->frame_end;
+		if (first >= end) continue;
+		
+		u64 node_count = 1;
+		nodes[0] = ZERO(Profiler_Flame_Node);
+		nodes[0].name = tprint("Thread %llu", t->thread_id);
+		nodes[0].first_child = -1;
+		nodes[0].next_sibling = -1;
+		
+		struct { s64 node; u64 begin_cycles; } stack[PROFILER_MAX_NESTING];
+		stack[0].node = 0;
+		stack[0].begin_cycles = 0;
+		u64 depth = 1;
+		
+		// Events are recorded when they end, so walking them backwards visits every parent
+		// before its children
+		for (u64 i = end; i > first; i--) {
+			Profile_Event e = t->events[(i-1) & (PROFILER_EVENTS_PER_THREAD-1)];
+			u64 cycles = (u64)max((s64)(e.end_cycles-e.begin_cycles), 0);
+			
+			while (depth > 1 && e.begin_cycles < stack[depth-1].begin_cycles) depth -= 1;
+			s64 parent = stack[depth-1].node;
+			
+			s64 node = nodes[parent].first_child;
+			while (node != -1 && nodes[node].name.data != (u8*)e.name && !strings_match(nodes[node].name, STR(e.name))) {
+				node = nodes[node].next_sibling;
+			}
+			if (node == -1) {
+				node = (s64)node_count;
+				node_count += 1;
+				nodes[node] = ZERO(Profiler_Flame_Node);
+				nodes[node].name = STR(e.name);
+				nodes[node].first_child = -1;
+				nodes[node].next_sibling = nodes[parent].first_child;
+				nodes[parent].first_child = node;
+			}
+			
+			nodes[node].calls += 1;
+			nodes[node].cycles += cycles;
+			nodes[parent].child_cycles += cycles;
+			if (parent == 0) {
+				nodes[0].cycles += cycles;
+				nodes[0].calls += 1;
+			}
+			
+			// Deeper than that gets attributed to the deepest parent we can keep
+			if (depth < PROFILER_MAX_NESTING) {
+				stack[depth].node = node;
+				stack[depth].begin_cycles = e.begin_cycles;
+				depth += 1;
+			}
+		}
+		
+		_profiler_append_flame_node(sb, nodes, 0, 0, ms_per_cycle);
+	}
+	
+	dealloc(get_heap_allocator(), nodes);
+}
+
+void profiler_dump_frame_flame() {
+	String_Builder sb;
+	string_builder_init_reserve(&sb, 1024*16, get_heap_allocator());
+	profiler_build_frame_flame(&sb);
+	print("%s", sb.result);
+	string_builder_deinit(&sb);
+}
+
+void profiler_build_trace_json(String_Builder *sb) {
+	string_builder_append(sb, STR("["));
+	
+	if (profiler_initted) {
+		// Compare against the OS clock over the whole run to get the rdtsc frequency
+		f64 seconds_per_cycle = _profiler_get_seconds_per_cycle();
+		
+		string fmt = STR("{\"cat\":\"function\",\"dur\":%.3f,\"name\":\"%cs\",\"ph\":\"X\",\"pid\":0,\"tid\":%llu,\"ts\":%.3f},");
+		for (Profiler_Thread_Events *t = _profiler_get_threads(); t; t = t->next) {
+			u64 count = t->count;
+			COMPILER_BARRIER; // Acquire
+			u64 first = count > PROFILER_EVENTS_PER_THREAD ? count-PROFILER_EVENTS_PER_THREAD : 0;
+			for (u64 i = first; i < count; i++) {
+				Profile_Event e = t->events[i & (PROFILER_EVENTS_PER_THREAD-1)];
+				
+				f64 start = _profiler_start_seconds + (f64)(s64)(e.begin_cycles-_profiler_start_cycles)*seconds_per_cycle;
+				// rdtsc can be a few cycles off between cores if the thread moved
+				f64 duration = max((f64)(s64)(e.end_cycles-e.begin_cycles), 0.0)*seconds_per_cycle;
+				string_builder_print(
+					sb,
+					fmt,
+					duration * 1000000,
+					e.name,
+					t->thread_id,
+					start * 1000000
+				);
+			}
+		}
+	}
+	
+	string_builder_append(sb, STR("{}]"));
+}
+
+void dump_profile_result() {
+	String_Builder sb;
+	string_builder_init_reserve(&sb, 1024*64, get_heap_allocator());
+	profiler_build_trace_json(&sb);
+	
+	File file = os_file_open("google_trace.json", O_CREATE | O_WRITE);
+	os_file_write_string(file, sb.result);
+	os_file_close(file);
+	
+	string_builder_deinit(&sb);
+	
+	log_verbose("Wrote profiling result to google_trace.json");
+}
+
+#endif
+
 #if ENABLE_PROFILING
+// The depth is restored rather than decremented, so a scope left through break or return
+// (which skips recording it) is repaired when the enclosing scope ends.
 #define tm_scope(name) \
-    for (f64 start_time = os_get_elapsed_seconds(), end_time = start_time, elapsed_time = 0; \
-         elapsed_time == 0; \
-         elapsed_time = (end_time = os_get_elapsed_seconds()) - start_time, _profiler_report_time(STR(name), elapsed_time, start_time))
+    for (u64 _tm_depth = _profiler_open_scopes++, _tm_begin = rdtsc(), _tm_done = 0; \
+         !_tm_done; \
+         _tm_done = 1, _profiler_open_scopes = _tm_depth, _profiler_record(name, _tm_begin, rdtsc()))
+// These are also recorded as a tm_scope, so they show up in the trace and frame stats
 #define tm_scope_var(name, var) \
+    tm_scope(name) \
     for (f64 start_time = os_get_elapsed_seconds(), end_time = start_time, elapsed_time = 0; \
          elapsed_time == 0; \
          elapsed_time = (end_time = os_get_elapsed_seconds()) - start_time, var=elapsed_time)
 #define tm_scope_accum(name, var) \
+    tm_scope(name) \
     for (f64 start_time = os_get_elapsed_seconds(), end_time = start_time, elapsed_time = 0; \
          elapsed_time == 0; \
          elapsed_time = (end_time = os_get_elapsed_seconds()) - start_time, var+=elapsed_time)
@@ -61,4 +571,4 @@ void _profiler_report_time(string name, f64 count, f64 start) {
 	#define tm_scope(...)
 	#define tm_scope_var(...)
 	#define tm_scope_accum(...)
-#endif
\ No newline at end of file
+#endif
@@ -79,6 +79,29 @@ strings_match(string a, string b) {
 	// Count match, pointer match: they are the same
 	if (a.data == b.data) return true;
 
+#if ENABLE_SIMD && SIMD_ENABLE_SSE2
+	// Most strings we compare are short (names, paths), where calling memcmp costs more than
+	// the compare. Long strings go to memcmp which is already vectorized and unrolled.
+	if (a.count >= 16 && a.count <= 64) {
+		// 16 bytes at a time, the last load overlaps the previous one instead of a scalar tail
+		u64 last = a.count-16;
+		for (u64 i = 0; i < last; i += 16) {
+			__m128i va = _mm_loadu_si128((__m128i*)(a.data+i));
+			__m128i vb = _mm_loadu_si128((__m128i*)(b.data+i));
+			if (_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) != 0xFFFF) return false;
+		}
+		__m128i va = _mm_loadu_si128((__m128i*)(a.data+last));
+		__m128i vb = _mm_loadu_si128((__m128i*)(b.data+last));
+		return _mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) == 0xFFFF;
+	}
+	if (a.count >= 8 && a.count < 16) {
+		u64 a0, b0, a1, b1;
+		memcpy(&a0, a.data, 8); memcpy(&a1, a.data+a.count-8, 8);
+		memcpy(&b0, b.data, 8); memcpy(&b1, b.data+b.count-8, 8);
+		return a0 == b0 && a1 == b1;
+	}
+#endif
+
 	return memcmp(a.data, b.data, a.count) == 0;
 }
 
@@ -98,23 +121,32 @@ string_view(string s, u64 start_index, u64 count) {
 	return result;
 }
 
-// Returns first index from left where "sub" matches in "s". Returns -1 if no match is found.
+///
+// Substring search
+// The simd versions compare the first and last byte of sub against a block of candidate
+// positions at once and only memcmp the candidates where both match.
+// Which one is used is picked at startup by string_select_simd_procs().
+
 s64 
-string_find_from_left(string s, string sub) {
-	for (s64 i = 0; i <= s.count-sub.count; i++) {
-		if (strings_match(string_view(s, i, sub.count), sub)) {
+string_find_from_left_scalar(string s, string sub) {
+	if (sub.count > s.count) return -1;
+	if (sub.count == 0) return 0;
+	
+	for (u64 i = 0; i <= s.count-sub.count; i++) {
+		if (s.data[i] == sub.data[0] && memcmp(s.data+i, sub.data, sub.count) == 0) {
 			return i;
 		}
 	}
 	
 	return -1;
 }
-
-// Returns first index from right where "sub" matches in "s" Returns -1 if no match is found.
 s64 
-string_find_from_right(string s, string sub) {
-	for (s64 i = s.count-sub.count; i >= 0 ; i--) {
-		if (strings_match(string_view(s, i, sub.count), sub)) {
+string_find_from_right_scalar(string s, string sub) {
+	if (sub.count > s.count) return -1;
+	if (sub.count == 0) return s.count;
+	
+	for (s64 i = s.count-sub.count; i >= 0; i--) {
+		if (s.data[i] == sub.data[0] && memcmp(s.data+i, sub.data, sub.count) == 0) {
 			return i;
 		}
 	}
@@ -122,6 +154,155 @@ string_find_from_right(string s, string sub) {
 	return -1;
 }
 
+#if ENABLE_SIMD && SIMD_ENABLE_SSE2
+s64 
+string_find_from_left_sse2(string s, string sub) {
+	if (sub.count > s.count) return -1;
+	if (sub.count == 0) return 0;
+	
+	__m128i first = _mm_set1_epi8((char)sub.data[0]);
+	__m128i last  = _mm_set1_epi8((char)sub.data[sub.count-1]);
+	
+	u64 candidate_count = s.count-sub.count+1;
+	u64 i = 0;
+	for (; i+16 <= candidate_count; i += 16) {
+		__m128i block_first = _mm_loadu_si128((__m128i*)(s.data+i));
+		__m128i block_last  = _mm_loadu_si128((__m128i*)(s.data+i+sub.count-1));
+		u32 mask = (u32)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, block_first), _mm_cmpeq_epi8(last, block_last)));
+		while (mask) {
+			u64 index = i+bit_scan_forward_32(mask);
+			if (memcmp(s.data+index, sub.data, sub.count) == 0) return index;
+			mask &= mask-1;
+		}
+	}
+	for (; i < candidate_count; i++) {
+		if (s.data[i] == sub.data[0] && memcmp(s.data+i, sub.data, sub.count) == 0) return i;
+	}
+	
+	return -1;
+}
+s64 
+string_find_from_right_sse2(string s, string sub) {
+	if (sub.count > s.count) return -1;
+	if (sub.count == 0) return s.count;
+	
+	__m128i first = _mm_set1_epi8((char)sub.data[0]);
+	__m128i last  = _mm_set1_epi8((char)sub.data[sub.count-1]);
+	
+	// Candidates are [0, end)
+	u64 end = s.count-sub.count+1;
+	for (; end >= 16; end -= 16) {
+		u64 base = end-16;
+		__m128i block_first = _mm_loadu_si128((__m128i*)(s.data+base));
+		__m128i block_last  = _mm_loadu_si128((__m128i*)(s.data+base+sub.count-1));
+		u32 mask = (u32)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, block_first), _mm_cmpeq_epi8(last, block_last)));
+		while (mask) {
+			u32 bit = bit_scan_reverse_32(mask);
+			if (memcmp(s.data+base+bit, sub.data, sub.count) == 0) return base+bit;
+			mask &= ~(1u << bit);
+		}
+	}
+	for (s64 i = (s64)end-1; i >= 0; i--) {
+		if (s.data[i] == sub.data[0] && memcmp(s.data+i, sub.data, sub.count) == 0) return i;
+	}
+	
+	return -1;
+}
+#endif
+
+#if ENABLE_SIMD && COMPILER_CAN_TARGET_AVX2
+target_avx2 s64 
+string_find_from_left_avx2(string s, string sub) {
+	if (sub.count > s.count) return -1;
+	if (sub.count == 0) return 0;
+	
+	__m256i first = _mm256_set1_epi8((char)sub.data[0]);
+	__m256i last  = _mm256_set1_epi8((char)sub.data[sub.count-1]);
+	
+	u64 candidate_count = s.count-sub.count+1;
+	u64 i = 0;
+	for (; i+32 <= candidate_count; i += 32) {
+		__m256i block_first = _mm256_loadu_si256((__m256i*)(s.data+i));
+		__m256i block_last  = _mm256_loadu_si256((__m256i*)(s.data+i+sub.count-1));
+		u32 mask = (u32)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(first, block_first), _mm256_cmpeq_epi8(last, block_last)));
+		while (mask) {
+			u64 index = i+bit_scan_forward_32(mask);
+			if (memcmp(s.data+index, sub.data, sub.count) == 0) return index;
+			mask &= mask-1;
+		}
+	}
+	for (; i < candidate_count; i++) {
+		if (s.data[i] == sub.data[0] && memcmp(s.data+i, sub.data, sub.count) == 0) return i;
+	}
+	
+	return -1;
+}
+target_avx2 s64 
+string_find_from_right_avx2(string s, string sub) {
+	if (sub.count > s.count) return -1;
+	if (sub.count == 0) return s.count;
+	
+	__m256i first = _mm256_set1_epi8((char)sub.data[0]);
+	__m256i last  = _mm256_set1_epi8((char)sub.data[sub.count-1]);
+	
+	u64 end = s.count-sub.count+1;
+	for (; end >= 32; end -= 32) {
+		u64 base = end-32;
+		__m256i block_first = _mm256_loadu_si256((__m256i*)(s.data+base));
+		__m256i block_last  = _mm256_loadu_si256((__m256i*)(s.data+base+sub.count-1));
+		u32 mask = (u32)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(first, block_first), _mm256_cmpeq_epi8(last, block_last)));
+		while (mask) {
+			u32 bit = bit_scan_reverse_32(mask);
+			if (memcmp(s.data+base+bit, sub.data, sub.count) == 0) return base+bit;
+			mask &= ~(1u << bit);
+		}
+	}
+	for (s64 i = (s64)end-1; i >= 0; i--) {
+		if (s.data[i] == sub.data[0] && memcmp(s.data+i, sub.data, sub.count) == 0) return i;
+	}
+	
+	return -1;
+}
+#endif
+
+typedef s64(*String_Find_Proc)(string s, string sub);
+
+// #Global
+ogb_instance String_Find_Proc string_find_from_left_proc;
+ogb_instance String_Find_Proc string_find_from_right_proc;
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+#if ENABLE_SIMD && SIMD_ENABLE_SSE2
+String_Find_Proc string_find_from_left_proc  = string_find_from_left_sse2;
+String_Find_Proc string_find_from_right_proc = string_find_from_right_sse2;
+#else
+String_Find_Proc string_find_from_left_proc  = string_find_from_left_scalar;
+String_Find_Proc string_find_from_right_proc = string_find_from_right_scalar;
+#endif
+#endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
+
+void 
+string_select_simd_procs(Cpu_Capabilities features) {
+#if ENABLE_SIMD && COMPILER_CAN_TARGET_AVX2
+	if (features.avx2) {
+		string_find_from_left_proc  = string_find_from_left_avx2;
+		string_find_from_right_proc = string_find_from_right_avx2;
+	}
+#endif
+}
+
+// Returns first index from left where "sub" matches in "s". Returns -1 if no match is found.
+s64 
+string_find_from_left(string s, string sub) {
+	return string_find_from_left_proc(s, sub);
+}
+
+// Returns first index from right where "sub" matches in "s" Returns -1 if no match is found.
+s64 
+string_find_from_right(string s, string sub) {
+	return string_find_from_right_proc(s, sub);
+}
+
 bool 
 string_starts_with(string s, string sub) {
 	if (s.count < sub.count) return false;
@@ -154,12 +335,7 @@ string_builder_reserve(String_Builder *b, u64 required_capacity) {
 	if (b->buffer_capacity >= required_capacity) return;
 	
 	u64 new_capacity = max(b->buffer_capacity*2, (u64)(required_capacity*1.5));
-	u8 *new_buffer = alloc(b->allocator, new_capacity);
-	if (b->buffer) {
-		memcpy(new_buffer, b->buffer, b->count);
-		dealloc(b->allocator, b->buffer);
-	}
-	b->buffer = new_buffer;
+	b->buffer = reallocate(b->allocator, b->buffer, b->count, new_capacity);
 	b->buffer_capacity = new_capacity;
 }
 void 
@@ -192,6 +368,195 @@ string_builder_get_string(String_Builder b) {
 	return b.result;
 }
 
+/*
+	Gap_Buffer is for large text that is edited in place (console, log viewer, text fields).
+	
+	The text is stored as [before gap][gap][after gap]. Inserting or removing at the cursor
+	only touches the gap, moving the cursor by n characters moves n bytes. So editing near
+	the same place is amortized O(1) no matter how big the text is, unlike String_Builder
+	where every insert in the middle moves everything after it.
+	
+	Usage:
+	
+		Gap_Buffer text;
+		gap_buffer_init(&text, get_heap_allocator());
+		
+		gap_buffer_append(&text, STR("Hello world"));
+		gap_buffer_insert(&text, 5, STR(","));  // "Hello, world"
+		gap_buffer_remove(&text, 0, 7);         // "world"
+		
+		// Zero copy, gives at most two views
+		u64 iterator = 0;
+		string view;
+		while (gap_buffer_iterate(&text, 0, gap_buffer_count(&text), &iterator, &view)) {
+			os_write_string_to_stdout(view);
+		}
+		
+		// Contiguous view, moves the gap to the end. Valid until the next edit.
+		string s = gap_buffer_flatten(&text);
+		
+		gap_buffer_deinit(&text);
+*/
+
+#define GAP_BUFFER_MIN_GAP 64
+
+typedef struct Gap_Buffer {
+	u8 *buffer;
+	u64 capacity;
+	u64 gap_start;
+	u64 gap_end;
+	Allocator allocator;
+} Gap_Buffer;
+
+inline u64 
+gap_buffer_count(Gap_Buffer *g) {
+	return g->capacity - (g->gap_end - g->gap_start);
+}
+
+void 
+gap_buffer_init_reserve(Gap_Buffer *g, u64 reserved_capacity, Allocator allocator) {
+	reserved_capacity = max(reserved_capacity, GAP_BUFFER_MIN_GAP);
+	g->allocator = allocator;
+	g->buffer = alloc(allocator, reserved_capacity);
+	g->capacity = reserved_capacity;
+	g->gap_start = 0;
+	g->gap_end = reserved_capacity;
+}
+void 
+gap_buffer_init(Gap_Buffer *g, Allocator allocator) {
+	gap_buffer_init_reserve(g, 128, allocator);
+}
+void 
+gap_buffer_deinit(Gap_Buffer *g) {
+	dealloc(g->allocator, g->buffer);
+	*g = ZERO(Gap_Buffer);
+}
+void 
+gap_buffer_clear(Gap_Buffer *g) {
+	g->gap_start = 0;
+	g->gap_end = g->capacity;
+}
+
+// Moves the gap so it starts at index (in text characters, not buffer bytes)
+void 
+gap_buffer_move_gap(Gap_Buffer *g, u64 index) {
+	assert(index <= gap_buffer_count(g), "Gap_Buffer index %llu out of range (count %llu)", index, gap_buffer_count(g));
+	
+	u64 gap = g->gap_end - g->gap_start;
+	if (index < g->gap_start) {
+		u64 n = g->gap_start - index;
+		memmove(g->buffer + g->gap_end - n, g->buffer + index, n);
+	} else if (index > g->gap_start) {
+		u64 n = index - g->gap_start;
+		memmove(g->buffer + g->gap_start, g->buffer + g->gap_end, n);
+	}
+	g->gap_start = index;
+	g->gap_end = index + gap;
+}
+
+void 
+gap_buffer_reserve_gap(Gap_Buffer *g, u64 required_gap) {
+	u64 gap = g->gap_end - g->gap_start;
+	if (gap >= required_gap) return;
+	
+	u64 count = gap_buffer_count(g);
+	u64 new_capacity = max(g->capacity*2, count + required_gap + GAP_BUFFER_MIN_GAP);
+	u64 after_count = g->capacity - g->gap_end;
+	
+	g->buffer = reallocate(g->allocator, g->buffer, g->capacity, new_capacity);
+	
+	u64 new_gap_end = new_capacity - after_count;
+	memmove(g->buffer + new_gap_end, g->buffer + g->gap_end, after_count);
+	g->gap_end = new_gap_end;
+	g->capacity = new_capacity;
+}
+
+void 
+gap_buffer_insert(Gap_Buffer *g, u64 index, string s) {
+	assert(g->allocator.proc, "Gap_Buffer is missing allocator");
+	if (s.count == 0) return;
+	
+	gap_buffer_move_gap(g, index);
+	gap_buffer_reserve_gap(g, s.count);
+	
+	memcpy(g->buffer + g->gap_start, s.data, s.count);
+	g->gap_start += s.count;
+}
+void 
+gap_buffer_append(Gap_Buffer *g, string s) {
+	gap_buffer_insert(g, gap_buffer_count(g), s);
+}
+void 
+gap_buffer_remove(Gap_Buffer *g, u64 index, u64 count) {
+	assert(index + count <= gap_buffer_count(g), "Gap_Buffer remove range %llu..%llu out of range (count %llu)", index, index+count, gap_buffer_count(g));
+	if (count == 0) return;
+	
+	// Deleting at the end of the gap (backspace) or at the start of it (delete) moves nothing
+	if (index + count == g->gap_start) {
+		g->gap_start -= count;
+	} else {
+		gap_buffer_move_gap(g, index);
+		g->gap_end += count;
+	}
+}
+
+inline u8 
+gap_buffer_get(Gap_Buffer *g, u64 index) {
+	assert(index < gap_buffer_count(g), "Gap_Buffer index %llu out of range (count %llu)", index, gap_buffer_count(g));
+	return index < g->gap_start ? g->buffer[index] : g->buffer[index + (g->gap_end - g->gap_start)];
+}
+
+// Gives views into the text range [start, start+count), at most one per side of the gap.
+// Set *iterator to 0 before the first call. Views are valid until the next edit.
+bool 
+gap_buffer_iterate(Gap_Buffer *g, u64 start, u64 count, u64 *iterator, string *view) {
+	assert(start + count <= gap_buffer_count(g), "Gap_Buffer range %llu..%llu out of range (count %llu)", start, start+count, gap_buffer_count(g));
+	if (count == 0) return false;
+	
+	u64 end = start + count;
+	
+	if (*iterator == 0) {
+		*iterator = 1;
+		if (start < g->gap_start) {
+			view->data = g->buffer + start;
+			view->count = min(end, g->gap_start) - start;
+			return true;
+		}
+	}
+	if (*iterator == 1) {
+		*iterator = 2;
+		if (end > g->gap_start) {
+			u64 first = max(start, g->gap_start);
+			view->data = g->buffer + first + (g->gap_end - g->gap_start);
+			view->count = end - first;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Moves the gap to the end and returns all text as one view. Valid until the next edit.
+string 
+gap_buffer_flatten(Gap_Buffer *g) {
+	gap_buffer_move_gap(g, gap_buffer_count(g));
+	return (string){g->gap_start, g->buffer};
+}
+
+// Copies [start, start+count) into a new string, leaves the gap where it is
+string 
+gap_buffer_copy_range(Gap_Buffer *g, u64 start, u64 count, Allocator allocator) {
+	if (count == 0) return null_string;
+	string result = alloc_string(allocator, count);
+	u64 at = 0;
+	u64 iterator = 0;
+	string view;
+	while (gap_buffer_iterate(g, start, count, &iterator, &view)) {
+		memcpy(result.data + at, view.data, view.count);
+		at += view.count;
+	}
+	return result;
+}
+
 
 string 
 string_replace_all(string s, string old, string new, Allocator allocator) {
@@ -201,16 +566,22 @@ string_replace_all(string s, string old, string new, Allocator allocator) {
 	String_Builder builder;
 	string_builder_init_reserve(&builder, s.count, allocator);
 	
+	if (old.count == 0) {
+		string_builder_append(&builder, s);
+		return string_builder_get_string(builder);
+	}
+	
 	while (s.count > 0) {
-		if (s.count >= old.count && strings_match(string_view(s, 0, old.count), old)) {
-			if (new.count != 0) string_builder_append(&builder, new);
-			s.data += old.count;
-			s.count -= old.count;
-		} else {
-			string_builder_append(&builder, string_view(s, 0, 1));
-			s.data += 1;
-			s.count -= 1;
+		s64 index = string_find_from_left(s, old);
+		if (index < 0) {
+			string_builder_append(&builder, s);
+			break;
 		}
+		
+		if (index > 0) string_builder_append(&builder, string_view(s, 0, index));
+		if (new.count != 0) string_builder_append(&builder, new);
+		s.data += index+old.count;
+		s.count -= index+old.count;
 	}
 	
 	return string_builder_get_string(builder);
@@ -218,6 +589,20 @@ string_replace_all(string s, string old, string new, Allocator allocator) {
 	
 string
 string_trim_left(string s) {
+#if ENABLE_SIMD && SIMD_ENABLE_SSE2
+	__m128i spaces = _mm_set1_epi8(' ');
+	while (s.count >= 16) {
+		u32 mask = (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((__m128i*)s.data), spaces));
+		if (mask != 0xFFFF) {
+			u32 first_non_space = bit_scan_forward_32(~mask & 0xFFFF);
+			s.data += first_non_space;
+			s.count -= first_non_space;
+			return s;
+		}
+		s.data += 16;
+		s.count -= 16;
+	}
+#endif
 	while (s.count > 0 && *s.data == ' ') {
 		s.data += 1;
 		s.count -= 1;
@@ -226,7 +611,18 @@ string_trim_left(string s) {
 }
 string
 string_trim_right(string s) {
-
+#if ENABLE_SIMD && SIMD_ENABLE_SSE2
+	__m128i spaces = _mm_set1_epi8(' ');
+	while (s.count >= 16) {
+		u32 mask = (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((__m128i*)(s.data+s.count-16)), spaces));
+		if (mask != 0xFFFF) {
+			u32 last_non_space = bit_scan_reverse_32(~mask & 0xFFFF);
+			s.count = s.count-16+last_non_space+1;
+			return s;
+		}
+		s.count -= 16;
+	}
+#endif
 	while (s.count > 0 && s.data[s.count-1] == ' ') {
 		s.count -= 1;
 	}
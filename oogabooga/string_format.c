@@ -26,6 +26,11 @@
 		
 	Also includes all of the standard C printf-like format specifiers:
 	https://www.geeksforgeeks.org/format-specifiers-in-c/
+	
+	Integers, %f, strings, chars, bools and vectors are formatted here with flags, width,
+	precision and length modifiers (%-8s, %08.3f, %llu, %zu, %I64x ...). Precision also works
+	on vectors, %.2v2. Only %e, %g, %a, %p and %f with a precision above 9 or values above
+	1e18 go through the CRT vsnprintf.
 */
 
 ogb_instance void os_write_string_to_stdout(string s);
@@ -33,7 +38,499 @@ inline int crt_sprintf(char *str, const char *format, ...);
 int vsnprintf(char* buffer, size_t n, const char* fmt, va_list args);
 bool is_pointer_valid(void *p);
 
-u64 format_string_to_buffer(char* buffer, u64 count, const char* fmt, va_list args);
+// Same layout as Vector2/3/4 so va_arg picks the same registers (floats, not bytes) on SysV
+typedef struct Format_Vector2_Arg {f32 _[2];} Format_Vector2_Arg;
+typedef struct Format_Vector3_Arg {f32 _[3];} Format_Vector3_Arg;
+typedef struct Format_Vector4_Arg {f32 _[4];} Format_Vector4_Arg;
+
+// Formatting writes through a Format_Writer. It writes into buffer until it's full, then either
+// calls flush (if set) and starts over at the start of the buffer, or drops the rest.
+// total is always the full formatted length so you can format once with a small buffer and
+// only format again if it didn't fit. Buffer can be 0 to only count.
+typedef void(*Format_Flush_Proc)(string s, void *data);
+typedef struct Format_Writer {
+	char *buffer;
+	u64 capacity; // Including null terminator
+	u64 at;
+	u64 total;
+	Format_Flush_Proc flush;
+	void *flush_data;
+} Format_Writer;
+
+typedef struct Format_Spec {
+	bool left_align;
+	bool zero_pad;
+	bool plus_sign;
+	bool space_sign;
+	bool alternate;
+	u64 width;
+	s64 precision; // -1 if not specified
+} Format_Spec;
+
+Format_Writer make_format_writer(char *buffer, u64 capacity) {
+	Format_Writer w = ZERO(Format_Writer);
+	w.buffer = capacity ? buffer : 0;
+	w.capacity = capacity;
+	return w;
+}
+
+// Null terminates and flushes whatever is left in the buffer
+void format_writer_finish(Format_Writer *w) {
+	if (!w->buffer || !w->capacity) return;
+	w->buffer[w->at] = 0;
+	if (w->flush && w->at) {
+		w->flush((string){w->at, (u8*)w->buffer}, w->flush_data);
+		w->at = 0;
+	}
+}
+
+void format_writer_put(Format_Writer *w, const void *data, u64 n) {
+	w->total += n;
+	if (!w->buffer) return;
+	if (w->at + n < w->capacity) {
+		memcpy(w->buffer + w->at, data, n);
+		w->at += n;
+		return;
+	}
+	const char *p = (const char*)data;
+	while (n) {
+		u64 space = w->capacity - 1 - w->at;
+		if (space == 0) {
+			if (!w->flush) return;
+			w->flush((string){w->at, (u8*)w->buffer}, w->flush_data);
+			w->at = 0;
+			continue;
+		}
+		u64 c = min(n, space);
+		memcpy(w->buffer + w->at, p, c);
+		w->at += c;
+		p += c;
+		n -= c;
+	}
+}
+
+void format_writer_put_repeat(Format_Writer *w, char c, u64 n) {
+	char chunk[32];
+	memset(chunk, c, min(n, sizeof(chunk)));
+	while (n) {
+		u64 k = min(n, sizeof(chunk));
+		format_writer_put(w, chunk, k);
+		n -= k;
+	}
+}
+
+// Writes prefix (sign, 0x) and body padded to the spec width. Zero padding goes between them.
+void format_writer_put_padded(Format_Writer *w, Format_Spec spec, const char *prefix, u64 prefix_count, const char *body, u64 body_count) {
+	u64 count = prefix_count + body_count;
+	u64 pad = spec.width > count ? spec.width - count : 0;
+	
+	if (pad && !spec.left_align && !spec.zero_pad) format_writer_put_repeat(w, ' ', pad);
+	format_writer_put(w, prefix, prefix_count);
+	if (pad && !spec.left_align && spec.zero_pad)  format_writer_put_repeat(w, '0', pad);
+	format_writer_put(w, body, body_count);
+	if (pad && spec.left_align) format_writer_put_repeat(w, ' ', pad);
+}
+
+const char format_digit_pairs[201] =
+	"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+	"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+// Writes digits backwards ending at end, returns pointer to first digit
+char *format_u64_digits(char *end, u64 x, u32 base, bool upper) {
+	char *p = end;
+	if (base == 10) {
+		while (x >= 100) {
+			u64 pair = (x % 100)*2;
+			x /= 100;
+			p -= 2;
+			p[0] = format_digit_pairs[pair];
+			p[1] = format_digit_pairs[pair+1];
+		}
+		if (x >= 10) {
+			p -= 2;
+			p[0] = format_digit_pairs[x*2];
+			p[1] = format_digit_pairs[x*2+1];
+		} else {
+			*--p = (char)('0' + x);
+		}
+	} else {
+		const char *digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+		do {
+			*--p = digits[x % base];
+			x /= base;
+		} while (x);
+	}
+	return p;
+}
+
+void format_integer(Format_Writer *w, Format_Spec spec, u64 magnitude, bool negative, u32 base, bool upper) {
+	char digits_buffer[96];
+	char *end = digits_buffer + sizeof(digits_buffer);
+	char *digits = end;
+	
+	// Precision 0 with value 0 prints no digits, like printf
+	if (magnitude != 0 || spec.precision != 0) digits = format_u64_digits(end, magnitude, base, upper);
+	
+	if (spec.precision >= 0) {
+		u64 min_digits = min((u64)spec.precision, sizeof(digits_buffer)-1);
+		while ((u64)(end-digits) < min_digits) *--digits = '0';
+		spec.zero_pad = false;
+	}
+	
+	char prefix[2];
+	u64 prefix_count = 0;
+	if (negative)             prefix[prefix_count++] = '-';
+	else if (spec.plus_sign)  prefix[prefix_count++] = '+';
+	else if (spec.space_sign) prefix[prefix_count++] = ' ';
+	
+	if (spec.alternate && magnitude != 0) {
+		if (base == 16) {
+			prefix[0] = '0';
+			prefix[1] = upper ? 'X' : 'x';
+			prefix_count = 2;
+		} else if (base == 8 && *digits != '0') {
+			*--digits = '0';
+		}
+	}
+	
+	format_writer_put_padded(w, spec, prefix, prefix_count, digits, end-digits);
+}
+
+// Formats like %.Nf, but only when it can guarantee the same digits as a correctly rounding
+// CRT. Returns false when the caller should fall back to the CRT (very large values, high
+// precision or values that are within rounding error of a tie).
+bool format_float64_fixed(Format_Writer *w, Format_Spec spec, float64 x) {
+	local_persist const u64 powers_of_ten[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000};
+	
+	u64 bits;
+	memcpy(&bits, &x, sizeof(bits));
+	bool negative = (bits >> 63) != 0;
+	float64 ax = negative ? -x : x;
+	
+	char prefix[1];
+	u64 prefix_count = 0;
+	if (negative)             prefix[prefix_count++] = '-';
+	else if (spec.plus_sign)  prefix[prefix_count++] = '+';
+	else if (spec.space_sign) prefix[prefix_count++] = ' ';
+	
+	if (ax != ax || ax > 1.7976931348623157e308) {
+		spec.zero_pad = false;
+		const char *s = ax != ax ? "nan" : "inf";
+		format_writer_put_padded(w, spec, prefix, prefix_count, s, 3);
+		return true;
+	}
+	
+	u64 precision = spec.precision < 0 ? 6 : (u64)spec.precision;
+	if (precision >= sizeof(powers_of_ten)/sizeof(powers_of_ten[0]) || ax >= 1e18) return false;
+	
+	u64 whole = (u64)ax;
+	float64 fraction = ax - (float64)whole; // Exact
+	u64 scale = powers_of_ten[precision];
+	float64 scaled = fraction * (float64)scale;
+	u64 rounded = (u64)scaled;
+	float64 remainder = scaled - (float64)rounded;
+	
+	// The multiplication rounds, so close to a tie we can't tell which side we're really on
+	if (remainder > 0.5-1e-6 && remainder < 0.5+1e-6) return false;
+	
+	if (remainder > 0.5) rounded += 1;
+	if (rounded >= scale) {
+		rounded -= scale;
+		whole += 1;
+	}
+	
+	char body[64];
+	char *end = body + sizeof(body);
+	char *p = end;
+	if (precision) {
+		char *fraction_start = end - precision;
+		p = format_u64_digits(end, rounded, 10, false);
+		while (p > fraction_start) *--p = '0';
+	}
+	if (precision || spec.alternate) *--p = '.';
+	p = format_u64_digits(p, whole, 10, false);
+	
+	format_writer_put_padded(w, spec, prefix, prefix_count, p, end-p);
+	return true;
+}
+
+// For anything we don't format ourselves (%e, %g, %a, %p ...). Spec must be a single specifier.
+void format_with_crt(Format_Writer *w, const char *spec_start, u64 spec_count, ...) {
+	char spec[64];
+	char result[512];
+	if (spec_count >= sizeof(spec)) return;
+	memcpy(spec, spec_start, spec_count);
+	spec[spec_count] = 0;
+	
+	va_list args;
+	va_start(args, spec_count);
+	int n = vsnprintf(result, sizeof(result), spec, args);
+	va_end(args);
+	
+	if (n > 0) format_writer_put(w, result, min((u64)n, sizeof(result)-1));
+}
+
+void format_float64(Format_Writer *w, Format_Spec spec, float64 x, char conversion) {
+	if (conversion == 'f' && format_float64_fixed(w, spec, x)) return;
+	
+	// Width and precision are already resolved (they may have come from '*')
+	char crt_spec[64];
+	Format_Writer sw = make_format_writer(crt_spec, sizeof(crt_spec));
+	format_writer_put(&sw, "%", 1);
+	if (spec.left_align) format_writer_put(&sw, "-", 1);
+	if (spec.zero_pad)   format_writer_put(&sw, "0", 1);
+	if (spec.plus_sign)  format_writer_put(&sw, "+", 1);
+	if (spec.space_sign) format_writer_put(&sw, " ", 1);
+	if (spec.alternate)  format_writer_put(&sw, "#", 1);
+	char digits_buffer[32];
+	char *end = digits_buffer + sizeof(digits_buffer);
+	if (spec.width) {
+		char *d = format_u64_digits(end, spec.width, 10, false);
+		format_writer_put(&sw, d, end-d);
+	}
+	if (spec.precision >= 0) {
+		format_writer_put(&sw, ".", 1);
+		char *d = format_u64_digits(end, (u64)spec.precision, 10, false);
+		format_writer_put(&sw, d, end-d);
+	}
+	format_writer_put(&sw, &conversion, 1);
+	format_writer_finish(&sw);
+	
+	format_with_crt(w, crt_spec, sw.at, x);
+}
+
+void format_vector(Format_Writer *w, Format_Spec spec, f32 *v, u64 n) {
+	local_persist const char *names[] = {"X", "Y", "Z", "W"};
+	Format_Spec component = spec;
+	component.width = 0;
+	format_writer_put(w, "{ ", 2);
+	for (u64 i = 0; i < n; i++) {
+		if (i) format_writer_put(w, ", ", 2);
+		format_writer_put(w, names[i], 1);
+		format_writer_put(w, ": ", 2);
+		format_float64(w, component, (float64)v[i], 'f');
+	}
+	format_writer_put(w, " }", 2);
+}
+
+void format_c_string(Format_Writer *w, Format_Spec spec, const char *s) {
+	if (!s) s = "(null)";
+	u64 len = 0;
+	u64 max_len = spec.precision >= 0 ? (u64)spec.precision : (1024ULL*1024ULL*1024ULL*1ULL);
+	while (len < max_len && s[len] != '\0') len += 1;
+	assert(len < (1024ULL*1024ULL*1024ULL*1ULL), "The argument passed to %%cs is either way too big, missing null-termination or simply not a char*.");
+	spec.zero_pad = false;
+	format_writer_put_padded(w, spec, 0, 0, s, len);
+}
+
+void format_string_to_writer(Format_Writer *w, string fmt, va_list args) {
+	const char *p = (const char*)fmt.data;
+	const char *fmt_end = p + fmt.count;
+	
+	while (p < fmt_end) {
+		const char *next = p;
+		while (next < fmt_end && *next != '%') next += 1;
+		format_writer_put(w, p, next-p);
+		p = next;
+		if (p >= fmt_end) break;
+		
+		const char *spec_start = p;
+		p += 1;
+		if (p >= fmt_end) break;
+		if (*p == '%') {
+			format_writer_put(w, "%", 1);
+			p += 1;
+			continue;
+		}
+		
+		Format_Spec spec = ZERO(Format_Spec);
+		spec.precision = -1;
+		
+		for (bool is_flag = true; is_flag && p < fmt_end;) {
+			switch (*p) {
+				case '-': spec.left_align = true; break;
+				case '0': spec.zero_pad   = true; break;
+				case '+': spec.plus_sign  = true; break;
+				case ' ': spec.space_sign = true; break;
+				case '#': spec.alternate  = true; break;
+				default:  is_flag = false; continue;
+			}
+			p += 1;
+		}
+		
+		if (p < fmt_end && *p == '*') {
+			int width = va_arg(args, int);
+			if (width < 0) {
+				spec.left_align = true;
+				width = -width;
+			}
+			spec.width = (u64)width;
+			p += 1;
+		} else {
+			while (p < fmt_end && *p >= '0' && *p <= '9') spec.width = spec.width*10 + (*p++ - '0');
+		}
+		
+		if (p < fmt_end && *p == '.') {
+			p += 1;
+			spec.precision = 0;
+			if (p < fmt_end && *p == '*') {
+				int precision = va_arg(args, int);
+				spec.precision = precision < 0 ? -1 : precision;
+				p += 1;
+			} else {
+				while (p < fmt_end && *p >= '0' && *p <= '9') spec.precision = spec.precision*10 + (*p++ - '0');
+			}
+		}
+		if (spec.left_align) spec.zero_pad = false;
+		
+		// Argument size in bytes for integers, 0 means default (int)
+		u64 int_size = 0;
+		bool long_double = false;
+		if (p < fmt_end) {
+			if (*p == 'h') {
+				p += 1;
+				int_size = sizeof(short);
+				if (p < fmt_end && *p == 'h') { p += 1; int_size = sizeof(char); }
+			} else if (*p == 'l') {
+				p += 1;
+				int_size = sizeof(long);
+				if (p < fmt_end && *p == 'l') { p += 1; int_size = sizeof(long long); }
+			} else if (*p == 'z' || *p == 't') {
+				p += 1;
+				int_size = sizeof(size_t);
+			} else if (*p == 'j') {
+				p += 1;
+				int_size = sizeof(long long);
+			} else if (*p == 'L') {
+				p += 1;
+				long_double = true;
+			} else if (*p == 'I' && p+2 < fmt_end && p[1] == '6' && p[2] == '4') {
+				// MSVC %I64x
+				p += 3;
+				int_size = 8;
+			} else if (*p == 'I' && p+2 < fmt_end && p[1] == '3' && p[2] == '2') {
+				p += 3;
+				int_size = 4;
+			}
+		}
+		if (p >= fmt_end) break;
+		
+		char conversion = *p++;
+		
+		switch (conversion) {
+			case 'd': case 'i': {
+				s64 x;
+				if      (int_size == 8) x = va_arg(args, s64);
+				else if (int_size == 2) x = (s16)va_arg(args, int);
+				else if (int_size == 1) x = (s8)va_arg(args, int);
+				else                    x = va_arg(args, int);
+				u64 magnitude = x < 0 ? (u64)0 - (u64)x : (u64)x;
+				format_integer(w, spec, magnitude, x < 0, 10, false);
+				break;
+			}
+			case 'u': case 'x': case 'X': case 'o': {
+				u64 x;
+				if      (int_size == 8) x = va_arg(args, u64);
+				else if (int_size == 2) x = (u16)va_arg(args, unsigned int);
+				else if (int_size == 1) x = (u8)va_arg(args, unsigned int);
+				else                    x = va_arg(args, unsigned int);
+				u32 base = conversion == 'u' ? 10 : conversion == 'o' ? 8 : 16;
+				format_integer(w, spec, x, false, base, conversion == 'X');
+				break;
+			}
+			case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A': {
+				float64 x = long_double ? (float64)va_arg(args, long double) : va_arg(args, float64);
+				format_float64(w, spec, x, conversion);
+				break;
+			}
+			case 's': {
+				// We replace %s formatting with our fixed length string (if it is a valid such, otherwise treat as char*)
+				va_list args2; // C varargs are so good
+				va_copy(args2, args);
+				string s = va_arg(args2, string);
+				va_end(args2);
+				// Ooga booga moment
+				bool is_valid_fixed_length_string = s.count < 1024ULL*1024ULL*1024ULL*256ULL && is_pointer_valid(s.data);
+				if (is_valid_fixed_length_string) {
+					va_arg(args, string);
+					u64 count = spec.precision >= 0 ? min(s.count, (u64)spec.precision) : s.count;
+					spec.zero_pad = false;
+					format_writer_put_padded(w, spec, 0, 0, (const char*)s.data, count);
+				} else {
+					format_c_string(w, spec, va_arg(args, char*));
+				}
+				break;
+			}
+			case 'c': {
+				if (p < fmt_end && *p == 's') {
+					// We extend the standard formatting and add %cs so we can format c strings if we need to
+					p += 1;
+					format_c_string(w, spec, va_arg(args, char*));
+				} else {
+					char c = (char)va_arg(args, int);
+					spec.zero_pad = false;
+					format_writer_put_padded(w, spec, 0, 0, &c, 1);
+				}
+				break;
+			}
+			case 'b': {
+				int data = va_arg(args, int);
+				const char *result = data ? "true" : "false";
+				spec.zero_pad = false;
+				format_writer_put_padded(w, spec, 0, 0, result, data ? 4 : 5);
+				break;
+			}
+			case 'v': {
+				char n = p < fmt_end ? *p : 0;
+				if (n == '2') {
+					Format_Vector2_Arg data = va_arg(args, Format_Vector2_Arg);
+					format_vector(w, spec, data._, 2);
+				} else if (n == '3') {
+					Format_Vector3_Arg data = va_arg(args, Format_Vector3_Arg);
+					format_vector(w, spec, data._, 3);
+				} else if (n == '4') {
+					Format_Vector4_Arg data = va_arg(args, Format_Vector4_Arg);
+					format_vector(w, spec, data._, 4);
+				} else {
+					// Not a vector, print as is
+					format_writer_put(w, spec_start, p-spec_start);
+					break;
+				}
+				p += 1;
+				break;
+			}
+			case 'p': {
+				format_with_crt(w, spec_start, p-spec_start, va_arg(args, void*));
+				break;
+			}
+			case 'n': {
+				if      (int_size == 8) *va_arg(args, s64*) = (s64)w->total;
+				else if (int_size == 2) *va_arg(args, s16*) = (s16)w->total;
+				else if (int_size == 1) *va_arg(args, s8*)  = (s8)w->total;
+				else                    *va_arg(args, int*) = (int)w->total;
+				break;
+			}
+			default: {
+				// Unknown specifier, print as is
+				format_writer_put(w, spec_start, p-spec_start);
+				break;
+			}
+		}
+	}
+	
+	format_writer_finish(w);
+}
+
+// Returns the number of characters written, excluding the null terminator.
+// Pass buffer 0 to get the formatted length.
+u64 format_string_to_buffer(char* buffer, u64 count, const char* fmt, va_list args) {
+	if (!buffer) count = UINT64_MAX;
+	if (count == 0) return 0;
+	Format_Writer w = make_format_writer(buffer, count);
+	format_string_to_writer(&w, (string){strlen(fmt), (u8*)fmt}, args);
+	return min(w.total, count-1);
+}
 u64 format_string_to_buffer_vararg(char* buffer, u64 count, const char* fmt, ...) {
 	va_list args;
 	va_start(args, fmt);
@@ -41,159 +538,6 @@ u64 format_string_to_buffer_vararg(char* buffer, u64 count, const char* fmt, ...
 	va_end(args);
 	return n;
 }
-typedef struct _8_Bytes {u8 _[8];} _8_Bytes;
-typedef struct _12_Bytes {u8 _[12];} _12_Bytes;
-typedef struct _16_Bytes {u8 _[16];} _16_Bytes;
-u64 format_string_to_buffer(char* buffer, u64 count, const char* fmt, va_list args) {
-	if (!buffer) count = UINT64_MAX;
-    const char* p = fmt;
-    char* bufp = buffer;
-    while (*p != '\0' && (bufp - buffer) < count - 1) {
-        if (*p == '%') {
-            p += 1;
-            if (*p == 's') {
-            	p += 1;
-            	// We replace %s formatting with our fixed length string (if it is a valid such, otherwise treat as char*)
-				va_list args2; // C varargs are so good
-				va_copy(args2, args);
-                string s = va_arg(args2, string);
-                va_end(args2);
-            	// Ooga booga moment
-            	bool is_valid_fixed_length_string = s.count < 1024ULL*1024ULL*1024ULL*256ULL && is_pointer_valid(s.data);
-            	if (is_valid_fixed_length_string) {
-            		va_arg(args, string);
-	                for (u64 i = 0; i < s.count && (bufp - buffer) < count - 1; i++) {
-	                	if (buffer) *bufp = s.data[i];
-	                    bufp += 1;
-	                }
-                } else {
-	            	// #Copypaste
-	            	// We extend the standard formatting and add %cs so we can format c strings if we need to
-	                char* s = va_arg(args, char*);
-	                u64 len = 0;
-	                while (*s != '\0' && (bufp - buffer) < count - 1) {
-	                	assert(len < (1024ULL*1024ULL*1024ULL*1ULL), "The argument passed to %%cs is either way too big, missing null-termination or simply not a char*.");
-	                	if (buffer) {
-	                		*bufp = *s;
-	                	}
-	                	s += 1;
-	                    bufp += 1;
-	                    len += 1;
-	                    assert(len < (1024ULL*1024ULL*1024ULL*1ULL), "The argument passed to %%cs is either way too big, missing null-termination or simply not a char*.");
-                    }
-                }
-            } else if (*p == 'c' && *(p+1) == 's') {
-            	// #Copypaste
-            	// We extend the standard formatting and add %cs so we can format c strings if we need to
-                p += 2;
-                char* s = va_arg(args, char*);
-                u64 len = 0;
-                while (*s != '\0' && (bufp - buffer) < count - 1) {
-                	assert(len < (1024ULL*1024ULL*1024ULL*1ULL), "The argument passed to %%cs is either way too big, missing null-termination or simply not a char*.");
-                	if (buffer) {
-                		*bufp = *s;
-                	}
-                	s += 1;
-                    bufp += 1;
-                    len += 1;
-                    assert(len < (1024ULL*1024ULL*1024ULL*1ULL), "The argument passed to %%cs is either way too big, missing null-termination or simply not a char*.");
-                }
-            } else if (*p == 'b') {
-            	p += 1;
-            	int data = va_arg(args, int);
-            	bool val = !(data == 0);
-            	
-            	char *result = (val ? "true" : "false");
-            	
-            	if (buffer) {
-            		memcpy(bufp, result, strlen(result));
-            	}
-        		bufp += strlen(result);
-            	
-            } else if (*p == 'v' && *(p+1) == '2') {
-            	p += 2;
-            	
-            	_8_Bytes data = va_arg(args, _8_Bytes);
-            	
-            	f32 x = *(((f32*)(&data))+0);
-            	f32 y = *(((f32*)(&data))+1);
-            	
-                u64 n = format_string_to_buffer_vararg(buffer ? bufp : 0, 128, "{ X: %f, Y: %f }", x, y);
-                
-                bufp += n;
-            } else if (*p == 'v' && *(p+1) == '3') {
-            	p += 2;
-            	
-            	_12_Bytes data = va_arg(args, _12_Bytes);
-            	
-            	f32 x = *(((f32*)(&data))+0);
-            	f32 y = *(((f32*)(&data))+1);
-            	f32 z = *(((f32*)(&data))+2);
-            	
-                u64 n = format_string_to_buffer_vararg(buffer ? bufp : 0, 196, "{ X: %f, Y: %f, Z: %f }", x, y, z);
-                
-                bufp += n;
-            } else if (*p == 'v' && *(p+1) == '4') {
-            	p += 2;
-            	
-            	_16_Bytes data = va_arg(args, _16_Bytes);
-            	
-            	f32 x = *(((f32*)(&data))+0);
-            	f32 y = *(((f32*)(&data))+1);
-            	f32 z = *(((f32*)(&data))+2);
-            	f32 w = *(((f32*)(&data))+3);
-            	
-                u64 n = format_string_to_buffer_vararg(buffer ? bufp : 0, 256, "{ X: %f, Y: %f, Z: %f, W: %f }", x, y, z, w);
-                
-                bufp += n;
-            } else {
-                // Fallback to standard vsnprintf
-                char temp_buffer[512];
-                char format_specifier[64];
-                int specifier_len = 0;
-                format_specifier[specifier_len++] = '%';
-
-                while (*p != '\0' && strchr("diuoxXfFeEgGaAcCpn%", *p) == NULL) {
-                    format_specifier[specifier_len++] = *p++;
-                }
-                if (*p != '\0') {
-                    format_specifier[specifier_len++] = *p++;
-                }
-                format_specifier[specifier_len] = '\0';
-
-                int temp_len = vsnprintf(temp_buffer, sizeof(temp_buffer), format_specifier, args);
-                switch (format_specifier[specifier_len - 1]) {
-                    case 'd': case 'i': va_arg(args, int); break;
-                    case 'u': case 'x': case 'X': case 'o': va_arg(args, unsigned int); break;
-                    case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A': va_arg(args, double); break;
-                    case 'c': va_arg(args, int); break;
-                    case 's': va_arg(args, char*); break;
-                    case 'p': va_arg(args, void*); break;
-                    case 'n': va_arg(args, int*); break;
-                    default: break;
-                }
-                
-                if (temp_len < 0) {
-                    return -1; // Error in formatting
-                }
-
-                for (int i = 0; i < temp_len && (bufp - buffer) < count - 1; i++) {
-                    if (buffer) *bufp = temp_buffer[i];
-                    bufp += 1;
-                }
-            }
-        } else {
-            if (buffer) {
-                *bufp = *p;
-            }
-            bufp += 1;
-            p += 1;
-        }
-    }
-    if (buffer)  *bufp = '\0';
-    
-    return bufp - buffer;
-}
 u64 format_string_to_buffer_va(char* buffer, u64 count, const char* fmt, ...) {
 	va_list args;
 	va_start(args, fmt);
@@ -216,21 +560,34 @@ string sprint_null_terminated_string_va_list_to_buffer(const char *fmt, va_list
     return result;
 }
 string sprint_va_list_to_buffer(const string fmt, va_list args, void* buffer, u64 buffer_size) {
-	
-	char* fmt_cstring = temp_convert_to_null_terminated_string(fmt);
-	return sprint_null_terminated_string_va_list_to_buffer(fmt_cstring, args, buffer, buffer_size);
+	Format_Writer w = make_format_writer((char*)buffer, buffer_size);
+	format_string_to_writer(&w, fmt, args);
+	return (string){min(w.total, buffer_size-1), (u8*)buffer};
 }
 
+#define SPRINT_STACK_BUFFER_SIZE 512
 string sprint_va_list(Allocator allocator, const string fmt, va_list args) {
 
-    char* fmt_cstring = temp_convert_to_null_terminated_string(fmt);
-    u64 count = format_string_to_buffer(NULL, 0, fmt_cstring, args) + 1; 
-
-    char* buffer = NULL;
-
-    buffer = (char*)alloc(allocator, count);
+	// Most formatted strings are short, so format once on the stack and copy rather than
+	// formatting once to count and once more to write.
+	char stack_buffer[SPRINT_STACK_BUFFER_SIZE];
+	
+	va_list args_copy;
+	va_copy(args_copy, args);
+	Format_Writer w = make_format_writer(stack_buffer, sizeof(stack_buffer));
+	format_string_to_writer(&w, fmt, args_copy);
+	va_end(args_copy);
+	
+	char *buffer = (char*)alloc(allocator, w.total+1);
+	
+	if (w.total < sizeof(stack_buffer)) {
+		memcpy(buffer, stack_buffer, w.total+1);
+	} else {
+		Format_Writer w2 = make_format_writer(buffer, w.total+1);
+		format_string_to_writer(&w2, fmt, args);
+	}
 
-    return sprint_null_terminated_string_va_list_to_buffer(fmt_cstring, args, buffer, count);
+	return (string){w.total, (u8*)buffer};
 }
 
 
@@ -281,31 +638,19 @@ string tprintf(const char *fmt, ...) {
 // prints for 'string' and printf for 'char*'
 
 #define PRINT_BUFFER_SIZE 4096
-// Avoids all and any allocations but overhead in speed and memory.
+void format_flush_to_stdout(string s, void *data) {
+	os_write_string_to_stdout(s);
+}
+// Avoids all and any allocations.
 // Need this for standard printing so we don't get infinite recursions.
 // (for example something in memory might fail assert and it needs to print that)
 void print_va_list_buffered(const string fmt, va_list args) {
 
-	string current = fmt;
-
 	char buffer[PRINT_BUFFER_SIZE];
 	
-	while (true) {
-		u64 size = min(current.count, PRINT_BUFFER_SIZE-1);
-		if (current.count <= 0) break;
-		
-		memcpy(buffer, current.data, size);
-		
-		char fmt_cstring[PRINT_BUFFER_SIZE+1];
-		memcpy(fmt_cstring, current.data, size);
-		fmt_cstring[size] = 0;
-		
-		string s = sprint_null_terminated_string_va_list_to_buffer(fmt_cstring, args, buffer, PRINT_BUFFER_SIZE);
-		os_write_string_to_stdout(s);
-		
-		current.count -= size;
-		current.data += size;
-	}
+	Format_Writer w = make_format_writer(buffer, PRINT_BUFFER_SIZE);
+	w.flush = format_flush_to_stdout;
+	format_string_to_writer(&w, fmt, args);
 }
 
 
@@ -344,43 +689,35 @@ typedef void(*Logger_Proc)(Log_Level level, string s);
 
 
 
-void string_builder_prints(String_Builder *b, string fmt, ...) {
+void string_builder_print_va_list(String_Builder *b, string fmt, va_list args) {
 	assert(b->allocator.proc, "String_Builder is missing allocator");
 	
-	va_list args1 = 0;
-	va_start(args1, fmt);
-	va_list args2 = 0;
-	va_copy(args2, args1);
-	
-	u64 formatted_count = format_string_to_buffer(0, 0, temp_convert_to_null_terminated_string(fmt), args1);
-	
-	va_end(args1);
+	// Format straight into the free space and only format again if it didn't fit
+	va_list args_copy;
+	va_copy(args_copy, args);
+	Format_Writer w = make_format_writer((char*)b->buffer+b->count, b->buffer_capacity-b->count);
+	format_string_to_writer(&w, fmt, args_copy);
+	va_end(args_copy);
 	
-	string_builder_reserve(b, b->count+formatted_count+1);
-	
-	format_string_to_buffer((char*)b->buffer+b->count, b->count+formatted_count+1, temp_convert_to_null_terminated_string(fmt), args2);
-	b->count += formatted_count;
+	if (b->count+w.total+1 > b->buffer_capacity) {
+		string_builder_reserve(b, b->count+w.total+1);
+		w = make_format_writer((char*)b->buffer+b->count, b->buffer_capacity-b->count);
+		format_string_to_writer(&w, fmt, args);
+	}
 	
-	va_end(args2);
+	b->count += w.total;
+}
+void string_builder_prints(String_Builder *b, string fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	string_builder_print_va_list(b, fmt, args);
+	va_end(args);
 }
 void string_builder_printf(String_Builder *b, const char *fmt, ...) {
-	assert(b->allocator.proc, "String_Builder is missing allocator");
-	
-	va_list args1 = 0;
-	va_start(args1, fmt);
-	va_list args2 = 0;
-	va_copy(args2, args1);
-	
-	u64 formatted_count = format_string_to_buffer(0, 0, fmt, args1);
-	
-	va_end(args1);
-	
-	string_builder_reserve(b, b->count+formatted_count+1);
-	
-	format_string_to_buffer((char*)b->buffer+b->count, b->buffer_capacity-b->count+1, fmt, args2);
-	b->count += formatted_count;
-	
-	va_end(args2);
+	va_list args;
+	va_start(args, fmt);
+	string_builder_print_va_list(b, (string){strlen(fmt), (u8*)fmt}, args);
+	va_end(args);
 }
 
 #define string_builder_print(...) _Generic((SECOND_ARG(__VA_ARGS__)), \
@@ -0,0 +1,221 @@
+
+/*
+
+	String interning.
+
+	Maps strings to small integer Atoms. The same string always gives the same Atom for the
+	lifetime of the program, so string-keyed tables and string comparisons can use the Atom
+	instead.
+
+	Usage:
+
+		Atom path = intern_string(STR("res/sprites/player.png"));
+
+		if (path == other_path) { ... } // Instead of strings_match
+
+		string s = atom_to_string(path); // Points into the intern storage, never freed
+
+		// Returns 0 if the string was never interned, never adds it
+		Atom a = find_interned_string(STR("Not interned"));
+
+	Atom 0 is the empty string.
+
+	Interned bytes are stored in an append-only virtual arena and atoms are never removed.
+	atom_to_string() and find_interned_string() are lock free. intern_string() is lock free
+	when the string is already interned and takes a spinlock when it needs to add it.
+
+	#Portability
+	Like the queues in concurrency.c, publishing relies on x86 not reordering loads with
+	loads or stores with stores, so the lock free paths only use COMPILER_BARRIER.
+
+*/
+
+typedef u32 Atom;
+
+#ifndef STRING_INTERN_MAX_ATOMS
+	#define STRING_INTERN_MAX_ATOMS (1ULL << 22)
+#endif
+#ifndef STRING_INTERN_MAX_BYTES
+	#define STRING_INTERN_MAX_BYTES GB(1)
+#endif
+
+#define STRING_INTERN_MIN_INDEX_CAPACITY 1024
+
+typedef struct Atom_Entry {
+	u64 hash;
+	string s;
+} Atom_Entry;
+
+// Open addressing index from hash to atom, 0 means empty slot.
+// When it grows, a new index is published and the old one is left as is since other
+// threads may still be probing it. Old indices are never freed, which costs less than
+// the size of the current one.
+typedef struct String_Intern_Index {
+	u64 capacity; // Power of two
+	volatile Atom slots[];
+} String_Intern_Index;
+
+typedef struct String_Intern_Storage {
+	Spinlock lock;
+	volatile bool initted;
+
+	Arena entries; // Atom_Entry, indexed by atom
+	Arena bytes;   // Interned string bytes and index tables
+
+	String_Intern_Index *volatile index;
+	volatile u32 atom_count; // Including the empty string
+} String_Intern_Storage;
+
+// #Global
+ogb_instance String_Intern_Storage string_intern_storage;
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+String_Intern_Storage string_intern_storage = {0};
+#endif
+
+Atom ogb_instance
+intern_string(string s);
+
+Atom ogb_instance
+find_interned_string(string s);
+
+string ogb_instance
+atom_to_string(Atom atom);
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+
+void *string_intern_push_aligned(Arena *arena, u64 size) {
+	u64 misalignment = (u64)arena->next & 7;
+	if (misalignment) arena_push(arena, 8-misalignment);
+	return arena_push(arena, size);
+}
+
+String_Intern_Index *make_string_intern_index(u64 capacity) {
+	String_Intern_Index *index = string_intern_push_aligned(&string_intern_storage.bytes, sizeof(String_Intern_Index) + capacity*sizeof(Atom));
+	index->capacity = capacity;
+	memset((void*)index->slots, 0, capacity*sizeof(Atom));
+	return index;
+}
+
+void string_intern_init() {
+	String_Intern_Storage *st = &string_intern_storage;
+
+	st->entries = make_virtual_arena(STRING_INTERN_MAX_ATOMS*sizeof(Atom_Entry));
+	st->bytes = make_virtual_arena(STRING_INTERN_MAX_BYTES);
+
+	// Atom 0 is the empty string
+	Atom_Entry *empty = arena_push_struct(&st->entries, Atom_Entry);
+	*empty = ZERO(Atom_Entry);
+	st->atom_count = 1;
+
+	st->index = make_string_intern_index(STRING_INTERN_MIN_INDEX_CAPACITY);
+
+	COMPILER_BARRIER; // Release
+	st->initted = true;
+}
+
+inline Atom_Entry *get_atom_entry(Atom atom) {
+	return (Atom_Entry*)string_intern_storage.entries.start + atom;
+}
+
+// Returns the atom, or 0 if not found. *out_slot is the empty slot where it would go.
+Atom string_intern_index_find(String_Intern_Index *index, string s, u64 hash, u64 *out_slot) {
+	u64 mask = index->capacity-1;
+	for (u64 slot = hash & mask;; slot = (slot+1) & mask) {
+		Atom atom = index->slots[slot];
+		if (atom == 0) {
+			if (out_slot) *out_slot = slot;
+			return 0;
+		}
+		// Entries are written before the atom is published to the index
+		COMPILER_BARRIER; // Acquire
+		Atom_Entry *entry = get_atom_entry(atom);
+		if (entry->hash == hash && strings_match(entry->s, s)) return atom;
+	}
+}
+
+Atom find_interned_string(string s) {
+	if (s.count == 0) return 0;
+	if (!string_intern_storage.initted) return 0;
+
+	String_Intern_Index *index = string_intern_storage.index;
+	COMPILER_BARRIER; // Acquire
+	return string_intern_index_find(index, s, string_get_hash(s), 0);
+}
+
+void string_intern_grow_index() {
+	String_Intern_Storage *st = &string_intern_storage;
+
+	String_Intern_Index *old = st->index;
+	String_Intern_Index *new_index = make_string_intern_index(old->capacity*2);
+
+	u64 mask = new_index->capacity-1;
+	for (u64 i = 0; i < old->capacity; i++) {
+		Atom atom = old->slots[i];
+		if (!atom) continue;
+		u64 slot = get_atom_entry(atom)->hash & mask;
+		while (new_index->slots[slot]) slot = (slot+1) & mask;
+		new_index->slots[slot] = atom;
+	}
+
+	COMPILER_BARRIER; // Release, slots are filled before the index is published
+	st->index = new_index;
+}
+
+Atom intern_string(string s) {
+	if (s.count == 0) return 0;
+
+	String_Intern_Storage *st = &string_intern_storage;
+	u64 hash = string_get_hash(s);
+
+	// Fast path, no lock
+	if (st->initted) {
+		String_Intern_Index *index = st->index;
+		COMPILER_BARRIER; // Acquire
+		Atom atom = string_intern_index_find(index, s, hash, 0);
+		if (atom) return atom;
+	}
+
+	spinlock_acquire_or_wait(&st->lock);
+
+	if (!st->initted) string_intern_init();
+
+	// Someone may have added it (or grown the index) since we looked
+	u64 slot;
+	Atom atom = string_intern_index_find(st->index, s, hash, &slot);
+	if (atom) {
+		spinlock_release(&st->lock);
+		return atom;
+	}
+
+	assert(st->atom_count < STRING_INTERN_MAX_ATOMS, "Out of atoms. Increase STRING_INTERN_MAX_ATOMS.");
+
+	atom = st->atom_count;
+
+	Atom_Entry *entry = arena_push_struct(&st->entries, Atom_Entry);
+	entry->hash = hash;
+	entry->s.count = s.count;
+	entry->s.data = arena_push(&st->bytes, s.count);
+	memcpy(entry->s.data, s.data, s.count);
+
+	COMPILER_BARRIER; // Release, the entry is written before the atom is published
+	st->atom_count += 1;
+	st->index->slots[slot] = atom;
+
+	// Keep load factor under 1/2
+	if ((u64)(st->atom_count-1)*2 > st->index->capacity) {
+		string_intern_grow_index();
+	}
+
+	spinlock_release(&st->lock);
+
+	return atom;
+}
+
+string atom_to_string(Atom atom) {
+	if (atom == 0) return ZERO(string);
+	assert(atom < string_intern_storage.atom_count, "Invalid atom %u", atom);
+	return get_atom_entry(atom)->s;
+}
+
+#endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
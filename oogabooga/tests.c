@@ -31,9 +31,54 @@ void log_heap() {
 		
 		block = block->next;
 	}
+	
+	for (u64 i = 0; i < HEAP_SIZE_CLASS_COUNT; i++) {
+		Heap_Slab *lists[] = { heap_thread_cache.slabs_with_free_slots[i], heap_thread_cache.full_slabs[i], heap_abandoned_slabs[i] };
+		for (u64 j = 0; j < sizeof(lists)/sizeof(lists[0]); j++) {
+			Heap_Slab *slab = lists[j];
+			while (slab != 0) {
+				print("\tSLAB @ 0x%I64x, %llu byte slots, %llu/%llu used, owner %llu\n", (u64)slab, slab->slot_size, slab->used_count, slab->slot_count, slab->owner);
+				slab = slab->next;
+			}
+		}
+	}
+	
+	Heap_Large_Allocation *large = heap_large_allocations;
+	while (large != 0) {
+		print("\tLARGE ALLOCATION @ 0x%I64x, %llu bytes committed, %llu bytes reserved\n", (u64)large, large->committed_size, large->reserved_size);
+		large = large->next;
+	}
 	spinlock_release(&heap_lock);
 }
 
+// Keeps live_count allocations alive and replaces a random one each iteration so the heap
+// is properly fragmented while we measure.
+void benchmark_heap_throughput(const char *name, u64 min_size, u64 max_size, u64 live_count, u64 iterations) {
+	Allocator heap = get_heap_allocator();
+	
+	void **live = (void**)alloc(heap, live_count*sizeof(void*));
+	for (u64 i = 0; i < live_count; i++) {
+		live[i] = alloc_uninitialized(heap, get_random_int_in_range(min_size, max_size));
+	}
+	
+	float64 start_seconds = os_get_elapsed_seconds();
+	u64 start_cycles = rdtsc();
+	for (u64 i = 0; i < iterations; i++) {
+		u64 index = get_random() % live_count;
+		dealloc(heap, live[index]);
+		live[index] = alloc_uninitialized(heap, get_random_int_in_range(min_size, max_size));
+	}
+	u64 end_cycles = rdtsc();
+	float64 end_seconds = os_get_elapsed_seconds();
+	
+	for (u64 i = 0; i < live_count; i++) {
+		dealloc(heap, live[i]);
+	}
+	dealloc(heap, live);
+	
+	print("%cs: %.2f million alloc+dealloc per second, %llu cycles on average\n", name, ((float64)iterations/(end_seconds-start_seconds))/1000000.0, (end_cycles-start_cycles)/iterations);
+}
+
 void test_allocator(bool do_log_heap) {
 
 	u64 h = get_hash((string*)69);
@@ -139,6 +184,35 @@ void test_allocator(bool do_log_heap) {
     
     assert(old_foo == foo, "Temp allocator goof");
     
+    // Overflowing temporary storage links in more memory instead of wrapping around
+    {
+        reset_temporary_storage();
+        Temporary_Storage_Stats stats = get_temporary_storage_stats();
+        u64 count = (stats.capacity/KB(64))*2;
+        u8 **blocks = (u8**)alloc(heap, count*sizeof(u8*));
+        for (u64 i = 0; i < count; i++) {
+            blocks[i] = (u8*)talloc(KB(64));
+            memset(blocks[i], (u8)i, KB(64));
+        }
+        for (u64 i = 0; i < count; i++) {
+            assert(blocks[i][0] == (u8)i && blocks[i][KB(64)-1] == (u8)i, "Temporary storage overflow corrupted memory");
+        }
+        dealloc(heap, blocks);
+        
+        Temporary_Storage_Stats overflown = get_temporary_storage_stats();
+        assert(overflown.overflow_count > stats.overflow_count, "Temporary storage should have overflown");
+        assert(overflown.high_water >= count*KB(64), "Temporary storage high water is wrong");
+        
+        reset_temporary_storage();
+        Temporary_Storage_Stats after_reset = get_temporary_storage_stats();
+        assert(after_reset.used == 0, "reset_temporary_storage did not reset used count");
+        assert(after_reset.capacity >= overflown.high_water, "Temporary storage should grow to the high water mark after overflowing");
+        
+        for (u64 i = 0; i < count; i++) talloc(KB(64));
+        assert(get_temporary_storage_stats().overflow_count == overflown.overflow_count, "Temporary storage should not overflow again after growing");
+        reset_temporary_storage();
+    }
+    
     // Repeated Allocation and Free
     for (int i = 0; i < 10000; ++i) {
         void* temp = alloc(heap, 128);
@@ -194,6 +268,131 @@ void test_allocator(bool do_log_heap) {
     
     assert(bytes_match(check_bytes, check_bytes_copy, 1024), "Memory corrupt");
     
+    // Slab slots are reused and don't overlap
+    for (int i = 0; i < 100; ++i) {
+        blocks[i] = alloc(heap, (i % 8 + 1) * 16);
+        memset(blocks[i], i, (i % 8 + 1) * 16);
+    }
+    for (int i = 0; i < 100; i += 3) {
+        dealloc(heap, blocks[i]);
+        blocks[i] = alloc(heap, (i % 8 + 1) * 16);
+        memset(blocks[i], i, (i % 8 + 1) * 16);
+    }
+    for (int i = 0; i < 100; ++i) {
+        u8 *bytes = (u8*)blocks[i];
+        for (int j = 0; j < (i % 8 + 1) * 16; j++) {
+            assert(bytes[j] == (u8)i, "Heap slab slots overlap");
+        }
+        dealloc(heap, blocks[i]);
+    }
+    
+    // Enough small allocations of the same size to need several slabs
+    void **many = (void**)alloc(heap, sizeof(void*) * 10000);
+    for (int i = 0; i < 10000; ++i) {
+        many[i] = alloc(heap, 200);
+        *(int*)many[i] = i;
+    }
+    for (int i = 0; i < 10000; ++i) {
+        assert(*(int*)many[i] == i, "Memory corruption detected");
+        dealloc(heap, many[i]);
+    }
+    dealloc(heap, many);
+    
+    // Realloc keeps contents, and grows/shrinks in place when the next free node allows it
+    {
+        u8 *p = (u8*)alloc(heap, KB(8));
+        for (u64 i = 0; i < KB(8); i++) p[i] = (u8)i;
+        
+        u8 *grown = (u8*)heap.proc(KB(64), p, ALLOCATOR_REALLOCATE, heap.data);
+        for (u64 i = 0; i < KB(8); i++) assert(grown[i] == (u8)i, "Failed: realloc lost contents when growing");
+        
+        void *blocker = alloc(heap, KB(8));
+        
+        u8 *shrunk = (u8*)heap.proc(KB(16), grown, ALLOCATOR_REALLOCATE, heap.data);
+        assert(shrunk == grown, "Failed: realloc did not shrink in place");
+        for (u64 i = 0; i < KB(8); i++) assert(shrunk[i] == (u8)i, "Failed: realloc lost contents when shrinking");
+        
+        // The tail we just gave back should be right there to grow into again
+        u8 *regrown = (u8*)heap.proc(KB(32), shrunk, ALLOCATOR_REALLOCATE, heap.data);
+        assert(regrown == shrunk, "Failed: realloc did not grow in place");
+        for (u64 i = 0; i < KB(8); i++) assert(regrown[i] == (u8)i, "Failed: realloc lost contents when growing in place");
+        
+        // Small to large and back
+        u8 *small = (u8*)alloc(heap, 100);
+        memset(small, 7, 100);
+        small = (u8*)heap.proc(50, small, ALLOCATOR_REALLOCATE, heap.data);
+        u8 *large = (u8*)heap.proc(KB(10), small, ALLOCATOR_REALLOCATE, heap.data);
+        for (u64 i = 0; i < 50; i++) assert(large[i] == 7, "Failed: realloc lost contents moving to a larger size class");
+        small = (u8*)heap.proc(64, large, ALLOCATOR_REALLOCATE, heap.data);
+        for (u64 i = 0; i < 50; i++) assert(small[i] == 7, "Failed: realloc lost contents moving to a smaller size class");
+        
+        dealloc(heap, small);
+        dealloc(heap, regrown);
+        dealloc(heap, blocker);
+    }
+    
+    // Growing in place finds the free node after the allocation no matter what order the
+    // free nodes were released in
+    {
+        u8 *blocks[8];
+        for (u64 i = 0; i < 8; i++) blocks[i] = (u8*)alloc(heap, KB(8));
+        u64 stride = (u64)(blocks[1]-blocks[0]);
+        for (u64 i = 1; i < 8; i++) assert((u64)(blocks[i]-blocks[i-1]) == stride, "Failed: test blocks were not allocated back to back");
+        
+        dealloc(heap, blocks[1]);
+        dealloc(heap, blocks[3]);
+        dealloc(heap, blocks[5]);
+        
+        u8 *grown = (u8*)heap.proc(KB(16), blocks[2], ALLOCATOR_REALLOCATE, heap.data);
+        assert(grown == blocks[2], "Failed: realloc did not grow in place after out of order frees");
+        grown = (u8*)heap.proc(KB(16), blocks[4], ALLOCATOR_REALLOCATE, heap.data);
+        assert(grown == blocks[4], "Failed: realloc did not grow in place after out of order frees");
+        
+        dealloc(heap, blocks[0]);
+        dealloc(heap, blocks[2]);
+        dealloc(heap, blocks[4]);
+        dealloc(heap, blocks[6]);
+        dealloc(heap, blocks[7]);
+    }
+    
+    // Large allocations get their own pages, even past the heap block size
+    {
+        u64 size = MAX_HEAP_BLOCK_SIZE+MB(10);
+        u8 *big = (u8*)alloc_uninitialized(heap, size);
+        assert(!is_pointer_in_program_memory(big), "Failed: large allocation should not be in program memory");
+        assert(is_pointer_valid(big) && is_pointer_valid(big+size-1), "Failed: large allocation should be a valid pointer");
+        big[0] = 1;
+        big[size-1] = 2;
+        
+        // %s checks string data with is_pointer_valid, which must not take heap_lock
+        memcpy(big, "large", 5);
+        string in_large = {5, big};
+        spinlock_acquire_or_wait(&heap_lock);
+        bool valid_while_locked = is_pointer_valid(big);
+        spinlock_release(&heap_lock);
+        assert(valid_while_locked, "Failed: large allocation should be valid while heap_lock is held");
+        assert(strings_match(tprint("%s", in_large), STR("large")), "Failed: string in a large allocation was not formatted as a string");
+        
+        dealloc(heap, big);
+        assert(!is_pointer_valid(big), "Failed: large allocation should be released on dealloc");
+        
+        u8 *buffer = (u8*)alloc(heap, MB(2));
+        for (u64 i = 0; i < MB(2); i += 1024) buffer[i] = (u8)(i/1024);
+        
+        u8 *grown = (u8*)heap.proc(MB(5), buffer, ALLOCATOR_REALLOCATE, heap.data);
+        assert(grown == buffer, "Failed: large allocation did not grow in place within its reserved pages");
+        grown[MB(5)-1] = 3;
+        
+        u8 *shrunk = (u8*)heap.proc(MB(3), grown, ALLOCATOR_REALLOCATE, heap.data);
+        assert(shrunk == buffer, "Failed: large allocation did not shrink in place");
+        
+        u8 *moved = (u8*)heap.proc(KB(64), shrunk, ALLOCATOR_REALLOCATE, heap.data);
+        assert(is_pointer_in_program_memory(moved), "Failed: large allocation shrunk below HEAP_LARGE_ALLOCATION_MIN should move to the heap blocks");
+        for (u64 i = 0; i < KB(64); i += 1024) assert(moved[i] == (u8)(i/1024), "Failed: large allocation lost contents when reallocating");
+        
+        dealloc(heap, moved);
+    }
+    
     if (do_log_heap) log_heap();
 }
 
@@ -258,6 +457,359 @@ void test_allocator_threaded(Thread *t) {
     }
 }
 
+typedef struct Heap_Cross_Thread_Test_Data {
+	void **pointers;
+	u64 count;
+} Heap_Cross_Thread_Test_Data;
+void heap_cross_thread_alloc_proc(Thread *t) {
+	Heap_Cross_Thread_Test_Data *data = (Heap_Cross_Thread_Test_Data*)t->data;
+	for (u64 i = 0; i < data->count; i++) {
+		u64 size = 16 + (i*37) % KB(2);
+		data->pointers[i] = alloc(get_heap_allocator(), size);
+		memset(data->pointers[i], (u8)i, size);
+	}
+}
+void heap_cross_thread_dealloc_proc(Thread *t) {
+	Heap_Cross_Thread_Test_Data *data = (Heap_Cross_Thread_Test_Data*)t->data;
+	for (u64 i = 0; i < data->count; i++) {
+		assert(*(u8*)data->pointers[i] == (u8)i, "Cross thread allocation was corrupted");
+		dealloc(get_heap_allocator(), data->pointers[i]);
+	}
+}
+
+#define HEAP_THREAD_BENCHMARK_ITERATIONS 1000000
+void heap_thread_benchmark_proc(Thread *t) {
+	Allocator heap = get_heap_allocator();
+	
+	void *live[256] = {0};
+	for (u64 i = 0; i < 256; i++) {
+		live[i] = alloc_uninitialized(heap, get_random_int_in_range(16, KB(1)));
+	}
+	for (u64 i = 0; i < HEAP_THREAD_BENCHMARK_ITERATIONS; i++) {
+		u64 index = get_random() % 256;
+		dealloc(heap, live[index]);
+		live[index] = alloc_uninitialized(heap, get_random_int_in_range(16, KB(1)));
+	}
+	for (u64 i = 0; i < 256; i++) {
+		dealloc(heap, live[i]);
+	}
+}
+
+void test_allocator_threads() {
+	Allocator heap = get_heap_allocator();
+	
+	const u64 num_threads = 16;
+	Thread *threads = alloc(heap, sizeof(Thread)*num_threads);
+	
+	for (u64 i = 0; i < num_threads; i++) {
+		os_thread_init(&threads[i], test_allocator_threaded);
+	}
+	for (u64 i = 0; i < num_threads; i++) {
+		os_thread_start(&threads[i]);
+	}
+	for (u64 i = 0; i < num_threads; i++) {
+		os_thread_join(&threads[i]);
+		os_thread_destroy(&threads[i]);
+	}
+	
+	// Allocate on one set of threads and free on another, twice so the second round
+	// adopts the slabs the first round abandoned.
+	const u64 pairs = num_threads/2;
+	Heap_Cross_Thread_Test_Data *data = alloc(heap, sizeof(Heap_Cross_Thread_Test_Data)*pairs);
+	for (u64 i = 0; i < pairs; i++) {
+		data[i].count = 20000;
+		data[i].pointers = alloc(heap, sizeof(void*)*data[i].count);
+	}
+	for (u64 round = 0; round < 2; round++) {
+		for (u64 i = 0; i < pairs; i++) {
+			os_thread_init(&threads[i], heap_cross_thread_alloc_proc);
+			threads[i].data = &data[i];
+			os_thread_start(&threads[i]);
+		}
+		for (u64 i = 0; i < pairs; i++) {
+			os_thread_join(&threads[i]);
+			os_thread_destroy(&threads[i]);
+		}
+		for (u64 i = 0; i < pairs; i++) {
+			// Free into another threads allocations
+			os_thread_init(&threads[i], heap_cross_thread_dealloc_proc);
+			threads[i].data = &data[(i+1)%pairs];
+			os_thread_start(&threads[i]);
+		}
+		for (u64 i = 0; i < pairs; i++) {
+			os_thread_join(&threads[i]);
+			os_thread_destroy(&threads[i]);
+		}
+	}
+	for (u64 i = 0; i < pairs; i++) {
+		dealloc(heap, data[i].pointers);
+	}
+	dealloc(heap, data);
+	dealloc(heap, threads);
+}
+
+void benchmark_heap() {
+	Allocator heap = get_heap_allocator();
+	
+	benchmark_heap_throughput("Heap throughput, small (16b-1kb) ", 16, KB(1), 4096, 1000000);
+	benchmark_heap_throughput("Heap throughput, large (8kb-32kb)", KB(8), KB(32), 256, 10000);
+	
+	// Throughput as threads are added. This should scale roughly linearly now that the
+	// small allocation path doesn't take heap_lock.
+	u64 max_threads = os_get_number_of_logical_processors();
+	Thread *threads = alloc(heap, sizeof(Thread)*max_threads);
+	for (u64 thread_count = 1; thread_count <= max_threads; thread_count *= 2) {
+		for (u64 i = 0; i < thread_count; i++) {
+			os_thread_init(&threads[i], heap_thread_benchmark_proc);
+		}
+		
+		float64 start_seconds = os_get_elapsed_seconds();
+		for (u64 i = 0; i < thread_count; i++) {
+			os_thread_start(&threads[i]);
+		}
+		for (u64 i = 0; i < thread_count; i++) {
+			os_thread_join(&threads[i]);
+		}
+		float64 seconds = os_get_elapsed_seconds()-start_seconds;
+		
+		for (u64 i = 0; i < thread_count; i++) {
+			os_thread_destroy(&threads[i]);
+		}
+		
+		float64 allocs_per_second = (float64)(thread_count*HEAP_THREAD_BENCHMARK_ITERATIONS)/seconds;
+		print("Heap throughput with %llu threads: %.2f million allocs per second\n", thread_count, allocs_per_second/1000000.0);
+	}
+	dealloc(heap, threads);
+}
+
+void test_arena() {
+	Arena arena = make_virtual_arena(MB(64));
+	assert(arena.size == 0, "Failed: virtual arena should not commit anything up front");
+	
+	u8 *first = (u8*)arena_push(&arena, 100);
+	memset(first, 1, 100);
+	assert(arena.size >= 100 && arena.size < arena.reserved_size, "Failed: virtual arena should commit lazily");
+	
+	Arena_Checkpoint checkpoint = arena_checkpoint(&arena);
+	
+	// Grow well past the first commit
+	u8 *big = (u8*)arena_push(&arena, MB(10));
+	memset(big, 2, MB(10));
+	assert(big == first+100, "Failed: virtual arena should never move");
+	assert(arena.size >= MB(10)+100, "Failed: virtual arena did not commit enough");
+	
+	{
+		Arena_Checkpoint inner = arena_checkpoint(&arena);
+		u64 *n = arena_push_struct(&arena, u64);
+		*n = 69;
+		arena_restore(inner);
+		assert(arena.next == inner.next, "Failed: arena_restore");
+	}
+	
+	u64 high_water = arena.high_water;
+	arena_restore(checkpoint);
+	assert(arena.next == checkpoint.next, "Failed: arena_restore");
+	assert(arena.high_water == high_water, "Failed: arena_restore should not touch high water mark");
+	for (u64 i = 0; i < 100; i++) assert(first[i] == 1, "Failed: arena_restore clobbered memory before the checkpoint");
+	
+	u8 *again = (u8*)arena_push(&arena, 16);
+	assert(again == big, "Failed: arena should reuse memory after restore");
+	
+	// Decommit on reset, keeping decommit_threshold bytes around
+	arena.decommit_threshold = MB(1);
+	arena_reset(&arena);
+	assert(arena.next == arena.start, "Failed: arena_reset");
+	assert(arena.size == MB(1), "Failed: arena_reset should decommit down to decommit_threshold");
+	
+	u8 *after_reset = (u8*)arena_push(&arena, MB(2));
+	memset(after_reset, 3, MB(2));
+	assert(after_reset == arena.start, "Failed: arena_push after reset");
+	
+	destroy_virtual_arena(&arena);
+	
+	// Fixed arena, through the allocator interface
+	Allocator fixed = make_arena_allocator(KB(4));
+	Arena *fixed_arena = (Arena*)fixed.data;
+	Arena_Checkpoint fixed_checkpoint = arena_checkpoint(fixed_arena);
+	for (u64 i = 0; i < 10; i++) {
+		u64 *p = alloc(fixed, sizeof(u64));
+		*p = i;
+	}
+	arena_restore(fixed_checkpoint);
+	assert(fixed_arena->next == fixed_arena->start, "Failed: arena_restore on fixed arena");
+	dealloc(get_heap_allocator(), fixed_arena);
+}
+
+typedef struct Pool_Test_Item {
+	u64 id;
+	Vector4 v;
+} Pool_Test_Item;
+void test_pool() {
+	Pool pool = make_pool(Pool_Test_Item, 16, get_heap_allocator());
+	
+	Pool_Handle null_handle = ZERO(Pool_Handle);
+	assert(!pool_is_valid(&pool, null_handle), "Failed: zero handle should never be valid");
+	
+	const u64 count = 1000;
+	Pool_Handle *handles = alloc(get_heap_allocator(), count*sizeof(Pool_Handle));
+	Pool_Test_Item **pointers = alloc(get_heap_allocator(), count*sizeof(Pool_Test_Item*));
+	
+	for (u64 i = 0; i < count; i++) {
+		Pool_Test_Item *item = pool_acquire(&pool, &handles[i]);
+		assert(item->id == 0, "Failed: pool_acquire should zero the item");
+		assert(((u64)item & 7) == 0, "Failed: pool items should be 8-byte aligned");
+		item->id = i;
+		pointers[i] = item;
+	}
+	assert(pool_get_live_count(&pool) == count, "Failed: pool_get_live_count");
+	
+	// Growing must never move live items
+	for (u64 i = 0; i < count; i++) {
+		assert(pool_get(&pool, handles[i]) == pointers[i], "Failed: pool item moved");
+		assert(pointers[i]->id == i, "Failed: pool item was clobbered");
+	}
+	
+	// Release every other item
+	for (u64 i = 0; i < count; i += 2) {
+		pool_release(&pool, handles[i]);
+	}
+	assert(pool_get_live_count(&pool) == count/2, "Failed: pool_get_live_count after release");
+	for (u64 i = 0; i < count; i++) {
+		Pool_Test_Item *expected = (i % 2 == 0) ? 0 : pointers[i];
+		assert(pool_get(&pool, handles[i]) == expected, "Failed: pool handle validation");
+	}
+	
+	// Dense iteration only visits live items
+	u64 id_sum = 0;
+	for (u64 i = 0; i < pool_get_live_count(&pool); i++) {
+		Pool_Test_Item *item = pool_get_live(&pool, i);
+		assert(item->id % 2 == 1, "Failed: dense iteration visited a released item");
+		Pool_Handle handle = pool_get_live_handle(&pool, i);
+		assert(pool_get(&pool, handle) == item, "Failed: pool_get_live_handle");
+		id_sum += item->id;
+	}
+	assert(id_sum == (count/2)*(count/2), "Failed: dense iteration missed items");
+	
+	// Slots are reused, but old handles to them stay stale
+	u32 slot_count = pool.slot_count;
+	for (u64 i = 0; i < count; i += 2) {
+		Pool_Handle old = handles[i];
+		Pool_Test_Item *item = pool_acquire(&pool, &handles[i]);
+		item->id = i;
+		assert(pool_get(&pool, old) == 0, "Failed: reused slot should invalidate old handle");
+		assert(handles[i].generation != old.generation || handles[i].index != old.index, "Failed: reused slot got the same handle");
+	}
+	assert(pool.slot_count == slot_count, "Failed: pool grew instead of reusing free slots");
+	
+	// Release while iterating backwards
+	for (s64 i = (s64)pool_get_live_count(&pool)-1; i >= 0; i--) {
+		Pool_Test_Item *item = pool_get_live(&pool, i);
+		if (item->id % 3 == 0) pool_release(&pool, pool_get_live_handle(&pool, i));
+	}
+	for (u64 i = 0; i < count; i++) {
+		Pool_Test_Item *item = pool_get(&pool, handles[i]);
+		assert((item == 0) == (i % 3 == 0), "Failed: release while iterating");
+	}
+	
+	// Slot order doesn't change when releasing while iterating
+	u64 slot_order_count = 0;
+	for (u64 i = 0; i < pool_get_slot_count(&pool); i++) {
+		Pool_Test_Item *item = pool_get_by_slot(&pool, i);
+		if (!item) continue;
+		pointers[slot_order_count] = item;
+		slot_order_count += 1;
+	}
+	assert(slot_order_count == pool_get_live_count(&pool), "Failed: slot iteration missed items");
+	u64 slot_order_index = 0;
+	for (u64 i = 0; i < pool_get_slot_count(&pool); i++) {
+		Pool_Test_Item *item = pool_get_by_slot(&pool, i);
+		if (!item) continue;
+		assert(item == pointers[slot_order_index], "Failed: slot order changed after a release");
+		slot_order_index += 1;
+		if (item->id % 5 == 0) pool_release(&pool, pool_get_handle_by_slot(&pool, i));
+	}
+	assert(slot_order_index == slot_order_count, "Failed: slot iteration skipped items after a release");
+	
+	pool_clear(&pool);
+	assert(pool_get_live_count(&pool) == 0, "Failed: pool_clear");
+	for (u64 i = 0; i < count; i++) assert(!pool_is_valid(&pool, handles[i]), "Failed: pool_clear should invalidate handles");
+	
+	pool_deinit(&pool);
+	dealloc(get_heap_allocator(), handles);
+	dealloc(get_heap_allocator(), pointers);
+}
+
+#define STRING_INTERN_TEST_COUNT 5000
+typedef struct String_Intern_Test_Data {
+	u64 start;
+	Atom *atoms; // STRING_INTERN_TEST_COUNT
+} String_Intern_Test_Data;
+void string_intern_test_proc(Thread *t) {
+	String_Intern_Test_Data *data = (String_Intern_Test_Data*)t->data;
+	// Every thread interns the same strings, starting at different offsets so they race on adding them
+	for (u64 n = 0; n < STRING_INTERN_TEST_COUNT; n++) {
+		u64 i = (data->start + n) % STRING_INTERN_TEST_COUNT;
+		string s = tprint("res/sounds/sound_%i.wav", i);
+		data->atoms[i] = intern_string(s);
+	}
+}
+void test_string_intern() {
+	Allocator heap = get_heap_allocator();
+	
+	assert(intern_string(STR("")) == 0, "Failed: Empty string should be atom 0");
+	assert(atom_to_string(0).count == 0, "Failed: Atom 0 should be the empty string");
+	
+	Atom a = intern_string(STR("Interned string"));
+	assert(a != 0, "Failed: intern_string");
+	
+	string copy = string_copy(STR("Interned string"), heap);
+	assert(intern_string(copy) == a, "Failed: Same string should give the same atom");
+	assert(find_interned_string(copy) == a, "Failed: find_interned_string");
+	memset(copy.data, 'x', copy.count);
+	assert(strings_match(atom_to_string(a), STR("Interned string")), "Failed: Interned bytes should be copied");
+	dealloc_string(heap, copy);
+	
+	// Interned bytes live in a virtual arena, %s must still see them as a string
+	assert(strings_match(tprint("%s", atom_to_string(intern_string(STR("x")))), STR("x")), "Failed: Interned string was formatted as a char*");
+	assert(strings_match(tprint("%s!", atom_to_string(a)), STR("Interned string!")), "Failed: Interned string was formatted as a char*");
+	
+	assert(find_interned_string(STR("Never interned")) == 0, "Failed: find_interned_string should not add strings");
+	assert(intern_string(STR("Interned strin")) != a, "Failed: Prefix should be a different atom");
+	
+	const u64 num_threads = 8;
+	Thread *threads = alloc(heap, sizeof(Thread)*num_threads);
+	String_Intern_Test_Data *data = alloc(heap, sizeof(String_Intern_Test_Data)*num_threads);
+	for (u64 i = 0; i < num_threads; i++) {
+		data[i].start = i*(STRING_INTERN_TEST_COUNT/num_threads);
+		data[i].atoms = alloc(heap, sizeof(Atom)*STRING_INTERN_TEST_COUNT);
+		os_thread_init(&threads[i], string_intern_test_proc);
+		threads[i].data = &data[i];
+	}
+	for (u64 i = 0; i < num_threads; i++) {
+		os_thread_start(&threads[i]);
+	}
+	for (u64 i = 0; i < num_threads; i++) {
+		os_thread_join(&threads[i]);
+		os_thread_destroy(&threads[i]);
+	}
+	
+	for (u64 i = 0; i < STRING_INTERN_TEST_COUNT; i++) {
+		Atom atom = data[0].atoms[i];
+		for (u64 j = 1; j < num_threads; j++) {
+			assert(data[j].atoms[i] == atom, "Failed: Threads got different atoms for the same string");
+		}
+		for (u64 j = 0; j < i; j += 97) {
+			assert(data[0].atoms[j] != atom, "Failed: Different strings got the same atom");
+		}
+		string expected = tprint("res/sounds/sound_%i.wav", i);
+		assert(strings_match(atom_to_string(atom), expected), "Failed: atom_to_string");
+	}
+	
+	for (u64 i = 0; i < num_threads; i++) dealloc(heap, data[i].atoms);
+	dealloc(heap, data);
+	dealloc(heap, threads);
+}
+
 void test_strings() {
 	Allocator heap = get_heap_allocator();
 	{
@@ -450,35 +1002,476 @@ void test_strings() {
     assert(strings_match(hello_balls, STR("Greetings, Balls!")), "Failed: string_replace");
 }
 
-void test_file_io() {
-
-#if TARGET_OS == WINDOWS && !OOGABOOGA_LINK_EXTERNAL_INSTANCE
-    // Test win32_fixed_utf8_to_null_terminated_wide
-    string utf8_str = STR("Test");
-    u16 *wide_str = win32_fixed_utf8_to_null_terminated_wide(utf8_str, get_heap_allocator());
-    assert(wide_str != NULL, "Failed: win32_fixed_utf8_to_null_terminated_wide");
-    assert(wide_str[4] == 0, "Failed: win32_fixed_utf8_to_null_terminated_wide");
-    dealloc(get_heap_allocator(), wide_str);
+typedef s64(*Test_String_Find_Proc)(string, string);
+void test_string_simd_find_variants(string s, string sub, s64 expected_left, s64 expected_right) {
+	Test_String_Find_Proc left[3]  = {string_find_from_left_scalar, 0, 0};
+	Test_String_Find_Proc right[3] = {string_find_from_right_scalar, 0, 0};
+#if ENABLE_SIMD && SIMD_ENABLE_SSE2
+	left[1]  = string_find_from_left_sse2;
+	right[1] = string_find_from_right_sse2;
+#endif
+#if ENABLE_SIMD && COMPILER_CAN_TARGET_AVX2
+	if (query_cpu_capabilities().avx2) {
+		left[2]  = string_find_from_left_avx2;
+		right[2] = string_find_from_right_avx2;
+	}
+#endif
+	for (u64 i = 0; i < 3; i++) {
+		if (left[i])  assert(left[i](s, sub)  == expected_left,  "Failed: string_find_from_left variant %llu gave %lli, expected %lli", i, left[i](s, sub), expected_left);
+		if (right[i]) assert(right[i](s, sub) == expected_right, "Failed: string_find_from_right variant %llu gave %lli, expected %lli", i, right[i](s, sub), expected_right);
+	}
+}
+void test_string_simd() {
+	Allocator heap = get_heap_allocator();
+	
+	// Substring search at every offset and across block boundaries
+	const u64 haystack_count = 200;
+	string haystack = alloc_string(heap, haystack_count);
+	for (u64 i = 0; i < haystack_count; i++) haystack.data[i] = 'a' + (i % 7);
+	string needles[] = { STR("x"), STR("xy"), STR("xyzxyzxyzxyzxyzxyzxyz"), STR("xaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaax") };
+	for (u64 n = 0; n < sizeof(needles)/sizeof(needles[0]); n++) {
+		string needle = needles[n];
+		test_string_simd_find_variants(haystack, needle, -1, -1);
+		for (u64 at = 0; at+needle.count <= haystack_count; at += 3) {
+			string s = string_copy(haystack, heap);
+			memcpy(s.data+at, needle.data, needle.count);
+			test_string_simd_find_variants(s, needle, at, at);
+			// Second occurrence further right, if it fits
+			u64 at2 = at+needle.count+17;
+			if (at2+needle.count <= haystack_count) {
+				memcpy(s.data+at2, needle.data, needle.count);
+				test_string_simd_find_variants(s, needle, at, at2);
+			}
+			dealloc_string(heap, s);
+		}
+	}
+	// First and last byte match but the middle doesn't
+	test_string_simd_find_variants(STR("xyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyz"), STR("xaz"), -1, -1);
+	test_string_simd_find_variants(STR("short"), STR("longer than short"), -1, -1);
+	test_string_simd_find_variants(STR("abc"), STR(""), 0, 3);
+	dealloc_string(heap, haystack);
+	
+	// strings_match around the 8 and 16 byte paths
+	for (u64 count = 1; count < 70; count++) {
+		string a = alloc_string(heap, count);
+		string b = alloc_string(heap, count);
+		for (u64 i = 0; i < count; i++) a.data[i] = b.data[i] = (u8)(i*31);
+		assert(strings_match(a, b), "Failed: strings_match count %llu", count);
+		for (u64 i = 0; i < count; i++) {
+			b.data[i] ^= 1;
+			assert(!strings_match(a, b), "Failed: strings_match count %llu differing at %llu", count, i);
+			b.data[i] ^= 1;
+		}
+		dealloc_string(heap, a);
+		dealloc_string(heap, b);
+	}
+	
+	// Trimming
+	assert(strings_match(string_trim(STR("                     trimmed                         ")), STR("trimmed")), "Failed: string_trim");
+	assert(strings_match(string_trim(STR("                                        ")), STR("")), "Failed: string_trim all spaces");
+	assert(strings_match(string_trim(STR(" a                b  ")), STR("a                b")), "Failed: string_trim inner spaces");
+	assert(strings_match(string_trim_left(STR("                  x                  ")), STR("x                  ")), "Failed: string_trim_left");
+	assert(strings_match(string_trim_right(STR("                  x                  ")), STR("                  x")), "Failed: string_trim_right");
+	
+	// Bulk utf8 decode must give the same as next_utf8, including errors
+	string text = STR("Plain ascii that is long enough for a couple of simd blocks, then "
+	                  "\xc3\xa5\xc3\xa4\xc3\xb6 \xe2\x82\xac \xf0\x9f\x98\x80 and more ascii after it to go back to the fast path"
+	                  "\xff trailing \xe2\x82");
+	u32 *expected = alloc(heap, text.count*sizeof(u32));
+	u64 expected_count = 0;
+	string t = text;
+	while (t.count > 0) expected[expected_count++] = next_utf8(&t);
+	
+	Utf8_To_Utf32_Bulk_Proc procs[3] = {utf8_to_utf32_bulk_scalar, 0, 0};
+#if ENABLE_SIMD && SIMD_ENABLE_SSE2
+	procs[1] = utf8_to_utf32_bulk_sse2;
+#endif
+#if ENABLE_SIMD && COMPILER_CAN_TARGET_AVX2
+	if (query_cpu_capabilities().avx2) procs[2] = utf8_to_utf32_bulk_avx2;
+#endif
+	u32 *decoded = alloc(heap, text.count*sizeof(u32));
+	for (u64 p = 0; p < 3; p++) {
+		if (!procs[p]) continue;
+		t = text;
+		u64 count = procs[p](&t, decoded, text.count);
+		assert(count == expected_count && t.count == 0, "Failed: utf8_to_utf32_bulk variant %llu decoded %llu, expected %llu", p, count, expected_count);
+		for (u64 i = 0; i < count; i++) {
+			assert(decoded[i] == expected[i], "Failed: utf8_to_utf32_bulk variant %llu at %llu: %u, expected %u", p, i, decoded[i], expected[i]);
+		}
+		
+		// Stops when out is full and can be resumed
+		t = text;
+		u64 first = procs[p](&t, decoded, 37);
+		u64 rest = procs[p](&t, decoded+first, text.count);
+		assert(first == 37 && first+rest == expected_count, "Failed: utf8_to_utf32_bulk variant %llu resume", p);
+		assert(bytes_match(decoded, expected, expected_count*sizeof(u32)), "Failed: utf8_to_utf32_bulk variant %llu resume", p);
+	}
+	dealloc(heap, decoded);
+	dealloc(heap, expected);
+}
 
-    // Test temp_win32_fixed_utf8_to_null_terminated_wide
-    wide_str = temp_win32_fixed_utf8_to_null_terminated_wide(utf8_str);
-    assert(wide_str != NULL, "Failed: temp_win32_fixed_utf8_to_null_terminated_wide");
-    assert(wide_str[4] == 0, "Failed: temp_win32_fixed_utf8_to_null_terminated_wide");
+void benchmark_strings() {
+	Allocator heap = get_heap_allocator();
+	
+	const u64 size = MB(8);
+	string text = alloc_string(heap, size);
+	for (u64 i = 0; i < size; i++) text.data[i] = 'a' + (get_random() % 26);
+	string needle = STR("res/sprites/needle.png");
+	memcpy(text.data+size-needle.count, needle.data, needle.count);
+	const u64 iterations = 10;
+	
+	#define BENCHMARK_STRING_PROC(name, expression) {\
+		float64 start_seconds = os_get_elapsed_seconds();\
+		u64 start_cycles = rdtsc();\
+		for (u64 i = 0; i < iterations; i++) { expression; }\
+		u64 cycles = rdtsc()-start_cycles;\
+		float64 seconds = os_get_elapsed_seconds()-start_seconds;\
+		print("%cs: %.2f MB/s, %llu cycles per iteration\n", name, ((float64)(size*iterations)/seconds)/(1024.0*1024.0), cycles/iterations);\
+	}
+	
+	volatile s64 sink = 0;
+	BENCHMARK_STRING_PROC("string_find_from_left scalar", sink += string_find_from_left_scalar(text, needle));
+#if ENABLE_SIMD && SIMD_ENABLE_SSE2
+	BENCHMARK_STRING_PROC("string_find_from_left sse2  ", sink += string_find_from_left_sse2(text, needle));
+#endif
+#if ENABLE_SIMD && COMPILER_CAN_TARGET_AVX2
+	if (query_cpu_capabilities().avx2) {
+		BENCHMARK_STRING_PROC("string_find_from_left avx2  ", sink += string_find_from_left_avx2(text, needle));
+	}
+#endif
+	
+	string copy = string_copy(text, heap);
+	BENCHMARK_STRING_PROC("strings_match               ", sink += strings_match(text, copy));
+	// Short strings, like asset names
+	BENCHMARK_STRING_PROC("strings_match 48 bytes      ", for (u64 j = 0; j < size; j += 48) sink += strings_match(string_view(text, j%(size-48), 48), string_view(copy, j%(size-48), 48)));
+	dealloc_string(heap, copy);
+	
+	u32 *codepoints = alloc(heap, size*sizeof(u32));
+	BENCHMARK_STRING_PROC("next_utf8 loop              ", string t = text; u64 n = 0; while (t.count) codepoints[n++] = next_utf8(&t); sink += n);
+	BENCHMARK_STRING_PROC("utf8_to_utf32_bulk scalar   ", string t = text; sink += utf8_to_utf32_bulk_scalar(&t, codepoints, size));
+#if ENABLE_SIMD && SIMD_ENABLE_SSE2
+	BENCHMARK_STRING_PROC("utf8_to_utf32_bulk sse2     ", string t = text; sink += utf8_to_utf32_bulk_sse2(&t, codepoints, size));
+#endif
+#if ENABLE_SIMD && COMPILER_CAN_TARGET_AVX2
+	if (query_cpu_capabilities().avx2) {
+		BENCHMARK_STRING_PROC("utf8_to_utf32_bulk avx2     ", string t = text; sink += utf8_to_utf32_bulk_avx2(&t, codepoints, size));
+	}
 #endif
+	
+	#undef BENCHMARK_STRING_PROC
+	
+	dealloc(heap, codepoints);
+	dealloc_string(heap, text);
+}
 
-	File file = OS_INVALID_FILE;
+void test_gap_buffer() {
+	Allocator heap = get_heap_allocator();
+	
+	Gap_Buffer text;
+	gap_buffer_init(&text, heap);
+	
+	gap_buffer_append(&text, STR("Hello world"));
+	gap_buffer_insert(&text, 5, STR(","));
+	assert(strings_match(gap_buffer_flatten(&text), STR("Hello, world")), "Gap_Buffer insert failed");
+	gap_buffer_remove(&text, 0, 7);
+	assert(strings_match(gap_buffer_flatten(&text), STR("world")), "Gap_Buffer remove failed");
+	assert(gap_buffer_get(&text, 4) == 'd', "Gap_Buffer get failed");
+	gap_buffer_clear(&text);
+	assert(gap_buffer_count(&text) == 0, "Gap_Buffer clear failed");
+	
+	// Random edits against a plain array
+	const u64 max_count = 20000;
+	u8 *expected = alloc(heap, max_count);
+	u64 expected_count = 0;
+	u8 chunk[64];
+	u64 cursor = 0;
+	for (u64 i = 0; i < 20000; i++) {
+		u64 op = get_random() % 8;
+		
+		// Mostly edits near the cursor, like typing
+		if (get_random() % 8 == 0) cursor = expected_count ? get_random() % (expected_count+1) : 0;
+		cursor = min(cursor, expected_count);
+		
+		if (op < 5 && expected_count + sizeof(chunk) < max_count) {
+			u64 n = get_random() % sizeof(chunk);
+			for (u64 j = 0; j < n; j++) chunk[j] = 'a' + (u8)(get_random() % 26);
+			gap_buffer_insert(&text, cursor, (string){n, chunk});
+			memmove(expected + cursor + n, expected + cursor, expected_count - cursor);
+			memcpy(expected + cursor, chunk, n);
+			expected_count += n;
+			cursor += n;
+		} else if (expected_count) {
+			// Backspace or delete
+			u64 n = get_random() % 16;
+			u64 start = op == 5 ? (cursor >= n ? cursor - n : 0) : cursor;
+			n = min(n, expected_count - start);
+			gap_buffer_remove(&text, start, n);
+			memmove(expected + start, expected + start + n, expected_count - start - n);
+			expected_count -= n;
+			cursor = start;
+		}
+		
+		assert(gap_buffer_count(&text) == expected_count, "Gap_Buffer count is %llu, expected %llu", gap_buffer_count(&text), expected_count);
+		
+		if (i % 97 == 0 && expected_count) {
+			u64 start = get_random() % expected_count;
+			u64 count = get_random() % (expected_count - start + 1);
+			u64 iterator = 0;
+			u64 at = start;
+			u64 view_count = 0;
+			string view;
+			while (gap_buffer_iterate(&text, start, count, &iterator, &view)) {
+				assert(view.count > 0, "Gap_Buffer iterate gave an empty view");
+				assert(memcmp(view.data, expected + at, view.count) == 0, "Gap_Buffer iterate gave wrong text");
+				at += view.count;
+				view_count += 1;
+			}
+			assert(at == start + count && view_count <= 2, "Gap_Buffer iterate covered the wrong range");
+			
+			string copy = gap_buffer_copy_range(&text, start, count, heap);
+			assert(copy.count == count && (count == 0 || memcmp(copy.data, expected + start, count) == 0), "Gap_Buffer copy_range failed");
+			if (copy.count) dealloc_string(heap, copy);
+			
+			assert(gap_buffer_get(&text, start) == expected[start], "Gap_Buffer get failed");
+		}
+	}
+	
+	string flat = gap_buffer_flatten(&text);
+	assert(flat.count == expected_count && memcmp(flat.data, expected, expected_count) == 0, "Gap_Buffer flatten failed");
+	
+	dealloc(heap, expected);
+	gap_buffer_deinit(&text);
+}
 
-    os_file_close(file);
-    // Test os_file_open and os_file_close
-    file = os_file_open("test.txt", O_WRITE | O_CREATE);
-    assert(file != OS_INVALID_FILE, "Failed: os_file_open (write/create)");
-    os_file_close(file);
-    
+void benchmark_gap_buffer() {
+	Allocator heap = get_heap_allocator();
+	
+	// Typing in the middle of a big log
+	const u64 size = MB(4);
+	const u64 edits = 10000;
+	string text = alloc_string(heap, size);
+	memset(text.data, 'x', size);
+	string typed = STR("a");
+	
+	Gap_Buffer g;
+	gap_buffer_init_reserve(&g, size + edits, heap);
+	gap_buffer_append(&g, text);
+	
+	String_Builder b;
+	string_builder_init_reserve(&b, size + edits, heap);
+	string_builder_append(&b, text);
+	
+	u64 cursor = size/2;
+	
+	u64 start_cycles = rdtsc();
+	float64 start_seconds = os_get_elapsed_seconds();
+	for (u64 i = 0; i < edits; i++) {
+		gap_buffer_insert(&g, cursor+i, typed);
+		if (i % 4 == 3) gap_buffer_remove(&g, cursor+i, 1);
+	}
+	u64 gap_cycles = rdtsc() - start_cycles;
+	float64 gap_seconds = os_get_elapsed_seconds() - start_seconds;
+	
+	start_cycles = rdtsc();
+	start_seconds = os_get_elapsed_seconds();
+	for (u64 i = 0; i < edits; i++) {
+		u64 at = cursor+i;
+		string_builder_reserve(&b, b.count+1);
+		memmove(b.buffer+at+1, b.buffer+at, b.count-at);
+		b.buffer[at] = typed.data[0];
+		b.count += 1;
+		if (i % 4 == 3) {
+			memmove(b.buffer+at, b.buffer+at+1, b.count-at-1);
+			b.count -= 1;
+		}
+	}
+	u64 builder_cycles = rdtsc() - start_cycles;
+	float64 builder_seconds = os_get_elapsed_seconds() - start_seconds;
+	
+	print("Gap_Buffer %llu edits in 4mb text: %.2fms, %llu cycles per edit\n", edits, gap_seconds*1000.0, gap_cycles/edits);
+	print("Memmove    %llu edits in 4mb text: %.2fms, %llu cycles per edit\n", edits, builder_seconds*1000.0, builder_cycles/edits);
+	
+	assert(strings_match(gap_buffer_flatten(&g), b.result), "Gap_Buffer and String_Builder disagree");
+	
+	string_builder_deinit(&b);
+	gap_buffer_deinit(&g);
+	dealloc_string(heap, text);
+}
 
-    // Test os_file_write_string and os_file_read
-    string hello_world_write = STR("Hello, World!");
-    file = os_file_open("test.txt", O_WRITE | O_CREATE);
-    assert(file != OS_INVALID_FILE, "Failed: os_file_open (write/create)");
+int test_crt_format(char *buffer, u64 count, const char *fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	int n = vsnprintf(buffer, count, fmt, args);
+	va_end(args);
+	return n;
+}
+
+void test_string_format() {
+	
+	#define EXPECT_FORMAT(expected, ...) {\
+		string result = tprint(__VA_ARGS__);\
+		assert(strings_match(result, STR(expected)), "Expected '%cs', got '%s'", expected, result);\
+		assert(result.data[result.count] == 0, "Formatted string is not null terminated");\
+	}
+	
+	EXPECT_FORMAT("", "");
+	EXPECT_FORMAT("100%", "100%%");
+	EXPECT_FORMAT("-42 42 42", "%d %i %u", -42, 42, 42u);
+	EXPECT_FORMAT("-9223372036854775808", "%lld", (s64)0x8000000000000000ULL);
+	EXPECT_FORMAT("18446744073709551615", "%llu", 0xFFFFFFFFFFFFFFFFULL);
+	EXPECT_FORMAT("-2147483648", "%d", (int)0x80000000);
+	EXPECT_FORMAT("ff FF 0xff 0XFF 777 0777", "%x %X %#x %#X %o %#o", 255, 255, 255, 255, 511, 511);
+	EXPECT_FORMAT("0xdeadbeefcafe", "0x%I64x", 0xDEADBEEFCAFEULL);
+	EXPECT_FORMAT("[   42] [42   ] [00042] [  -42] [-0042] [+42] [ 42]", "[%5d] [%-5d] [%05d] [%5d] [%05d] [%+d] [% d]", 42, 42, 42, -42, -42, 42, 42);
+	EXPECT_FORMAT("[  007] [] [1]", "[%5.3d] [%.0d] [%.0u]", 7, 0, 1u);
+	EXPECT_FORMAT("[   42] [42   ]", "[%*d] [%-*d]", 5, 42, 5, 42);
+	EXPECT_FORMAT("-1 255 65535", "%hhd %hhu %hu", 255, 255, 65535);
+	EXPECT_FORMAT("12345 12345", "%zu %llu", (size_t)12345, (u64)12345);
+	
+	EXPECT_FORMAT("Hello, World!", "Hello, %s!", STR("World"));
+	EXPECT_FORMAT("Hello, World!", "Hello, %cs!", "World");
+	EXPECT_FORMAT("[   ab] [ab   ] [Wor]", "[%5s] [%-5s] [%.3s]", STR("ab"), STR("ab"), STR("World"));
+	EXPECT_FORMAT("[   ab] [abc]", "[%5cs] [%.3cs]", "ab", "abcdef");
+	EXPECT_FORMAT("true false", "%b %b", true, false);
+	EXPECT_FORMAT("a [  b]", "%c [%3c]", 'a', 'b');
+	
+	EXPECT_FORMAT("3.140000 3.14 3 3.", "%f %.2f %.0f %#.0f", 3.14, 3.14, 3.14, 3.14);
+	EXPECT_FORMAT("-0.000000 -0.00", "%f %.2f", -0.0, -0.0001);
+	EXPECT_FORMAT("[  1.50] [1.50  ] [001.50] [-01.50] [+1.5]", "[%6.2f] [%-6.2f] [%06.2f] [%06.2f] [%+.1f]", 1.5, 1.5, 1.5, -1.5, 1.5);
+	EXPECT_FORMAT("0 2 2 4", "%.0f %.0f %.0f %.0f", 0.5, 1.5, 2.5, 3.5);
+	EXPECT_FORMAT("0.12 0.38", "%.2f %.2f", 0.125, 0.375);
+	EXPECT_FORMAT("1.00 0.28", "%.2f %.2f", 1.005, 0.285);
+	volatile f64 zero = 0.0;
+	EXPECT_FORMAT("inf -inf", "%f %f", 1.0/zero, -1.0/zero);
+	EXPECT_FORMAT("{ X: 1.000000, Y: -2.500000 }", "%v2", v2(1, -2.5));
+	EXPECT_FORMAT("{ X: 1.00, Y: 2.00, Z: 3.00 }", "%.2v3", v3(1, 2, 3));
+	EXPECT_FORMAT("{ X: 1.0, Y: 2.0, Z: 3.0, W: 4.0 } 7", "%.1v4 %d", v4(1, 2, 3, 4), 7);
+	
+	// Through the CRT
+	EXPECT_FORMAT("1.500000e+00 1.5", "%e %g", 1.5, 1.5);
+	EXPECT_FORMAT("3.1415926535898", "%.13f", 3.14159265358979);
+	
+	int written = 0;
+	EXPECT_FORMAT("abc", "abc%n", &written);
+	assert(written == 3, "%%n wrote %d", written);
+	
+	// Must give exactly what the CRT gives
+	char crt[512];
+	const char *float_formats[] = {"%f", "%.0f", "%.1f", "%.2f", "%.3f", "%.5f", "%.9f", "%12.4f", "%-12.4f", "%012.4f", "%.12f", "%.20f"};
+	for (u64 i = 0; i < 200000; i++) {
+		float64 x;
+		switch (i % 4) {
+			case 0: x = get_random_float64_in_range(-1.0, 1.0); break;
+			case 1: x = get_random_float64_in_range(-1000.0, 1000.0); break;
+			case 2: x = (float64)(get_random_int_in_range(-100000, 100000)) / 1000.0; break;
+			default: {
+				// Random bits, any magnitude
+				u64 bits = get_random();
+				memcpy(&x, &bits, sizeof(x));
+				if (x != x) x = 0.0;
+				break;
+			}
+		}
+		const char *fmt = float_formats[i % (sizeof(float_formats)/sizeof(float_formats[0]))];
+		test_crt_format(crt, sizeof(crt), fmt, x);
+		string ours = tprint(fmt, x);
+		string theirs = STR(crt);
+		assert(strings_match(ours, theirs), "'%cs' with %.17g: got '%s', CRT gave '%s'", fmt, x, ours, theirs);
+	}
+	for (u64 i = 0; i < 100000; i++) {
+		s64 x = (s64)get_random() >> (get_random() % 64);
+		test_crt_format(crt, sizeof(crt), "%lld|%llu|%llx|%20lld|%-20lld|%020lld|%llo", x, x, x, x, x, x, x);
+		string ours = tprint("%lld|%llu|%llx|%20lld|%-20lld|%020lld|%llo", x, x, x, x, x, x, x);
+		assert(strings_match(ours, STR(crt)), "Got '%s', CRT gave '%cs'", ours, crt);
+	}
+	
+	// Longer than the stack buffers, in one piece and through the flushing writer
+	{
+		String_Builder builder;
+		string_builder_init_reserve(&builder, 8, get_heap_allocator());
+		for (u64 i = 0; i < 1000; i++) string_builder_print(&builder, STR("%llu %s|"), i, STR("abcdefghijklmnop"));
+		string long_string = string_builder_get_string(builder);
+		
+		string formatted = sprint(get_heap_allocator(), STR("<%s>"), long_string);
+		assert(formatted.count == long_string.count+2, "Long sprint has wrong length");
+		assert(strings_match(string_view(formatted, 1, long_string.count), long_string), "Long sprint has wrong content");
+		
+		u64 at = 0;
+		for (u64 i = 0; i < 1000; i++) {
+			string expected = tprint("%llu abcdefghijklmnop|", i);
+			assert(strings_match(string_view(long_string, at, expected.count), expected), "String_Builder print %llu is wrong", i);
+			at += expected.count;
+		}
+		assert(at == long_string.count, "String_Builder print has wrong length");
+		
+		char small[8];
+		u64 n = format_string_to_buffer_va(small, sizeof(small), "%s", long_string);
+		assert(n == 7 && small[7] == 0 && memcmp(small, long_string.data, 7) == 0, "Truncated formatting is wrong");
+		assert(format_string_to_buffer(0, 0, "", 0) == 0, "Counting empty format is wrong");
+		
+		dealloc_string(get_heap_allocator(), formatted);
+		string_builder_deinit(&builder);
+	}
+	
+	#undef EXPECT_FORMAT
+}
+
+void benchmark_string_format() {
+	const u64 iterations = 200000;
+	char buffer[256];
+	volatile u64 sink = 0;
+	
+	#define BENCHMARK_FORMAT_PROC(name, expression) {\
+		float64 start_seconds = os_get_elapsed_seconds();\
+		u64 start_cycles = rdtsc();\
+		for (u64 i = 0; i < iterations; i++) { expression; }\
+		u64 cycles = rdtsc()-start_cycles;\
+		float64 seconds = os_get_elapsed_seconds()-start_seconds;\
+		print("%cs: %.2f million per second, %llu cycles on average\n", name, ((float64)iterations/seconds)/1000000.0, cycles/iterations);\
+	}
+	
+	string name = STR("player");
+	BENCHMARK_FORMAT_PROC("Native format  ", sink += format_string_to_buffer_va(buffer, sizeof(buffer), "Entity %cs #%llu at %.2f, %.2f (%d%%)", "player", i, 12.5f, -3.25f, 87));
+	BENCHMARK_FORMAT_PROC("CRT vsnprintf  ", sink += test_crt_format(buffer, sizeof(buffer), "Entity %s #%llu at %.2f, %.2f (%d%%)", "player", i, 12.5f, -3.25f, 87));
+	BENCHMARK_FORMAT_PROC("tprint         ", sink += tprint("Entity %s #%llu at %.2f, %.2f (%d%%)", name, i, 12.5f, -3.25f, 87).count);
+	BENCHMARK_FORMAT_PROC("tprint %v2     ", sink += tprint("%v2", v2(12.5f, -3.25f)).count);
+	BENCHMARK_FORMAT_PROC("Native integers", sink += format_string_to_buffer_va(buffer, sizeof(buffer), "%llu %llu %d", i*7919, i, -(int)i));
+	BENCHMARK_FORMAT_PROC("CRT integers   ", sink += test_crt_format(buffer, sizeof(buffer), "%llu %llu %d", i*7919, i, -(int)i));
+	
+	#undef BENCHMARK_FORMAT_PROC
+	
+	reset_temporary_storage();
+}
+
+void test_file_io() {
+
+#if TARGET_OS == WINDOWS && !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+    // Test win32_fixed_utf8_to_null_terminated_wide
+    string utf8_str = STR("Test");
+    u16 *wide_str = win32_fixed_utf8_to_null_terminated_wide(utf8_str, get_heap_allocator());
+    assert(wide_str != NULL, "Failed: win32_fixed_utf8_to_null_terminated_wide");
+    assert(wide_str[4] == 0, "Failed: win32_fixed_utf8_to_null_terminated_wide");
+    dealloc(get_heap_allocator(), wide_str);
+
+    // Test temp_win32_fixed_utf8_to_null_terminated_wide
+    wide_str = temp_win32_fixed_utf8_to_null_terminated_wide(utf8_str);
+    assert(wide_str != NULL, "Failed: temp_win32_fixed_utf8_to_null_terminated_wide");
+    assert(wide_str[4] == 0, "Failed: temp_win32_fixed_utf8_to_null_terminated_wide");
+#endif
+
+	File file = OS_INVALID_FILE;
+
+    os_file_close(file);
+    // Test os_file_open and os_file_close
+    file = os_file_open("test.txt", O_WRITE | O_CREATE);
+    assert(file != OS_INVALID_FILE, "Failed: os_file_open (write/create)");
+    os_file_close(file);
+    
+
+    // Test os_file_write_string and os_file_read
+    string hello_world_write = STR("Hello, World!");
+    file = os_file_open("test.txt", O_WRITE | O_CREATE);
+    assert(file != OS_INVALID_FILE, "Failed: os_file_open (write/create)");
     bool write_result = os_file_write_string(file, hello_world_write);
     assert(write_result, "Failed: os_file_write_string");
     os_file_close(file);
@@ -1307,6 +2300,142 @@ void test_intmath() {
     assert(v4i_result.x == 1 && v4i_result.y == 2 && v4i_result.z == 3 && v4i_result.w == 4, "v4i_divi incorrect");
 }
 
+int compare_u64(const void *a, const void *b) {
+	u64 x = *(const u64*)a;
+	u64 y = *(const u64*)b;
+	return (x > y) - (x < y);
+}
+
+// Asset-like paths, lots of shared prefixes and suffixes which is where weak hashes collide
+u64 make_test_path_corpus(Arena *arena, string *paths, u64 max_count) {
+	Allocator allocator = make_arena_allocator_from_arena(arena);
+	const char *dirs[]  = {"res/sprites", "res/sprites/enemies", "res/audio/sfx", "res/audio/music", "res/fonts", "res/shaders", "assets/levels/world_01", "assets/levels/world_02"};
+	const char *names[] = {"player", "goblin", "slime", "tree", "rock", "chest", "door", "tile"};
+	const char *exts[]  = {".png", ".wav", ".ogg", ".ttf", ".hlsl", ".level"};
+	
+	u64 count = 0;
+	for (u64 d = 0; d < sizeof(dirs)/sizeof(dirs[0]); d++) {
+		for (u64 n = 0; n < sizeof(names)/sizeof(names[0]); n++) {
+			for (u64 e = 0; e < sizeof(exts)/sizeof(exts[0]); e++) {
+				for (u64 i = 0; i < 256; i++) {
+					if (count >= max_count) return count;
+					paths[count++] = sprint(allocator, STR("%cs/%cs_%llu/frame_%03llu%cs"), dirs[d], names[n], i/16, i%16, exts[e]);
+				}
+			}
+		}
+	}
+	return count;
+}
+
+void test_hash() {
+	Arena arena = make_virtual_arena(MB(64));
+	Allocator allocator = make_arena_allocator_from_arena(&arena);
+	
+	// Deterministic, seed matters, lengths around every code path boundary
+	u8 bytes[256];
+	for (u64 i = 0; i < sizeof(bytes); i++) bytes[i] = (u8)(i*7 + 3);
+	for (u64 count = 0; count <= sizeof(bytes); count++) {
+		string s = (string){count, bytes};
+		u64 h = string_get_hash(s);
+		assert(h == string_get_hash(s), "Hash is not deterministic for length %llu", count);
+		assert(h == string_get_hash_seeded(s, 0), "Seed 0 should match string_get_hash");
+		assert(h != string_get_hash_seeded(s, 12345), "Seed has no effect for length %llu", count);
+		assert(h == get_hash(s), "get_hash should use string_get_hash");
+		
+		// Every single bit flip must change the hash
+		for (u64 i = 0; i < count; i++) {
+			for (u64 bit = 0; bit < 8; bit++) {
+				bytes[i] ^= (u8)(1 << bit);
+				assert(string_get_hash(s) != h, "Flipping bit %llu of byte %llu in a %llu byte string did not change the hash", bit, i, count);
+				bytes[i] ^= (u8)(1 << bit);
+			}
+		}
+		
+		// Must not read outside the string
+		if (count < sizeof(bytes)) {
+			u8 saved = bytes[count];
+			bytes[count] ^= 0xFF;
+			assert(string_get_hash(s) == h, "Hash depends on bytes past the end for length %llu", count);
+			bytes[count] = saved;
+		}
+	}
+	assert(string_get_hash((string){1, (u8*)"aa"}) != string_get_hash((string){2, (u8*)"a\0"}), "Length should be part of the hash");
+	
+	const u64 max_paths = 1 << 17;
+	string *paths = alloc(allocator, max_paths*sizeof(string));
+	u64 path_count = make_test_path_corpus(&arena, paths, max_paths);
+	assert(path_count > 50000, "Path corpus too small");
+	
+	u64 *hashes = alloc(allocator, path_count*sizeof(u64));
+	u64 *help   = alloc(allocator, path_count*sizeof(u64));
+	
+	// No full 64 bit collisions
+	for (u64 i = 0; i < path_count; i++) hashes[i] = string_get_hash(paths[i]);
+	merge_sort(hashes, help, path_count, sizeof(u64), compare_u64);
+	for (u64 i = 1; i < path_count; i++) {
+		assert(hashes[i] != hashes[i-1], "64 bit hash collision in path corpus");
+	}
+	
+	// Low and high bits should both spread like random. With n keys in m buckets the
+	// expected number of empty buckets is m*e^(-n/m).
+	const u64 bucket_bits = 16;
+	const u64 bucket_count = 1ULL << bucket_bits;
+	u32 *buckets = alloc(allocator, bucket_count*sizeof(u32));
+	float64 expected_empty = (float64)bucket_count*exp(-(float64)path_count/(float64)bucket_count);
+	for (u64 shift = 0; shift <= 64-bucket_bits; shift += 64-bucket_bits) {
+		memset(buckets, 0, bucket_count*sizeof(u32));
+		u32 max_load = 0;
+		for (u64 i = 0; i < path_count; i++) {
+			u64 b = (string_get_hash(paths[i]) >> shift) & (bucket_count-1);
+			buckets[b] += 1;
+			max_load = max(max_load, buckets[b]);
+		}
+		u64 empty = 0;
+		for (u64 i = 0; i < bucket_count; i++) empty += buckets[i] == 0;
+		
+		float64 ratio = (float64)empty/expected_empty;
+		assert(ratio > 0.9 && ratio < 1.1, "Bad hash distribution in bits %llu..%llu: %llu empty buckets, expected about %.0f", shift, shift+bucket_bits, empty, expected_empty);
+		assert(max_load < 16, "Bad hash distribution in bits %llu..%llu: max bucket load %u", shift, shift+bucket_bits, max_load);
+	}
+	
+	destroy_virtual_arena(&arena);
+}
+
+void benchmark_hash() {
+	Allocator heap = get_heap_allocator();
+	
+	const u64 size = MB(8);
+	u8 *data = alloc(heap, size);
+	for (u64 i = 0; i < size; i++) data[i] = (u8)get_random();
+	
+	volatile u64 sink = 0;
+	
+	#define BENCHMARK_HASH_PROC(name, key_size, expression) {\
+		const u64 iterations = 10;\
+		float64 start_seconds = os_get_elapsed_seconds();\
+		u64 start_cycles = rdtsc();\
+		for (u64 i = 0; i < iterations; i++) for (u64 j = 0; j+(key_size) <= size; j += (key_size)) {\
+			string key = (string){(key_size), data+j};\
+			sink += expression;\
+		}\
+		u64 cycles = rdtsc()-start_cycles;\
+		float64 seconds = os_get_elapsed_seconds()-start_seconds;\
+		u64 key_count = (size/(key_size))*iterations;\
+		print("%cs %5llu byte keys: %8.2f MB/s, %.2f cycles per key\n", name, (u64)(key_size), ((float64)(key_count*(key_size))/seconds)/(1024.0*1024.0), (float64)cycles/(float64)key_count);\
+	}
+	
+	u64 key_sizes[] = {8, 24, 48, 100, 4096};
+	for (u64 k = 0; k < sizeof(key_sizes)/sizeof(key_sizes[0]); k++) {
+		u64 key_size = key_sizes[k];
+		BENCHMARK_HASH_PROC("string_get_hash", key_size, string_get_hash(key));
+		BENCHMARK_HASH_PROC("djb2_hash      ", key_size, djb2_hash(key));
+	}
+	
+	#undef BENCHMARK_HASH_PROC
+	
+	dealloc(heap, data);
+}
+
 void test_hash_table() {
     Hash_Table table = make_hash_table(string, int, get_heap_allocator());
     
@@ -1342,6 +2471,143 @@ void test_hash_table() {
     assert(table.entries == NULL, "Failed: Hash table entries should be NULL after destroy");
     assert(table.count == 0, "Failed: Hash table count should be 0 after destroy");
     assert(table.capacity_count == 0, "Failed: Hash table capacity count should be 0 after destroy");
+    
+    // String keys are copied, so the table doesn't care what happens to the key afterwards
+    {
+    	Hash_Table strings = make_hash_table(string, int, get_heap_allocator());
+    	string temp_key = string_copy(STR("Temporary key"), get_heap_allocator());
+    	int value = 5;
+    	hash_table_add(&strings, temp_key, value);
+    	string same_key = STR("Temporary key");
+    	memset(temp_key.data, 'x', temp_key.count);
+    	assert(hash_table_contains(&strings, same_key), "Failed: String key should be copied into the table");
+    	dealloc_string(get_heap_allocator(), temp_key);
+    	hash_table_destroy(&strings);
+    }
+    
+    // Keys with the same hash must not alias
+    {
+    	Hash_Table colliding = make_hash_table(u64, u64, get_heap_allocator());
+    	u64 hash = 1234;
+    	for (u64 k = 0; k < 100; k++) {
+    		u64 v = k*10;
+    		bool added = hash_table_set_raw(&colliding, hash, &k, &v, sizeof(u64), sizeof(u64));
+    		assert(added, "Failed: Colliding key %llu should be newly added", k);
+    	}
+    	assert(colliding.count == 100, "Failed: Colliding keys count");
+    	for (u64 k = 0; k < 100; k++) {
+    		u64 *v = hash_table_find_raw(&colliding, hash, &k, sizeof(u64));
+    		assert(v && *v == k*10, "Failed: Colliding key %llu aliased", k);
+    	}
+    	for (u64 k = 0; k < 100; k += 2) {
+    		assert(hash_table_remove_raw(&colliding, hash, &k, sizeof(u64)), "Failed: remove colliding key");
+    	}
+    	for (u64 k = 0; k < 100; k++) {
+    		u64 *v = hash_table_find_raw(&colliding, hash, &k, sizeof(u64));
+    		if (k % 2 == 0) assert(!v, "Failed: Removed colliding key %llu still found", k);
+    		if (k % 2 == 1) assert(v && *v == k*10, "Failed: Colliding key %llu lost after removing its neighbours", k);
+    	}
+    	hash_table_destroy(&colliding);
+    }
+    
+    // Grow, remove, reuse tombstones, iterate
+    {
+    	Hash_Table ints = make_hash_table(u64, u64, get_heap_allocator());
+    	const u64 count = 10000;
+    	for (u64 k = 0; k < count; k++) {
+    		u64 v = k+1;
+    		hash_table_add(&ints, k, v);
+    	}
+    	assert(ints.count == count, "Failed: Hash table count after growing");
+    	assert(ints.count <= hash_table_get_max_load(ints.capacity_count), "Failed: Hash table load factor");
+    	
+    	for (u64 k = 0; k < count; k += 3) {
+    		assert(hash_table_remove(&ints, k), "Failed: hash_table_remove");
+    		assert(!hash_table_remove(&ints, k), "Failed: hash_table_remove twice");
+    	}
+    	
+    	u64 iterator = 0;
+    	u64 *key;
+    	u64 *value;
+    	u64 iterated = 0;
+    	while (hash_table_iterate(&ints, &iterator, (void**)&key, (void**)&value)) {
+    		assert(*key % 3 != 0, "Failed: Iterated removed key %llu", *key);
+    		assert(*value == *key+1, "Failed: Iterated wrong value for key %llu", *key);
+    		iterated += 1;
+    	}
+    	assert(iterated == ints.count, "Failed: hash_table_iterate visited %llu of %llu", iterated, ints.count);
+    	
+    	// Churn with add/remove should not grow the table forever
+    	u64 capacity = ints.capacity_count;
+    	for (u64 i = 0; i < 100000; i++) {
+    		u64 k = count + i;
+    		u64 v = k+1;
+    		hash_table_add(&ints, k, v);
+    		hash_table_remove(&ints, k);
+    	}
+    	assert(ints.capacity_count == capacity, "Failed: Tombstones made the table grow");
+    	for (u64 k = 0; k < count; k++) {
+    		u64 *v = hash_table_find(&ints, k);
+    		if (k % 3 == 0) assert(!v, "Failed: Removed key %llu found", k);
+    		if (k % 3 != 0) assert(v && *v == k+1, "Failed: Key %llu lost", k);
+    	}
+    	hash_table_destroy(&ints);
+    }
+}
+
+void benchmark_hash_table() {
+	const u64 count = 1000000;
+	Hash_Table ints = make_hash_table(u64, u64, get_heap_allocator());
+	
+	float64 start_seconds = os_get_elapsed_seconds();
+	u64 start_cycles = rdtsc();
+	for (u64 k = 0; k < count; k++) {
+		u64 v = k;
+		hash_table_add(&ints, k, v);
+	}
+	u64 insert_cycles = rdtsc()-start_cycles;
+	float64 insert_seconds = os_get_elapsed_seconds()-start_seconds;
+	
+	u64 sum = 0;
+	start_seconds = os_get_elapsed_seconds();
+	start_cycles = rdtsc();
+	for (u64 i = 0; i < count; i++) {
+		// Half hits, half misses
+		u64 k = (i*7919) % (count*2);
+		u64 *v = hash_table_find(&ints, k);
+		if (v) sum += *v;
+	}
+	u64 lookup_cycles = rdtsc()-start_cycles;
+	float64 lookup_seconds = os_get_elapsed_seconds()-start_seconds;
+	
+	print("Hash table %llu inserts: %.2fms, %llu cycles on average\n", count, insert_seconds*1000.0, insert_cycles/count);
+	print("Hash table %llu lookups: %.2fms, %llu cycles on average (%llu)\n", count, lookup_seconds*1000.0, lookup_cycles/count, sum);
+	
+	hash_table_destroy(&ints);
+	
+	// Asset-style lookups: a few thousand string keys that all stay in cache
+	const u64 string_count = 4096;
+	Hash_Table strings = make_hash_table(string, u64, get_heap_allocator());
+	string *keys = alloc(get_heap_allocator(), string_count*sizeof(string));
+	for (u64 i = 0; i < string_count; i++) {
+		keys[i] = sprint(get_heap_allocator(), STR("res/sprites/asset_%i.png"), i);
+		hash_table_add(&strings, keys[i], i);
+	}
+	
+	sum = 0;
+	start_seconds = os_get_elapsed_seconds();
+	start_cycles = rdtsc();
+	for (u64 i = 0; i < count; i++) {
+		u64 *v = hash_table_find(&strings, keys[(i*7919) % string_count]);
+		sum += *v;
+	}
+	lookup_cycles = rdtsc()-start_cycles;
+	lookup_seconds = os_get_elapsed_seconds()-start_seconds;
+	print("Hash table %llu string lookups: %.2fms, %llu cycles on average (%llu)\n", count, lookup_seconds*1000.0, lookup_cycles/count, sum);
+	
+	for (u64 i = 0; i < string_count; i++) dealloc_string(get_heap_allocator(), keys[i]);
+	dealloc(get_heap_allocator(), keys);
+	hash_table_destroy(&strings);
 }
 
 #define NUM_BINS 100
@@ -1385,20 +2651,413 @@ void mutex_test_increment_counter(Thread* t) {
         mutex_release(&data->mutex);
     }
 }
+#define QUEUE_TEST_ITEM_COUNT 200000
+
+typedef struct Queue_Test_Producer {
+	Mpsc_Queue *mpsc;
+	Spsc_Queue *spsc;
+	Spinlock *lock; // For the locked baseline
+	u64 *locked_ring;
+	volatile u64 *locked_head;
+	volatile u64 *locked_tail;
+	u64 id;
+	u64 count;
+	u64 batch;
+} Queue_Test_Producer;
+
+void queue_test_producer_proc(Thread *t) {
+	Queue_Test_Producer *p = (Queue_Test_Producer*)t->data;
+	u64 items[64];
+	for (u64 i = 0; i < p->count;) {
+		u64 n = min(p->batch, p->count - i);
+		for (u64 j = 0; j < n; j++) items[j] = (p->id << 32) | (i + j);
+		
+		u64 pushed = 0;
+		if (p->spsc) {
+			pushed = p->batch > 1 ? spsc_queue_push_batch(p->spsc, items, n) : spsc_queue_push(p->spsc, items);
+		} else if (p->mpsc) {
+			pushed = p->batch > 1 ? mpsc_queue_push_batch(p->mpsc, items, n) : mpsc_queue_push(p->mpsc, items);
+		} else {
+			spinlock_acquire_or_wait(p->lock);
+			if (*p->locked_head - *p->locked_tail < 1024) {
+				p->locked_ring[*p->locked_head & 1023] = items[0];
+				*p->locked_head += 1;
+				pushed = 1;
+			}
+			spinlock_release(p->lock);
+		}
+		
+		if (pushed == 0) os_yield_thread();
+		i += pushed;
+	}
+}
+
+// Pops until total items arrived, checks each producer's items come in order
+u64 queue_test_consume(Queue_Test_Producer *p, u64 total, u64 producer_count) {
+	u64 next_expected[16] = {0};
+	u64 items[64];
+	u64 received = 0;
+	while (received < total) {
+		u64 n = 0;
+		if (p->spsc) {
+			n = spsc_queue_pop_batch(p->spsc, items, 64);
+		} else if (p->mpsc) {
+			n = mpsc_queue_pop_batch(p->mpsc, items, 64);
+		} else {
+			spinlock_acquire_or_wait(p->lock);
+			while (*p->locked_tail != *p->locked_head && n < 64) {
+				items[n++] = p->locked_ring[*p->locked_tail & 1023];
+				*p->locked_tail += 1;
+			}
+			spinlock_release(p->lock);
+		}
+		if (n == 0) {
+			os_yield_thread();
+			continue;
+		}
+		for (u64 i = 0; i < n; i++) {
+			u64 id = items[i] >> 32;
+			u64 seq = items[i] & 0xFFFFFFFF;
+			assert(id < producer_count, "Queue gave an item from an unknown producer %llu", id);
+			assert(seq == next_expected[id], "Queue gave producer %llu's items out of order: %llu, expected %llu", id, seq, next_expected[id]);
+			next_expected[id] += 1;
+		}
+		received += n;
+	}
+	return received;
+}
+
+// Kind 0: spsc, 1: mpsc, 2: spinlock baseline
+float64 run_queue_test(u64 kind, u64 producer_count, u64 batch, u64 items_per_producer) {
+	Allocator heap = get_heap_allocator();
+	
+	Spsc_Queue spsc;
+	Mpsc_Queue mpsc;
+	Spinlock lock;
+	volatile u64 locked_head = 0;
+	volatile u64 locked_tail = 0;
+	u64 *locked_ring = 0;
+	if (kind == 0) spsc_queue_init(&spsc, sizeof(u64), 1024, heap);
+	if (kind == 1) mpsc_queue_init(&mpsc, sizeof(u64), 1024, heap);
+	if (kind == 2) {
+		spinlock_init(&lock);
+		locked_ring = alloc(heap, 1024*sizeof(u64));
+	}
+	
+	Queue_Test_Producer producers[16];
+	Thread threads[16];
+	for (u64 i = 0; i < producer_count; i++) {
+		producers[i] = ZERO(Queue_Test_Producer);
+		producers[i].spsc = kind == 0 ? &spsc : 0;
+		producers[i].mpsc = kind == 1 ? &mpsc : 0;
+		producers[i].lock = &lock;
+		producers[i].locked_ring = locked_ring;
+		producers[i].locked_head = &locked_head;
+		producers[i].locked_tail = &locked_tail;
+		producers[i].id = i;
+		producers[i].count = items_per_producer;
+		producers[i].batch = batch;
+		os_thread_init(&threads[i], queue_test_producer_proc);
+		threads[i].data = &producers[i];
+	}
+	
+	float64 start = os_get_elapsed_seconds();
+	for (u64 i = 0; i < producer_count; i++) os_thread_start(&threads[i]);
+	
+	queue_test_consume(&producers[0], items_per_producer*producer_count, producer_count);
+	
+	for (u64 i = 0; i < producer_count; i++) {
+		os_thread_join(&threads[i]);
+		os_thread_destroy(&threads[i]);
+	}
+	float64 seconds = os_get_elapsed_seconds() - start;
+	
+	if (kind == 0) spsc_queue_deinit(&spsc);
+	if (kind == 1) mpsc_queue_deinit(&mpsc);
+	if (kind == 2) dealloc(heap, locked_ring);
+	
+	return seconds;
+}
+
+void test_queues() {
+	Allocator heap = get_heap_allocator();
+	
+	// Single threaded edge cases
+	{
+		Spsc_Queue q;
+		spsc_queue_init(&q, sizeof(u32), 5, heap);
+		assert(q.capacity == 8, "Failed: Spsc_Queue capacity should round to power of two");
+		
+		u32 x;
+		assert(!spsc_queue_pop(&q, &x), "Failed: Spsc_Queue pop on empty");
+		for (u32 i = 0; i < 8; i++) assert(spsc_queue_push(&q, &i), "Failed: Spsc_Queue push");
+		u32 overflow = 100;
+		assert(!spsc_queue_push(&q, &overflow), "Failed: Spsc_Queue push on full");
+		
+		// Wrap around with batches
+		for (u32 lap = 0; lap < 10; lap++) {
+			u32 out[5];
+			assert(spsc_queue_pop_batch(&q, out, 5) == 5, "Failed: Spsc_Queue pop_batch");
+			for (u32 i = 0; i < 5; i++) assert(out[i] == lap*5 + i, "Failed: Spsc_Queue order");
+			u32 in[8];
+			for (u32 i = 0; i < 8; i++) in[i] = lap*5 + 8 + i;
+			assert(spsc_queue_push_batch(&q, in, 8) == 5, "Failed: Spsc_Queue push_batch should push what fits");
+		}
+		spsc_queue_deinit(&q);
+	}
+	{
+		Mpsc_Queue q;
+		mpsc_queue_init(&q, 12, 4, heap);
+		
+		u8 item[12] = {0};
+		u8 out[12];
+		assert(!mpsc_queue_pop(&q, out), "Failed: Mpsc_Queue pop on empty");
+		for (u8 i = 0; i < 4; i++) {
+			item[11] = i;
+			assert(mpsc_queue_push(&q, item), "Failed: Mpsc_Queue push");
+		}
+		assert(!mpsc_queue_push(&q, item), "Failed: Mpsc_Queue push on full");
+		assert(mpsc_queue_push_batch(&q, item, 1) == 0, "Failed: Mpsc_Queue push_batch on full");
+		
+		for (u8 lap = 0; lap < 10; lap++) {
+			u8 outs[3][12];
+			assert(mpsc_queue_pop_batch(&q, outs, 3) == 3, "Failed: Mpsc_Queue pop_batch");
+			for (u8 i = 0; i < 3; i++) assert(outs[i][11] == (u8)(lap*3 + i), "Failed: Mpsc_Queue order");
+			u8 ins[4][12] = {0};
+			for (u8 i = 0; i < 4; i++) ins[i][11] = (u8)(lap*3 + 4 + i);
+			assert(mpsc_queue_push_batch(&q, ins, 4) == 3, "Failed: Mpsc_Queue push_batch should push what fits");
+		}
+		mpsc_queue_deinit(&q);
+	}
+	
+	// Threaded, checks order and that nothing is lost or duplicated
+	run_queue_test(0, 1, 1,  QUEUE_TEST_ITEM_COUNT);
+	run_queue_test(0, 1, 16, QUEUE_TEST_ITEM_COUNT);
+	run_queue_test(1, 4, 1,  QUEUE_TEST_ITEM_COUNT/4);
+	run_queue_test(1, 4, 16, QUEUE_TEST_ITEM_COUNT/4);
+}
+
+void benchmark_queues() {
+	u64 core_count = os_get_number_of_logical_processors();
+	u64 max_producers = clamp(core_count-1, 1, 8);
+	
+	const u64 total = QUEUE_TEST_ITEM_COUNT*5;
+	
+	float64 seconds = run_queue_test(0, 1, 1, total);
+	print("Spsc_Queue 1 producer:                 %.2f million items per second\n", (float64)total/seconds/1000000.0);
+	seconds = run_queue_test(0, 1, 16, total);
+	print("Spsc_Queue 1 producer, batches of 16:  %.2f million items per second\n", (float64)total/seconds/1000000.0);
+	
+	for (u64 producers = 1; producers <= max_producers; producers *= 2) {
+		u64 per_producer = total/producers;
+		seconds = run_queue_test(1, producers, 1, per_producer);
+		print("Mpsc_Queue %llu producers:                %.2f million items per second\n", producers, (float64)(per_producer*producers)/seconds/1000000.0);
+		seconds = run_queue_test(1, producers, 16, per_producer);
+		print("Mpsc_Queue %llu producers, batches of 16: %.2f million items per second\n", producers, (float64)(per_producer*producers)/seconds/1000000.0);
+		seconds = run_queue_test(2, producers, 1, per_producer);
+		print("Spinlock   %llu producers:                %.2f million items per second\n", producers, (float64)(per_producer*producers)/seconds/1000000.0);
+	}
+}
+
+void job_test_increment(void *data) {
+	*(u64*)data += 1;
+}
+
+typedef struct Job_Test_Fork {
+	u64 depth;
+	volatile u64 *leaf_count;
+} Job_Test_Fork;
+void job_test_fork(void *data) {
+	Job_Test_Fork *fork = (Job_Test_Fork*)data;
+	if (fork->depth == 0) {
+		atomic_add_64(fork->leaf_count, 1);
+		return;
+	}
+	
+	Job_Test_Fork children[2];
+	Job_Counter counter = ZERO(Job_Counter);
+	for (u64 i = 0; i < 2; i++) {
+		children[i].depth = fork->depth-1;
+		children[i].leaf_count = fork->leaf_count;
+		job_submit(&counter, job_test_fork, &children[i]);
+	}
+	job_wait(&counter);
+}
+
+void job_test_touch_range(u64 first, u64 last, void *data) {
+	u8 *touched = (u8*)data;
+	for (u64 i = first; i < last; i++) touched[i] += 1;
+}
+
+void job_test_check_parallel_for(u64 count, u64 grain) {
+	u8 *touched = alloc(get_heap_allocator(), max(count, 1));
+	memset(touched, 0, count);
+	parallel_for(count, grain, job_test_touch_range, touched);
+	for (u64 i = 0; i < count; i++) {
+		assert(touched[i] == 1, "parallel_for(%llu, %llu) touched item %llu %d times", count, grain, i, touched[i]);
+	}
+	dealloc(get_heap_allocator(), touched);
+}
+
+// Submits from a thread that isn't a worker, so the jobs go through the shared queue
+void job_test_outside_thread(Thread *t) {
+	u64 *slots = (u64*)t->data;
+	Job_Counter counter = ZERO(Job_Counter);
+	for (u64 i = 0; i < 3000; i++) {
+		job_submit(&counter, job_test_increment, &slots[i]);
+	}
+	job_wait(&counter);
+	
+	job_test_check_parallel_for(50000, 100);
+}
+
+void test_jobs() {
+	Allocator heap = get_heap_allocator();
+	
+	// The job system is opt-in, run it just for the test if the program didn't start it
+	bool started_job_system = !job_system.workers;
+	if (started_job_system) job_system_init(JOB_WORKER_COUNT, heap);
+	
+	// Plain jobs
+	const u64 job_count = 10000;
+	u64 *slots = alloc(heap, job_count*sizeof(u64));
+	memset(slots, 0, job_count*sizeof(u64));
+	Job_Counter counter = ZERO(Job_Counter);
+	for (u64 i = 0; i < job_count; i++) {
+		job_submit(&counter, job_test_increment, &slots[i]);
+	}
+	job_wait(&counter);
+	assert(job_counter_is_done(&counter), "Job counter not done after job_wait");
+	for (u64 i = 0; i < job_count; i++) {
+		assert(slots[i] == 1, "Job %llu ran %llu times", i, slots[i]);
+	}
+	
+	// Waiting on a counter with nothing submitted
+	Job_Counter empty = ZERO(Job_Counter);
+	job_wait(&empty);
+	
+	// Fork/join, jobs waiting on their own child jobs
+	volatile u64 leaf_count = 0;
+	Job_Test_Fork root = {12, &leaf_count};
+	Job_Counter root_counter = ZERO(Job_Counter);
+	job_submit(&root_counter, job_test_fork, &root);
+	job_wait(&root_counter);
+	assert(leaf_count == 4096, "Expected 4096 leaves, got %llu", leaf_count);
+	
+	// parallel_for, every item exactly once no matter how the range splits
+	u64 counts[] = {0, 1, 2, 7, 1000, 4097, 100003};
+	u64 grains[] = {0, 1, 3, 64, 1000, 1000000};
+	for (u64 c = 0; c < sizeof(counts)/sizeof(u64); c++) {
+		for (u64 g = 0; g < sizeof(grains)/sizeof(u64); g++) {
+			// Grain 1 on the big ranges is just slow
+			if (counts[c] > 5000 && grains[g] < 64) continue;
+			job_test_check_parallel_for(counts[c], grains[g]);
+		}
+	}
+	
+	// More jobs than fit in a deque, the overflow runs inline
+	u64 many_count = JOB_DEQUE_CAPACITY*3;
+	u64 *many = alloc(heap, many_count*sizeof(u64));
+	memset(many, 0, many_count*sizeof(u64));
+	Job_Counter many_counter = ZERO(Job_Counter);
+	for (u64 i = 0; i < many_count; i++) {
+		job_submit(&many_counter, job_test_increment, &many[i]);
+	}
+	job_wait(&many_counter);
+	for (u64 i = 0; i < many_count; i++) {
+		assert(many[i] == 1, "Job %llu ran %llu times", i, many[i]);
+	}
+	
+	// Submitting and waiting from threads outside the job system, while the main
+	// thread is also using it
+	Thread threads[3];
+	u64 *outside_slots[3];
+	for (u64 i = 0; i < 3; i++) {
+		outside_slots[i] = alloc(heap, 3000*sizeof(u64));
+		memset(outside_slots[i], 0, 3000*sizeof(u64));
+		os_thread_init(&threads[i], job_test_outside_thread);
+		threads[i].data = outside_slots[i];
+		os_thread_start(&threads[i]);
+	}
+	job_test_check_parallel_for(200000, 500);
+	for (u64 i = 0; i < 3; i++) {
+		os_thread_join(&threads[i]);
+		os_thread_destroy(&threads[i]);
+		for (u64 j = 0; j < 3000; j++) {
+			assert(outside_slots[i][j] == 1, "Outside job %llu ran %llu times", j, outside_slots[i][j]);
+		}
+		dealloc(heap, outside_slots[i]);
+	}
+	
+	dealloc(heap, many);
+	dealloc(heap, slots);
+	
+	if (started_job_system) job_system_shutdown();
+}
+
+void job_benchmark_work(u64 first, u64 last, void *data) {
+	float32 *values = (float32*)data;
+	for (u64 i = first; i < last; i++) {
+		float32 x = values[i];
+		for (u64 j = 0; j < 16; j++) x = sqrtf(x*x + 1.0f) * 0.5f;
+		values[i] = x;
+	}
+}
+void job_benchmark_empty(void *data) {}
+
+void benchmark_jobs() {
+	Allocator heap = get_heap_allocator();
+	
+	bool started_job_system = !job_system.workers;
+	if (started_job_system) job_system_init(JOB_WORKER_COUNT, heap);
+	const u64 count = 1 << 22;
+	float32 *values = alloc(heap, count*sizeof(float32));
+	for (u64 i = 0; i < count; i++) values[i] = (float32)i;
+	
+	float64 start = os_get_elapsed_seconds();
+	job_benchmark_work(0, count, values);
+	float64 single = os_get_elapsed_seconds()-start;
+	
+	print("Job system with %llu workers:\n", job_system.worker_count);
+	print("Single thread loop:              %.3f ms\n", single*1000.0);
+	u64 grains[] = {256, 4096, 65536};
+	for (u64 g = 0; g < sizeof(grains)/sizeof(u64); g++) {
+		start = os_get_elapsed_seconds();
+		parallel_for(count, grains[g], job_benchmark_work, values);
+		float64 seconds = os_get_elapsed_seconds()-start;
+		print("parallel_for grain %-6llu        %.3f ms (%.2fx)\n", grains[g], seconds*1000.0, single/seconds);
+	}
+	
+	const u64 job_count = 100000;
+	Job_Counter counter = ZERO(Job_Counter);
+	u64 cycles = rdtsc();
+	start = os_get_elapsed_seconds();
+	for (u64 i = 0; i < job_count; i++) {
+		job_submit(&counter, job_benchmark_empty, 0);
+	}
+	job_wait(&counter);
+	float64 seconds = os_get_elapsed_seconds()-start;
+	cycles = rdtsc()-cycles;
+	print("Submit + run empty job:          %.1f ns, %llu cycles\n", seconds*1000000000.0/(float64)job_count, cycles/job_count);
+	
+	dealloc(heap, values);
+	
+	if (started_job_system) job_system_shutdown();
+}
+
 void test_mutex() {
     Mutex m;
     
     // Test initialization
     mutex_init(&m);
-    assert(m.spin_time_microseconds == MUTEX_DEFAULT_SPIN_TIME_MICROSECONDS, "Failed: Default spin time incorrect");
-    assert(!m.spinlock_acquired, "Failed: Spinlock should not be acquired after initialization");
+    assert(m.state == MUTEX_UNLOCKED, "Failed: Mutex should be unlocked after initialization");
 
     // Test acquire and release without contention
     mutex_acquire_or_wait(&m);
-    assert(m.spinlock_acquired, "Failed: Mutex should be acquired after mutex_acquire_or_wait");
+    assert(m.state == MUTEX_LOCKED, "Failed: Mutex should be acquired after mutex_acquire_or_wait");
     
     mutex_release(&m);
-    assert(!m.spinlock_acquired, "Failed: Spinlock should not be acquired after mutex_release");
+    assert(m.state == MUTEX_UNLOCKED, "Failed: Mutex should not be acquired after mutex_release");
 
     // Clean up
     mutex_destroy(&m);
@@ -1427,8 +3086,685 @@ void test_mutex() {
     assert(data.counter == num_threads * MUTEX_TEST_TASK_COUNT, "Failed: Counter does not match expected value after threading tasks");
 
     mutex_destroy(&data.mutex);
+    
+    // Held for long enough that the waiter stops spinning and parks
+    data.counter = 0;
+    mutex_init(&data.mutex);
+    mutex_acquire_or_wait(&data.mutex);
+    Thread waiter;
+    os_thread_init(&waiter, mutex_test_increment_counter);
+    waiter.data = &data;
+    os_thread_start(&waiter);
+    for (u64 i = 0; i < 1000 && data.mutex.state != MUTEX_LOCKED_AND_WAITED; i++) {
+    	os_sleep(1);
+    }
+    assert(data.mutex.state == MUTEX_LOCKED_AND_WAITED, "Failed: Waiting thread should have parked");
+    assert(data.counter == 0, "Failed: Waiting thread got into the critical section");
+    mutex_release(&data.mutex);
+    os_thread_join(&waiter);
+    os_thread_destroy(&waiter);
+    assert(data.counter == MUTEX_TEST_TASK_COUNT, "Failed: Parked thread didn't finish after being woken");
+    assert(data.mutex.state == MUTEX_UNLOCKED, "Failed: Mutex should be unlocked");
+    mutex_destroy(&data.mutex);
+}
+
+///
+// Locks
+
+// What spinlock_acquire_or_wait used to do, for comparing against
+typedef struct Naive_Spinlock {
+	volatile bool locked;
+} Naive_Spinlock;
+void naive_spinlock_acquire(Naive_Spinlock *l) {
+	while (true) {
+		if (compare_and_swap_bool(&l->locked, true, false)) return;
+		while (l->locked) {}
+	}
+}
+void naive_spinlock_release(Naive_Spinlock *l) {
+	compare_and_swap_bool(&l->locked, false, true);
+}
+
+typedef enum Lock_Test_Kind {
+	LOCK_TEST_NAIVE_SPINLOCK,
+	LOCK_TEST_SPINLOCK,
+	LOCK_TEST_TICKET_LOCK,
+	LOCK_TEST_MUTEX,
+	LOCK_TEST_RW_LOCK,
+	LOCK_TEST_KIND_COUNT,
+} Lock_Test_Kind;
+
+typedef struct Lock_Test_Shared {
+	Lock_Test_Kind kind;
+	Naive_Spinlock naive;
+	Spinlock spinlock;
+	Ticket_Lock ticket;
+	Mutex mutex;
+	Rw_Lock rw;
+	
+	u64 iterations;      // 0 means run until stop
+	u64 read_percentage; // Only for LOCK_TEST_RW_LOCK and LOCK_TEST_SPINLOCK
+	volatile bool start;
+	volatile bool stop;
+	
+	// Protected by the lock
+	u64 a;
+	u64 b;
+	volatile bool inside;
+} Lock_Test_Shared;
+
+typedef struct Lock_Test_Thread {
+	Lock_Test_Shared *shared;
+	u64 acquisitions;
+	u64 seed;
+} Lock_Test_Thread;
+
+void lock_test_acquire(Lock_Test_Shared *s, bool write) {
+	switch (s->kind) {
+		case LOCK_TEST_NAIVE_SPINLOCK: naive_spinlock_acquire(&s->naive); break;
+		case LOCK_TEST_SPINLOCK:       spinlock_acquire_or_wait(&s->spinlock); break;
+		case LOCK_TEST_TICKET_LOCK:    ticket_lock_acquire_or_wait(&s->ticket); break;
+		case LOCK_TEST_MUTEX:          mutex_acquire_or_wait(&s->mutex); break;
+		case LOCK_TEST_RW_LOCK: {
+			if (write) rw_lock_acquire_write(&s->rw);
+			else       rw_lock_acquire_read(&s->rw);
+			break;
+		}
+		case LOCK_TEST_KIND_COUNT: break;
+	}
+}
+void lock_test_release(Lock_Test_Shared *s, bool write) {
+	switch (s->kind) {
+		case LOCK_TEST_NAIVE_SPINLOCK: naive_spinlock_release(&s->naive); break;
+		case LOCK_TEST_SPINLOCK:       spinlock_release(&s->spinlock); break;
+		case LOCK_TEST_TICKET_LOCK:    ticket_lock_release(&s->ticket); break;
+		case LOCK_TEST_MUTEX:          mutex_release(&s->mutex); break;
+		case LOCK_TEST_RW_LOCK: {
+			if (write) rw_lock_release_write(&s->rw);
+			else       rw_lock_release_read(&s->rw);
+			break;
+		}
+		case LOCK_TEST_KIND_COUNT: break;
+	}
+}
+
+void lock_test_thread_proc(Thread *t) {
+	Lock_Test_Thread *thread = (Lock_Test_Thread*)t->data;
+	Lock_Test_Shared *s = thread->shared;
+	while (!s->start) { os_yield_thread(); }
+	
+	u64 i = 0;
+	while (s->iterations ? i < s->iterations : !s->stop) {
+		thread->seed ^= thread->seed << 13; thread->seed ^= thread->seed >> 7; thread->seed ^= thread->seed << 17;
+		bool write = (thread->seed % 100) >= s->read_percentage;
+		
+		lock_test_acquire(s, write);
+		if (write) {
+			assert(!s->inside, "Two writers in the critical section");
+			s->inside = true;
+			s->a += 1;
+			for (u64 j = 0; j < 16; j++) s->b = s->b*6364136223846793005ull + 1442695040888963407ull;
+			s->b = s->a;
+			s->inside = false;
+		} else {
+			assert(!s->inside, "Reader and writer in the critical section");
+			u64 a = s->a;
+			for (u64 j = 0; j < 16; j++) a = a*6364136223846793005ull + 1442695040888963407ull;
+			assert(s->a == s->b, "Reader saw a half written update");
+		}
+		lock_test_release(s, write);
+		
+		thread->acquisitions += 1;
+		i += 1;
+		
+		// Some work outside the lock
+		for (u64 j = 0; j < 16; j++) thread->seed = thread->seed*6364136223846793005ull + 1;
+		if (!thread->seed) thread->seed = 1;
+	}
+}
+
+// Returns seconds taken. If iterations is 0, runs for duration seconds.
+float64 run_lock_test(Lock_Test_Kind kind, u64 thread_count, u64 iterations, u64 read_percentage, float64 duration, u64 *out_min, u64 *out_max, u64 *out_total) {
+	Allocator heap = get_heap_allocator();
+	Lock_Test_Shared *s = alloc(heap, sizeof(Lock_Test_Shared));
+	memset(s, 0, sizeof(Lock_Test_Shared));
+	s->kind = kind;
+	s->iterations = iterations;
+	s->read_percentage = read_percentage;
+	spinlock_init(&s->spinlock);
+	ticket_lock_init(&s->ticket);
+	mutex_init(&s->mutex);
+	rw_lock_init(&s->rw);
+	
+	Thread *threads = alloc(heap, thread_count*sizeof(Thread));
+	Lock_Test_Thread *data = alloc(heap, thread_count*sizeof(Lock_Test_Thread));
+	for (u64 i = 0; i < thread_count; i++) {
+		data[i] = ZERO(Lock_Test_Thread);
+		data[i].shared = s;
+		data[i].seed = 0x9E3779B97F4A7C15ull*(i+1);
+		os_thread_init(&threads[i], lock_test_thread_proc);
+		threads[i].data = &data[i];
+		os_thread_start(&threads[i]);
+	}
+	
+	float64 start = os_get_elapsed_seconds();
+	s->start = true;
+	if (!iterations) {
+		os_sleep((u32)(duration*1000.0));
+		s->stop = true;
+	}
+	for (u64 i = 0; i < thread_count; i++) {
+		os_thread_join(&threads[i]);
+		os_thread_destroy(&threads[i]);
+	}
+	float64 seconds = os_get_elapsed_seconds()-start;
+	
+	u64 total = 0, least = UINT64_MAX, most = 0;
+	for (u64 i = 0; i < thread_count; i++) {
+		total += data[i].acquisitions;
+		least = min(least, data[i].acquisitions);
+		most = max(most, data[i].acquisitions);
+	}
+	u64 writes = s->a;
+	if (read_percentage == 0) {
+		assert(writes == total, "Lost updates: %llu acquisitions but counter is %llu", total, writes);
+	}
+	
+	if (out_min) *out_min = least;
+	if (out_max) *out_max = most;
+	if (out_total) *out_total = total;
+	
+	mutex_destroy(&s->mutex);
+	dealloc(heap, data);
+	dealloc(heap, threads);
+	dealloc(heap, s);
+	return seconds;
+}
+
+void test_locks() {
+	Spin_Backoff backoff = ZERO(Spin_Backoff);
+	for (u64 i = 0; i < 20; i++) spin_backoff(&backoff);
+	assert(backoff.pauses > SPIN_BACKOFF_MAX_PAUSES, "Backoff should have reached the yield stage, pauses is %u", backoff.pauses);
+	
+	Spinlock l;
+	spinlock_init(&l);
+	assert(spinlock_try_acquire(&l), "try_acquire failed on a free spinlock");
+	assert(!spinlock_try_acquire(&l), "try_acquire succeeded on a taken spinlock");
+	assert(!spinlock_acquire_or_wait_timeout(&l, 0.001), "Timed acquire succeeded on a taken spinlock");
+	spinlock_release(&l);
+	assert(spinlock_acquire_or_wait_timeout(&l, 0.001), "Timed acquire failed on a free spinlock");
+	spinlock_release(&l);
+	
+	Ticket_Lock t;
+	ticket_lock_init(&t);
+	for (u64 i = 0; i < 3; i++) {
+		ticket_lock_acquire_or_wait(&t);
+		ticket_lock_release(&t);
+	}
+	assert(t.next_ticket == 3 && t.now_serving == 3, "Ticket lock counters are off");
+	
+	Rw_Lock rw;
+	rw_lock_init(&rw);
+	rw_lock_acquire_read(&rw);
+	rw_lock_acquire_read(&rw);
+	assert(rw.state == 2, "Expected 2 readers, state is %llx", rw.state);
+	rw_lock_release_read(&rw);
+	rw_lock_release_read(&rw);
+	rw_lock_acquire_write(&rw);
+	assert(rw.state == RW_LOCK_WRITER, "Expected writer, state is %llx", rw.state);
+	rw_lock_release_write(&rw);
+	assert(rw.state == 0, "Expected free, state is %llx", rw.state);
+	
+	// Mutual exclusion under contention (run_lock_test asserts there are no lost updates)
+	for (Lock_Test_Kind kind = 0; kind < LOCK_TEST_KIND_COUNT; kind++) {
+		run_lock_test(kind, 4, 5000, 0, 0, 0, 0, 0);
+	}
+	// Readers never see a writer's half done update
+	run_lock_test(LOCK_TEST_RW_LOCK, 4, 20000, 90, 0, 0, 0, 0);
 }
 
+void benchmark_locks() {
+	u64 core_count = os_get_number_of_logical_processors();
+	u64 thread_counts[] = {2, clamp(core_count, 2, 16)};
+	string names[] = {STR("Old spinlock"), STR("Spinlock"), STR("Ticket_Lock"), STR("Mutex"), STR("Rw_Lock (writes)")};
+	
+	for (u64 t = 0; t < sizeof(thread_counts)/sizeof(u64); t++) {
+		if (t > 0 && thread_counts[t] == thread_counts[t-1]) break;
+		u64 thread_count = thread_counts[t];
+		for (Lock_Test_Kind kind = 0; kind < LOCK_TEST_KIND_COUNT; kind++) {
+			u64 least, most, total;
+			float64 seconds = run_lock_test(kind, thread_count, 0, 0, 0.2, &least, &most, &total);
+			print("%s, %llu threads: %.2f million acquisitions per second, fairness (least/most) %.2f\n", names[kind], thread_count, (float64)total/seconds/1000000.0, (float64)least/(float64)max(most, 1));
+		}
+		
+		u64 total;
+		float64 seconds = run_lock_test(LOCK_TEST_SPINLOCK, thread_count, 0, 90, 0.2, 0, 0, &total);
+		print("Spinlock 90%% reads, %llu threads: %.2f million acquisitions per second\n", thread_count, (float64)total/seconds/1000000.0);
+		seconds = run_lock_test(LOCK_TEST_RW_LOCK, thread_count, 0, 90, 0.2, 0, 0, &total);
+		print("Rw_Lock 90%% reads, %llu threads:  %.2f million acquisitions per second\n", thread_count, (float64)total/seconds/1000000.0);
+	}
+}
+
+void benchmark_mutex() {
+	const u64 iterations = 1000000;
+	
+	Mutex m;
+	mutex_init(&m);
+	u64 cycles = rdtsc();
+	for (u64 i = 0; i < iterations; i++) {
+		mutex_acquire_or_wait(&m);
+		mutex_release(&m);
+	}
+	cycles = rdtsc()-cycles;
+	print("Mutex uncontended acquire + release:     %llu cycles\n", cycles/iterations);
+	mutex_destroy(&m);
+	
+	Spinlock l;
+	spinlock_init(&l);
+	cycles = rdtsc();
+	for (u64 i = 0; i < iterations; i++) {
+		spinlock_acquire_or_wait(&l);
+		spinlock_release(&l);
+	}
+	cycles = rdtsc()-cycles;
+	print("Spinlock uncontended acquire + release:  %llu cycles\n", cycles/iterations);
+	
+	Mutex_Handle os_mutex = os_make_mutex();
+	cycles = rdtsc();
+	for (u64 i = 0; i < iterations; i++) {
+		os_lock_mutex(os_mutex);
+		os_unlock_mutex(os_mutex);
+	}
+	cycles = rdtsc()-cycles;
+	print("OS mutex uncontended lock + unlock:      %llu cycles\n", cycles/iterations);
+	os_destroy_mutex(os_mutex);
+	
+	u64 core_count = os_get_number_of_logical_processors();
+	u64 thread_counts[] = {2, clamp(core_count, 2, 16), clamp(core_count*2, 4, 32)};
+	for (u64 t = 0; t < sizeof(thread_counts)/sizeof(u64); t++) {
+		if (t > 0 && thread_counts[t] == thread_counts[t-1]) continue;
+		u64 total;
+		float64 seconds = run_lock_test(LOCK_TEST_MUTEX, thread_counts[t], 0, 0, 0.2, 0, 0, &total);
+		print("Mutex contended, %llu threads:            %.1f ns per acquire + release\n", thread_counts[t], seconds*1000000000.0/(float64)total);
+	}
+}
+
+u64 profiler_test_count_occurrences(string s, string sub) {
+	u64 count = 0;
+	while (true) {
+		s64 index = string_find_from_left(s, sub);
+		if (index < 0) break;
+		count += 1;
+		s = string_view(s, index+sub.count, s.count-index-sub.count);
+	}
+	return count;
+}
+
+void profiler_test_thread(Thread *t) {
+	for (u64 i = 0; i < 5; i++) {
+		u64 begin = rdtsc();
+		_profiler_record("profiler_test_other_thread", begin, rdtsc());
+	}
+}
+
+#if ENABLE_PROFILING
+void profiler_test_leave_by_return() {
+	tm_scope("profiler_test_leak_return") {
+		return;
+	}
+}
+#endif
+
+void test_profiler() {
+	Allocator heap = get_heap_allocator();
+	
+	u64 begin = rdtsc();
+	_profiler_record("profiler_test_a", begin, rdtsc());
+	_profiler_record("profiler_test_b", begin, rdtsc());
+	
+	Thread thread;
+	os_thread_init(&thread, profiler_test_thread);
+	os_thread_start(&thread);
+	os_thread_join(&thread);
+	os_thread_destroy(&thread);
+	
+	String_Builder sb;
+	string_builder_init(&sb, heap);
+	profiler_build_trace_json(&sb);
+	string json = sb.result;
+	assert(json.count >= 2 && json.data[0] == '[' && json.data[json.count-1] == ']', "Trace is not a JSON array");
+	assert(profiler_test_count_occurrences(json, STR("\"name\":\"profiler_test_a\"")) == 1, "Expected one profiler_test_a event");
+	assert(profiler_test_count_occurrences(json, STR("\"name\":\"profiler_test_b\"")) == 1, "Expected one profiler_test_b event");
+	assert(profiler_test_count_occurrences(json, STR("\"name\":\"profiler_test_other_thread\"")) == 5, "Expected 5 events from the other thread");
+	assert(profiler_test_count_occurrences(json, STR("\"dur\":-")) == 0, "Negative duration in trace");
+	string_builder_deinit(&sb);
+	
+	// Overflowing the ring keeps only the latest events
+	for (u64 i = 0; i < PROFILER_EVENTS_PER_THREAD+10; i++) {
+		_profiler_record("profiler_test_overflow", begin, begin+i);
+	}
+	string_builder_init(&sb, heap);
+	profiler_build_trace_json(&sb);
+	json = sb.result;
+	assert(profiler_test_count_occurrences(json, STR("\"name\":\"profiler_test_a\"")) == 0, "Overwritten event is still in trace");
+#if ENABLE_PROFILING && ENABLE_ENGINE_PROFILING
+	// The string builder's heap_alloc's go in the same ring
+	u64 overflow_count = profiler_test_count_occurrences(json, STR("\"name\":\"profiler_test_overflow\""));
+	assert(overflow_count <= PROFILER_EVENTS_PER_THREAD && overflow_count > PROFILER_EVENTS_PER_THREAD-64, "Expected a full ring of overflow events, got %llu", overflow_count);
+#else
+	assert(profiler_test_count_occurrences(json, STR("\"name\":\"profiler_test_overflow\"")) == PROFILER_EVENTS_PER_THREAD, "Expected a full ring of overflow events");
+#endif
+	assert(profiler_test_count_occurrences(json, STR("\"name\":\"profiler_test_other_thread\"")) == 5, "Other thread's events should be untouched");
+	string_builder_deinit(&sb);
+	
+	// Frame stats. Flush what's been recorded so far, then fill a whole window with
+	// frames of known cycle counts.
+	profiler_end_frame();
+	u64 base = rdtsc();
+	for (u64 i = 0; i < PROFILER_STATS_FRAME_COUNT; i++) {
+		u64 frame_begin = base + i*100000;
+		// Children end first, parent spans both
+		_profiler_record("profiler_test_child", frame_begin+100, frame_begin+300);
+		_profiler_record("profiler_test_child", frame_begin+400, frame_begin+500);
+		_profiler_record("profiler_test_parent", frame_begin, frame_begin+1000);
+		_profiler_record("profiler_test_frame", frame_begin, frame_begin+(i+1)*100);
+		profiler_end_frame();
+	}
+	
+	Profiler_Scope_Stats parent, child, frame;
+	assert(profiler_get_scope_stats(STR("profiler_test_parent"), &parent), "Missing parent stats");
+	assert(profiler_get_scope_stats(STR("profiler_test_child"), &child), "Missing child stats");
+	assert(profiler_get_scope_stats(STR("profiler_test_frame"), &frame), "Missing frame stats");
+	Profiler_Scope_Stats unknown;
+	assert(!profiler_get_scope_stats(STR("profiler_test_never_recorded"), &unknown), "Unknown scope should have no stats");
+	
+	f64 seconds_per_cycle = parent.total_seconds/(f64)(1000*PROFILER_STATS_FRAME_COUNT);
+	assert(seconds_per_cycle > 0, "Profiler has no clock");
+	#define EXPECT_CYCLES(seconds, cycles) assert(fabs((seconds)/seconds_per_cycle - (f64)(cycles)) < 0.01*(f64)(cycles), #seconds " is %f cycles, expected %llu", (seconds)/seconds_per_cycle, (u64)(cycles))
+	assert(parent.frame_count == PROFILER_STATS_FRAME_COUNT, "Stats window is %llu frames", parent.frame_count);
+	assert(parent.call_count == PROFILER_STATS_FRAME_COUNT, "Parent calls %llu", parent.call_count);
+	assert(child.call_count == PROFILER_STATS_FRAME_COUNT*2, "Child calls %llu", child.call_count);
+	EXPECT_CYCLES(parent.self_seconds, 700*PROFILER_STATS_FRAME_COUNT);
+	EXPECT_CYCLES(child.total_seconds, 300*PROFILER_STATS_FRAME_COUNT);
+	EXPECT_CYCLES(child.self_seconds, 300*PROFILER_STATS_FRAME_COUNT);
+	EXPECT_CYCLES(child.min_seconds, 100);
+	EXPECT_CYCLES(child.max_seconds, 200);
+	EXPECT_CYCLES(parent.p50_seconds, 1000);
+	
+	// Frame i took (i+1)*100 cycles
+	u64 last = PROFILER_STATS_FRAME_COUNT-1;
+	EXPECT_CYCLES(frame.min_seconds, 100);
+	EXPECT_CYCLES(frame.max_seconds, PROFILER_STATS_FRAME_COUNT*100);
+	EXPECT_CYCLES(frame.p50_seconds, ((last*50+50)/100+1)*100);
+	EXPECT_CYCLES(frame.p95_seconds, ((last*95+50)/100+1)*100);
+	EXPECT_CYCLES(frame.p99_seconds, ((last*99+50)/100+1)*100);
+	
+	// Frames roll out of the window
+	for (u64 i = 0; i < PROFILER_STATS_FRAME_COUNT; i++) profiler_end_frame();
+	assert(profiler_get_scope_stats(STR("profiler_test_parent"), &parent), "Missing parent stats");
+	assert(parent.call_count == 0 && parent.total_seconds == 0, "Old frames should have left the window");
+	
+	// More direct children than PROFILER_MAX_NESTING, all of them are subtracted
+	base = rdtsc();
+	const u64 many_children = PROFILER_MAX_NESTING*3;
+	_profiler_open_scopes += 1;
+	for (u64 i = 0; i < many_children; i++) {
+		_profiler_record("profiler_test_many_child", base+i*100+10, base+i*100+60);
+	}
+	_profiler_open_scopes -= 1;
+	_profiler_record("profiler_test_many_parent", base, base+many_children*100);
+	profiler_end_frame();
+	Profiler_Scope_Stats many_parent;
+	assert(profiler_get_scope_stats(STR("profiler_test_many_parent"), &many_parent), "Missing parent stats");
+	EXPECT_CYCLES(many_parent.self_seconds, many_children*50);
+	
+	// A sibling of the parent must not be folded with the parent's children:
+	// outer { sibling, parent { child } }
+	base = rdtsc();
+	_profiler_open_scopes += 1;
+	_profiler_record("profiler_test_fold_sibling", base+10, base+20);
+	_profiler_open_scopes += 1;
+	_profiler_record("profiler_test_fold_child", base+40, base+70);
+	_profiler_open_scopes -= 1;
+	_profiler_record("profiler_test_fold_parent", base+30, base+80);
+	_profiler_open_scopes -= 1;
+	_profiler_record("profiler_test_fold_outer", base, base+1000);
+	profiler_end_frame();
+	Profiler_Scope_Stats fold_parent, fold_outer;
+	assert(profiler_get_scope_stats(STR("profiler_test_fold_parent"), &fold_parent), "Missing parent stats");
+	assert(profiler_get_scope_stats(STR("profiler_test_fold_outer"), &fold_outer), "Missing outer stats");
+	EXPECT_CYCLES(fold_parent.self_seconds, 20);
+	EXPECT_CYCLES(fold_outer.self_seconds, 1000-10-50);
+	#undef EXPECT_CYCLES
+	
+	// Frame flame
+	base = rdtsc();
+	_profiler_record("profiler_test_flame_leaf",  base+200, base+300);
+	_profiler_record("profiler_test_flame_child", base+100, base+400);
+	_profiler_record("profiler_test_flame_child", base+500, base+600);
+	_profiler_record("profiler_test_flame_root",  base,     base+1000);
+	profiler_end_frame();
+	
+	string_builder_init(&sb, get_heap_allocator());
+	profiler_build_frame_flame(&sb);
+	string flame = sb.result;
+	assert(profiler_test_count_occurrences(flame, STR("\n  profiler_test_flame_root ")) == 1, "Expected the root at depth 1:\n%s", flame);
+	assert(profiler_test_count_occurrences(flame, STR("\n    profiler_test_flame_child ")) == 1, "Expected both child calls merged at depth 2:\n%s", flame);
+	assert(profiler_test_count_occurrences(flame, STR("\n      profiler_test_flame_leaf ")) == 1, "Expected the leaf at depth 3:\n%s", flame);
+	assert(profiler_test_count_occurrences(flame, STR("profiler_test_parent")) == 0, "Only the last frame should be in the flame");
+	
+	s64 child_line = string_find_from_left(flame, STR("profiler_test_flame_child"));
+	string child_rest = string_view(flame, child_line, flame.count-child_line);
+	s64 child_line_end = string_find_from_left(child_rest, STR("\n"));
+	assert(strings_match(string_view(child_rest, child_line_end-2, 2), STR(" 2")), "Expected 2 child calls:\n%s", flame);
+	string_builder_deinit(&sb);
+	
+#if ENABLE_PROFILING
+	// Scopes left through break or return aren't recorded, and the enclosing scope puts
+	// the depth back when it ends
+	u64 depth_before = _profiler_open_scopes;
+	tm_scope("profiler_test_leak_outer") {
+		tm_scope("profiler_test_leak_break") {
+			break;
+		}
+		profiler_test_leave_by_return();
+		tm_scope("profiler_test_leak_child") {
+			os_yield_thread();
+		}
+	}
+	assert(_profiler_open_scopes == depth_before, "Open scope count leaked, %llu instead of %llu", _profiler_open_scopes, depth_before);
+	tm_scope("profiler_test_leak_after") {}
+	Profiler_Thread_Events *this_thread = _profiler_this_thread;
+	Profile_Event after = this_thread->events[(this_thread->count-1) & (PROFILER_EVENTS_PER_THREAD-1)];
+	assert(after.depth == depth_before, "Scope after a leak recorded depth %llu, expected %llu", after.depth, depth_before);
+	profiler_end_frame();
+	
+	Profiler_Scope_Stats leak_outer, leak_child, leaked;
+	assert(!profiler_get_scope_stats(STR("profiler_test_leak_break"), &leaked), "Scope left through break was recorded");
+	assert(!profiler_get_scope_stats(STR("profiler_test_leak_return"), &leaked), "Scope left through return was recorded");
+	assert(profiler_get_scope_stats(STR("profiler_test_leak_outer"), &leak_outer), "Missing outer stats");
+	assert(profiler_get_scope_stats(STR("profiler_test_leak_child"), &leak_child), "Missing child stats");
+	assert(leak_outer.call_count == 1 && leak_child.call_count == 1, "Expected one outer and one child call");
+	f64 expected_outer_self = leak_outer.total_seconds-leak_child.total_seconds;
+	assert(fabs(leak_outer.self_seconds-expected_outer_self) <= 0.001*leak_outer.total_seconds, "Outer self time %f, expected %f", leak_outer.self_seconds, expected_outer_self);
+	assert(leak_child.self_seconds == leak_child.total_seconds, "Child has no children");
+#endif
+	
+#if ENABLE_PROFILING && ENABLE_ENGINE_PROFILING
+	// Engine hot paths record themselves
+	void *engine_alloc = alloc(get_heap_allocator(), 64);
+	dealloc(get_heap_allocator(), engine_alloc);
+	u64 sort_items[16] = {0};
+	u64 sort_help[16];
+	radix_sort(sort_items, sort_help, 16, sizeof(u64), 0, 8);
+	profiler_end_frame();
+	
+	Profiler_Scope_Stats engine;
+	assert(profiler_get_scope_stats(STR("heap_alloc"), &engine), "heap_alloc is not instrumented");
+	assert(engine.call_count > 0, "heap_alloc was not recorded");
+	assert(profiler_get_scope_stats(STR("radix_sort"), &engine), "radix_sort is not instrumented");
+	assert(engine.call_count == 1, "radix_sort recorded %llu times", engine.call_count);
+#endif
+}
+
+void benchmark_profiler() {
+	const u64 iterations = 100000;
+	
+	// What every tm_scope used to do
+	Spinlock lock;
+	spinlock_init(&lock);
+	String_Builder sb;
+	string_builder_init_reserve(&sb, 1024*1000, get_heap_allocator());
+	string fmt = STR("{\"cat\":\"function\",\"dur\":%.3f,\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%zu,\"ts\":%.3f},");
+	float64 start = os_get_elapsed_seconds();
+	for (u64 i = 0; i < iterations; i++) {
+		f64 scope_start = os_get_elapsed_seconds();
+		f64 elapsed = os_get_elapsed_seconds()-scope_start;
+		spinlock_acquire_or_wait(&lock);
+		string_builder_print(&sb, fmt, elapsed*1000000, STR("benchmark"), get_context().thread_id, scope_start*1000000);
+		spinlock_release(&lock);
+	}
+	float64 old_seconds = os_get_elapsed_seconds()-start;
+	string_builder_deinit(&sb);
+	
+	start = os_get_elapsed_seconds();
+	for (u64 i = 0; i < iterations; i++) {
+		u64 begin = rdtsc();
+		_profiler_record("benchmark", begin, rdtsc());
+	}
+	float64 new_seconds = os_get_elapsed_seconds()-start;
+	
+	print("Profiler scope overhead, JSON string builder: %.1f ns\n", old_seconds*1000000000.0/(float64)iterations);
+	print("Profiler scope overhead, binary ring buffer:  %.1f ns\n", new_seconds*1000000000.0/(float64)iterations);
+}
+
+#if ENABLE_ALLOCATION_TRACKING
+bool allocation_tracker_test_find(u32 line, Allocation_Callsite_Stats *result) {
+	local_persist Allocation_Callsite_Stats stats[ALLOCATION_TRACKER_MAX_CALLSITES];
+	u64 count = allocation_tracker_get_callsite_stats(stats, ALLOCATION_TRACKER_MAX_CALLSITES);
+	for (u64 i = 0; i < count; i++) {
+		if (stats[i].line == line && strings_match(stats[i].file, STR(__FILE__))) {
+			*result = stats[i];
+			return true;
+		}
+	}
+	return false;
+}
+
+#define ALLOCATION_TRACKER_TEST_THREAD_ALLOCS 1000
+u32 allocation_tracker_test_thread_line = 0;
+void allocation_tracker_test_thread(Thread *t) {
+	Allocator heap = get_heap_allocator();
+	for (u64 i = 0; i < ALLOCATION_TRACKER_TEST_THREAD_ALLOCS; i++) {
+		allocation_tracker_test_thread_line = __LINE__; void *p = alloc(heap, 32+i%200);
+		dealloc(heap, p);
+	}
+}
+
+void test_allocation_tracker() {
+	Allocator heap = get_heap_allocator();
+	Allocation_Callsite_Stats stats;
+	
+	Allocation_Tracker_Stats before;
+	allocation_tracker_get_stats(&before);
+	
+	void *blocks[3];
+	u32 heap_line = __LINE__; for (u64 i = 0; i < 3; i++) blocks[i] = alloc(heap, 100);
+	u32 temp_line = __LINE__; void *temp = alloc(get_temporary_allocator(), 100);
+	(void)temp;
+	
+	assert(allocation_tracker_test_find(heap_line, &stats), "Heap callsite was not tracked");
+	assert(stats.allocation_count == 3 && stats.allocated_bytes == 300, "Expected 3 allocations of 100 bytes, got %llu (%llu bytes)", stats.allocation_count, stats.allocated_bytes);
+	assert(stats.live_count == 3, "Expected 3 live blocks, got %llu", stats.live_count);
+	assert(stats.live_bytes >= 300 && stats.peak_live_bytes == stats.live_bytes, "Bad live bytes %llu, peak %llu", stats.live_bytes, stats.peak_live_bytes);
+	u64 three_blocks_bytes = stats.live_bytes;
+	
+	// Temporary storage is freed all at once, so it's only counted
+	assert(allocation_tracker_test_find(temp_line, &stats), "Temporary allocation callsite was not tracked");
+	assert(stats.allocation_count == 1 && stats.live_count == 0, "Temporary allocations should not be live");
+	
+	Allocation_Block_Info info = allocation_tracker_get_block_info(blocks[1]);
+	assert(info.line == heap_line && strings_match(info.file, STR(__FILE__)), "Block info points to %s:%u", info.file, info.line);
+	assert(info.frame == (u32)before.frame, "Block info frame is %u, expected %llu", info.frame, before.frame);
+	assert(info.size >= 100, "Block info size is %llu", info.size);
+	
+	// Per frame numbers
+	allocation_tracker_end_frame();
+	assert(allocation_tracker_test_find(heap_line, &stats), "Heap callsite was not tracked");
+	assert(stats.last_frame_allocation_count == 3 && stats.last_frame_allocated_bytes == 300, "Expected 3 allocations last frame, got %llu", stats.last_frame_allocation_count);
+	allocation_tracker_end_frame();
+	assert(allocation_tracker_test_find(heap_line, &stats), "Heap callsite was not tracked");
+	assert(stats.last_frame_allocation_count == 0, "Nothing was allocated last frame");
+	
+	Allocation_Tracker_Stats after;
+	allocation_tracker_get_stats(&after);
+	assert(after.frame == before.frame+2, "Expected 2 more frames");
+	assert(after.live_count >= before.live_count+3, "Totals are missing live blocks");
+	assert(after.peak_live_bytes >= after.live_bytes, "Peak is below live bytes");
+	
+	// Reallocating through allocator.proc keeps the callsite, even when it moves
+	blocks[0] = heap.proc(KB(10), blocks[0], ALLOCATOR_REALLOCATE, heap.data);
+	assert(allocation_tracker_test_find(heap_line, &stats), "Heap callsite was not tracked");
+	assert(stats.live_count == 3 && stats.live_bytes > three_blocks_bytes, "Realloc should move the live bytes with it");
+	
+	// reallocate is its own callsite
+	u32 realloc_line = __LINE__; blocks[1] = reallocate(heap, blocks[1], 100, KB(10));
+	assert(allocation_tracker_test_find(realloc_line, &stats), "Reallocate callsite was not tracked");
+	assert(stats.allocation_count == 1 && stats.live_count == 1, "Moved reallocation should be live at the reallocate callsite");
+	assert(allocation_tracker_test_find(heap_line, &stats), "Heap callsite was not tracked");
+	assert(stats.live_count == 2, "Moved reallocation should have left the original callsite");
+	
+	for (u64 i = 0; i < 3; i++) dealloc(heap, blocks[i]);
+	assert(allocation_tracker_test_find(heap_line, &stats), "Heap callsite was not tracked");
+	assert(stats.live_count == 0 && stats.live_bytes == 0, "Leaked %llu blocks, %llu bytes", stats.live_count, stats.live_bytes);
+	assert(stats.peak_live_bytes > three_blocks_bytes, "Peak should have the grown block");
+	
+	// Several threads on the same callsite
+	const u64 thread_count = 4;
+	Thread threads[4];
+	for (u64 i = 0; i < thread_count; i++) {
+		os_thread_init(&threads[i], allocation_tracker_test_thread);
+		os_thread_start(&threads[i]);
+	}
+	for (u64 i = 0; i < thread_count; i++) {
+		os_thread_join(&threads[i]);
+		os_thread_destroy(&threads[i]);
+	}
+	assert(allocation_tracker_test_find(allocation_tracker_test_thread_line, &stats), "Thread callsite was not tracked");
+	assert(stats.allocation_count == thread_count*ALLOCATION_TRACKER_TEST_THREAD_ALLOCS, "Lost allocations between threads: %llu", stats.allocation_count);
+	assert(stats.live_count == 0 && stats.live_bytes == 0, "Lost deallocations between threads: %llu blocks, %llu bytes", stats.live_count, stats.live_bytes);
+	
+	String_Builder sb;
+	string_builder_init(&sb, heap);
+	allocation_tracker_build_report(&sb);
+	assert(string_find_from_left(sb.result, tprint("%cs:%u\n", __FILE__, heap_line)) >= 0, "Report is missing a callsite:\n%s", sb.result);
+	string_builder_deinit(&sb);
+}
+
+void benchmark_allocation_tracker() {
+	const u64 iterations = 1000000;
+	Allocator heap = get_heap_allocator();
+	
+	// (alloc) skips the callsite macro, heap live bytes are still tracked
+	float64 start = os_get_elapsed_seconds();
+	for (u64 i = 0; i < iterations; i++) {
+		void *p = (alloc)(heap, 64);
+		dealloc(heap, p);
+	}
+	float64 untracked_seconds = os_get_elapsed_seconds()-start;
+	
+	start = os_get_elapsed_seconds();
+	for (u64 i = 0; i < iterations; i++) {
+		void *p = alloc(heap, 64);
+		dealloc(heap, p);
+	}
+	float64 tracked_seconds = os_get_elapsed_seconds()-start;
+	
+	print("Heap alloc+dealloc without callsite: %.1f ns\n", untracked_seconds*1000000000.0/(float64)iterations);
+	print("Heap alloc+dealloc with callsite:    %.1f ns\n", tracked_seconds*1000000000.0/(float64)iterations);
+}
+#endif
+
 #ifndef OOGABOOGA_HEADLESS
 int compare_draw_quads(const void *a, const void *b) {
     return ((Draw_Quad*)a)->z-((Draw_Quad*)b)->z;
@@ -1499,12 +3835,130 @@ void test_sort() {
     
     print("Merge sort took on average %llu cycles and %.2f ms\n", cycles / num_samples, (seconds * 1000.0) / (float64)num_samples);
 }
+
+u64 test_count_quad_chunks(Draw_Frame *frame) {
+	u64 count = 0;
+	for (Draw_Quad_Chunk *chunk = frame->first_quad_chunk; chunk; chunk = chunk->next) count += 1;
+	return count;
+}
+void test_draw_frame_quads() {
+	Draw_Frame frame;
+	draw_frame_init_with_quad_arena(&frame);
+	assert(draw_frame_get_quad_count(&frame) == 0, "Failed: new quad arena should be empty");
+	
+	// Spans several chunks, quads must never move while the frame grows
+	const u64 quad_count = DRAW_QUAD_CHUNK_CAPACITY*4+17;
+	Draw_Quad **quads = alloc(get_heap_allocator(), quad_count*sizeof(Draw_Quad*));
+	for (u64 i = 0; i < quad_count; i++) {
+		quads[i] = draw_frame_push_quad(&frame);
+		quads[i]->z = (s32)i;
+		quads[i]->color = v4((float32)i, 0, 0, 1);
+		assert(draw_frame_get_quad_count(&frame) == i+1, "Failed: draw_frame_get_quad_count, expected %llu got %llu", i+1, draw_frame_get_quad_count(&frame));
+	}
+	for (u64 i = 0; i < quad_count; i++) {
+		assert(quads[i]->z == (s32)i && quads[i]->color.x == (float32)i, "Failed: quad %llu was moved or overwritten", i);
+		if (i > 0) assert(quads[i] != quads[i-1], "Failed: quad %llu was handed out twice", i);
+	}
+	u64 spike_chunks = test_count_quad_chunks(&frame);
+	assert(spike_chunks == 5, "Failed: expected 5 chunks, got %llu", spike_chunks);
+	
+	// Chunks are kept right after the spike, and reused without moving
+	draw_frame_reset_quad_arena(&frame);
+	assert(draw_frame_get_quad_count(&frame) == 0, "Failed: quad count after reset");
+	assert(test_count_quad_chunks(&frame) == spike_chunks, "Failed: chunks should be kept right after a spike");
+	Draw_Quad *first = draw_frame_push_quad(&frame);
+	assert(first == quads[0], "Failed: quad arena should reuse its chunks after reset");
+	
+	// Small frames, the high water mark decays and the extra chunks are freed
+	for (u64 i = 0; i < 1000; i++) {
+		for (u64 j = 0; j < 10; j++) draw_frame_push_quad(&frame);
+		draw_frame_reset_quad_arena(&frame);
+	}
+	assert(test_count_quad_chunks(&frame) == 1, "Failed: chunks were not trimmed after the spike decayed, %llu left", test_count_quad_chunks(&frame));
+	assert(frame.first_quad_chunk->next == 0, "Failed: trimmed chunk list is not terminated");
+	for (u64 i = 0; i < DRAW_QUAD_CHUNK_CAPACITY+1; i++) draw_frame_push_quad(&frame);
+	assert(draw_frame_get_quad_count(&frame) == DRAW_QUAD_CHUNK_CAPACITY+1, "Failed: draw_frame_get_quad_count after trim");
+	assert(test_count_quad_chunks(&frame) == 2, "Failed: quad arena should grow again after trim");
+	
+	draw_frame_deinit(&frame);
+	assert(frame.first_quad_chunk == 0 && frame.current_quad_chunk == 0 && draw_frame_get_quad_count(&frame) == 0, "Failed: draw_frame_deinit should leave an empty frame");
+	dealloc(get_heap_allocator(), quads);
+}
 #endif /* OOGABOOGA_HEADLESS */
 
 typedef struct Test_Thing {
     int foo;
     float bar;
 } Test_Thing;
+bool test_growing_array_is_multiple(void *item, void *data) {
+    return *(u64*)item % *(u64*)data == 0;
+}
+typedef struct Test_Counting_Predicate {
+    u64 modulo;
+    u64 calls;
+} Test_Counting_Predicate;
+bool test_growing_array_is_multiple_counted(void *item, void *data) {
+    Test_Counting_Predicate *p = (Test_Counting_Predicate*)data;
+    p->calls += 1;
+    return *(u64*)item % p->modulo == 0;
+}
+bool test_growing_array_is_dead_particle(void *item, void *data) {
+    return ((Test_Thing*)item)->foo < 0;
+}
+
+void benchmark_growing_array_batch() {
+    // Particle cleanup, a few hundred dead out of many thousand
+    const u64 count = 20000;
+    const u64 dead_count = 500;
+    Test_Thing *things;
+    growing_array_init_reserve((void**)&things, sizeof(Test_Thing), count, get_heap_allocator());
+    
+    u64 cycles_one_by_one = 0;
+    u64 cycles_remove_if = 0;
+    for (u64 pass = 0; pass < 2; pass++) {
+        growing_array_clear((void**)&things);
+        for (u64 i = 0; i < count; i++) {
+            bool dead = (i % (count/dead_count)) == 0;
+            growing_array_add((void**)&things, &(Test_Thing){dead ? -1 : (int)i, 0});
+        }
+        
+        u64 start = rdtsc();
+        if (pass == 0) {
+            for (s64 i = (s64)growing_array_get_valid_count(things)-1; i >= 0; i--) {
+                if (things[i].foo < 0) growing_array_ordered_remove_by_index((void**)&things, (u64)i);
+            }
+            cycles_one_by_one = rdtsc()-start;
+        } else {
+            growing_array_ordered_remove_if((void**)&things, test_growing_array_is_dead_particle, 0);
+            cycles_remove_if = rdtsc()-start;
+        }
+        assert(growing_array_get_valid_count(things) == count-dead_count, "Failed: benchmark removed wrong count");
+    }
+    print("Removing %llu of %llu items: %llu cycles one by one, %llu cycles with remove_if\n", dead_count, count, cycles_one_by_one, cycles_remove_if);
+    
+    // Find, worst case (last item)
+    u32 *numbers;
+    growing_array_init((void**)&numbers, sizeof(u32), get_heap_allocator());
+    for (u32 i = 0; i < 1000000; i++) growing_array_add((void**)&numbers, &i);
+    u32 last = 999999;
+    
+    u64 start = rdtsc();
+    volatile s64 found = growing_array_find_index_from_left_by_value((void**)&numbers, &last);
+    u64 cycles_find = rdtsc()-start;
+    
+    start = rdtsc();
+    s64 found_bytes = -1;
+    for (u64 i = 0; i < growing_array_get_valid_count(numbers); i++) {
+        if (bytes_match(&numbers[i], &last, sizeof(u32))) { found_bytes = (s64)i; break; }
+    }
+    u64 cycles_bytes = rdtsc()-start;
+    assert(found == found_bytes, "Failed: find mismatch");
+    print("Finding u32 in 1000000 items: %llu cycles, %llu cycles with byte compare\n", cycles_find, cycles_bytes);
+    
+    growing_array_deinit((void**)&numbers);
+    growing_array_deinit((void**)&things);
+}
+
 void test_growing_array() {
     Test_Thing *things = 0;
     
@@ -1565,6 +4019,173 @@ void test_growing_array() {
     assert(!bytes_match(&copy, thing, sizeof(Test_Thing)), "Failed: growing_array_unordered_remove_by_pointer");
     
     assert(growing_array_get_valid_count(things) == 99, "Failed: growing_array_get_valid_count");
+    
+    growing_array_deinit((void**)&things);
+    
+    // Growth policies
+    {
+        u32 *numbers;
+        growing_array_init_reserve((void**)&numbers, sizeof(u32), 10, get_heap_allocator());
+        assert(growing_array_get_allocated_count(numbers) == 16, "Failed: growing_array_init_reserve should round up to power of two");
+        
+        growing_array_set_growth((void**)&numbers, GROWING_ARRAY_GROWTH_EXACT);
+        growing_array_reserve((void**)&numbers, 17);
+        assert(growing_array_get_allocated_count(numbers) == 17, "Failed: GROWING_ARRAY_GROWTH_EXACT");
+        
+        growing_array_set_growth((void**)&numbers, GROWING_ARRAY_GROWTH_ONE_AND_A_HALF);
+        growing_array_reserve((void**)&numbers, 18);
+        assert(growing_array_get_allocated_count(numbers) == 25, "Failed: GROWING_ARRAY_GROWTH_ONE_AND_A_HALF");
+        growing_array_reserve((void**)&numbers, 100);
+        assert(growing_array_get_allocated_count(numbers) == 100, "Failed: GROWING_ARRAY_GROWTH_ONE_AND_A_HALF should give at least what was asked for");
+        
+        for (u32 i = 0; i < 1000; i++) growing_array_add((void**)&numbers, &i);
+        for (u32 i = 0; i < 1000; i++) assert(numbers[i] == i, "Failed: growing array lost items when growing");
+        
+        growing_array_deinit((void**)&numbers);
+    }
+    
+    // Inline storage
+    {
+        GROWING_ARRAY_INLINE_STORAGE(storage, Test_Thing, 4);
+        Test_Thing *inline_things;
+        growing_array_init_with_storage((void**)&inline_things, sizeof(Test_Thing), storage, sizeof(storage), get_heap_allocator());
+        assert((u8*)inline_things > (u8*)storage && (u8*)inline_things < (u8*)storage + sizeof(storage), "Failed: growing_array_init_with_storage should use the storage");
+        assert(growing_array_get_allocated_count(inline_things) == 4, "Failed: growing_array_init_with_storage allocated count");
+        
+        for (u32 i = 0; i < 4; i++) growing_array_add((void**)&inline_things, &(Test_Thing){i, (float32)i});
+        assert((u8*)inline_things < (u8*)storage + sizeof(storage), "Failed: growing array left inline storage before it was full");
+        
+        for (u32 i = 4; i < 100; i++) growing_array_add((void**)&inline_things, &(Test_Thing){i, (float32)i});
+        assert((u8*)inline_things < (u8*)storage || (u8*)inline_things >= (u8*)storage + sizeof(storage), "Failed: growing array should leave inline storage when full");
+        assert(growing_array_get_valid_count(inline_things) == 100, "Failed: growing_array_get_valid_count after leaving inline storage");
+        for (u32 i = 0; i < 100; i++) assert(inline_things[i].foo == i, "Failed: growing array lost items when leaving inline storage");
+        
+        growing_array_deinit((void**)&inline_things);
+        
+        // Deinit while still inline must not dealloc the storage
+        growing_array_init_with_storage((void**)&inline_things, sizeof(Test_Thing), storage, sizeof(storage), get_heap_allocator());
+        growing_array_add((void**)&inline_things, &(Test_Thing){1, 1});
+        growing_array_deinit((void**)&inline_things);
+    }
+    
+    // Batch operations
+    {
+        Allocator heap = get_heap_allocator();
+        const u64 count = 10000;
+        u64 *numbers;
+        growing_array_init((void**)&numbers, sizeof(u64), heap);
+        for (u64 i = 0; i < count; i++) growing_array_add((void**)&numbers, &i);
+        
+        u64 modulo = 3;
+        u64 removed = growing_array_ordered_remove_if((void**)&numbers, test_growing_array_is_multiple, &modulo);
+        assert(removed == (count+2)/3, "Failed: growing_array_ordered_remove_if removed %llu", removed);
+        assert(growing_array_get_valid_count(numbers) == count-removed, "Failed: growing_array_ordered_remove_if count");
+        for (u64 i = 0; i < growing_array_get_valid_count(numbers); i++) {
+            u64 expected = (i/2)*3 + 1 + (i%2);
+            assert(numbers[i] == expected, "Failed: growing_array_ordered_remove_if order, %llu at %llu", numbers[i], i);
+        }
+        
+        // Predicates with side effects see every item exactly once
+        Test_Counting_Predicate counting = {4, 0};
+        u64 before = growing_array_get_valid_count(numbers);
+        removed = growing_array_ordered_remove_if((void**)&numbers, test_growing_array_is_multiple_counted, &counting);
+        assert(counting.calls == before, "Failed: growing_array_ordered_remove_if called the predicate %llu times for %llu items", counting.calls, before);
+        assert(growing_array_get_valid_count(numbers) == before-removed, "Failed: growing_array_ordered_remove_if count");
+        for (u64 i = 0; i < growing_array_get_valid_count(numbers); i++) {
+            assert(numbers[i] % 4 != 0 && (i == 0 || numbers[i] > numbers[i-1]), "Failed: growing_array_ordered_remove_if left %llu at %llu", numbers[i], i);
+        }
+        
+        modulo = 2;
+        before = growing_array_get_valid_count(numbers);
+        removed = growing_array_unordered_remove_if((void**)&numbers, test_growing_array_is_multiple, &modulo);
+        assert(growing_array_get_valid_count(numbers) == before-removed, "Failed: growing_array_unordered_remove_if count");
+        for (u64 i = 0; i < growing_array_get_valid_count(numbers); i++) {
+            assert(numbers[i] % 2 != 0 && numbers[i] % 3 != 0, "Failed: growing_array_unordered_remove_if left %llu", numbers[i]);
+        }
+        
+        growing_array_clear((void**)&numbers);
+        for (u64 i = 0; i < 20; i++) growing_array_add((void**)&numbers, &i);
+        u64 indices[] = {0, 3, 4, 5, 10, 19};
+        growing_array_ordered_remove_indices((void**)&numbers, indices, 6);
+        u64 expected_left[] = {1, 2, 6, 7, 8, 9, 11, 12, 13, 14, 15, 16, 17, 18};
+        assert(growing_array_get_valid_count(numbers) == 14, "Failed: growing_array_ordered_remove_indices count");
+        assert(bytes_match(numbers, expected_left, sizeof(expected_left)), "Failed: growing_array_ordered_remove_indices");
+        
+        u64 inserted[] = {100, 101, 102};
+        growing_array_insert_multiple((void**)&numbers, 2, inserted, 3);
+        u64 expected_inserted[] = {1, 2, 100, 101, 102, 6, 7};
+        assert(bytes_match(numbers, expected_inserted, sizeof(expected_inserted)), "Failed: growing_array_insert_multiple");
+        assert(numbers[16] == 18, "Failed: growing_array_insert_multiple tail");
+        
+        assert(growing_array_find_index_from_left_by_pointer((void**)&numbers, &numbers[5]) == 5, "Failed: growing_array_find_index_from_left_by_pointer");
+        assert(growing_array_find_index_from_left_by_pointer((void**)&numbers, (u8*)&numbers[5]+1) == -1, "Failed: growing_array_find_index_from_left_by_pointer misaligned");
+        assert(growing_array_find_index_from_left_by_pointer((void**)&numbers, &numbers[17]) == -1, "Failed: growing_array_find_index_from_left_by_pointer out of range");
+        
+        growing_array_deinit((void**)&numbers);
+        
+        // Find for every size with a vector path, match at every position
+        u64 sizes[] = {4, 8, 16, 12};
+        for (u64 s = 0; s < sizeof(sizes)/sizeof(sizes[0]); s++) {
+            u64 size = sizes[s];
+            u8 *items;
+            growing_array_init((void**)&items, size, heap);
+            growing_array_resize((void**)&items, 37);
+            memset(items, 0, 37*size);
+            for (u64 i = 0; i < 37; i++) items[i*size + size-1] = (u8)(i+1);
+            
+            u8 value[16] = {0};
+            for (u64 i = 0; i < 37; i++) {
+                value[size-1] = (u8)(i+1);
+                s64 found = growing_array_find_index_from_left_by_value((void**)&items, value);
+                assert(found == (s64)i, "Failed: growing_array_find_index_from_left_by_value size %llu expected %llu got %lld", size, i, found);
+            }
+            // Partial matches must not count
+            value[size-1] = 1;
+            value[0] = 1;
+            assert(growing_array_find_index_from_left_by_value((void**)&items, value) == -1, "Failed: growing_array_find_index_from_left_by_value partial match, size %llu", size);
+            
+            growing_array_deinit((void**)&items);
+        }
+    }
+}
+
+void benchmark_growing_array() {
+    benchmark_growing_array_batch();
+    
+    // Growing in place means reserve shouldn't need to copy much, if anything
+    {
+        u32 *numbers;
+        growing_array_init((void**)&numbers, sizeof(u32), get_heap_allocator());
+        
+        const u64 item_count = 10000000;
+        u64 bytes_copied = 0;
+        u64 bytes_copied_without_realloc = 0;
+        
+        float64 start_seconds = os_get_elapsed_seconds();
+        u64 start_cycles = rdtsc();
+        for (u32 i = 0; i < item_count; i++) {
+            u32 *before = numbers;
+            u64 allocated_before = growing_array_get_allocated_count(numbers);
+            
+            growing_array_add((void**)&numbers, &i);
+            
+            if (growing_array_get_allocated_count(numbers) != allocated_before) {
+                u64 old_bytes = allocated_before*sizeof(u32);
+                bytes_copied_without_realloc += old_bytes;
+                if (numbers != before) bytes_copied += old_bytes;
+            }
+        }
+        u64 cycles = rdtsc()-start_cycles;
+        float64 seconds = os_get_elapsed_seconds()-start_seconds;
+        
+        for (u32 i = 0; i < item_count; i += 9973) {
+            assert(numbers[i] == i, "Failed: growing array lost items when growing");
+        }
+        
+        print("Growing array append %llu items: %llu cycles, %.2fms. Copied %llu bytes (alloc+copy would copy %llu bytes)\n", item_count, cycles, seconds*1000.0, bytes_copied, bytes_copied_without_realloc);
+        
+        growing_array_deinit((void**)&numbers);
+    }
 }
 
 
@@ -1712,10 +4333,38 @@ void oogabooga_run_tests() {
 	test_threads();
 	print("OK!\n");
 	
+	print("Testing threaded allocator... ");
+	test_allocator_threads();
+	print("OK!\n");
+	
+	print("Testing arena... ");
+	test_arena();
+	print("OK!\n");
+	
+	print("Testing pool... ");
+	test_pool();
+	print("OK!\n");
+	
+	print("Testing string interning... ");
+	test_string_intern();
+	print("OK!\n");
+	
 	print("Testing strings... ");
 	test_strings();
 	print("OK!\n");
 	
+	print("Testing gap buffer... ");
+	test_gap_buffer();
+	print("OK!\n");
+	
+	print("Testing string formatting... ");
+	test_string_format();
+	print("OK!\n");
+	
+	print("Testing simd strings... ");
+	test_string_simd();
+	print("OK!\n");
+	
 	print("Testing file IO... ");
 	test_file_io();
 	print("OK!\n");
@@ -1732,6 +4381,10 @@ void oogabooga_run_tests() {
 	test_simd();
 	print("OK!\n");
 	
+	print("Testing hash... ");
+	test_hash();
+	print("OK!\n");
+	
 	print("Testing hash table... ");
 	test_hash_table();
 	print("OK!\n");
@@ -1744,6 +4397,28 @@ void oogabooga_run_tests() {
 	test_mutex();
 	print("OK!\n");
 	
+	print("Testing locks... ");
+	test_locks();
+	print("OK!\n");
+	
+	print("Testing profiler... ");
+	test_profiler();
+	print("OK!\n");
+	
+#if ENABLE_ALLOCATION_TRACKING
+	print("Testing allocation tracker... ");
+	test_allocation_tracker();
+	print("OK!\n");
+#endif
+	
+	print("Testing queues... ");
+	test_queues();
+	print("OK!\n");
+	
+	print("Testing job system... ");
+	test_jobs();
+	print("OK!\n");
+	
 	print("Testing binary semaphore... ");
 	test_os_binary_semaphore();
 	print("OK!\n");
@@ -1752,9 +4427,34 @@ void oogabooga_run_tests() {
 	print("Testing radix sort... ");
 	test_sort();
 	print("OK!\n");
+	
+	print("Testing draw frame quads... ");
+	test_draw_frame_quads();
+	print("OK!\n");
 #endif
 
 	
 	
 	print("All tests ok!\n");
 }
+
+// Timings only, nothing is checked here. Enable with RUN_BENCHMARKS (oogabooga.c).
+void oogabooga_run_benchmarks() {
+	benchmark_heap();
+	benchmark_growing_array();
+	benchmark_gap_buffer();
+	benchmark_string_format();
+	benchmark_strings();
+	benchmark_hash();
+	benchmark_hash_table();
+	benchmark_locks();
+	benchmark_mutex();
+	benchmark_profiler();
+#if ENABLE_ALLOCATION_TRACKING
+	benchmark_allocation_tracker();
+#endif
+	benchmark_queues();
+	benchmark_jobs();
+	
+	print("All benchmarks done!\n");
+}
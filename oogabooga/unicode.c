@@ -110,6 +110,122 @@ u32 next_utf8(string *s) {
     return result.utf32;
 }
 
+///
+// Bulk utf8 decoding
+// Gives the same codepoints as calling next_utf8() until the string is empty or out is
+// full, including 0 for invalid sequences. Runs of ascii are widened 16 (sse2) or 32 (avx2)
+// bytes at a time. Which one is used is picked at startup by unicode_select_simd_procs().
+// Advances s past the decoded bytes and returns the number of codepoints written to out.
+
+u64 utf8_to_utf32_bulk_scalar(string *s, u32 *out, u64 out_capacity) {
+	u64 count = 0;
+	while (s->count > 0 && count < out_capacity) {
+		if (s->data[0] < 0x80) {
+			out[count++] = s->data[0];
+			s->data += 1;
+			s->count -= 1;
+		} else {
+			out[count++] = next_utf8(s);
+		}
+	}
+	return count;
+}
+
+#if ENABLE_SIMD && SIMD_ENABLE_SSE2
+u64 utf8_to_utf32_bulk_sse2(string *s, u32 *out, u64 out_capacity) {
+	u64 count = 0;
+	__m128i zero = _mm_setzero_si128();
+	while (s->count > 0 && count < out_capacity) {
+		if (s->count >= 16 && out_capacity-count >= 16) {
+			__m128i bytes = _mm_loadu_si128((__m128i*)s->data);
+			u32 non_ascii = (u32)_mm_movemask_epi8(bytes);
+			if (non_ascii == 0) {
+				__m128i lo = _mm_unpacklo_epi8(bytes, zero);
+				__m128i hi = _mm_unpackhi_epi8(bytes, zero);
+				_mm_storeu_si128((__m128i*)(out+count+0),  _mm_unpacklo_epi16(lo, zero));
+				_mm_storeu_si128((__m128i*)(out+count+4),  _mm_unpackhi_epi16(lo, zero));
+				_mm_storeu_si128((__m128i*)(out+count+8),  _mm_unpacklo_epi16(hi, zero));
+				_mm_storeu_si128((__m128i*)(out+count+12), _mm_unpackhi_epi16(hi, zero));
+				count += 16;
+				s->data += 16;
+				s->count -= 16;
+				continue;
+			}
+			// Copy the ascii before the first non-ascii byte, then decode that one below
+			u32 ascii_count = bit_scan_forward_32(non_ascii);
+			for (u32 i = 0; i < ascii_count; i++) out[count++] = s->data[i];
+			s->data += ascii_count;
+			s->count -= ascii_count;
+		}
+		if (s->data[0] < 0x80) {
+			out[count++] = s->data[0];
+			s->data += 1;
+			s->count -= 1;
+		} else {
+			out[count++] = next_utf8(s);
+		}
+	}
+	return count;
+}
+#endif
+
+#if ENABLE_SIMD && COMPILER_CAN_TARGET_AVX2
+target_avx2 u64 utf8_to_utf32_bulk_avx2(string *s, u32 *out, u64 out_capacity) {
+	u64 count = 0;
+	while (s->count > 0 && count < out_capacity) {
+		if (s->count >= 32 && out_capacity-count >= 32) {
+			__m256i bytes = _mm256_loadu_si256((__m256i*)s->data);
+			u32 non_ascii = (u32)_mm256_movemask_epi8(bytes);
+			if (non_ascii == 0) {
+				for (u32 i = 0; i < 32; i += 8) {
+					__m128i eight = _mm_loadl_epi64((__m128i*)(s->data+i));
+					_mm256_storeu_si256((__m256i*)(out+count+i), _mm256_cvtepu8_epi32(eight));
+				}
+				count += 32;
+				s->data += 32;
+				s->count -= 32;
+				continue;
+			}
+			u32 ascii_count = bit_scan_forward_32(non_ascii);
+			for (u32 i = 0; i < ascii_count; i++) out[count++] = s->data[i];
+			s->data += ascii_count;
+			s->count -= ascii_count;
+		}
+		if (s->data[0] < 0x80) {
+			out[count++] = s->data[0];
+			s->data += 1;
+			s->count -= 1;
+		} else {
+			out[count++] = next_utf8(s);
+		}
+	}
+	return count;
+}
+#endif
+
+typedef u64(*Utf8_To_Utf32_Bulk_Proc)(string *s, u32 *out, u64 out_capacity);
+
+// #Global
+ogb_instance Utf8_To_Utf32_Bulk_Proc utf8_to_utf32_bulk_proc;
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+#if ENABLE_SIMD && SIMD_ENABLE_SSE2
+Utf8_To_Utf32_Bulk_Proc utf8_to_utf32_bulk_proc = utf8_to_utf32_bulk_sse2;
+#else
+Utf8_To_Utf32_Bulk_Proc utf8_to_utf32_bulk_proc = utf8_to_utf32_bulk_scalar;
+#endif
+#endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
+
+void unicode_select_simd_procs(Cpu_Capabilities features) {
+#if ENABLE_SIMD && COMPILER_CAN_TARGET_AVX2
+	if (features.avx2) utf8_to_utf32_bulk_proc = utf8_to_utf32_bulk_avx2;
+#endif
+}
+
+inline u64 utf8_to_utf32_bulk(string *s, u32 *out, u64 out_capacity) {
+	return utf8_to_utf32_bulk_proc(s, out, out_capacity);
+}
+
 u64 utf8_index_to_byte_index(string str, u64 index) {
 	u64 byte_index = 0;
 	u64 utf8_index = 0;
@@ -21,6 +21,8 @@
 // At 21 bits I'm able to sort a completely randomized collection of 100k integers at around
 // 8m cycles (or 2.5-2.6ms on my shitty laptop i5-11300H)
 void radix_sort(void *collection, void *help_buffer, u64 item_count, u64 item_size, u64 sort_value_offset_in_item, u64 number_of_bits) {
+    engine_tm_begin("radix_sort");
+    
     local_persist const int RADIX = 256;
     local_persist const int BITS_PER_PASS = 8;
     
@@ -63,6 +65,8 @@ void radix_sort(void *collection, void *help_buffer, u64 item_count, u64 item_si
 
         memcpy(collection, help_buffer, item_count * item_size);
     }
+    
+    engine_tm_end();
 }
 
 void merge_sort(void *collection, void *help_buffer, u64 item_count, u64 item_size, int (*compare)(const void *, const void *)) {